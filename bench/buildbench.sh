@@ -0,0 +1,31 @@
+#!/bin/sh
+# End to end build time of kite programs, with the built-in assembler
+# (--emit=obj) and with NASM (--emit=asm, then nasm -felf64)
+#
+# usage: bench/buildbench.sh path/to/kitelang [files.kite...] (the stdlib by default)
+
+KITE=$(realpath "${1:-kitelang/kitelang}")
+shift
+if [ $# -eq 0 ]; then
+    set -- stdlib/*.kite
+fi
+
+now() { date +%s%N; }
+
+run() {
+    start=$(now)
+    for f in "$@"; do
+        eval "$BUILD" || exit 1
+    done
+    echo $(( ($(now) - start) / 1000000 ))
+}
+
+BUILD='$KITE --emit=obj "$f"'
+echo "built-in assembler: $(run "$@") ms"
+
+if command -v nasm > /dev/null; then
+    BUILD='$KITE --emit=asm "$f" && nasm -felf64 -o "$(dirname "$f")/kbuild/$(basename "$f" .kite).o" "$(dirname "$f")/kbuild/$(basename "$f" .kite).asm"'
+    echo "nasm:               $(run "$@") ms"
+else
+    echo "nasm:               not installed"
+fi
@@ -0,0 +1,477 @@
+// KITEBENCH.CPP
+// Throughput benchmark of every compiler stage and of whole builds, on synthetic Kite programs
+// every stage is timed on its own (its input is prepared before the clock starts) and the
+// build is timed end to end, over several repetitions and at several program sizes, so the
+// growth of the time with the size shows asymptotic regressions
+//
+// usage: kitebench [-r repetitions] [-n functions] [-d depth] [-e terms] [-s strings]
+//                  [-D defines] [-I includes] [--scales 1,2,4] [--stage name]
+//                  [--save file] [--compare file] [--tolerance percent]
+//
+//   -n  functions in the program at scale 1 (the scales multiply it)
+//   -d  depth of the nested if/for/loop blocks in every function
+//   -e  terms in the long expressions
+//   -s  string literals in every function
+//   -D  #defines (used as constants in the expressions), spread over the includes
+//   -I  files included with #include
+//   --stage     only run this stage (precompile, lex, parse, parse+free, parse-expr, check,
+//               codegen, assemble, build)
+//   --save      write the results as a baseline
+//   --compare   compare with a baseline, exits with 1 if a stage got slower than the tolerance
+//               (10% by default) or grows faster with the size than it did
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "precompiler/precompiler.h"
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "semantics/checker.h"
+#include "compiler/compiler.h"
+#include "assembler/assembler.h"
+#include "driver/driver.h"
+#include "stats/stats.h"
+
+namespace fs = std::filesystem;
+
+struct Params {
+	int functions = 2000;
+	int depth = 3;
+	int terms = 8;
+	int strings = 2;
+	int defines = 200;
+	int includes = 10;
+	// everything that changes the generated program, baselines made with other
+	// parameters are not comparable
+	std::string str() const {
+		return "n=" + std::to_string(functions) + " d=" + std::to_string(depth) + " e=" + std::to_string(terms) +
+			" s=" + std::to_string(strings) + " D=" + std::to_string(defines) + " I=" + std::to_string(includes);
+	}
+};
+
+// a long expression over the arguments, the locals (the first `vars` of a, b, x, y)
+// and the defined constants
+static std::string expression(const Params& p, int seed, int vars = 4) {
+	static const char* operands[] = { "a", "b", "x", "y" };
+	static const char* operators[] = { " + ", " - ", " * " };
+	std::string e;
+	for (int t = 0; t < p.terms; t++) {
+		if (t) e += operators[(seed + t) % 3];
+		// every fourth term is a parenthesized group
+		if (t % 4 == 3) e += "(" + std::string(operands[(seed + t) % vars]) + " / " + std::to_string(t + 2) + ")";
+		else if (p.defines && t % 3 == 1) e += "K_" + std::to_string((seed * 7 + t) % p.defines);
+		else if (t % 3 == 2) e += std::to_string(seed % 97 + t);
+		else e += operands[(seed + t) % vars];
+	}
+	return e;
+}
+
+// blocks nested `level` deep, cycling through if, for and loop
+static void nest(const Params& p, std::string& src, int fn, int level, std::string indent) {
+	if (level == p.depth) {
+		src += indent + "x = " + expression(p, fn + level) + "\n";
+		src += indent + "buf[" + std::to_string(level) + "] = 'a'\n";
+		return;
+	}
+	std::string inner = indent + "\t";
+	switch (level % 3) {
+	case 0:
+		src += indent + "if x < y {\n";
+		nest(p, src, fn, level + 1, inner);
+		src += indent + "} else {\n" + inner + "y = y - " + std::to_string(level + 1) + "\n" + indent + "}\n";
+		break;
+	case 1:
+		src += indent + "for i" + std::to_string(level) + " = 0 -> 10 ^ 1 {\n";
+		nest(p, src, fn, level + 1, inner);
+		src += inner + "x = x + i" + std::to_string(level) + " * 2\n" + indent + "}\n";
+		break;
+	case 2:
+		src += indent + "loop {\n" + inner + "if x == 0 break\n";
+		nest(p, src, fn, level + 1, inner);
+		src += inner + "x = x / 2\n" + indent + "}\n";
+		break;
+	}
+}
+
+// writes the program (and its includes) to `dir`, returns the path of the main file
+static fs::path generate(const Params& p, const fs::path& dir) {
+	fs::create_directories(dir);
+	// the defines are spread over the includes (or the main file without includes)
+	std::string src;
+	for (int i = 0; i < p.includes; i++) {
+		std::string name = "kb_inc_" + std::to_string(i) + ".km";
+		std::string inc = "~\ngenerated include " + std::to_string(i) + "\n~\n";
+		for (int d = i; d < p.defines; d += p.includes)
+			inc += "#define K_" + std::to_string(d) + " " + std::to_string(d * 13 % 1000 + 1) + "\n";
+		std::ofstream(dir / name) << inc;
+		src += "#include \"" + name + "\"\n";
+	}
+	if (p.includes == 0)
+		for (int d = 0; d < p.defines; d++)
+			src += "#define K_" + std::to_string(d) + " " + std::to_string(d * 13 % 1000 + 1) + "\n";
+
+	src += "extern {\n\tprinti(int64) : void,\n\tprint(ptr8) : void,\n}\n";
+	for (int f = 0; f < p.functions; f++) {
+		std::string n = std::to_string(f);
+		src += "~\nfunction " + n + ", generated for benchmarking\n~\n";
+		src += "global f" + n + "\n";
+		src += "fn f" + n + "(a : int64, b : int64) : int64 {\n";
+		src += "\tlet x : int64 = " + expression(p, f, 2) + "\n";
+		src += "\tlet y : int64 = " + expression(p, f + 1, 3) + "\n";
+		src += "\tlet buf : char[64]\n";
+		nest(p, src, f, 0, "\t");
+		for (int s = 0; s < p.strings; s++)
+			src += "\tprint(\"function " + n + " string " + std::to_string(s) + "\\n\")\n";
+		src += "\tprinti(x + y)\n";
+		if (f) src += "\tx = f" + std::to_string(f - 1) + "(x, y)\n";
+		src += "\treturn x + y * 2\n}\n\n";
+	}
+	fs::path main = dir / "kitebench.kite";
+	std::ofstream(main) << src;
+	return main;
+}
+
+static std::string read(const fs::path& path) {
+	std::ifstream file(path);
+	std::ostringstream ss;
+	ss << file.rdbuf();
+	return ss.str();
+}
+
+// output that is only counted
+class NullBuf : public std::streambuf {
+public:
+	size_t bytes = 0;
+protected:
+	int overflow(int c) override { bytes++; return c; }
+	std::streamsize xsputn(const char*, std::streamsize n) override { bytes += n; return n; }
+};
+
+struct Result {
+	std::string stage;
+	int scale;
+	double units;				// amount of input, in `unit`s
+	std::string unit;
+	std::vector<double> seconds;	// sorted
+	double percentile(double p) const {
+		size_t i = (size_t)std::ceil(p / 100 * seconds.size());
+		return seconds[std::min(seconds.size() - 1, i ? i - 1 : 0)];
+	}
+	double median() const { return percentile(50); }
+	double throughput() const { return units / median(); }
+};
+
+static Result measure(const std::string& stage, int scale, double units, const char* unit, int reps, const std::function<void()>& prepare, const std::function<void()>& run) {
+	Result r{ stage, scale, units, unit };
+	// one run to warm up the caches (and the include cache) first
+	prepare();
+	run();
+	for (int i = 0; i < reps; i++) {
+		prepare();
+		auto start = std::chrono::steady_clock::now();
+		run();
+		r.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(r.seconds.begin(), r.seconds.end());
+	return r;
+}
+
+static std::string rate(double perSecond, const std::string& unit) {
+	char buf[64];
+	if (unit == "bytes") std::snprintf(buf, sizeof(buf), "%8.2f MB/s", perSecond / 1048576);
+	else std::snprintf(buf, sizeof(buf), "%8.2f M %s/s", perSecond / 1e6, unit.c_str());
+	return buf;
+}
+
+// how fast the time grows with the size: 1 is linear, 2 quadratic
+static std::map<std::string, double> exponents(const std::vector<Result>& results) {
+	// compares the smallest and the largest program of every stage
+	std::map<std::string, std::pair<const Result*, const Result*>> range;
+	for (const Result& r : results) {
+		auto& [first, last] = range[r.stage];
+		if (first == nullptr || r.scale < first->scale) first = &r;
+		if (last == nullptr || r.scale > last->scale) last = &r;
+	}
+	std::map<std::string, double> e;
+	for (const auto& [stage, r] : range)
+		if (r.second->units > r.first->units)
+			e[stage] = std::log(r.second->median() / r.first->median()) / std::log(r.second->units / r.first->units);
+	return e;
+}
+
+int main(int argc, char* argv[]) {
+	Params p;
+	int reps = 7;
+	std::vector<int> scales = { 1, 2, 4 };
+	std::string only, save, compare;
+	double tolerance = 10;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (value == nullptr) {
+			std::fprintf(stderr, "kitebench: missing value of %s\n", arg.c_str());
+			return 1;
+		}
+		i++;
+		if (arg == "-r") reps = std::max(1, std::atoi(value));
+		else if (arg == "-n") p.functions = std::max(1, std::atoi(value));
+		else if (arg == "-d") p.depth = std::max(0, std::atoi(value));
+		else if (arg == "-e") p.terms = std::max(1, std::atoi(value));
+		else if (arg == "-s") p.strings = std::max(0, std::atoi(value));
+		else if (arg == "-D") p.defines = std::max(0, std::atoi(value));
+		else if (arg == "-I") p.includes = std::max(0, std::atoi(value));
+		else if (arg == "--stage") only = value;
+		else if (arg == "--save") save = value;
+		else if (arg == "--compare") compare = value;
+		else if (arg == "--tolerance") tolerance = std::atof(value);
+		else if (arg == "--scales") {
+			scales.clear();
+			std::istringstream list(value);
+			for (std::string s; std::getline(list, s, ',');)
+				if (std::atoi(s.c_str()) > 0) scales.push_back(std::atoi(s.c_str()));
+			std::sort(scales.begin(), scales.end());
+		}
+		else {
+			std::fprintf(stderr, "kitebench: unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (scales.empty()) scales.push_back(1);
+	auto wanted = [&](const char* stage) { return only.empty() || only == stage; };
+
+	fs::path root = fs::temp_directory_path() / ("kitebench-" + std::to_string(getpid()));
+	std::printf("program: %s, scales:", p.str().c_str());
+	for (int s : scales) std::printf(" %d", s);
+	std::printf(", %d repetitions\n\n", reps);
+	std::printf("%-10s %5s %12s %10s %10s %10s %10s %18s\n", "stage", "scale", "input", "min ms", "p10 ms", "median ms", "p90 ms", "throughput");
+
+	stats::count_heap();
+	// per scale: the bytes of the nodes in the arena and the peak heap growth of parse+free
+	struct Tree {
+		int scale;
+		size_t arena;
+		int64_t heap;
+	};
+	std::vector<Tree> trees;
+	std::vector<Result> results;
+	for (int scale : scales) {
+		Params sp = p;
+		sp.functions = p.functions * scale;
+		fs::path dir = root / std::to_string(scale);
+		fs::path path = generate(sp, dir);
+		std::string original = read(path);
+
+		// the input of every stage is the output of the one before, made once
+		std::string src;
+		lexer::SymbolTable lexed, parsed;
+		std::vector<lexer::Token> tokens;
+		parser::Arena arena;
+		parser::RootNode* tree;
+		semantics::Checker checker(parsed);
+		std::ostringstream asmText;
+		try {
+			src = Precompiler(dir).precompile(original);
+			tokens = lexer::Lexer(src, lexed).tokenize();
+			parsed = lexed;
+			tree = parser::Parser(tokens, src, arena, parsed).parse();
+			checker.check(tree);
+			compiler::Compiler c(tree);
+			c.stream(asmText);
+			c.codegen();
+		}
+		catch (errors::kiterr& e) {
+			std::fprintf(stderr, "kitebench: the generated program does not compile: %s at line %d\n", e.what(), e.line);
+			std::error_code ec;
+			fs::remove_all(root, ec);
+			return 1;
+		}
+		size_t nodes = 0;
+		for (size_t t = 0; t < parser::Arena::kinds; t++) nodes += arena.count(t);
+		std::string assembly = asmText.str();
+
+		std::vector<Result> scaled;
+		if (wanted("precompile"))
+			scaled.push_back(measure("precompile", scale, (double)original.size(), "bytes", reps, [] {}, [&] {
+				std::ostringstream log;
+				Precompiler(dir, log).precompile(original);
+			}));
+		if (wanted("lex")) {
+			lexer::SymbolTable symbols;
+			scaled.push_back(measure("lex", scale, (double)src.size(), "bytes", reps, [&] { symbols = lexer::SymbolTable(); }, [&] {
+				lexer::Lexer(src, symbols).tokenize();
+			}));
+		}
+		// parse leaves the tree to the next repetition, parse+free destroys it too
+		if (wanted("parse")) {
+			lexer::SymbolTable symbols;
+			std::unique_ptr<parser::Arena> a;
+			scaled.push_back(measure("parse", scale, (double)tokens.size(), "tokens", reps, [&] {
+				a.reset();
+				a = std::make_unique<parser::Arena>();
+				symbols = lexed;
+			}, [&] {
+				parser::Parser(tokens, src, *a, symbols).parse();
+			}));
+		}
+		if (wanted("parse+free")) {
+			lexer::SymbolTable symbols;
+			scaled.push_back(measure("parse+free", scale, (double)tokens.size(), "tokens", reps, [&] { symbols = lexed; }, [&] {
+				parser::Arena a;
+				parser::Parser(tokens, src, a, symbols).parse();
+			}));
+			// the memory the tree takes, once more outside the clock
+			symbols = lexed;
+			int64_t before = stats::heap_in_use();
+			stats::reset_heap_peak();
+			{
+				parser::Arena a;
+				parser::Parser(tokens, src, a, symbols).parse();
+				trees.push_back({ scale, a.bytes(), stats::heap_peak() - before });
+			}
+		}
+		// the same amount of functions with nothing but long expressions (8 times the terms, no
+		// blocks or strings), for the expression parser alone
+		if (wanted("parse-expr")) {
+			Params ep = sp;
+			ep.terms = p.terms * 8;
+			ep.depth = 0;
+			ep.strings = 0;
+			fs::path exprDir = dir / "expr";
+			std::string exprSrc = Precompiler(exprDir).precompile(read(generate(ep, exprDir)));
+			lexer::SymbolTable exprLexed, symbols;
+			std::vector<lexer::Token> exprTokens = lexer::Lexer(exprSrc, exprLexed).tokenize();
+			std::unique_ptr<parser::Arena> a;
+			scaled.push_back(measure("parse-expr", scale, (double)exprTokens.size(), "tokens", reps, [&] {
+				a.reset();
+				a = std::make_unique<parser::Arena>();
+				symbols = exprLexed;
+			}, [&] {
+				parser::Parser(exprTokens, exprSrc, *a, symbols).parse();
+			}));
+		}
+		// the tree is annotated again every time, the same way (the calls point into the last checker)
+		if (wanted("check"))
+			scaled.push_back(measure("check", scale, (double)nodes, "nodes", reps, [] {}, [&] {
+				checker = semantics::Checker(parsed);
+				checker.check(tree);
+			}));
+		if (wanted("codegen"))
+			scaled.push_back(measure("codegen", scale, (double)nodes, "nodes", reps, [] {}, [&] {
+				NullBuf null;
+				std::ostream out(&null);
+				compiler::Compiler c(tree);
+				c.stream(out);
+				c.codegen();
+			}));
+		if (wanted("assemble"))
+			scaled.push_back(measure("assemble", scale, (double)assembly.size(), "bytes", reps, [] {}, [&] {
+				assembler::Assembler as;
+				assembler::AsmStreamBuf buf(as);
+				std::ostream text(&buf);
+				text.write(assembly.data(), (std::streamsize)assembly.size());
+				buf.finish();
+				as.object();
+			}));
+		if (wanted("build")) {
+			driver::Options options;
+			options.emitObj = true;
+			scaled.push_back(measure("build", scale, (double)original.size(), "bytes", reps, [] {}, [&] {
+				std::ostringstream diag;
+				if (driver::compile(path.string(), options, diag) != 0) {
+					std::fprintf(stderr, "kitebench: the generated program failed to build:\n%s", diag.str().c_str());
+					std::exit(1);
+				}
+			}));
+		}
+
+		for (const Result& r : scaled) {
+			char input[32];
+			if (r.unit == "bytes") std::snprintf(input, sizeof(input), "%.2f MB", r.units / 1048576);
+			else std::snprintf(input, sizeof(input), "%.0f %s", r.units, r.unit.c_str());
+			std::printf("%-10s %5d %12s %10.2f %10.2f %10.2f %10.2f %18s\n", r.stage.c_str(), r.scale, input,
+				r.seconds.front() * 1e3, r.percentile(10) * 1e3, r.median() * 1e3, r.percentile(90) * 1e3, rate(r.throughput(), r.unit).c_str());
+		}
+		results.insert(results.end(), scaled.begin(), scaled.end());
+	}
+	std::error_code ec;
+	fs::remove_all(root, ec);
+
+	if (!trees.empty()) {
+		std::printf("\nsyntax tree memory (parse+free):\n");
+		for (const Tree& t : trees)
+			std::printf("  scale %-4d %10.2f MB in the arena %10.2f MB peak heap\n", t.scale, t.arena / 1048576.0, t.heap / 1048576.0);
+	}
+
+	std::map<std::string, double> growth = exponents(results);
+	if (!growth.empty()) {
+		std::printf("\ngrowth of the time with the size (1 is linear):\n");
+		for (const auto& [stage, e] : growth) std::printf("  %-10s %.2f\n", stage.c_str(), e);
+	}
+
+	// a baseline is a line per measurement: <stage>@<scale> <throughput>, or <stage>.growth <exponent>
+	std::map<std::string, double> current;
+	for (const Result& r : results) current[r.stage + "@" + std::to_string(r.scale)] = r.throughput();
+	for (const auto& [stage, e] : growth) current[stage + ".growth"] = e;
+
+	if (!save.empty()) {
+		std::ofstream out(save);
+		out << "# kitebench " << p.str() << "\n";
+		for (const auto& [key, value] : current) out << key << " " << value << "\n";
+		if (!out) {
+			std::fprintf(stderr, "kitebench: failed to write %s\n", save.c_str());
+			return 1;
+		}
+		std::printf("\nbaseline written to %s\n", save.c_str());
+	}
+
+	int status = 0;
+	if (!compare.empty()) {
+		std::ifstream in(compare);
+		if (!in) {
+			std::fprintf(stderr, "kitebench: failed to open %s\n", compare.c_str());
+			return 1;
+		}
+		std::printf("\ncompared with %s (tolerance %.1f%%):\n", compare.c_str(), tolerance);
+		for (std::string line; std::getline(in, line);) {
+			if (line.rfind("# kitebench ", 0) == 0) {
+				if (line.substr(12) != p.str())
+					std::printf("  warning: the baseline was made with %s\n", line.substr(12).c_str());
+				continue;
+			}
+			std::istringstream fields(line);
+			std::string key;
+			double base;
+			if (!(fields >> key >> base) || !current.count(key)) continue;
+			double now = current[key];
+			bool growthKey = key.size() > 7 && key.compare(key.size() - 7, 7, ".growth") == 0;
+			const char* verdict = "";
+			if (growthKey) {
+				// the exponent is noisy on small programs, only a clear change counts
+				if (now > base + 0.15) verdict = "  GROWS FASTER";
+				std::printf("  %-18s %8.2f -> %8.2f%s\n", key.c_str(), base, now, verdict);
+			}
+			else {
+				double change = (now / base - 1) * 100;
+				if (change < -tolerance) verdict = "  SLOWER";
+				std::printf("  %-18s %+7.1f%%%s\n", key.c_str(), change, verdict);
+			}
+			if (*verdict) status = 1;
+		}
+		std::printf(status ? "\nregressions found\n" : "\nno regressions\n");
+	}
+	return status;
+}
@@ -0,0 +1,320 @@
+// KITERUNBENCH.CPP
+// Benchmark of the code the compiler generates, on routines of the standard library
+// every routine is called in a loop by a small _start, which is compiled with the stdlib,
+// linked with ld and run; the time of a call is the time of the loop minus the time of the
+// same loop without the call
+// the static instruction count of every routine is taken from the assembly, and with --trace
+// the instructions a call executes are counted by single-stepping the program (ptrace)
+// first, readln (and readc, whose asm block reserves stack with @stackszinc) read a line from
+// a pipe, so a routine that does not leave the stack as it found it stops the benchmark
+//
+// usage: kiterunbench [-r repetitions] [-n calls] [-O] [--trace] [--stdlib dir]
+//                     [--save file] [--compare file] [--tolerance percent]
+//
+//   -n        calls timed in every run
+//   -O        compile with the optimizations
+//   --trace   count the executed instructions too (slow, on 1000 calls)
+//   --stdlib  the directory of the standard library (the one of the source tree by default)
+//   --save    write the results as a baseline
+//   --compare compare with a baseline, exits with 1 if something got slower (or longer)
+//             than the tolerance (10% by default)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "driver/driver.h"
+
+namespace fs = std::filesystem;
+
+// a routine and the call of it the loop makes (with `s`, a buffer holding "12345678")
+struct Kernel {
+	const char* name;
+	const char* call;
+};
+
+static const Kernel kernels[] = {
+	{ "empty", "k" },
+	{ "strlen", "strlen(s)" },
+	{ "stoi", "stoi(s)" },
+};
+
+// the routines whose instructions are counted, in the file they are in
+static const char* routines[][2] = {
+	{ "string", "strlen" },
+	{ "string", "stoi" },
+	{ "math", "pow" },
+};
+
+static std::string program(const Kernel& k, long calls) {
+	std::string src = "#include \"include/string.km\"\n\n";
+	src += "global _start\n";
+	src += "fn _start(argc : int32, argv : ptr64) : int32 {\n";
+	src += "\tlet s : char[32]\n";
+	// the bytes after the 8 digits end the string
+	src += "\tfor i = 0 -> 15 ^ 1 {\n\t\ts[i] = 0\n\t}\n";
+	src += "\tfor i = 0 -> 7 ^ 1 {\n\t\ts[i] = '1' + i\n\t}\n";
+	src += "\tlet total : int64 = 0\n";
+	src += "\tfor k = 1 -> " + std::to_string(calls) + " ^ 1 {\n";
+	src += "\t\ttotal = total + " + std::string(k.call) + "\n\t}\n";
+	src += "\treturn total % 251\n}\n";
+	return src;
+}
+
+static bool optimize = false;
+
+static bool compile(const fs::path& source, bool obj) {
+	driver::Options options;
+	options.emitObj = obj;
+	options.optimize = optimize;
+	std::ostringstream diag;
+	if (driver::compile(source.string(), options, diag) == 0) return true;
+	std::fprintf(stderr, "kiterunbench: %s does not compile:\n%s", source.string().c_str(), diag.str().c_str());
+	return false;
+}
+
+// builds the loop calling the kernel into `dir`, returns the path of the executable (empty on failure)
+static fs::path build(const fs::path& dir, const Kernel& k, long calls, const std::string& suffix) {
+	fs::path source = dir / (std::string(k.name) + suffix + ".kite");
+	std::ofstream(source) << program(k, calls);
+	if (!compile(source, true)) return {};
+	fs::path bin = dir / "kbuild" / (std::string(k.name) + suffix);
+	std::string objs = (dir / "kbuild" / (std::string(k.name) + suffix + ".o")).string();
+	std::string cmd = "ld -o " + bin.string() + " " + objs + " " + (dir / "kbuild" / "string.o").string() + " " + (dir / "kbuild" / "math.o").string();
+	if (std::system(cmd.c_str()) != 0) {
+		std::fprintf(stderr, "kiterunbench: failed to link %s\n", bin.string().c_str());
+		return {};
+	}
+	return bin;
+}
+
+// reads "12\n" with readln into a buffer and returns stoi of it, the program must exit with 12
+static bool check(const fs::path& dir) {
+	fs::path source = dir / "check.kite";
+	std::ofstream(source) << "#include \"include/stdio.km\"\n#include \"include/string.km\"\n\n"
+		"global _start\n"
+		"fn _start(argc : int32, argv : ptr64) : int32 {\n"
+		"\tlet buf : char[16]\n"
+		"\treadln(buf, 16)\n"
+		"\treturn stoi(buf)\n}\n";
+	if (!compile(source, true)) return false;
+	std::string bin = (dir / "kbuild" / "check").string();
+	std::string cmd = "ld -o " + bin;
+	for (const char* file : { "check", "stdio", "string", "math" }) cmd += " " + (dir / "kbuild" / (std::string(file) + ".o")).string();
+	if (std::system(cmd.c_str()) != 0) {
+		std::fprintf(stderr, "kiterunbench: failed to link %s\n", bin.c_str());
+		return false;
+	}
+	int status = std::system(("printf '12\\n' | " + bin).c_str());
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 12) return true;
+	// the shell gives a crash as 128 + the signal
+	std::fprintf(stderr, "kiterunbench: readln of \"12\" in %s exited with %d instead of 12\n", bin.c_str(), WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+	return false;
+}
+
+// runs the program, returns the seconds it took (negative on failure) and its exit status
+static double run(const fs::path& bin, int& status) {
+	auto start = std::chrono::steady_clock::now();
+	pid_t pid = fork();
+	if (pid == 0) {
+		execl(bin.c_str(), bin.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+	int wstatus;
+	if (pid < 0 || waitpid(pid, &wstatus, 0) < 0 || !WIFEXITED(wstatus)) return -1;
+	status = WEXITSTATUS(wstatus);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the instructions the program executes (-1 if it cannot be traced)
+static long long trace(const fs::path& bin) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+		execl(bin.c_str(), bin.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+	int wstatus;
+	if (pid < 0 || waitpid(pid, &wstatus, 0) < 0 || !WIFSTOPPED(wstatus)) return -1;
+	long long steps = 0;
+	while (WIFSTOPPED(wstatus)) {
+		if (ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) < 0) return -1;
+		if (waitpid(pid, &wstatus, 0) < 0) return -1;
+		steps++;
+	}
+	return steps;
+}
+
+// the instructions from the label of the routine to its ret
+static int count(const fs::path& assembly, const std::string& routine) {
+	std::ifstream in(assembly);
+	bool inside = false;
+	int n = 0;
+	for (std::string line; std::getline(in, line);) {
+		size_t first = line.find_first_not_of(" \t");
+		if (first == std::string::npos) continue;
+		line = line.substr(first);
+		if (!inside) {
+			inside = line == routine + ":";
+			continue;
+		}
+		if (line.back() == ':' || line[0] == ';') continue;
+		n++;
+		if (line == "ret") return n;
+	}
+	return inside ? n : -1;
+}
+
+static double median(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	return v[v.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+	int reps = 5;
+	long calls = 1000000;
+	const long traced = 1000;
+	bool tracing = false;
+	std::string stdlib = KITE_STDLIB, save, compare;
+	double tolerance = 10;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--trace") {
+			tracing = true;
+			continue;
+		}
+		if (arg == "-O") {
+			optimize = true;
+			continue;
+		}
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (value == nullptr) {
+			std::fprintf(stderr, "kiterunbench: missing value of %s\n", arg.c_str());
+			return 1;
+		}
+		i++;
+		if (arg == "-r") reps = std::max(1, std::atoi(value));
+		else if (arg == "-n") calls = std::max(1L, std::atol(value));
+		else if (arg == "--stdlib") stdlib = value;
+		else if (arg == "--save") save = value;
+		else if (arg == "--compare") compare = value;
+		else if (arg == "--tolerance") tolerance = std::atof(value);
+		else {
+			std::fprintf(stderr, "kiterunbench: unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	fs::path dir = fs::temp_directory_path() / ("kiterunbench-" + std::to_string(getpid()));
+	auto fail = [&]() {
+		std::error_code ec;
+		fs::remove_all(dir, ec);
+		return 1;
+	};
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+	fs::copy(fs::path(stdlib) / "include", dir / "include", fs::copy_options::recursive, ec);
+	for (const char* file : { "string.kite", "math.kite", "stdio.kite" }) fs::copy_file(fs::path(stdlib) / file, dir / file, ec);
+	if (ec) {
+		std::fprintf(stderr, "kiterunbench: failed to copy the standard library from %s\n", stdlib.c_str());
+		return fail();
+	}
+	for (const char* file : { "string", "math" })
+		if (!compile(dir / (std::string(file) + ".kite"), false) || !compile(dir / (std::string(file) + ".kite"), true)) return fail();
+	if (!compile(dir / "stdio.kite", true) || !check(dir)) return fail();
+
+	// a baseline is a line per measurement: <routine>.static, <kernel>.ns or <kernel>.executed, and its value
+	std::map<std::string, double> current;
+	std::printf("%-10s %14s\n", "routine", "instructions");
+	for (const auto& [file, routine] : routines) {
+		int n = count(dir / "kbuild" / (std::string(file) + ".asm"), routine);
+		std::printf("%-10s %14d\n", routine, n);
+		current[std::string(routine) + ".static"] = n;
+	}
+
+	std::printf("\n%d repetitions of %ld calls%s\n", reps, calls, tracing ? ", executed instructions of 1000 calls" : "");
+	std::printf("%-10s %10s %10s %12s %10s\n", "kernel", "median ms", "ns/call", "executed", "result");
+	double empty = 0;
+	long long emptySteps = 0;
+	for (const Kernel& k : kernels) {
+		fs::path bin = build(dir, k, calls, "");
+		if (bin.empty()) return fail();
+		std::vector<double> seconds;
+		int status = 0;
+		// one run to warm up first
+		run(bin, status);
+		for (int i = 0; i < reps; i++) {
+			double s = run(bin, status);
+			if (s < 0) {
+				std::fprintf(stderr, "kiterunbench: %s crashed\n", bin.string().c_str());
+				return fail();
+			}
+			seconds.push_back(s);
+		}
+		double time = median(seconds);
+		bool base = std::string(k.name) == "empty";
+		if (base) empty = time;
+		double ns = (time - empty) / calls * 1e9;
+
+		long long steps = -1;
+		if (tracing) {
+			fs::path small = build(dir, k, traced, "_traced");
+			if (small.empty()) return fail();
+			steps = trace(small);
+			if (base) emptySteps = steps;
+		}
+		char executed[32] = "-";
+		if (steps >= 0 && !base) std::snprintf(executed, sizeof(executed), "%.1f", (double)(steps - emptySteps) / traced);
+		std::printf("%-10s %10.2f %10.2f %12s %10d\n", k.name, time * 1e3, ns, executed, status);
+		if (base) continue;
+		current[std::string(k.name) + ".ns"] = ns;
+		if (steps >= 0) current[std::string(k.name) + ".executed"] = (double)(steps - emptySteps) / traced;
+	}
+	fs::remove_all(dir, ec);
+
+	if (!save.empty()) {
+		std::ofstream out(save);
+		out << "# kiterunbench\n";
+		for (const auto& [key, value] : current) out << key << " " << value << "\n";
+		if (!out) {
+			std::fprintf(stderr, "kiterunbench: failed to write %s\n", save.c_str());
+			return 1;
+		}
+		std::printf("\nbaseline written to %s\n", save.c_str());
+	}
+
+	int status = 0;
+	if (!compare.empty()) {
+		std::ifstream in(compare);
+		if (!in) {
+			std::fprintf(stderr, "kiterunbench: failed to open %s\n", compare.c_str());
+			return 1;
+		}
+		std::printf("\ncompared with %s (tolerance %.1f%%):\n", compare.c_str(), tolerance);
+		for (std::string line; std::getline(in, line);) {
+			std::istringstream fields(line);
+			std::string key;
+			double base;
+			if (line[0] == '#' || !(fields >> key >> base) || !current.count(key)) continue;
+			// everything measured is better lower
+			double now = current[key];
+			double change = base > 0 ? (now / base - 1) * 100 : 0;
+			const char* verdict = change > tolerance ? "  WORSE" : "";
+			std::printf("  %-18s %10.2f -> %10.2f %+7.1f%%%s\n", key.c_str(), base, now, change, verdict);
+			if (*verdict) status = 1;
+		}
+		std::printf(status ? "\nregressions found\n" : "\nno regressions\n");
+	}
+	return status;
+}
@@ -0,0 +1,92 @@
+// LEXBENCH.CPP
+// Microbenchmark of lexer::Lexer::tokenize, reports the throughput in MB/s of lexed source
+// for every scanner level (scalar, SSE2, AVX2) the CPU supports
+//
+// usage: kitelexbench [-r repetitions] [-s size in MB] [files...]
+// without files a synthetic Kite source of the given size is lexed
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lexer/lexer.h"
+#include "lexer/scan.h"
+
+// synthetic source with the usual mix of comments, identifiers, literals and operators
+static std::string synthetic(size_t bytes) {
+	std::string src;
+	src.reserve(bytes + 1024);
+	for (int f = 0; src.size() < bytes; f++) {
+		std::string n = std::to_string(f);
+		src += "~\nfunction_" + n + "\ngenerated for benchmarking\n~\n";
+		src += "global function_" + n + "\n";
+		src += "fn function_" + n + "(first_argument : int64, second_argument : ptr8) : int64 {\n";
+		src += "    let accumulator : int64 = first_argument * 31 + 7 ; running value\n";
+		src += "    let buffer : char[128]\n";
+		src += "    for index = 0 -> 127 ^ 1 {\n";
+		src += "        buffer[index] = second_argument[index]\n";
+		src += "        if buffer[index] == '\\0' break\n";
+		src += "        accumulator = accumulator + (index * 3) / 2 - 1\n";
+		src += "    }\n";
+		src += "    print(\"function " + n + " finished\\n\")\n";
+		src += "    return accumulator\n}\n\n";
+	}
+	return src;
+}
+
+static double median(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	return v[v.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+	int reps = 10;
+	size_t mbytes = 16;
+	std::string src;
+
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "-r") && i + 1 < argc) reps = std::atoi(argv[++i]);
+		else if (!std::strcmp(argv[i], "-s") && i + 1 < argc) mbytes = std::atoi(argv[++i]);
+		else {
+			std::ifstream file(argv[i]);
+			if (!file) {
+				std::fprintf(stderr, "kitelexbench: failed to open %s\n", argv[i]);
+				return 1;
+			}
+			std::ostringstream ss;
+			ss << file.rdbuf();
+			src += ss.str();
+			src += '\n';
+		}
+	}
+	if (src.empty()) src = synthetic(mbytes << 20);
+
+	lexer::scan::level_t best = lexer::scan::detect();
+	std::printf("source: %.2f MB, %d repetitions, best level: %s\n", src.size() / 1048576.0, reps, lexer::scan::level_name(best));
+
+	for (int l = lexer::scan::SCALAR; l <= best; l++) {
+		lexer::scan::set_level((lexer::scan::level_t)l);
+		std::vector<double> seconds;
+		size_t tokens = 0;
+		for (int r = 0; r < reps; r++) {
+			auto start = std::chrono::steady_clock::now();
+			lexer::SymbolTable symbols;
+			lexer::Lexer lex(src, symbols);
+			std::vector<lexer::Token> result = lex.tokenize();
+			auto end = std::chrono::steady_clock::now();
+			tokens = result.size();
+			seconds.push_back(std::chrono::duration<double>(end - start).count());
+		}
+		double med = median(seconds);
+		std::printf("%-8s %9.1f MB/s %9.2f Mtokens/s (median %.2f ms, %zu tokens)\n",
+			lexer::scan::level_name((lexer::scan::level_t)l),
+			src.size() / 1048576.0 / med, tokens / 1e6 / med, med * 1000, tokens);
+	}
+	return 0;
+}
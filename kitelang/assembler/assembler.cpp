@@ -0,0 +1,1006 @@
+#include "assembler.h"
+#include "elf.h"
+#include <algorithm>
+#include <cctype>
+
+using compiler::Reg;
+using compiler::reg_t;
+using compiler::NOREG;
+
+namespace {
+	std::string_view trim(std::string_view s) {
+		while (!s.empty() && isspace((unsigned char)s.front())) s.remove_prefix(1);
+		while (!s.empty() && isspace((unsigned char)s.back())) s.remove_suffix(1);
+		return s;
+	}
+
+	std::string lower(std::string_view s) {
+		std::string r(s);
+		for (char& c : r)
+			if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		return r;
+	}
+
+	bool is_quote(char c) { return c == '"' || c == '\'' || c == '`'; }
+
+	// the text before a comment
+	std::string_view strip_comment(std::string_view s) {
+		char quote = 0;
+		for (size_t i = 0; i < s.size(); i++) {
+			if (quote) {
+				if (s[i] == quote) quote = 0;
+			}
+			else if (is_quote(s[i])) quote = s[i];
+			else if (s[i] == ';') return s.substr(0, i);
+		}
+		return s;
+	}
+
+	// split on commas that are not inside quotes or brackets
+	void split_operands(std::string_view s, std::vector<std::string_view>& parts) {
+		parts.clear();
+		char quote = 0;
+		int depth = 0;
+		size_t start = 0;
+		for (size_t i = 0; i < s.size(); i++) {
+			if (quote) {
+				if (s[i] == quote) quote = 0;
+			}
+			else if (is_quote(s[i])) quote = s[i];
+			else if (s[i] == '[' || s[i] == '(') depth++;
+			else if (s[i] == ']' || s[i] == ')') depth--;
+			else if (s[i] == ',' && depth == 0) {
+				parts.push_back(trim(s.substr(start, i - start)));
+				start = i + 1;
+			}
+		}
+		std::string_view last = trim(s.substr(start));
+		if (!last.empty() || !parts.empty()) parts.push_back(last);
+	}
+
+	bool is_name_start(char c) { return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '?' || c == '$' || c == '@'; }
+	bool is_name_char(char c) { return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '?' || c == '$' || c == '@' || c == '#' || c == '~'; }
+
+	bool fits8(int64_t v) { return v >= -128 && v <= 127; }
+	bool fits32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+	// condition codes by their suffix (as in jcc, setcc and cmovcc)
+	int condition(std::string_view s) {
+		static const std::pair<std::string_view, int> codes[] = {
+			{"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3}, {"nb", 3}, {"nc", 3},
+			{"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5}, {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7},
+			{"s", 8}, {"ns", 9}, {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11},
+			{"l", 12}, {"nge", 12}, {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15}, {"nle", 15},
+		};
+		for (auto& [name, cc] : codes)
+			if (name == s) return cc;
+		return -1;
+	}
+
+	int arith(std::string_view m) {
+		static const std::pair<std::string_view, int> ops[] = {
+			{"add", 0}, {"or", 1}, {"adc", 2}, {"sbb", 3}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7},
+		};
+		for (auto& [name, n] : ops)
+			if (name == m) return n;
+		return -1;
+	}
+
+	int unary(std::string_view m) {
+		static const std::pair<std::string_view, int> ops[] = {
+			{"not", 2}, {"neg", 3}, {"mul", 4}, {"div", 6}, {"idiv", 7},
+		};
+		for (auto& [name, n] : ops)
+			if (name == m) return n;
+		return -1;
+	}
+
+	int shift(std::string_view m) {
+		static const std::pair<std::string_view, int> ops[] = {
+			{"rol", 0}, {"ror", 1}, {"rcl", 2}, {"rcr", 3}, {"shl", 4}, {"sal", 4}, {"shr", 5}, {"sar", 7},
+		};
+		for (auto& [name, n] : ops)
+			if (name == m) return n;
+		return -1;
+	}
+
+	int data_size(std::string_view d) {
+		if (d == "db") return 1;
+		if (d == "dw") return 2;
+		if (d == "dd") return 4;
+		if (d == "dq") return 8;
+		return 0;
+	}
+
+	int size_keyword(std::string_view w) {
+		if (w == "byte") return 1;
+		if (w == "word") return 2;
+		if (w == "dword") return 4;
+		if (w == "qword") return 8;
+		return 0;
+	}
+
+	// recommended multi-byte NOPs, for padding code
+	const uint8_t nops[9][9] = {
+		{ 0x90 },
+		{ 0x66, 0x90 },
+		{ 0x0f, 0x1f, 0x00 },
+		{ 0x0f, 0x1f, 0x40, 0x00 },
+		{ 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+		{ 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+		{ 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00 },
+		{ 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+		{ 0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+	};
+}
+
+assembler::Assembler::Assembler() {
+	sections.push_back(Section{ ".text", elf::SHT_PROGBITS, elf::SHF_ALLOC | elf::SHF_EXECINSTR, 16 });
+	sections.push_back(Section{ ".data", elf::SHT_PROGBITS, elf::SHF_ALLOC | elf::SHF_WRITE, 4 });
+}
+
+void assembler::Assembler::assemble(std::string_view source) {
+	size_t ptr = 0;
+	while (ptr < source.size()) {
+		size_t end = source.find('\n', ptr);
+		if (end == std::string_view::npos) end = source.size();
+		line++;
+		statement(source.substr(ptr, end - ptr));
+		ptr = end + 1;
+	}
+}
+
+std::streamsize assembler::AsmStreamBuf::xsputn(const char* s, std::streamsize n) {
+	std::string_view text(s, (size_t)n);
+	size_t end = text.rfind('\n');
+	if (end == std::string_view::npos) {
+		pending.append(text);
+		return n;
+	}
+	// whole lines are assembled straight from the written text
+	if (pending.empty()) as.assemble(text.substr(0, end + 1));
+	else {
+		pending.append(text.substr(0, end + 1));
+		as.assemble(pending);
+		pending.clear();
+	}
+	pending.append(text.substr(end + 1));
+	return n;
+}
+
+assembler::AsmStreamBuf::int_type assembler::AsmStreamBuf::overflow(int_type c) {
+	if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+	char ch = traits_type::to_char_type(c);
+	xsputn(&ch, 1);
+	return c;
+}
+
+void assembler::AsmStreamBuf::finish() {
+	if (pending.empty()) return;
+	as.assemble(pending);
+	pending.clear();
+}
+
+int assembler::Assembler::symbol(std::string_view name) {
+	// local labels belong to the last non-local label
+	if (name.size() > 1 && name[0] == '.' && name[1] != '.') {
+		local.assign(scope);
+		local.append(name);
+		name = local;
+	}
+	int id = names.intern(name);
+	if (id == (int)symbols.size()) symbols.emplace_back();
+	return id;
+}
+
+void assembler::Assembler::define(std::string_view name) {
+	int id = symbol(name);
+	Symbol& s = symbols[id];
+	if (s.section >= 0) error("label `" + std::string(names.name(id)) + "' redefined");
+	if (s.external) error("label `" + std::string(names.name(id)) + "' is declared extern");
+	s.section = cur;
+	s.frag = section().frags.size() - 1;
+	s.offset = section().bytes.size();
+	if (name[0] != '.') scope = std::string(name);
+}
+
+void assembler::Assembler::close(Fragment::tail_t tail) {
+	Fragment& f = frag();
+	f.end = section().bytes.size();
+	f.tail = tail;
+	f.line = line;
+	section().frags.push_back(Fragment{ f.end, f.end });
+}
+
+void assembler::Assembler::select_section(std::string_view name) {
+	std::string n = lower(trim(name));
+	size_t space = n.find_first_of(" \t");
+	if (space != std::string::npos) n = n.substr(0, space); // attributes are ignored
+	for (size_t i = 0; i < sections.size(); i++)
+		if (sections[i].name == n) {
+			cur = (int)i;
+			return;
+		}
+	unsupported("section " + n);
+}
+
+void assembler::Assembler::statement(std::string_view s) {
+	s = trim(strip_comment(s));
+	if (s.empty()) return;
+
+	// the first word, and a label if it ends with a colon
+	size_t n = 0;
+	while (n < s.size() && !isspace((unsigned char)s[n]) && s[n] != ':') n++;
+	std::string_view word = s.substr(0, n);
+	std::string_view rest = trim(s.substr(n));
+	if (!rest.empty() && rest[0] == ':') {
+		if (word.empty() || !is_name_start(word[0])) error("invalid label");
+		define(word);
+		return statement(rest.substr(1));
+	}
+
+	std::string w = lower(word);
+	if (w == "section" || w == "segment") return select_section(rest);
+	if (w == "extern" || w == "global") {
+		split_operands(rest, parts);
+		for (std::string_view name : parts) {
+			name = name.substr(0, name.find(':')); // `global f:function`
+			Symbol& sym = symbols[symbol(name)];
+			if (w == "extern") {
+				if (sym.section >= 0) continue; // NASM ignores extern for symbols it defines
+				sym.external = true;
+			}
+			else sym.global = true;
+		}
+		return;
+	}
+	if (w == "default") {
+		std::string mode = lower(rest);
+		if (mode == "rel") defaultRel = true;
+		else if (mode == "abs") defaultRel = false;
+		else unsupported("default " + mode);
+		return;
+	}
+	if (w == "bits") {
+		if (trim(rest) != "64") unsupported("bits " + std::string(rest));
+		return;
+	}
+	if (w == "align") {
+		int sym = -1;
+		split_operands(rest, parts);
+		int64_t a = expression(parts.at(0), sym);
+		if (sym >= 0 || a <= 0 || (a & (a - 1))) error("invalid alignment");
+		frag().alignment = (int)a;
+		section().align = std::max<uint64_t>(section().align, (uint64_t)a);
+		close(Fragment::ALIGN);
+		return;
+	}
+	if (data_size(w)) return data(w, rest);
+	if (w == "times" || w == "incbin" || w == "equ" || w.rfind("res", 0) == 0 || w[0] == '%') unsupported(w);
+
+	// a label without a colon, followed by data
+	size_t m = 0;
+	while (m < rest.size() && !isspace((unsigned char)rest[m])) m++;
+	std::string second = lower(rest.substr(0, m));
+	if (data_size(second)) {
+		define(word);
+		return data(second, trim(rest.substr(m)));
+	}
+
+	split_operands(rest, parts);
+	ops.clear();
+	for (std::string_view o : parts)
+		ops.push_back(operand(o));
+	instruction(w, ops);
+}
+
+void assembler::Assembler::data(std::string_view directive, std::string_view args) {
+	int unit = data_size(directive);
+	split_operands(args, parts);
+	for (std::string_view item : parts) {
+		if (item.size() >= 2 && is_quote(item[0]) && item.back() == item[0]) {
+			std::string_view str = item.substr(1, item.size() - 2);
+			if (item[0] == '`') unsupported("backquoted strings");
+			for (char c : str) byte((uint8_t)c);
+			// strings are padded to a multiple of the unit
+			for (size_t i = str.size(); i % unit; i++) byte(0);
+			continue;
+		}
+		int sym = -1;
+		int64_t v = expression(item, sym);
+		Operand o;
+		o.kind = Operand::IMM;
+		o.imm = v;
+		o.symbol = sym;
+		if (sym >= 0 && unit < 4) error("a symbol does not fit in " + std::to_string(unit) + " bytes");
+		imm_reloc(o, unit, unit == 8 ? R_X86_64_64 : R_X86_64_32);
+	}
+}
+
+int64_t assembler::Assembler::expression(std::string_view s, int& sym) {
+	s = trim(s);
+	if (s.empty()) error("expected an expression");
+	int64_t value = 0;
+	size_t i = 0;
+	while (i < s.size()) {
+		// sign(s) of the term
+		int sign = 1;
+		while (i < s.size() && (s[i] == '+' || s[i] == '-' || isspace((unsigned char)s[i]))) {
+			if (s[i] == '-') sign = -sign;
+			i++;
+		}
+		if (i >= s.size()) error("expected a term");
+		size_t start = i;
+		int64_t term = 0;
+		if (is_quote(s[i])) {
+			// character constant, packed little endian
+			char q = s[i++];
+			int shiftBy = 0;
+			while (i < s.size() && s[i] != q) {
+				if (shiftBy >= 64) error("character constant is too long");
+				term |= (int64_t)(unsigned char)s[i++] << shiftBy;
+				shiftBy += 8;
+			}
+			if (i >= s.size()) error("unterminated character constant");
+			i++;
+		}
+		else if (isdigit((unsigned char)s[i])) {
+			while (i < s.size() && isalnum((unsigned char)s[i])) i++;
+			std::string num = lower(s.substr(start, i - start));
+			int base = 10;
+			std::string digits = num;
+			if (num.size() > 2 && num[0] == '0' && (num[1] == 'x' || num[1] == 'h')) { base = 16; digits = num.substr(2); }
+			else if (num.size() > 2 && num[0] == '0' && (num[1] == 'b' || num[1] == 'y')) { base = 2; digits = num.substr(2); }
+			else if (num.back() == 'h') { base = 16; digits = num.substr(0, num.size() - 1); }
+			uint64_t v = 0;
+			for (char c : digits) {
+				int d = isdigit((unsigned char)c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : 99;
+				if (d >= base) error("invalid number " + num);
+				v = v * base + d;
+			}
+			term = (int64_t)v;
+		}
+		else if (is_name_start(s[i])) {
+			while (i < s.size() && is_name_char(s[i])) i++;
+			std::string_view name = s.substr(start, i - start);
+			if (name == "$" || name == "$$") unsupported("$ in expressions");
+			if (compiler::reg_from_name(lower(name)).id != NOREG) error("invalid use of register " + std::string(name));
+			if (sym >= 0 || sign < 0) unsupported("expression with more than one symbol");
+			sym = symbol(name);
+			symbols[sym].referenced = true;
+		}
+		else unsupported("expression " + std::string(s));
+		value += sign * term;
+		while (i < s.size() && isspace((unsigned char)s[i])) i++;
+		if (i < s.size() && s[i] != '+' && s[i] != '-') unsupported("expression " + std::string(s));
+	}
+	return value;
+}
+
+void assembler::Assembler::memory(std::string_view s, Operand& op) {
+	op.kind = Operand::MEM;
+	s = trim(s);
+	std::string l = lower(s.substr(0, 4));
+	if (l == "rel " || l == "abs ") {
+		op.rel = l == "rel ";
+		s = trim(s.substr(4));
+	}
+	else op.rel = defaultRel;
+
+	size_t i = 0;
+	while (i < s.size()) {
+		int sign = 1;
+		while (i < s.size() && (s[i] == '+' || s[i] == '-' || isspace((unsigned char)s[i]))) {
+			if (s[i] == '-') sign = -sign;
+			i++;
+		}
+		size_t start = i;
+		while (i < s.size() && s[i] != '+' && s[i] != '-') i++;
+		std::string_view term = trim(s.substr(start, i - start));
+		if (term.empty()) error("invalid memory operand");
+
+		size_t star = term.find('*');
+		if (star != std::string_view::npos) {
+			// index * scale (either order)
+			std::string_view a = trim(term.substr(0, star)), b = trim(term.substr(star + 1));
+			Reg r = compiler::reg_from_name(lower(a));
+			std::string_view scale = b;
+			if (r.none()) {
+				r = compiler::reg_from_name(lower(b));
+				scale = a;
+			}
+			int sym = -1;
+			int64_t f = expression(scale, sym);
+			if (r.none() || sym >= 0 || sign < 0 || op.index != NOREG) error("invalid memory operand");
+			if (f != 1 && f != 2 && f != 4 && f != 8) error("invalid scale " + std::to_string(f));
+			if (r.size != 8) unsupported("32-bit addressing");
+			op.index = r.id;
+			op.scale = (int)f;
+			continue;
+		}
+		Reg r = compiler::reg_from_name(lower(term));
+		if (!r.none()) {
+			if (sign < 0) error("invalid memory operand");
+			if (r.size != 8) unsupported("32-bit addressing");
+			if (op.base == NOREG) op.base = r.id;
+			else if (op.index == NOREG) op.index = r.id;
+			else error("invalid memory operand");
+			continue;
+		}
+		int sym = -1;
+		int64_t v = expression(term, sym);
+		if (sym >= 0) {
+			if (sign < 0 || op.symbol >= 0) unsupported("memory operand with more than one symbol");
+			op.symbol = sym;
+		}
+		op.imm += sign * v;
+	}
+	// rsp can only be a base
+	if (op.index == compiler::RSP) {
+		if (op.scale != 1 || op.base == compiler::RSP) error("invalid use of rsp as an index");
+		std::swap(op.base, op.index);
+	}
+	if (op.rel && (op.base != NOREG || op.index != NOREG)) op.rel = false;
+}
+
+assembler::Operand assembler::Assembler::operand(std::string_view s) {
+	Operand op;
+	s = trim(s);
+	if (s.empty()) error("expected an operand");
+
+	// size override (byte [x]) and jump distance (short label)
+	size_t n = 0;
+	while (n < s.size() && isalpha((unsigned char)s[n])) n++;
+	std::string w = lower(s.substr(0, n));
+	if (n < s.size() && (isspace((unsigned char)s[n]) || s[n] == '[')) {
+		if (int size = size_keyword(w)) {
+			op = operand(s.substr(n));
+			op.size = size;
+			return op;
+		}
+		if (w == "short" || w == "near") return operand(s.substr(n));
+	}
+
+	if (s.front() == '[') {
+		if (s.back() != ']') error("expected ]");
+		memory(s.substr(1, s.size() - 2), op);
+		return op;
+	}
+	std::string l = lower(s);
+	Reg r = compiler::reg_from_name(l);
+	if (!r.none()) {
+		op.kind = Operand::REG;
+		op.reg = r;
+		return op;
+	}
+	if (l == "ah" || l == "bh" || l == "ch" || l == "dh") unsupported("high byte registers");
+	op.kind = Operand::IMM;
+	op.imm = expression(s, op.symbol);
+	return op;
+}
+
+void assembler::Assembler::imm(int64_t v, int size) {
+	for (int i = 0; i < size; i++) byte((uint8_t)((uint64_t)v >> (8 * i)));
+}
+
+void assembler::Assembler::imm_reloc(const Operand& o, int size, uint32_t type) {
+	if (o.symbol >= 0) {
+		section().relocs.push_back(Reloc{ section().frags.size() - 1, section().bytes.size(), o.symbol, type, o.imm, line });
+		imm(0, size);
+	}
+	else imm(o.imm, size);
+}
+
+void assembler::Assembler::reg_opcode(int size, uint8_t opcode, Reg r) {
+	if (size == 2) byte(0x66);
+	uint8_t rex = (size == 8 ? 0x48 : 0) | (r.id >= 8 ? 0x41 : 0);
+	if (r.size == 1 && r.id >= compiler::RSP && r.id <= compiler::RDI) rex |= 0x40;
+	if (rex) byte(rex);
+	byte(opcode + (r.id & 7));
+}
+
+void assembler::Assembler::modrm(int size, std::initializer_list<uint8_t> opcode, int reg, const Operand& rm, bool regIsByte, int immSize) {
+	if (size == 2) byte(0x66);
+	uint8_t rex = (size == 8 ? 0x48 : 0) | (reg >= 8 ? 0x44 : 0);
+	// spl, bpl, sil and dil are only reachable with a REX prefix
+	if (regIsByte && reg >= compiler::RSP && reg <= compiler::RDI) rex |= 0x40;
+	if (rm.kind == Operand::REG) {
+		if (rm.reg.id >= 8) rex |= 0x41;
+		if (rm.reg.size == 1 && rm.reg.id >= compiler::RSP && rm.reg.id <= compiler::RDI) rex |= 0x40;
+	}
+	else {
+		if (rm.base != NOREG && rm.base >= 8) rex |= 0x41;
+		if (rm.index != NOREG && rm.index >= 8) rex |= 0x42;
+	}
+	if (rex) byte(rex);
+	for (uint8_t op : opcode) byte(op);
+
+	uint8_t r = (uint8_t)((reg & 7) << 3);
+	if (rm.kind == Operand::REG) {
+		byte(0xc0 | r | (rm.reg.id & 7));
+		return;
+	}
+
+	auto disp32 = [&](uint32_t type) {
+		if (rm.symbol >= 0) {
+			int64_t addend = rm.imm - (type == R_X86_64_PC32 ? 4 + immSize : 0);
+			section().relocs.push_back(Reloc{ section().frags.size() - 1, section().bytes.size(), rm.symbol, type, addend, line });
+			imm(0, 4);
+		}
+		else {
+			if (!fits32(rm.imm)) error("displacement out of range");
+			imm(rm.imm, 4);
+		}
+	};
+
+	if (rm.rel) {
+		byte(0x05 | r);
+		return disp32(R_X86_64_PC32);
+	}
+	if (rm.base == NOREG) {
+		// absolute, or index only
+		byte(0x04 | r);
+		uint8_t index = rm.index == NOREG ? 4 : (rm.index & 7);
+		uint8_t scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+		byte((uint8_t)(scale << 6 | index << 3 | 5));
+		return disp32(R_X86_64_32S);
+	}
+
+	bool sib = rm.index != NOREG || (rm.base & 7) == 4;
+	int mod;
+	if (rm.symbol >= 0 || !fits8(rm.imm)) mod = 2;
+	else if (rm.imm == 0 && (rm.base & 7) != 5) mod = 0;
+	else mod = 1;
+	byte((uint8_t)(mod << 6 | r | (sib ? 4 : (rm.base & 7))));
+	if (sib) {
+		uint8_t index = rm.index == NOREG ? 4 : (rm.index & 7);
+		uint8_t scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+		byte((uint8_t)(scale << 6 | index << 3 | (rm.base & 7)));
+	}
+	if (mod == 1) byte((uint8_t)rm.imm);
+	else if (mod == 2) disp32(R_X86_64_32S);
+}
+
+void assembler::Assembler::jump(int cc, const Operand& target) {
+	if (target.kind != Operand::IMM || target.symbol < 0 || target.imm != 0) unsupported("jump target");
+	frag().cc = cc;
+	frag().target = target.symbol;
+	close(Fragment::JUMP);
+}
+
+void assembler::Assembler::call(const Operand& target) {
+	if (target.kind != Operand::IMM || target.symbol < 0 || target.imm != 0) unsupported("call target");
+	frag().target = target.symbol;
+	close(Fragment::CALL);
+}
+
+void assembler::Assembler::instruction(std::string_view m, std::vector<Operand>& ops) {
+	using K = Operand::kind_t;
+	auto is = [&](size_t i, K k) { return i < ops.size() && ops[i].kind == k; };
+	auto count = [&](size_t n) {
+		if (ops.size() != n) error("invalid combination of opcode and operands");
+	};
+	// the operand size of an instruction with a register or a sized memory operand
+	auto opsize = [&]() {
+		for (const Operand& o : ops)
+			if (o.kind == Operand::REG) return o.reg.size;
+		for (const Operand& o : ops)
+			if (o.kind == Operand::MEM && o.size) return o.size;
+		error("operation size not specified");
+	};
+	auto check_imm = [&](const Operand& o, int size) {
+		if (o.symbol >= 0) return;
+		int64_t v = o.imm;
+		bool ok = size == 8 ? fits32(v)
+			: size == 4 ? (v >= INT32_MIN && v <= (int64_t)UINT32_MAX)
+			: size == 2 ? (v >= -32768 && v <= 65535)
+			: (v >= -128 && v <= 255);
+		if (!ok) error("immediate out of range");
+	};
+	// immediates are at most 32 bits, sign extended for 64-bit operations
+	auto imm_size = [](int size) { return size == 8 ? 4 : size; };
+	auto same_size = [&](const Operand& a, const Operand& b) {
+		if (a.kind == Operand::REG && b.kind == Operand::REG && a.reg.size != b.reg.size) error("mismatch in operand sizes");
+		if (a.kind == Operand::MEM && a.size && b.kind == Operand::REG && a.size != b.reg.size) error("mismatch in operand sizes");
+		if (b.kind == Operand::MEM && b.size && a.kind == Operand::REG && b.size != a.reg.size) error("mismatch in operand sizes");
+	};
+
+	if (m == "ret") {
+		if (ops.empty()) return byte(0xc3);
+		count(1);
+		if (!is(0, K::IMM)) error("invalid operand");
+		byte(0xc2);
+		return imm(ops[0].imm, 2);
+	}
+	if (ops.empty()) {
+		if (m == "syscall") { byte(0x0f); return byte(0x05); }
+		if (m == "nop") return byte(0x90);
+		if (m == "leave") return byte(0xc9);
+		if (m == "cqo") { byte(0x48); return byte(0x99); }
+		if (m == "cdq") return byte(0x99);
+		if (m == "hlt") return byte(0xf4);
+		if (m == "int3") return byte(0xcc);
+		if (m == "ud2") { byte(0x0f); return byte(0x0b); }
+	}
+
+	if (m == "mov") {
+		count(2);
+		Operand& d = ops[0];
+		Operand& s = ops[1];
+		same_size(d, s);
+		if (is(1, K::IMM)) {
+			int size = opsize();
+			if (d.kind == Operand::REG) {
+				if (size == 8) {
+					// the shortest form that gives the same 64-bit value
+					if (s.symbol >= 0) {
+						reg_opcode(8, 0xb8, d.reg);
+						return imm_reloc(s, 8, R_X86_64_64);
+					}
+					if (s.imm >= 0 && s.imm <= (int64_t)UINT32_MAX) {
+						reg_opcode(4, 0xb8, d.reg);
+						return imm(s.imm, 4);
+					}
+					if (fits32(s.imm)) {
+						modrm(8, { 0xc7 }, 0, d);
+						return imm(s.imm, 4);
+					}
+					reg_opcode(8, 0xb8, d.reg);
+					return imm(s.imm, 8);
+				}
+				check_imm(s, size);
+				reg_opcode(size, size == 1 ? 0xb0 : 0xb8, d.reg);
+				return imm_reloc(s, size, R_X86_64_32);
+			}
+			if (d.kind != Operand::MEM) error("invalid combination of opcode and operands");
+			check_imm(s, size);
+			modrm(size, { (uint8_t)(size == 1 ? 0xc6 : 0xc7) }, 0, d, false, imm_size(size));
+			return imm_reloc(s, imm_size(size), size == 8 ? R_X86_64_32S : R_X86_64_32);
+		}
+		if (is(0, K::REG) && (is(1, K::REG) || is(1, K::MEM))) {
+			int size = d.reg.size;
+			if (s.kind == Operand::REG) return modrm(size, { (uint8_t)(size == 1 ? 0x88 : 0x89) }, s.reg.id, d, size == 1);
+			return modrm(size, { (uint8_t)(size == 1 ? 0x8a : 0x8b) }, d.reg.id, s, size == 1);
+		}
+		if (is(0, K::MEM) && is(1, K::REG)) {
+			int size = s.reg.size;
+			return modrm(size, { (uint8_t)(size == 1 ? 0x88 : 0x89) }, s.reg.id, d, size == 1);
+		}
+		error("invalid combination of opcode and operands");
+	}
+
+	if (m == "movzx" || m == "movsx") {
+		count(2);
+		if (!is(0, K::REG) || ops[0].reg.size == 1) error("invalid combination of opcode and operands");
+		int from = is(1, K::REG) ? ops[1].reg.size : ops[1].size;
+		if (is(1, K::IMM) || (from != 1 && from != 2)) error("invalid combination of opcode and operands");
+		uint8_t op = (m == "movzx" ? 0xb6 : 0xbe) + (from == 2 ? 1 : 0);
+		return modrm(ops[0].reg.size, { 0x0f, op }, ops[0].reg.id, ops[1], from == 1);
+	}
+	if (m == "movsxd") {
+		count(2);
+		int from = is(1, K::REG) ? ops[1].reg.size : (ops[1].size ? ops[1].size : 4);
+		if (!is(0, K::REG) || ops[0].reg.size != 8 || is(1, K::IMM) || from != 4) error("invalid combination of opcode and operands");
+		return modrm(8, { 0x63 }, ops[0].reg.id, ops[1]);
+	}
+	if (m == "lea") {
+		count(2);
+		if (!is(0, K::REG) || !is(1, K::MEM) || ops[0].reg.size == 1) error("invalid combination of opcode and operands");
+		return modrm(ops[0].reg.size, { 0x8d }, ops[0].reg.id, ops[1]);
+	}
+
+	if (int n = arith(m); n >= 0) {
+		count(2);
+		Operand& d = ops[0];
+		Operand& s = ops[1];
+		same_size(d, s);
+		if (is(1, K::IMM)) {
+			if (d.kind == Operand::IMM) error("invalid combination of opcode and operands");
+			int size = opsize();
+			check_imm(s, size);
+			if (size == 1) {
+				modrm(1, { 0x80 }, n, d, false, 1);
+				return imm(s.imm, 1);
+			}
+			if (s.symbol < 0 && fits8(s.imm)) {
+				modrm(size, { 0x83 }, n, d, false, 1);
+				return imm(s.imm, 1);
+			}
+			modrm(size, { 0x81 }, n, d, false, imm_size(size));
+			return imm_reloc(s, imm_size(size), size == 8 ? R_X86_64_32S : R_X86_64_32);
+		}
+		uint8_t base = (uint8_t)(n * 8);
+		if (is(1, K::REG)) {
+			int size = s.reg.size;
+			return modrm(size, { (uint8_t)(base + (size == 1 ? 0 : 1)) }, s.reg.id, d, size == 1);
+		}
+		if (is(0, K::REG) && is(1, K::MEM)) {
+			int size = d.reg.size;
+			return modrm(size, { (uint8_t)(base + (size == 1 ? 2 : 3)) }, d.reg.id, s, size == 1);
+		}
+		error("invalid combination of opcode and operands");
+	}
+
+	if (m == "test") {
+		count(2);
+		same_size(ops[0], ops[1]);
+		// test is commutative, the register goes into the reg field
+		if (is(0, K::REG) && is(1, K::MEM)) std::swap(ops[0], ops[1]);
+		Operand& d = ops[0];
+		Operand& s = ops[1];
+		int size = opsize();
+		if (is(1, K::IMM)) {
+			check_imm(s, size);
+			modrm(size, { (uint8_t)(size == 1 ? 0xf6 : 0xf7) }, 0, d, false, imm_size(size));
+			return imm_reloc(s, imm_size(size), size == 8 ? R_X86_64_32S : R_X86_64_32);
+		}
+		if (is(1, K::REG)) return modrm(size, { (uint8_t)(size == 1 ? 0x84 : 0x85) }, s.reg.id, d, size == 1);
+		error("invalid combination of opcode and operands");
+	}
+
+	if (int n = unary(m); n >= 0) {
+		count(1);
+		if (is(0, K::IMM)) error("invalid combination of opcode and operands");
+		int size = opsize();
+		return modrm(size, { (uint8_t)(size == 1 ? 0xf6 : 0xf7) }, n, ops[0]);
+	}
+	if (m == "inc" || m == "dec") {
+		count(1);
+		if (is(0, K::IMM)) error("invalid combination of opcode and operands");
+		int size = opsize();
+		return modrm(size, { (uint8_t)(size == 1 ? 0xfe : 0xff) }, m == "inc" ? 0 : 1, ops[0]);
+	}
+
+	if (m == "imul") {
+		if (ops.size() == 1) {
+			if (is(0, K::IMM)) error("invalid combination of opcode and operands");
+			int size = opsize();
+			return modrm(size, { (uint8_t)(size == 1 ? 0xf6 : 0xf7) }, 5, ops[0]);
+		}
+		// imul r, imm is imul r, r, imm
+		if (ops.size() == 2 && is(1, K::IMM)) ops.insert(ops.begin() + 1, ops[0]);
+		if (!is(0, K::REG) || ops[0].reg.size == 1 || is(1, K::IMM)) error("invalid combination of opcode and operands");
+		same_size(ops[0], ops[1]);
+		int size = ops[0].reg.size;
+		if (ops.size() == 2) return modrm(size, { 0x0f, 0xaf }, ops[0].reg.id, ops[1]);
+		count(3);
+		if (!is(2, K::IMM) || ops[2].symbol >= 0) error("invalid combination of opcode and operands");
+		check_imm(ops[2], size);
+		if (fits8(ops[2].imm)) {
+			modrm(size, { 0x6b }, ops[0].reg.id, ops[1], false, 1);
+			return imm(ops[2].imm, 1);
+		}
+		modrm(size, { 0x69 }, ops[0].reg.id, ops[1], false, imm_size(size));
+		return imm(ops[2].imm, imm_size(size));
+	}
+
+	if (int n = shift(m); n >= 0) {
+		count(2);
+		if (is(0, K::IMM)) error("invalid combination of opcode and operands");
+		int size = is(0, K::REG) ? ops[0].reg.size : ops[0].size;
+		if (!size) error("operation size not specified");
+		bool byteOp = size == 1;
+		if (is(1, K::REG)) {
+			if (ops[1].reg.id != compiler::RCX || ops[1].reg.size != 1) error("invalid combination of opcode and operands");
+			return modrm(size, { (uint8_t)(byteOp ? 0xd2 : 0xd3) }, n, ops[0]);
+		}
+		if (!is(1, K::IMM) || ops[1].symbol >= 0) error("invalid combination of opcode and operands");
+		if (ops[1].imm == 1) return modrm(size, { (uint8_t)(byteOp ? 0xd0 : 0xd1) }, n, ops[0]);
+		modrm(size, { (uint8_t)(byteOp ? 0xc0 : 0xc1) }, n, ops[0], false, 1);
+		return imm(ops[1].imm, 1);
+	}
+
+	if (m == "push" || m == "pop") {
+		count(1);
+		bool push = m == "push";
+		if (is(0, K::REG)) {
+			if (ops[0].reg.size != 8) error("invalid combination of opcode and operands");
+			return reg_opcode(4, push ? 0x50 : 0x58, ops[0].reg);
+		}
+		if (is(0, K::MEM)) {
+			if (ops[0].size && ops[0].size != 8) error("invalid combination of opcode and operands");
+			return modrm(4, { (uint8_t)(push ? 0xff : 0x8f) }, push ? 6 : 0, ops[0]);
+		}
+		if (!push) error("invalid combination of opcode and operands");
+		if (ops[0].symbol < 0 && fits8(ops[0].imm)) {
+			byte(0x6a);
+			return imm(ops[0].imm, 1);
+		}
+		check_imm(ops[0], 8);
+		byte(0x68);
+		return imm_reloc(ops[0], 4, R_X86_64_32S);
+	}
+
+	if (m == "jmp" || m == "call") {
+		count(1);
+		if (is(0, K::IMM)) return m == "jmp" ? jump(-1, ops[0]) : call(ops[0]);
+		if (is(0, K::REG) && ops[0].reg.size != 8) error("invalid combination of opcode and operands");
+		return modrm(4, { 0xff }, m == "jmp" ? 4 : 2, ops[0]);
+	}
+	if (m.size() > 1 && m[0] == 'j') {
+		int cc = condition(m.substr(1));
+		if (cc >= 0) {
+			count(1);
+			return jump(cc, ops[0]);
+		}
+	}
+	if (m.size() > 3 && m.substr(0, 3) == "set") {
+		int cc = condition(m.substr(3));
+		if (cc >= 0) {
+			count(1);
+			if (is(0, K::IMM) || (is(0, K::REG) && ops[0].reg.size != 1)) error("invalid combination of opcode and operands");
+			return modrm(1, { 0x0f, (uint8_t)(0x90 + cc) }, 0, ops[0]);
+		}
+	}
+	if (m.size() > 4 && m.substr(0, 4) == "cmov") {
+		int cc = condition(m.substr(4));
+		if (cc >= 0) {
+			count(2);
+			if (!is(0, K::REG) || ops[0].reg.size == 1 || is(1, K::IMM)) error("invalid combination of opcode and operands");
+			same_size(ops[0], ops[1]);
+			return modrm(ops[0].reg.size, { 0x0f, (uint8_t)(0x40 + cc) }, ops[0].reg.id, ops[1]);
+		}
+	}
+	if (m == "int") {
+		count(1);
+		if (!is(0, K::IMM)) error("invalid combination of opcode and operands");
+		byte(0xcd);
+		return imm(ops[0].imm, 1);
+	}
+
+	unsupported("instruction " + std::string(m));
+}
+
+void assembler::Assembler::layout(Section& sec) {
+	int index = (int)(&sec - sections.data());
+	std::vector<int> labels;
+	for (size_t i = 0; i < symbols.size(); i++)
+		if (symbols[i].section == index) labels.push_back((int)i);
+
+	sec.frags.back().end = sec.bytes.size();
+
+	// jumps start short and are made long as long as any of them does not reach
+	// (they only ever grow, so this ends)
+	for (Fragment& f : sec.frags)
+		if (f.tail == Fragment::JUMP) f.far = symbols[f.target].section != index;
+	while (true) {
+		uint64_t addr = 0;
+		for (Fragment& f : sec.frags) {
+			f.addr = addr;
+			addr += f.end - f.begin;
+			switch (f.tail) {
+			case Fragment::JUMP: addr += f.far ? (f.cc < 0 ? 5 : 6) : 2; break;
+			case Fragment::CALL: addr += 5; break;
+			case Fragment::ALIGN: addr += (f.alignment - addr % f.alignment) % f.alignment; break;
+			default: break;
+			}
+		}
+		sec.size = addr;
+		for (int l : labels) {
+			const Fragment& f = sec.frags[symbols[l].frag];
+			symbols[l].value = f.addr + (symbols[l].offset - f.begin);
+		}
+
+		bool changed = false;
+		for (Fragment& f : sec.frags) {
+			if (f.tail != Fragment::JUMP || f.far) continue;
+			int64_t disp = (int64_t)symbols[f.target].value - (int64_t)(f.addr + (f.end - f.begin) + 2);
+			if (!fits8(disp)) {
+				f.far = true;
+				changed = true;
+			}
+		}
+		if (!changed) break;
+	}
+}
+
+std::string assembler::Assembler::object() {
+	for (Section& sec : sections) layout(sec);
+
+	// symbol table: null, the sections, the local labels, then the global symbols
+	std::vector<elf::Symbol> elfSymbols;
+	elfSymbols.push_back(elf::Symbol{ "", 0, elf::SHN_UNDEF, 0 });
+	for (size_t i = 0; i < sections.size(); i++) {
+		sections[i].symbol = (int)elfSymbols.size();
+		elfSymbols.push_back(elf::Symbol{ "", (elf::STB_LOCAL << 4) | elf::STT_SECTION, (uint16_t)(i + 1), 0 });
+	}
+	for (size_t i = 0; i < symbols.size(); i++) {
+		Symbol& s = symbols[i];
+		if (s.section >= 0 && !s.global) {
+			s.index = (int)elfSymbols.size();
+			elfSymbols.push_back(elf::Symbol{ names.name((int)i), (elf::STB_LOCAL << 4) | elf::STT_NOTYPE, (uint16_t)(s.section + 1), s.value });
+		}
+	}
+	size_t firstGlobal = elfSymbols.size();
+	for (size_t i = 0; i < symbols.size(); i++) {
+		Symbol& s = symbols[i];
+		if (s.global || (s.external && s.referenced)) {
+			s.index = (int)elfSymbols.size();
+			elfSymbols.push_back(elf::Symbol{ names.name((int)i), (elf::STB_GLOBAL << 4) | elf::STT_NOTYPE, (uint16_t)(s.section >= 0 ? s.section + 1 : elf::SHN_UNDEF), s.value });
+		}
+	}
+
+	std::vector<elf::Section> elfSections;
+	for (Section& sec : sections) {
+		resolve(sec);
+		elf::Section out{ sec.name, sec.type, sec.flags, sec.align, std::move(sec.data), sec.size, {} };
+		elfSections.push_back(std::move(out));
+	}
+	// the relocations were collected by resolve
+	for (size_t i = 0; i < sections.size(); i++) elfSections[i].relocs = std::move(relas[i]);
+	return elf::write(elfSections, elfSymbols, firstGlobal);
+}
+
+void assembler::Assembler::resolve(Section& sec) {
+	int index = (int)(&sec - sections.data());
+	relas.resize(sections.size());
+	std::vector<elf::Rela>& out = relas[index];
+	std::vector<uint8_t>& data = sec.data;
+	data.clear();
+	data.reserve(sec.size);
+
+	// a relocation for the symbol (plus the addend), or nothing if it is resolved here
+	auto relocate = [&](int symbolId, uint64_t at, uint32_t type, int64_t addend, int srcLine) {
+		Symbol& s = symbols[symbolId];
+		if (s.section == index && (type == R_X86_64_PC32 || type == R_X86_64_PLT32)) {
+			int64_t v = (int64_t)s.value + addend - (int64_t)at;
+			for (int i = 0; i < 4; i++) data[at + i] = (uint8_t)((uint64_t)v >> (8 * i));
+			return;
+		}
+		if (s.section >= 0) {
+			// against the section, NASM does the same for every defined symbol
+			out.push_back(elf::Rela{ at, (uint32_t)sections[s.section].symbol, type == R_X86_64_PLT32 ? R_X86_64_PC32 : type, addend + (int64_t)s.value });
+			return;
+		}
+		if (!s.external && !s.global) throw asmerr("symbol `" + std::string(names.name(symbolId)) + "' not defined", srcLine, false);
+		out.push_back(elf::Rela{ at, (uint32_t)s.index, type, addend });
+	};
+
+	size_t r = 0;
+	for (size_t fi = 0; fi < sec.frags.size(); fi++) {
+		Fragment& f = sec.frags[fi];
+		data.insert(data.end(), sec.bytes.begin() + f.begin, sec.bytes.begin() + f.end);
+		// relocations inside the fixed bytes (they were added in order)
+		for (; r < sec.relocs.size() && sec.relocs[r].frag == fi; r++) {
+			const Reloc& rel = sec.relocs[r];
+			relocate(rel.symbol, f.addr + (rel.offset - f.begin), rel.type, rel.addend, rel.line);
+		}
+		switch (f.tail) {
+		case Fragment::JUMP:
+		case Fragment::CALL: {
+			Symbol& t = symbols[f.target];
+			if (f.tail == Fragment::JUMP && !f.far) {
+				int64_t disp = (int64_t)t.value - (int64_t)(f.addr + (f.end - f.begin) + 2);
+				data.push_back(f.cc < 0 ? 0xeb : (uint8_t)(0x70 + f.cc));
+				data.push_back((uint8_t)disp);
+				break;
+			}
+			if (f.tail == Fragment::CALL) data.push_back(0xe8);
+			else if (f.cc < 0) data.push_back(0xe9);
+			else {
+				data.push_back(0x0f);
+				data.push_back((uint8_t)(0x80 + f.cc));
+			}
+			uint64_t at = data.size();
+			data.insert(data.end(), 4, 0);
+			t.referenced = true;
+			relocate(f.target, at, R_X86_64_PLT32, -4, f.line);
+			break;
+		}
+		case Fragment::ALIGN: {
+			size_t padding = (size_t)((f.alignment - data.size() % f.alignment) % f.alignment);
+			while (padding) {
+				size_t n = std::min<size_t>(padding, 9);
+				if (sec.flags & elf::SHF_EXECINSTR) data.insert(data.end(), nops[n - 1], nops[n - 1] + n);
+				else data.insert(data.end(), n, 0);
+				padding -= n;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	// the fixed bytes are all in `data` now
+	std::vector<uint8_t>().swap(sec.bytes);
+}
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../compiler/asm.h"
+#include "elf.h"
+#include "../lexer/symbols.h"
+
+// Built-in assembler for the subset of NASM syntax the compiler emits
+// (plus what the stdlib uses in `asm` blocks), it encodes x86-64 straight into
+// the sections of an ELF64 relocatable object
+namespace assembler {
+	// error while assembling, `unsupported` is set when the source is valid NASM
+	// the built-in assembler does not handle (the caller can fall back to NASM then)
+	class asmerr : public std::runtime_error {
+	public:
+		int line;
+		bool unsupported;
+		asmerr(const std::string& msg, int line, bool unsupported)
+			: std::runtime_error(msg), line(line), unsupported(unsupported) {}
+	};
+
+	// ELF relocation types used
+	enum : uint32_t {
+		R_X86_64_64 = 1,
+		R_X86_64_PC32 = 2,
+		R_X86_64_32 = 10,
+		R_X86_64_32S = 11,
+		R_X86_64_PLT32 = 4,
+	};
+
+	// a label, the name is in the assembler's name table
+	struct Symbol {
+		int section = -1;          // section it is defined in, -1 if it is not defined
+		size_t frag = 0;           // fragment and offset in the section's bytes it is defined at
+		size_t offset = 0;
+		bool global = false;       // declared with `global`
+		bool external = false;     // declared with `extern`
+		bool referenced = false;
+		uint64_t value = 0;        // offset in the section, after layout
+		int index = 0;             // index in the ELF symbol table
+	};
+
+	// a run of fixed bytes, optionally followed by a jump (whose size is only known
+	// after layout) or by alignment padding
+	struct Fragment {
+		size_t begin = 0, end = 0; // the fixed bytes, in the section's bytes
+		enum tail_t { NONE, JUMP, CALL, ALIGN } tail = NONE;
+		int cc = -1;               // JUMP: condition code, -1 for jmp
+		int target = -1;           // JUMP, CALL: the symbol
+		bool far = false;          // JUMP: rel32 form (rel8 otherwise)
+		int alignment = 1;         // ALIGN
+		int line = 0;
+		uint64_t addr = 0;         // offset in the section, after layout
+	};
+
+	struct Reloc {
+		size_t frag;
+		size_t offset;             // in the section's bytes
+		int symbol;
+		uint32_t type;
+		int64_t addend;
+		int line;
+	};
+
+	struct Section {
+		std::string name;
+		uint32_t type;             // SHT_PROGBITS or SHT_NOBITS
+		uint64_t flags;
+		uint64_t align;
+		std::vector<uint8_t> bytes; // the fixed bytes of all the fragments
+		std::vector<Fragment> frags{ Fragment{} };
+		std::vector<Reloc> relocs;
+		uint64_t size = 0;         // after layout
+		std::vector<uint8_t> data; // the final contents, after layout
+		int symbol = 0;            // index of the section symbol in the ELF symbol table
+	};
+
+	// an operand of an instruction
+	struct Operand {
+		enum kind_t { NONE, REG, IMM, MEM } kind = NONE;
+		compiler::Reg reg;         // REG
+		int64_t imm = 0;           // IMM, MEM (the displacement)
+		int symbol = -1;           // IMM, MEM: symbol added to the value, -1 if none
+		int size = 0;              // MEM: size given with byte/word/dword/qword (0 if none)
+		compiler::reg_t base = compiler::NOREG, index = compiler::NOREG;
+		int scale = 1;
+		bool rel = false;          // MEM: RIP-relative
+	};
+
+	class Assembler {
+	private:
+		std::vector<Section> sections;
+		std::vector<Symbol> symbols;
+		lexer::SymbolTable names; // names of the symbols, their IDs index `symbols`
+		int cur = 0;               // the current section
+		std::string scope;         // the last non-local label, local labels (.x) belong to it
+		bool defaultRel = false;
+		int line = 0;
+		std::vector<std::vector<elf::Rela>> relas; // per section, collected by resolve
+		// buffers reused for every statement
+		std::string local;
+		std::vector<std::string_view> parts;
+		std::vector<Operand> ops;
+
+		[[noreturn]] void error(const std::string& msg) const { throw asmerr(msg, line, false); }
+		[[noreturn]] void unsupported(const std::string& msg) const { throw asmerr(msg, line, true); }
+
+		Section& section() { return sections[cur]; }
+		Fragment& frag() { return sections[cur].frags.back(); }
+		// end the current fragment with the tail and start the next one
+		void close(Fragment::tail_t);
+		int symbol(std::string_view name);
+		void define(std::string_view name);
+		void select_section(std::string_view name);
+
+		// parsing
+		void statement(std::string_view);
+		void data(std::string_view directive, std::string_view args);
+		Operand operand(std::string_view);
+		int64_t expression(std::string_view, int& symbol);
+		void memory(std::string_view, Operand&);
+
+		// encoding
+		void instruction(std::string_view mnemonic, std::vector<Operand>& ops);
+		void byte(uint8_t b) { sections[cur].bytes.push_back(b); }
+		void imm(int64_t v, int size);
+		void imm_reloc(const Operand&, int size, uint32_t type);
+		void modrm(int size, std::initializer_list<uint8_t> opcode, int reg, const Operand& rm, bool regIsByte = false, int immSize = 0);
+		void reg_opcode(int size, uint8_t opcode, compiler::Reg r);
+		void jump(int cc, const Operand& target);
+		void call(const Operand& target);
+
+		void layout(Section&);
+		void resolve(Section&);
+	public:
+		Assembler();
+		// assemble a whole program (may be called again with more text)
+		void assemble(std::string_view source);
+		// lay out the sections and write the relocatable object
+		std::string object();
+	};
+
+	// stream buffer that assembles what is written to it, a line at a time
+	// (so the compiler can stream into the assembler without keeping the text)
+	class AsmStreamBuf : public std::streambuf {
+	private:
+		Assembler& as;
+		std::string pending;       // the last, unfinished line
+	protected:
+		std::streamsize xsputn(const char* s, std::streamsize n) override;
+		int_type overflow(int_type c) override;
+	public:
+		AsmStreamBuf(Assembler& as) : as(as) {}
+		// assemble the unfinished line, if any
+		void finish();
+	};
+}
\ No newline at end of file
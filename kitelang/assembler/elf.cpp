@@ -0,0 +1,132 @@
+#include "elf.h"
+#include <cstring>
+
+namespace {
+	struct Header {
+		std::string name;
+		uint32_t type;
+		uint64_t flags;
+		uint64_t offset;
+		uint64_t size;
+		uint32_t link;
+		uint32_t info;
+		uint64_t align;
+		uint64_t entsize;
+	};
+
+	template <typename T>
+	void put(std::string& out, T v) {
+		char b[sizeof(T)];
+		std::memcpy(b, &v, sizeof(T)); // x86-64 is little endian, so is the object
+		out.append(b, sizeof(T));
+	}
+
+	void pad(std::string& out, uint64_t align) {
+		while (out.size() % align) out.push_back('\0');
+	}
+
+	uint32_t add_string(std::string& table, std::string_view s) {
+		uint32_t at = (uint32_t)table.size();
+		table += s;
+		table.push_back('\0');
+		return at;
+	}
+}
+
+std::string assembler::elf::write(const std::vector<Section>& sections, const std::vector<Symbol>& symbols, size_t firstGlobal) {
+	std::string out(64, '\0'); // the ELF header is filled in at the end
+	std::vector<Header> headers;
+	headers.push_back(Header{ "", 0, 0, 0, 0, 0, 0, 0, 0 });
+
+	// contents of the sections
+	for (const Section& s : sections) {
+		pad(out, s.align ? s.align : 1);
+		headers.push_back(Header{ s.name, s.type, s.flags, out.size(), s.size, 0, 0, s.align, 0 });
+		if (s.type != SHT_NOBITS) out.append((const char*)s.data.data(), s.data.size());
+	}
+
+	uint32_t symtab = (uint32_t)(headers.size() + [&] {
+		size_t n = 0;
+		for (const Section& s : sections) n += !s.relocs.empty();
+		return n;
+	}());
+
+	// relocations
+	for (size_t i = 0; i < sections.size(); i++) {
+		const Section& s = sections[i];
+		if (s.relocs.empty()) continue;
+		pad(out, 8);
+		uint64_t offset = out.size();
+		for (const Rela& r : s.relocs) {
+			put<uint64_t>(out, r.offset);
+			put<uint64_t>(out, ((uint64_t)r.symbol << 32) | r.type);
+			put<int64_t>(out, r.addend);
+		}
+		headers.push_back(Header{ ".rela" + s.name, SHT_RELA, SHF_INFO_LINK, offset, out.size() - offset, symtab, (uint32_t)(i + 1), 8, 24 });
+	}
+
+	// symbols and their names
+	std::string strtab(1, '\0');
+	pad(out, 8);
+	uint64_t symOffset = out.size();
+	for (const Symbol& sym : symbols) {
+		put<uint32_t>(out, sym.name.empty() ? 0 : add_string(strtab, sym.name));
+		put<uint8_t>(out, sym.info);
+		put<uint8_t>(out, 0);
+		put<uint16_t>(out, sym.shndx);
+		put<uint64_t>(out, sym.value);
+		put<uint64_t>(out, 0);
+	}
+	headers.push_back(Header{ ".symtab", SHT_SYMTAB, 0, symOffset, out.size() - symOffset, symtab + 1, (uint32_t)firstGlobal, 8, 24 });
+	headers.push_back(Header{ ".strtab", SHT_STRTAB, 0, out.size(), strtab.size(), 0, 0, 1, 0 });
+	out += strtab;
+
+	// names of the sections
+	std::string shstrtab(1, '\0');
+	std::vector<uint32_t> names;
+	for (Header& h : headers) names.push_back(h.name.empty() ? 0 : add_string(shstrtab, h.name));
+	names.push_back(add_string(shstrtab, ".shstrtab"));
+	headers.push_back(Header{ ".shstrtab", SHT_STRTAB, 0, out.size(), shstrtab.size(), 0, 0, 1, 0 });
+	out += shstrtab;
+
+	// section header table
+	pad(out, 8);
+	uint64_t shoff = out.size();
+	for (size_t i = 0; i < headers.size(); i++) {
+		const Header& h = headers[i];
+		put<uint32_t>(out, names[i]);
+		put<uint32_t>(out, h.type);
+		put<uint64_t>(out, h.flags);
+		put<uint64_t>(out, 0);
+		put<uint64_t>(out, h.offset);
+		put<uint64_t>(out, h.size);
+		put<uint32_t>(out, h.link);
+		put<uint32_t>(out, h.info);
+		put<uint64_t>(out, h.align);
+		put<uint64_t>(out, h.entsize);
+	}
+
+	// ELF header
+	std::string eh;
+	eh.append("\x7f" "ELF", 4);
+	eh.push_back(2); // 64 bit
+	eh.push_back(1); // little endian
+	eh.push_back(1); // version
+	eh.push_back(0); // System V ABI
+	eh.append(8, '\0');
+	put<uint16_t>(eh, 1);   // relocatable
+	put<uint16_t>(eh, 62);  // x86-64
+	put<uint32_t>(eh, 1);
+	put<uint64_t>(eh, 0);   // entry
+	put<uint64_t>(eh, 0);   // program headers
+	put<uint64_t>(eh, shoff);
+	put<uint32_t>(eh, 0);   // flags
+	put<uint16_t>(eh, 64);  // header size
+	put<uint16_t>(eh, 0);
+	put<uint16_t>(eh, 0);
+	put<uint16_t>(eh, 64);  // section header size
+	put<uint16_t>(eh, (uint16_t)headers.size());
+	put<uint16_t>(eh, (uint16_t)(headers.size() - 1));
+	out.replace(0, 64, eh);
+	return out;
+}
\ No newline at end of file
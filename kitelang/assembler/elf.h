@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Writer for ELF64 relocatable objects (x86-64, little endian)
+namespace assembler::elf {
+	enum : uint32_t {
+		SHT_PROGBITS = 1,
+		SHT_SYMTAB = 2,
+		SHT_STRTAB = 3,
+		SHT_RELA = 4,
+		SHT_NOBITS = 8,
+	};
+	enum : uint64_t {
+		SHF_WRITE = 1,
+		SHF_ALLOC = 2,
+		SHF_EXECINSTR = 4,
+		SHF_INFO_LINK = 0x40,
+	};
+	enum : uint8_t {
+		STB_LOCAL = 0,
+		STB_GLOBAL = 1,
+		STT_NOTYPE = 0,
+		STT_SECTION = 3,
+		STT_FILE = 4,
+	};
+	enum : uint16_t {
+		SHN_UNDEF = 0,
+		SHN_ABS = 0xfff1,
+	};
+
+	struct Rela {
+		uint64_t offset;
+		uint32_t symbol;
+		uint32_t type;
+		int64_t addend;
+	};
+
+	struct Section {
+		std::string name;
+		uint32_t type;
+		uint64_t flags;
+		uint64_t align;
+		std::vector<uint8_t> data;   // empty for SHT_NOBITS
+		uint64_t size;
+		std::vector<Rela> relocs;
+	};
+
+	struct Symbol {
+		std::string_view name;
+		uint8_t info;               // binding << 4 | type
+		uint16_t shndx;             // index of the section (sections are numbered from 1), or SHN_*
+		uint64_t value;
+	};
+
+	// the object file with the sections, the symbols (local ones first, the first
+	// `firstGlobal` of them) and a .rela section for every section with relocations
+	std::string write(const std::vector<Section>& sections, const std::vector<Symbol>& symbols, size_t firstGlobal);
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "cache.h"
+#include "sha256.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+	// bumped when the layout of the cache changes
+	constexpr std::string_view cacheVersion = "kite-cache 1";
+
+	// size and modification time of the running compiler, a rebuilt compiler
+	// (which may generate different code) gets new keys
+	std::string compiler_identity() {
+		std::error_code ec;
+		fs::path exe = fs::canonical("/proc/self/exe", ec);
+		if (ec) return "unknown";
+		uintmax_t size = fs::file_size(exe, ec);
+		auto mtime = fs::last_write_time(exe, ec).time_since_epoch().count();
+		return exe.string() + ":" + std::to_string(size) + ":" + std::to_string(mtime);
+	}
+
+	// the bytes the entries take, next to their directories
+	constexpr std::string_view tallyName = "tally";
+
+	// false for the files of the cache that are not entries: one being written, or the tally
+	bool is_entry(const fs::path& p) {
+		std::string name = p.filename().string();
+		return name.find(".tmp") == std::string::npos && name != tallyName;
+	}
+
+	// passes the total in the tally (nullopt if it was never written) to f and writes back what
+	// f returns, with the tally locked so that concurrent compilers do not lose each other's stores
+	template <typename F>
+	void update_tally(const fs::path& path, F f) {
+		int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0) return;
+		if (flock(fd, LOCK_EX) == 0) {
+			uint64_t total;
+			std::optional<uint64_t> known;
+			if (pread(fd, &total, sizeof(total), 0) == sizeof(total)) known = total;
+			std::optional<uint64_t> updated = f(known);
+			if (updated && updated != known) {
+				total = *updated;
+				if (pwrite(fd, &total, sizeof(total), 0) != sizeof(total)) ftruncate(fd, 0);
+			}
+		}
+		// closing releases the lock
+		close(fd);
+	}
+}
+
+cache::OutputCache::OutputCache(fs::path dir, uintmax_t limit) : dir(std::move(dir)), limit(limit), compilerId(compiler_identity()) {}
+
+fs::path cache::OutputCache::default_dir() {
+	if (const char* d = std::getenv("KITE_CACHE_DIR")) return d;
+	if (const char* d = std::getenv("XDG_CACHE_HOME")) return fs::path(d) / "kite";
+	if (const char* d = std::getenv("HOME")) return fs::path(d) / ".cache" / "kite";
+	return fs::path();
+}
+
+uintmax_t cache::OutputCache::default_limit() {
+	if (const char* s = std::getenv("KITE_CACHE_SIZE")) return (uintmax_t)std::strtoull(s, nullptr, 10) << 20;
+	return (uintmax_t)512 << 20;
+}
+
+std::string cache::OutputCache::key(std::string_view source, std::string_view options) const {
+	Sha256 h;
+	// every part is followed by a separator that can not appear in the others
+	h.update(cacheVersion).update(std::string_view("\0", 1));
+	h.update(compilerId).update(std::string_view("\0", 1));
+	h.update(options).update(std::string_view("\0", 1));
+	h.update(source);
+	return h.hex();
+}
+
+fs::path cache::OutputCache::entry(const std::string& key) const {
+	// a directory per first byte keeps the directories small
+	return dir / key.substr(0, 2) / key;
+}
+
+bool cache::OutputCache::fetch(const std::string& key, const fs::path& out) {
+	std::error_code ec;
+	fs::path e = entry(key);
+	if (!fs::is_regular_file(e, ec)) {
+		missCount++;
+		return false;
+	}
+	fs::remove(out, ec);
+	fs::create_hard_link(e, out, ec);
+	if (ec) {
+		ec.clear();
+		fs::copy_file(e, out, fs::copy_options::overwrite_existing, ec);
+		if (ec) {
+			missCount++;
+			return false;
+		}
+	}
+	// the modification time of an entry is the time it was last used, for LRU eviction
+	fs::last_write_time(e, fs::file_time_type::clock::now(), ec);
+	hitCount++;
+	return true;
+}
+
+void cache::OutputCache::store(const std::string& key, const fs::path& out) {
+	std::error_code ec;
+	fs::path e = entry(key);
+	fs::create_directories(e.parent_path(), ec);
+	// written under a unique name and renamed in place, so concurrent compilers never see half an entry
+	static thread_local std::mt19937_64 rng(std::random_device{}());
+	fs::path tmp = e;
+	tmp += ".tmp" + std::to_string(rng());
+	fs::create_hard_link(out, tmp, ec);
+	if (ec) {
+		ec.clear();
+		fs::copy_file(out, tmp, ec);
+	}
+	if (!ec) fs::rename(tmp, e, ec);
+	if (ec) {
+		fs::remove(tmp, ec);
+		return;
+	}
+	uintmax_t size = fs::file_size(e, ec);
+	if (ec) return;
+	// an unknown total stays unknown, the next trim() counts it
+	update_tally(dir / tallyName, [size](std::optional<uint64_t> total) {
+		return total ? std::optional<uint64_t>(*total + size) : std::nullopt;
+	});
+}
+
+void cache::OutputCache::trim() {
+	update_tally(dir / tallyName, [this](std::optional<uint64_t> total) {
+		return total && *total <= limit ? total : std::optional<uint64_t>(evict());
+	});
+}
+
+uintmax_t cache::OutputCache::evict() {
+	struct File {
+		fs::path path;
+		uintmax_t size;
+		fs::file_time_type used;
+	};
+	std::vector<File> files;
+	uintmax_t total = 0;
+	std::error_code ec;
+	for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec) || !is_entry(it->path())) continue;
+		File f{ it->path(), it->file_size(ec), it->last_write_time(ec) };
+		if (ec) {
+			ec.clear();
+			continue;
+		}
+		total += f.size;
+		files.push_back(std::move(f));
+	}
+	if (total <= limit) return total;
+
+	std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.used < b.used; });
+	for (const File& f : files) {
+		if (total <= limit) break;
+		if (fs::remove(f.path, ec)) total -= f.size;
+	}
+	return total;
+}
+
+cache::OutputCache::Stats cache::OutputCache::stats() const {
+	Stats s;
+	std::error_code ec;
+	for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec) || !is_entry(it->path())) continue;
+		s.entries++;
+		s.bytes += it->file_size(ec);
+	}
+	return s;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace cache {
+	// On-disk cache of compiled outputs (.asm and .o), content addressed
+	// the key is the digest of everything the output depends on: the precompiled source,
+	// the compiler itself and the options, so entries never have to be invalidated
+	// outputs are hardlinked to and from the cache when possible, the driver removes an output
+	// before writing it so a cached copy is never written through
+	// store() adds the size of every entry to a tally file, the directory is only walked to
+	// evict when the tally exceeds the limit
+	class OutputCache {
+	private:
+		std::filesystem::path dir;
+		uintmax_t limit;           // bytes, the least recently used entries are evicted above it
+		std::string compilerId;    // identifies the compiler binary
+		std::atomic<int> hitCount{ 0 }, missCount{ 0 };
+		std::filesystem::path entry(const std::string& key) const;
+		// evicts the least recently used entries above the limit, returns the bytes left
+		uintmax_t evict();
+	public:
+		OutputCache(std::filesystem::path dir, uintmax_t limit);
+		// $KITE_CACHE_DIR, or kite/ in $XDG_CACHE_HOME or ~/.cache ("" if there is no home)
+		static std::filesystem::path default_dir();
+		// $KITE_CACHE_SIZE (in MB), 512 MB by default
+		static uintmax_t default_limit();
+
+		// key of the output of the source (after precompiling) with the options
+		std::string key(std::string_view source, std::string_view options) const;
+		// put the cached output at `out`, false if it is not cached
+		bool fetch(const std::string& key, const std::filesystem::path& out);
+		// add the output at `out` to the cache
+		void store(const std::string& key, const std::filesystem::path& out);
+		// evict the least recently used entries until the cache fits in the limit (nothing to do
+		// while the tally is below it)
+		void trim();
+
+		struct Stats {
+			size_t entries = 0;
+			uintmax_t bytes = 0;
+		};
+		Stats stats() const;
+		int hits() const { return hitCount; }
+		int misses() const { return missCount; }
+		const std::filesystem::path& path() const { return dir; }
+		uintmax_t size_limit() const { return limit; }
+	};
+}
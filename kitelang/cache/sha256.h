@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace cache {
+	// SHA-256, the keys of the output cache are the digests of everything the output depends on
+	class Sha256 {
+	private:
+		uint32_t state[8];
+		uint8_t block[64];
+		size_t used = 0;           // bytes in `block`
+		uint64_t length = 0;       // bytes hashed so far
+		void compress(const uint8_t*);
+	public:
+		Sha256();
+		Sha256& update(std::string_view);
+		// the digest as 64 lowercase hex digits (the object can not be updated after)
+		std::string hex();
+	};
+}
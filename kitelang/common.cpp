@@ -1,6 +1,6 @@
 #include "common.h"
 
-std::map<std::string, ktypes::ktype_t> ktypes::nktype_t {
+const std::map<std::string, ktypes::ktype_t, std::less<>> ktypes::nktype_t {
 	{"void",  VOID},
 	{"char",  CHAR},
 	{"byte",  BYTE},
@@ -14,7 +14,7 @@ std::map<std::string, ktypes::ktype_t> ktypes::nktype_t {
 	{"ptr64", PTR64},
 };
 
-std::map<ktypes::ktype_t, std::string> ktypes::ktype_tn = {
+const std::map<ktypes::ktype_t, std::string> ktypes::ktype_tn = {
 	{VOID, "void"},
 	{CHAR, "char"},
 	{BYTE, "byte"},
@@ -28,7 +28,7 @@ std::map<ktypes::ktype_t, std::string> ktypes::ktype_tn = {
 	{PTR64, "ptr64"}
 };
 
-std::map<ktypes::ktype_t, int> ktypes::bsktype_t{
+const std::map<ktypes::ktype_t, int> ktypes::bsktype_t{
 	{VOID,  0},
 	{CHAR,  1},
 	{BYTE,  1},
@@ -42,11 +42,12 @@ std::map<ktypes::ktype_t, int> ktypes::bsktype_t{
 	{PTR64, 8},
 };
 
-ktypes::ktype_t ktypes::from_string(std::string nm) {
-	if (nktype_t.contains(nm)) return nktype_t[nm];
-	else throw std::runtime_error("Unknown type " + nm);
+ktypes::ktype_t ktypes::from_string(std::string_view nm) {
+	auto it = nktype_t.find(nm);
+	if (it != nktype_t.end()) return it->second;
+	else throw std::runtime_error("Unknown type " + std::string(nm));
 }
 
 int ktypes::size(ktypes::ktype_t t) {
-	return bsktype_t[t];
+	return bsktype_t.at(t);
 }
\ No newline at end of file
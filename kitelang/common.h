@@ -2,6 +2,7 @@
 #include <map>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace ktypes {
@@ -23,6 +24,7 @@ namespace ktypes {
 	typedef struct {
 		std::string name;
 		ktype_t type;
+		int sym;                   // symbol ID of the name
 	} kval_t;
 
 	typedef struct {
@@ -30,11 +32,12 @@ namespace ktypes {
 		std::vector<ktype_t> argtps;
 		ktype_t returns;
 		bool is_variadic;
+		int sym;                   // symbol ID of the name
 	} kfndec_t;
 
-	extern std::map<std::string, ktype_t> nktype_t;
-	extern std::map<ktypes::ktype_t, std::string> ktype_tn;
-	extern std::map<ktype_t, int> bsktype_t;
-	extern ktype_t from_string(std::string);
+	extern const std::map<std::string, ktype_t, std::less<>> nktype_t;
+	extern const std::map<ktypes::ktype_t, std::string> ktype_tn;
+	extern const std::map<ktype_t, int> bsktype_t;
+	extern ktype_t from_string(std::string_view);
 	extern int size(ktype_t);
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "asm.h"
+#include <array>
+
+namespace {
+	// names of every register at 8, 4, 2 and 1 bytes, in the order of reg_t
+	constexpr std::string_view names[4][16] = {
+		{ "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" },
+		{ "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+		{ "ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" },
+		{ "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+	};
+
+	int width_index(int size) {
+		switch (size) {
+		case 1: return 3;
+		case 2: return 2;
+		case 4: return 1;
+		default: return 0;
+		}
+	}
+}
+
+std::string_view compiler::name(Reg r) {
+	if (r.none()) return "";
+	return names[width_index(r.size)][r.id];
+}
+
+compiler::Reg compiler::reg_from_name(std::string_view s) {
+	// every name is 2 to 4 characters, packed into an integer they are compared in one go
+	static constexpr int sizes[4] = { 8, 4, 2, 1 };
+	auto pack = [](std::string_view n) {
+		uint32_t k = 0;
+		for (size_t i = 0; i < n.size(); i++) k |= (uint32_t)(unsigned char)n[i] << (8 * i);
+		return k;
+	};
+	static const auto keys = [&] {
+		std::array<uint32_t, 64> k{};
+		for (int w = 0; w < 4; w++)
+			for (int i = 0; i < 16; i++) k[w * 16 + i] = pack(names[w][i]);
+		return k;
+	}();
+	if (s.size() < 2 || s.size() > 4) return Reg();
+	uint32_t key = pack(s);
+	for (int i = 0; i < 64; i++)
+		if (keys[i] == key) return Reg((reg_t)(i % 16), sizes[i / 16]);
+	return Reg();
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace compiler {
+	// general purpose registers, in the order of their encoding
+	typedef enum {
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15,
+		NOREG
+	} reg_t;
+
+	// a register used at a width (1, 2, 4 or 8 bytes)
+	struct Reg {
+		reg_t id = NOREG;
+		int size = 8;
+		constexpr Reg() = default;
+		constexpr Reg(reg_t id, int size = 8) : id(id), size(size) {}
+		constexpr bool none() const { return id == NOREG; }
+		// the same register at another width
+		constexpr Reg as(int sz) const { return Reg(id, sz); }
+		constexpr Reg r64() const { return Reg(id, 8); }
+		constexpr bool operator==(const Reg& o) const { return id == o.id && size == o.size; }
+	};
+
+	// NASM name of the register ("" for NOREG)
+	std::string_view name(Reg);
+	// the register with the NASM name, NOREG if there is none
+	Reg reg_from_name(std::string_view);
+
+	// Output buffer for assembly
+	// lines are formatted straight into one growing byte buffer (integers through to_chars),
+	// instead of building a string per instruction
+	// the buffer is reused after every flush, so streaming a program only keeps
+	// the part that is not yet written in memory
+	class AsmWriter {
+	private:
+		std::string buf;
+		size_t lineCount = 0;
+		size_t labelCount = 0;
+		void put(std::string_view s) { buf.append(s); }
+		void put(const char* s) { buf.append(s); }
+		void put(const std::string& s) { buf.append(s); }
+		void put(char c) { buf.push_back(c); }
+		void put(Reg r) { buf.append(name(r)); }
+		template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+		void put(T v) {
+			char digits[24];
+			auto res = std::to_chars(digits, digits + sizeof(digits), v);
+			buf.append(digits, res.ptr);
+		}
+	public:
+		AsmWriter() { buf.reserve(1 << 16); }
+		// write one indented line made of the pieces (strings, registers and integers)
+		template <typename... Args>
+		void ins(const Args&... args) {
+			buf.append("    ", 4);
+			(put(args), ...);
+			// a label ends with a colon (sometimes followed by a space)
+			size_t n = buf.size();
+			if (buf[n - 1] == ':' || (buf[n - 1] == ' ' && buf[n - 2] == ':')) labelCount++;
+			lineCount++;
+			buf.push_back('\n');
+		}
+		bool empty() const { return buf.empty(); }
+		size_t size() const { return buf.size(); }
+		std::string_view str() const { return buf; }
+		// lines written since the last flush, and how many of them are not labels
+		size_t lines() const { return lineCount; }
+		size_t instructions() const { return lineCount - labelCount; }
+		// write the contents to the stream and empty the buffer (keeping its memory)
+		void flush(std::ostream& out) {
+			out.write(buf.data(), (std::streamsize)buf.size());
+			buf.clear();
+			lineCount = labelCount = 0;
+		}
+		// move the contents to the string and empty the buffer (keeping its memory)
+		void flush(std::string& out) {
+			out.assign(buf);
+			buf.clear();
+			lineCount = labelCount = 0;
+		}
+		// add lines that are already formatted
+		void append(std::string_view lines) { buf.append(lines); }
+	};
+}
\ No newline at end of file
@@ -3,200 +3,99 @@
 #include <string>
 #include <memory>
 #include <iostream>
-#include <map>
+#include <array>
+#include <exception>
 #include "../parser/parser.h"
-#include "../semantics/semantics.h"
+#include "../ir/ir.h"
+#include "../optimizer/passes.h"
+#include "asm.h"
+#include "mir.h"
+#include "peephole.h"
 
 namespace compiler {
 
 	class Compiler {
 	private:
-		std::map<std::string, std::string> b64r{
-			{"rax", "rax"},
-			{"rcx", "rcx"},
-			{"rdx", "rdx"},
-			{"rbx", "rbx"},
-			{"rsi", "rsi"},
-			{"rdi", "rdi"},
-			{"rsp", "rsp"},
-			{"rbp", "rbp"},
-			{"r8", "r8"},
-			{"r9", "r9"},
-			{"r10", "r10"},
-			{"r11", "r11"},
-			{"r12", "r12"},
-			{"r13", "r13"},
-			{"r14", "r14"},
-			{"r15", "r15"},
-			{"eax", "rax"},
-			{"ecx", "rcx"},
-			{"edx", "rdx"},
-			{"ebx", "rbx"},
-			{"esi", "rsi"},
-			{"edi", "rdi"},
-			{"esp", "rsp"},
-			{"ebp", "rbp"},
-			{"r8d", "r8"},
-			{"r9d", "r9"},
-			{"r10d", "r10"},
-			{"r11d", "r11"},
-			{"r12d", "r12"},
-			{"r13d", "r13"},
-			{"r14d", "r14"},
-			{"r15d", "r15"},
-			{"ax", "rax"},
-			{"cx", "rcx"},
-			{"dx", "rdx"},
-			{"bx", "rbx"},
-			{"si", "rsi"},
-			{"di", "rdi"},
-			{"sp", "rsp"},
-			{"bp", "rbp"},
-			{"r8w", "r8"},
-			{"r9w", "r9"},
-			{"r10w", "r10"},
-			{"r11w", "r11"},
-			{"r12w", "r12"},
-			{"r13w", "r13"},
-			{"r14w", "r14"},
-			{"r15w", "r15"},
-			{"al", "rax"},
-			{"cl", "rcx"},
-			{"dl", "rdx"},
-			{"bl", "rbx"},
-			{"sil", "rsi"},
-			{"dil", "rdi"},
-			{"spl", "rsp"},
-			{"bpl", "rbp"},
-			{"r8b", "r8"},
-			{"r9b", "r9"},
-			{"r10b", "r10"},
-			{"r11b", "r11"},
-			{"r12b", "r12"},
-			{"r13b", "r13"},
-			{"r14b", "r14"},
-			{"r15b", "r15"},
-		};
-		std::map<std::string, std::string> b32r{
-			{"rax", "eax"},
-			{"rcx", "ecx"},
-			{"rdx", "edx"},
-			{"rbx", "ebx"},
-			{"rsi", "esi"},
-			{"rdi", "edi"},
-			{"rsp", "esp"},
-			{"rbp", "ebp"},
-			{"r8", "r8d"},
-			{"r9", "r9d"},
-			{"r10", "r10d"},
-			{"r11", "r11d"},
-			{"r12", "r12d"},
-			{"r13", "r13d"},
-			{"r14", "r14d"},
-			{"r15", "r15d"},
-		};
-		std::map<std::string, std::string> b16r{
-			{"rax", "ax"},
-			{"rcx", "cx"},
-			{"rdx", "dx"},
-			{"rbx", "bx"},
-			{"rsi", "si"},
-			{"rdi", "di"},
-			{"rsp", "sp"},
-			{"rbp", "bp"},
-			{"r8", "r8w"},
-			{"r9", "r9w"},
-			{"r10", "r10w"},
-			{"r11", "r11w"},
-			{"r12", "r12w"},
-			{"r13", "r13w"},
-			{"r14", "r14w"},
-			{"r15", "r15w"},
-		};
-		std::map<std::string, std::string> b8r{
-			{"rax", "al"},
-			{"rcx", "cl"},
-			{"rdx", "dl"},
-			{"rbx", "bl"},
-			{"rsi", "sil"},
-			{"rdi", "dil"},
-			{"rsp", "spl"},
-			{"rbp", "bpl"},
-			{"r8", "r8b"},
-			{"r9", "r9b"},
-			{"r10", "r10b"},
-			{"r11", "r11b"},
-			{"r12", "r12b"},
-			{"r13", "r13b"},
-			{"r14", "r14b"},
-			{"r15", "r15b"},
-		};
-		std::string txbreg(std::string, ktypes::ktype_t);
-		std::string t64breg(std::string, ktypes::ktype_t);
-		std::string argregs[6] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
-		std::map<std::string, std::string> cmpkeywordinstruction = {
-			{"eq", "je"},
-			{"neq", "jne"},
-		};
-		std::string curFn;							// the current function the compiler is inside
-		int curLoopId = 0;							// the current loop ID the compiler is inside
-		std::shared_ptr<parser::Node> curLoop;	    // the current loop the compiler is inside
+		// labels are numbered from 0 in every top-level function, so the output only depends on the input
+		// and not on the thread that generated it (the output cache relies on it)
 		int cmpLabelCount = 0;
 		int dataSectionCount = 0;
-		std::string tab = "    ";
-		std::shared_ptr<parser::RootNode> root;
-		std::vector<std::string> dataSection;
-		std::vector<std::string> textSection;
-		void visit_node(std::shared_ptr<parser::Node>, std::string = "");
-		void visit_root(std::shared_ptr<parser::RootNode>);
-		void visit_root_with_scope(std::shared_ptr<parser::RootNode>);
-		int visit_root_with_scope_return_amt(std::shared_ptr<parser::RootNode>);
-		void visit_int_lit(std::shared_ptr<parser::IntLitNode>, std::string);
-		void visit_char_lit(std::shared_ptr<parser::CharLitNode>, std::string);
-		void visit_reg(std::shared_ptr<parser::RegNode>, std::string);
-		void visit_addrof(std::shared_ptr<parser::AddrOfNode>, std::string);
-		void visit_deref(std::shared_ptr<parser::DerefNode>, std::string);
-		void visit_var(std::shared_ptr<parser::VarNode>, std::string);
-		void visit_idx(std::shared_ptr<parser::IndexNode>, std::string);
-		void visit_string_lit(std::shared_ptr<parser::StringLitNode>, std::string);
-		void visit_call(std::shared_ptr<parser::CallNode>, std::string);
-		void visit_extern(std::shared_ptr<parser::ExternNode>);
-		void visit_global(std::shared_ptr<parser::GlobalNode>);
-		void visit_fn(std::shared_ptr<parser::FnNode>);
-		void visit_return(std::shared_ptr<parser::ReturnNode>);
-		void visit_break();
-		void visit_continue();
-		void visit_cmp(std::shared_ptr<parser::CmpNode>);
-		void visit_if(std::shared_ptr<parser::IfNode>);
-		void visit_asm(std::shared_ptr<parser::AsmNode>);
-		void visit_for(std::shared_ptr<parser::ForNode>);
-		void visit_loop(std::shared_ptr<parser::LoopNode>);
-		void visit_let(std::shared_ptr<parser::LetNode>);
-		void visit_binop(std::shared_ptr<parser::BinOpNode>, std::string);
+		std::string chunkName;						// the top-level function being generated, names its data labels
+		parser::RootNode* root;
+		int threads = 1;							// threads generating the functions
+		const Compiler* parent = nullptr;			// the compiler a worker generates functions for
+		std::unique_ptr<Compiler> streamed;			// generates the functions handed in one at a time
+		AsmWriter data;								// lines of the data section not yet written
+		AsmWriter text;								// lines of the text section not yet written
+		std::ostream* out = nullptr;				// where finished functions are streamed (if set)
+		bool inText = false;						// the last section header streamed was .text
+		size_t instructionCount = 0;				// lines of .text emitted that are not labels
+		size_t entryCount = 0;						// lines of .data emitted
+		size_t spillCount = 0;						// registers the allocator put on the stack
+		bool optimizing = false;					// run the IR passes and the peephole optimizer (-O)
+		bool printIr = false;						// write the IR instead of the assembly
+		std::array<size_t, mir::RULES> rewriteCount{};	// rewrites of the peephole optimizer, per rule
+		std::array<size_t, optimizer::PASSES> changeCount{};	// changes of the IR passes, per pass
 
-		void visit_cdirect(std::shared_ptr<parser::CompDirectNode>);
-
-		int get_variable_offset(std::string);
+		// the generated code of one top-level statement
+		struct Chunk {
+			std::string data;
+			std::string text;
+			std::exception_ptr error;				// what generating it threw, rethrown when it is emitted
+			size_t instructions = 0;
+			size_t entries = 0;						// lines of the data section
+			size_t spills = 0;
+			std::array<size_t, mir::RULES> rewrites{};
+			std::array<size_t, optimizer::PASSES> changes{};
+			bool done = false;
+		};
+		explicit Compiler(const Compiler* parent);	// a worker generating the functions of the parent
+		void generate(parser::Node*, Chunk&);		// generate a top-level statement into the chunk
+		void emit(Chunk&);							// write a chunk to the output, in the order of the statements
+		// optimize the function, select its instructions into `m`, allocate their registers and write it
+		void finish(ir::Function&, mir::Function& m);
+		void top(parser::Node*, std::vector<ir::Function>&);	// generate a top-level statement other than a function
 
-		std::map<std::string, int> varlocs{};
-		std::map<std::string, ktypes::ktype_t> vartypes {};
-		std::map<std::string, ktypes::kfndec_t> fns {};
-		int stacksize = 0;
-		void push(std::string, ktypes::ktype_t);
-		void pop(std::string);
-		void pop();
+		// the variables of the top-level statements, by slot (see semantics::Checker), they stay
+		// in the frames of the statements that declared them
+		struct TopVariable {
+			int top = -1;							// how far below the first top-level frame
+			ktypes::ktype_t type = ktypes::ANY;
+		};
+		std::vector<TopVariable> tops;
+		int topSize = 0;							// bytes of the frames of the top-level statements so far
+		size_t spilled = 0;							// spills of the chunk being generated
+		std::array<size_t, mir::RULES> rewritten{};	// rewrites in the chunk being generated
+		std::array<size_t, optimizer::PASSES> changed{};	// changes of the IR passes in the chunk
 	public:
-		Compiler(std::shared_ptr<parser::RootNode> r) : root(r), dataSectionCount(0), curLoopId(0) {}
+		// the tree has to be annotated by semantics::Checker first (no tree when streaming)
+		explicit Compiler(parser::RootNode* r = nullptr) : root(r) {
+		}
+		// write every function to the stream as soon as it is generated, instead of keeping
+		// the whole program until print (each chunk gets its own section headers)
+		void stream(std::ostream& stream) { out = &stream; }
+		// generate the bodies of the functions on this many threads, the output is the same for any amount
+		void jobs(int n) { threads = n; }
+		size_t instructions() const { return instructionCount; }
+		size_t data_entries() const { return entryCount; }
+		size_t spills() const { return spillCount; }
+		// run the passes over the IR and rewrite the allocated code with the peephole optimizer (-O)
+		void optimize(bool on) { optimizing = on; }
+		size_t rewrites(mir::rule_t rule) const { return rewriteCount[rule]; }
+		size_t changes(optimizer::pass_t pass) const { return changeCount[pass]; }
+		// write the IR of every function (--emit=ir), after the passes when optimizing
+		void emit_ir(bool on) { printIr = on; }
 		void codegen();
+		// streaming, the top-level statements are handed in one at a time in the order of the file
+		// (each is checked, written out before the next, and not used after)
+		void codegen(parser::Node*);
+		// write the program (when not streaming)
 		void print(std::ostream& stream) {
-			stream << "section .data" << std::endl;
-			for (std::string instruction : dataSection) {
-				stream << tab << instruction << std::endl;
-			}
-			stream << "section .text" << std::endl;
-			for (std::string instruction : textSection) {
-				stream << tab << instruction << std::endl;
-			}
+			if (printIr) return text.flush(stream);
+			stream << "section .data\n";
+			data.flush(stream);
+			stream << "section .text\n";
+			text.flush(stream);
 		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,635 @@
+#include "lower.h"
+#include <algorithm>
+
+namespace {
+	compiler::mir::cond_t condition(ir::cond_t cc) {
+		static const compiler::mir::cond_t codes[] = {
+			compiler::mir::CC_E, compiler::mir::CC_NE, compiler::mir::CC_L,
+			compiler::mir::CC_GE, compiler::mir::CC_LE, compiler::mir::CC_G,
+		};
+		return codes[cc];
+	}
+
+	// the condition with the operands the other way around
+	ir::cond_t swapped(ir::cond_t cc) {
+		static const ir::cond_t codes[] = { ir::EQ, ir::NE, ir::GT, ir::LE, ir::GE, ir::LT };
+		return codes[cc];
+	}
+
+	// the multiplier and shift of an unsigned division by a constant (not a power of 2) ("Division
+	// by Invariant Integers using Multiplication", Granlund and Montgomery): the quotient is the
+	// high half of n*m shifted right, or with `add` (when m needs 65 bits) t + ((n - t) >> 1)
+	// shifted right, t being the high half of n*m
+	struct Magic {
+		uint64_t m;
+		int shift;
+		bool add;
+	};
+
+	Magic magic(uint64_t d) {
+		typedef unsigned __int128 u128;
+		int l = 64 - __builtin_clzll(d - 1);	// 2^l is the power of 2 above d
+		for (int p = 0; p <= l; p++) {
+			// m*d is above 2^(64+p) by at most 2^p, the error stays below 1/d for any n
+			u128 two = (u128)1 << (64 + p);
+			u128 m = two / d + 1;
+			if (m >> 64 == 0 && m * d - two <= (u128)1 << p) return Magic{ (uint64_t)m, p, false };
+		}
+		return Magic{ (uint64_t)(((u128)((1ull << l) - d) << 64) / d + 1), l - 1, true };
+	}
+
+	// the value cut to the width, zero extended
+	int64_t cut(int64_t value, int bytes) {
+		return bytes == 1 ? (uint8_t)value : bytes == 2 ? (uint16_t)value : bytes == 4 ? (uint32_t)value : value;
+	}
+}
+
+void compiler::Lowering::run() {
+	ir::split_critical_edges(fn);
+	out.label = fn.label;
+	out.entry = fn.entry;
+	// the asm blocks may read the arguments from their registers
+	if (fn.opaque) out.args = fn.args;
+	// the slots keep their numbers, the allocator adds its own after them
+	for (const ir::Slot& slot : fn.slots) {
+		out.slot(slot.size, slot.align);
+		out.slots.back().above = slot.above;
+	}
+	regs.assign(fn.values.size(), -1);
+	users.assign(fn.values.size(), {});
+	for (size_t v = 0; v < fn.values.size(); v++)
+		if (fn.values[v].op != ir::NOP)
+			for (int o : fn.values[v].ops) users[o].push_back((int)v);
+	fuse();
+	fold();
+	coalesce();
+	blockLabels.assign(fn.blocks.size(), -1);
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		if (b > 0) blockLabels[b] = out.name("." + fn.blocks[b].name);
+		// registers the asm uses are not known to the allocator, the callee-saved ones are kept
+		for (int v : fn.blocks[b].code)
+			if (fn.values[v].op == ir::ASM) mir::named_callee_saved(fn.names[fn.values[v].value], out.saved);
+	}
+
+	thread();
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		if (destination[b] != (int)b) continue;
+		depth = 0;
+		// the loops start on a 16 byte boundary, where the processor fetches from
+		if (b > 0) add(mir::LABEL, mir::Sym(blockLabels[b]), fn.blocks[b].loop ? mir::Imm(16) : mir::Operand());
+		for (int v : fn.blocks[b].code) {
+			const ir::Ins& ins = fn.values[v];
+			if (ins.op == ir::NOP) continue;
+			depth = ins.depth;
+			lower(ins, v);
+		}
+	}
+	if (end >= 0) {
+		depth = 0;
+		add(mir::LABEL, mir::Sym(end));
+	}
+}
+
+void compiler::Lowering::fuse() {
+	fused.assign(fn.values.size(), false);
+	for (const ir::Block& block : fn.blocks) {
+		if (block.removed || block.code.empty()) continue;
+		const ir::Ins& br = fn.values[block.code.back()];
+		if (br.op != ir::BR) continue;
+		// nothing between them changes the flags (constants are made where they are used)
+		int c = br.ops[0];
+		for (size_t i = block.code.size() - 1; i-- > 0;) {
+			int v = block.code[i];
+			if (fn.values[v].op == ir::NOP || (fn.values[v].op == ir::CONST && v != c)) continue;
+			fused[c] = v == c && fn.values[c].op == ir::CMP && users[c].size() == 1;
+			break;
+		}
+	}
+}
+
+void compiler::Lowering::fold() {
+	addresses.assign(fn.values.size(), Address());
+	folded.assign(fn.values.size(), false);
+	std::vector<int> inner;
+	for (const ir::Ins& ins : fn.values) {
+		if ((ins.op != ir::LOAD && ins.op != ir::STORE) || folded[ins.ops[0]]) continue;
+		// every user reads memory at it
+		int t = ins.ops[0];
+		bool addressOnly = true;
+		for (int u : users[t]) {
+			const ir::Ins& user = fn.values[u];
+			addressOnly = addressOnly && (user.op == ir::LOAD || (user.op == ir::STORE && user.ops[1] != t));
+		}
+		if (!addressOnly || (fn.values[t].op != ir::ADD && fn.values[t].op != ir::ADDR)) continue;
+		Address a;
+		inner.clear();
+		if (!collect(t, 1, true, a, inner) || a.disp != (int32_t)a.disp) continue;
+		addresses[t] = a;
+		folded[t] = true;
+		for (int v : inner) folded[v] = true;
+	}
+}
+
+bool compiler::Lowering::collect(int v, int scale, bool root, Address& a, std::vector<int>& inner) {
+	const ir::Ins& ins = fn.values[v];
+	// the values inside the address are only used by it
+	bool own = root || users[v].size() == 1;
+	if (ins.op == ir::CONST) {
+		if (ins.value != (int32_t)ins.value) return false;
+		a.disp += ins.value * scale;
+		return true;
+	}
+	if (own && ins.op == ir::ADD) {
+		if (!root) inner.push_back(v);
+		return collect(ins.ops[0], scale, false, a, inner) && collect(ins.ops[1], scale, false, a, inner);
+	}
+	if (own && ins.op == ir::MUL) {
+		for (int i = 0; i < 2; i++) {
+			const ir::Ins& k = fn.values[ins.ops[i]];
+			if (k.op != ir::CONST || k.value < 1 || k.value > 8) continue;
+			int product = (int)k.value * scale;
+			if (product != 1 && product != 2 && product != 4 && product != 8) continue;
+			inner.push_back(v);
+			return collect(ins.ops[1 - i], product, false, a, inner);
+		}
+	}
+	if (own && ins.op == ir::ADDR && scale == 1 && a.base < 0 && a.slot < 0) {
+		if (!root) inner.push_back(v);
+		a.slot = (int)ins.value;
+		return true;
+	}
+	// a register, the base needs a scale of 1 and is rsp for a slot
+	if (scale == 1 && a.base < 0 && a.slot < 0 && a.index < 0) a.base = v;
+	else if (a.index < 0) {
+		a.index = v;
+		a.scale = scale;
+	}
+	else if (scale == 1 && a.base < 0 && a.slot < 0) a.base = v;
+	else return false;
+	return true;
+}
+
+void compiler::Lowering::operands(int v, std::vector<int>& read) const {
+	const ir::Ins& ins = fn.values[v];
+	if (folded[v] || fused[v]) return;
+	for (size_t i = 0; i < ins.ops.size(); i++) {
+		int o = ins.ops[i];
+		if (i == 0 && (ins.op == ir::LOAD || ins.op == ir::STORE) && folded[o]) {
+			if (addresses[o].base >= 0) read.push_back(addresses[o].base);
+			if (addresses[o].index >= 0) read.push_back(addresses[o].index);
+		}
+		else if (ins.op == ir::BR && fused[o]) read.insert(read.end(), fn.values[o].ops.begin(), fn.values[o].ops.end());
+		else read.push_back(o);
+	}
+}
+
+void compiler::Lowering::coalesce() {
+	size_t words = (fn.values.size() + 63) / 64;
+	auto has = [](const std::vector<uint64_t>& set, int v) { return (set[v >> 6] >> (v & 63)) & 1; };
+	auto put = [](std::vector<uint64_t>& set, int v, bool in) {
+		if (in) set[v >> 6] |= 1ull << (v & 63);
+		else set[v >> 6] &= ~(1ull << (v & 63));
+	};
+	// a constant is made where it is used, it is never in a register for long
+	auto kept = [&](int v) { return fn.values[v].op != ir::CONST; };
+
+	// the values live at the end of every block, a phi operand only at the end of its predecessor
+	std::vector<int> order = ir::reverse_postorder(fn);
+	std::vector<std::vector<uint64_t>> liveIn(fn.blocks.size(), std::vector<uint64_t>(words)), liveOut = liveIn;
+	std::vector<uint64_t> live(words);
+	// the values are read where the machine code reads them (a folded address where it is used)
+	std::vector<int> read;
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (auto it = order.rbegin(); it != order.rend(); ++it) {
+			int b = *it, succ[2];
+			std::fill(live.begin(), live.end(), 0);
+			for (int i = 0, n = fn.successors(b, succ); i < n; i++) {
+				const ir::Block& s = fn.blocks[succ[i]];
+				for (size_t w = 0; w < words; w++) live[w] |= liveIn[succ[i]][w];
+				size_t k = std::find(s.preds.begin(), s.preds.end(), b) - s.preds.begin();
+				for (int v : s.code) {
+					if (fn.values[v].op == ir::NOP) continue;
+					if (fn.values[v].op != ir::PHI) break;
+					if (kept(fn.values[v].ops[k])) put(live, fn.values[v].ops[k], true);
+				}
+			}
+			liveOut[b] = live;
+			const std::vector<int>& code = fn.blocks[b].code;
+			for (auto v = code.rbegin(); v != code.rend(); ++v) {
+				const ir::Ins& ins = fn.values[*v];
+				if (ins.op == ir::NOP) continue;
+				put(live, *v, false);
+				if (ins.op == ir::PHI) continue;
+				read.clear();
+				operands(*v, read);
+				for (int o : read)
+					if (kept(o)) put(live, o, true);
+			}
+			if (live == liveIn[b]) continue;
+			liveIn[b] = live;
+			changed = true;
+		}
+	}
+
+	std::vector<int> idom = ir::dominators(fn, order), position(fn.values.size(), -1);
+	for (const ir::Block& block : fn.blocks)
+		for (size_t i = 0; i < block.code.size(); i++) position[block.code[i]] = (int)i;
+	// the definition of `a` comes first on every way to the one of `b`
+	auto before = [&](int a, int b) {
+		int x = fn.values[a].block, y = fn.values[b].block;
+		if (x == y) return position[a] < position[b];
+		while (y >= 0 && y != x) y = idom[y];
+		return y == x;
+	};
+	// `a` is still used after `b` is defined
+	auto live_after = [&](int a, int b) {
+		const ir::Block& block = fn.blocks[fn.values[b].block];
+		if (has(liveOut[fn.values[b].block], a)) return true;
+		for (size_t i = position[b] + 1; i < block.code.size(); i++) {
+			if (fn.values[block.code[i]].op == ir::PHI) continue;
+			read.clear();
+			operands(block.code[i], read);
+			if (std::find(read.begin(), read.end(), a) != read.end()) return true;
+		}
+		return false;
+	};
+	// in SSA form two values overlap when one is live where the other is defined
+	auto interfere = [&](int a, int b) {
+		if (before(a, b)) return live_after(a, b);
+		if (before(b, a)) return live_after(b, a);
+		return false;
+	};
+
+	// the values sharing a register, by the value leading them
+	std::vector<int> leader(fn.values.size());
+	std::vector<std::vector<int>> members(fn.values.size());
+	for (size_t v = 0; v < fn.values.size(); v++) {
+		leader[v] = (int)v;
+		members[v].push_back((int)v);
+	}
+	for (const ir::Block& block : fn.blocks)
+		for (int p : block.code) {
+			if (fn.values[p].op == ir::NOP) continue;
+			if (fn.values[p].op != ir::PHI) break;
+			for (int o : fn.values[p].ops) {
+				int x = leader[p], y = leader[o];
+				if (!kept(o) || x == y) continue;
+				bool overlap = false;
+				for (int a : members[x])
+					for (int b : members[y]) overlap = overlap || interfere(a, b);
+				if (overlap) continue;
+				for (int b : members[y]) leader[b] = x;
+				members[x].insert(members[x].end(), members[y].begin(), members[y].end());
+				members[y].clear();
+			}
+		}
+	for (size_t v = 0; v < fn.values.size(); v++) {
+		if (members[v].size() < 2) continue;
+		int shared = out.reg();
+		for (int m : members[v]) regs[m] = shared;
+	}
+}
+
+void compiler::Lowering::thread() {
+	destination.assign(fn.blocks.size(), -1);
+	for (size_t b = 1; b < fn.blocks.size(); b++) {
+		const ir::Block& block = fn.blocks[b];
+		std::vector<int> code;
+		for (int v : block.code)
+			if (fn.values[v].op != ir::NOP) code.push_back(v);
+		if (code.size() != 1 || fn.values[code[0]].op != ir::JMP) continue;
+		// it has nothing to copy to the phis of the block it goes to
+		int to = fn.values[code[0]].target[0];
+		const ir::Block& succ = fn.blocks[to];
+		size_t k = std::find(succ.preds.begin(), succ.preds.end(), (int)b) - succ.preds.begin();
+		bool copies = false;
+		for (int v : succ.code) {
+			const ir::Ins& phi = fn.values[v];
+			if (phi.op == ir::NOP) continue;
+			if (phi.op != ir::PHI) break;
+			copies = copies || fn.values[phi.ops[k]].op == ir::CONST || reg(phi.ops[k]) != reg(v);
+		}
+		if (!copies) destination[b] = to;
+	}
+	std::vector<char> state(fn.blocks.size(), 0);
+	for (size_t b = 0; b < fn.blocks.size(); b++) destination[b] = follow((int)b, state);
+	following.assign(fn.blocks.size(), (int)fn.blocks.size());
+	for (int b = (int)fn.blocks.size() - 2; b >= 0; b--)
+		following[b] = destination[b + 1] == b + 1 ? b + 1 : following[b + 1];
+}
+
+int compiler::Lowering::follow(int b, std::vector<char>& state) {
+	// a block is its own destination when it does not only jump on
+	if (destination[b] < 0 || destination[b] == b) return destination[b] = b;
+	if (state[b] == 2) return destination[b];
+	// an endless loop of empty blocks keeps the block it is entered at
+	if (state[b] == 1) return destination[b] = b;
+	state[b] = 1;
+	int to = follow(destination[b], state);
+	state[b] = 2;
+	if (destination[b] != b) destination[b] = to;
+	return destination[b];
+}
+
+int compiler::Lowering::reg(int v) {
+	if (regs[v] < 0) regs[v] = out.reg();
+	return regs[v];
+}
+
+int compiler::Lowering::value(int v) {
+	if (fn.values[v].op != ir::CONST) return reg(v);
+	int r = out.reg();
+	add(mir::MOV, mir::R(r), mir::Imm(fn.values[v].value));
+	return r;
+}
+
+compiler::mir::Operand compiler::Lowering::operand(int v) {
+	// an immediate operand is 32 bits, sign extended
+	const ir::Ins& ins = fn.values[v];
+	if (ins.op == ir::CONST && ins.value == (int32_t)ins.value) return mir::Imm(ins.value);
+	return mir::R(value(v));
+}
+
+compiler::mir::Operand compiler::Lowering::memory(int address, int size) {
+	if (!folded[address]) return mir::Mem(value(address), 0, size);
+	const Address& a = addresses[address];
+	mir::Operand m = a.slot >= 0 ? mir::Slot(a.slot, size) : mir::Mem(a.base >= 0 ? reg(a.base) : -1, 0, size);
+	m.value += a.disp;
+	return a.index >= 0 ? mir::Index(m, reg(a.index), a.scale) : m;
+}
+
+void compiler::Lowering::move(int dst, int o) {
+	if (fn.values[o].op == ir::CONST) add(mir::MOV, mir::R(dst), mir::Imm(fn.values[o].value));
+	else if (reg(o) != dst) add(mir::MOV, mir::R(dst), mir::R(reg(o)));
+}
+
+bool compiler::Lowering::multiply(int v, int a, int64_t k) {
+	int shift = 0;
+	while (shift < 62 && (int64_t)1 << shift < k) shift++;
+	if (k > 0 && (int64_t)1 << shift == k) {
+		move(reg(v), a);
+		if (shift) add(mir::SHL, mir::R(reg(v)), mir::Imm(shift));
+		return true;
+	}
+	// x*3, x*5 and x*9 are x + x*2, x + x*4 and x + x*8
+	if (k == 3 || k == 5 || k == 9) {
+		int x = value(a);
+		add(mir::LEA, mir::R(reg(v)), mir::Index(mir::Mem(x), x, (int)k - 1));
+		return true;
+	}
+	return false;
+}
+
+void compiler::Lowering::divide(const ir::Ins& ins, int v, int64_t d) {
+	// the dividend is not sign extended for idiv, which divides it as unsigned by a divisor
+	// above 1, so the division is the unsigned one (by 1 a negative dividend faults, like it
+	// does for the folder, so that one stays an idiv)
+	int a = ins.ops[0];
+	int shift = 0;
+	while (shift < 62 && (int64_t)1 << shift < d) shift++;
+	if ((int64_t)1 << shift == d) {
+		move(reg(v), a);
+		if (ins.op == ir::DIV) {
+			if (shift) add(mir::SHR, mir::R(reg(v)), mir::Imm(shift));
+		}
+		else if (d - 1 == (int32_t)(d - 1)) add(mir::AND, mir::R(reg(v)), mir::Imm(d - 1));
+		else {
+			int mask = out.reg();
+			add(mir::MOV, mir::R(mask), mir::Imm(d - 1));
+			add(mir::AND, mir::R(reg(v)), mir::R(mask));
+		}
+		return;
+	}
+
+	Magic k = magic((uint64_t)d);
+	int n = value(a);
+	add(mir::MOV, mir::R(RAX), mir::Imm((int64_t)k.m));
+	add(mir::MUL, mir::Operand(), mir::R(n));
+	// the remainder needs the dividend after the quotient
+	int q = ins.op == ir::DIV ? reg(v) : out.reg();
+	if (k.add) {
+		if (q != n) add(mir::MOV, mir::R(q), mir::R(n));
+		add(mir::SUB, mir::R(q), mir::R(RDX));
+		add(mir::SHR, mir::R(q), mir::Imm(1));
+		add(mir::ADD, mir::R(q), mir::R(RDX));
+	}
+	else add(mir::MOV, mir::R(q), mir::R(RDX));
+	if (k.shift) add(mir::SHR, mir::R(q), mir::Imm(k.shift));
+	if (ins.op == ir::DIV) return;
+	// n - q*d
+	if (d == (int32_t)d) add(mir::IMUL, mir::R(q), mir::Imm(d));
+	else {
+		int divisor = out.reg();
+		add(mir::MOV, mir::R(divisor), mir::Imm(d));
+		add(mir::IMUL, mir::R(q), mir::R(divisor));
+	}
+	move(reg(v), a);
+	add(mir::SUB, mir::R(reg(v)), mir::R(q));
+}
+
+compiler::mir::cond_t compiler::Lowering::compare(int v) {
+	const ir::Ins& ins = fn.values[v];
+	int a = ins.ops[0], c = ins.ops[1];
+	ir::cond_t cc = ins.cc;
+	// a constant is better as the immediate
+	if (fn.values[a].op == ir::CONST && fn.values[c].op != ir::CONST) {
+		std::swap(a, c);
+		cc = swapped(cc);
+	}
+	int left = value(a);
+	add(mir::CMP, mir::R(left), operand(c));
+	return condition(cc);
+}
+
+void compiler::Lowering::jump(int block, int next) {
+	if (destination[block] != next) add(mir::JMP, mir::Sym(blockLabels[destination[block]]));
+}
+
+void compiler::Lowering::copies(int from, int to) {
+	const ir::Block& block = fn.blocks[to];
+	size_t k = std::find(block.preds.begin(), block.preds.end(), from) - block.preds.begin();
+	std::vector<std::pair<int, int>> moves;		// (to, from) registers
+	std::vector<std::pair<int, int64_t>> constants;
+	for (int v : block.code) {
+		const ir::Ins& phi = fn.values[v];
+		if (phi.op == ir::NOP) continue;
+		if (phi.op != ir::PHI) break;
+		int source = phi.ops[k];
+		if (fn.values[source].op == ir::CONST) constants.emplace_back(reg(v), fn.values[source].value);
+		else if (reg(source) != reg(v)) moves.emplace_back(reg(v), reg(source));
+	}
+	// the copies happen at once: a register is only written when no copy left reads it, and a
+	// cycle is broken by moving one of them aside first
+	while (!moves.empty()) {
+		auto free = std::find_if(moves.begin(), moves.end(), [&](const std::pair<int, int>& m) {
+			return std::none_of(moves.begin(), moves.end(), [&](const std::pair<int, int>& o) { return o.second == m.first; });
+		});
+		if (free == moves.end()) {
+			int aside = out.reg();
+			int overwritten = moves[0].first;
+			add(mir::MOV, mir::R(aside), mir::R(overwritten));
+			for (auto& m : moves)
+				if (m.second == overwritten) m.second = aside;
+			continue;
+		}
+		add(mir::MOV, mir::R(free->first), mir::R(free->second));
+		moves.erase(free);
+	}
+	for (const auto& [r, c] : constants) add(mir::MOV, mir::R(r), mir::Imm(c));
+}
+
+void compiler::Lowering::lower(const ir::Ins& ins, int v) {
+	int b = ins.block, next = following[b];
+	// computed by the addressing of the loads and stores using it
+	if (folded[v]) return;
+	switch (ins.op) {
+	// made where they are used
+	case ir::CONST:
+	case ir::PHI:
+	case ir::NOP:
+		return;
+	case ir::ARG:
+		add(mir::MOV, mir::R(reg(v)), mir::R(mir::argregs[ins.value]));
+		return;
+	case ir::REG: {
+		Reg source((reg_t)ins.value, ir::bytes(ins.type));
+		if (source.size >= 4) add(mir::MOV, mir::R(reg(v), source.size), mir::R(source.id, source.size));
+		else add(mir::MOVZX, mir::R(reg(v)), mir::R(source.id, source.size));
+		return;
+	}
+	case ir::STR:
+		add(mir::MOV, mir::R(reg(v)), mir::Sym(out.name(fn.strings[ins.value].first)));
+		return;
+	case ir::ADDR:
+		add(mir::LEA, mir::R(reg(v)), mir::Slot((int)ins.value));
+		return;
+	case ir::COPY:
+		move(reg(v), ins.ops[0]);
+		return;
+	case ir::ADD:
+	case ir::SUB:
+	case ir::MUL: {
+		int a = ins.ops[0], c = ins.ops[1];
+		// a constant is better as the immediate
+		if (ins.op != ir::SUB && fn.values[a].op == ir::CONST && fn.values[c].op != ir::CONST) std::swap(a, c);
+		if (ins.op == ir::MUL && fn.values[c].op == ir::CONST && multiply(v, a, fn.values[c].value)) return;
+		mir::op_t op = ins.op == ir::ADD ? mir::ADD : ins.op == ir::SUB ? mir::SUB : mir::IMUL;
+		mir::Operand right = operand(c);
+		// the right operand may share the register of the result, which the left one is moved to first
+		if (right.is_reg(reg(v)) && (fn.values[a].op == ir::CONST || reg(a) != reg(v))) {
+			if (ins.op != ir::SUB) {
+				add(op, mir::R(reg(v)), operand(a));
+				return;
+			}
+			int result = out.reg();
+			move(result, a);
+			add(op, mir::R(result), right);
+			add(mir::MOV, mir::R(reg(v)), mir::R(result));
+			return;
+		}
+		move(reg(v), a);
+		add(op, mir::R(reg(v)), right);
+		return;
+	}
+	case ir::DIV:
+	case ir::MOD: {
+		if (fn.values[ins.ops[1]].op == ir::CONST && fn.values[ins.ops[1]].value > 1) return divide(ins, v, fn.values[ins.ops[1]].value);
+		int divisor = value(ins.ops[1]);
+		move(RAX, ins.ops[0]);
+		add(mir::XOR, mir::R(RDX), mir::R(RDX));	// clear rdx for the division
+		add(mir::IDIV, mir::Operand(), mir::R(divisor));
+		add(mir::MOV, mir::R(reg(v)), mir::R(ins.op == ir::DIV ? RAX : RDX));
+		return;
+	}
+	case ir::CMP: {
+		if (fused[v]) return;
+		// the register is cleared before the cmp, setcc only writes its low byte
+		int result = reg(v);
+		for (int o : ins.ops)
+			if (fn.values[o].op != ir::CONST && reg(o) == result) result = out.reg();
+		add(mir::XOR, mir::R(result, 4), mir::R(result, 4));
+		out.setcc(compare(v), mir::R(result, 1), depth);
+		if (result != reg(v)) add(mir::MOV, mir::R(reg(v)), mir::R(result));
+		return;
+	}
+	case ir::TRUNC: {
+		int width = ir::bytes(ins.type);
+		const ir::Ins& source = fn.values[ins.ops[0]];
+		if (source.op == ir::CONST) add(mir::MOV, mir::R(reg(v)), mir::Imm(cut(source.value, width)));
+		else if (width < 4) add(mir::MOVZX, mir::R(reg(v)), mir::R(reg(ins.ops[0]), width));
+		// in 64-bit code, writing a 32-bit register zero extends it through the upper 32 bits
+		else if (width == 4) add(mir::MOV, mir::R(reg(v), 4), mir::R(reg(ins.ops[0]), 4));
+		else add(mir::MOV, mir::R(reg(v)), mir::R(reg(ins.ops[0])));
+		return;
+	}
+	case ir::LOAD: {
+		// zero extended, like every narrow value
+		int width = ir::bytes(ins.type);
+		mir::Operand source = memory(ins.ops[0], width);
+		if (width < 4) add(mir::MOVZX, mir::R(reg(v)), source);
+		else add(mir::MOV, mir::R(reg(v), width), source);
+		return;
+	}
+	case ir::STORE: {
+		int width = ir::bytes((ir::type_t)ins.value);
+		const ir::Ins& stored = fn.values[ins.ops[1]];
+		mir::Operand source;
+		// an immediate as wide as the store, sign extended from it
+		if (stored.op == ir::CONST && width < 8) source = mir::Imm(width == 1 ? (int8_t)stored.value : width == 2 ? (int16_t)stored.value : (int32_t)stored.value);
+		else {
+			source = operand(ins.ops[1]);
+			if (source.is_reg()) source.size = (uint8_t)width;
+		}
+		add(mir::MOV, memory(ins.ops[0], width), source);
+		return;
+	}
+	case ir::GET:
+		add(mir::MOV, mir::R(reg(v)), mir::Slot((int)ins.value));
+		return;
+	case ir::SET:
+		add(mir::MOV, mir::Slot((int)ins.value), operand(ins.ops[0]));
+		return;
+	case ir::CALL:
+		// every argument was computed before, none of them is in an argument register
+		for (size_t i = 0; i < ins.ops.size(); i++) move(mir::argregs[i], ins.ops[i]);
+		add(mir::CALL, mir::Sym(out.name(fn.names[ins.value])), mir::Imm((int64_t)ins.ops.size()));
+		add(mir::MOV, mir::R(reg(v)), mir::R(RAX));
+		return;
+	case ir::ASM:
+		add(mir::RAW, mir::Operand(), mir::Sym(out.name(fn.names[ins.value])));
+		return;
+	case ir::JMP:
+		copies(b, ins.target[0]);
+		jump(ins.target[0], next);
+		return;
+	case ir::BR: {
+		int onTrue = destination[ins.target[0]], onFalse = destination[ins.target[1]];
+		if (onTrue == onFalse) return jump(onTrue, next);
+		mir::cond_t cc = mir::CC_NE;
+		if (fused[ins.ops[0]]) cc = compare(ins.ops[0]);
+		else add(mir::CMP, mir::R(value(ins.ops[0])), mir::Imm(0));
+		if (onTrue == next) out.jcc(mir::negate(cc), blockLabels[onFalse], depth);
+		else if (onFalse == next) out.jcc(cc, blockLabels[onTrue], depth);
+		// the branch back to the start of a loop is the one taken more often
+		else if (onFalse <= b) {
+			out.jcc(mir::negate(cc), blockLabels[onFalse], depth);
+			jump(onTrue, next);
+		}
+		else {
+			out.jcc(cc, blockLabels[onTrue], depth);
+			jump(onFalse, next);
+		}
+		return;
+	}
+	case ir::RET:
+		if (!ins.ops.empty()) move(RAX, ins.ops[0]);
+		// the epilogue only frees the frame, what asm blocks pushed (@stackszinc) goes first
+		if (ins.depth) add(mir::ADD, mir::R(RSP), mir::Imm(ins.depth));
+		// the epilogue follows the last block
+		if (next == (int)fn.blocks.size()) return;
+		if (end < 0) end = out.name(fn.label.empty() ? ".return_" + std::to_string(labels++) : fn.label + "_end");
+		add(mir::JMP, mir::Sym(end));
+		return;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include "mir.h"
+#include "../ir/ir.h"
+
+namespace compiler {
+	// Lowering
+	// selects the x86-64 instructions for a function of the IR, on a virtual register per value
+	// the constants are made where they are used (as immediates when they fit), and the phis
+	// become copies at the end of the predecessors (the critical edges are split first, so a
+	// block with several successors never has to copy)
+	// a phi shares its register with the operands whose live ranges do not overlap with it (the
+	// allocator gives a register one interval, a loop variable copied into a new one every
+	// iteration would keep two registers busy over the whole loop)
+	// a comparison only used by the branch right after it is not made into a value, the branch
+	// jumps on its flags (with the condition negated to fall through to the next block)
+	// the additions and multiplications making the addresses of loads and stores are done by the
+	// addressing of the instructions ([base + index*scale + disp]) when nothing else uses them
+	class Lowering {
+	private:
+		ir::Function& fn;
+		mir::Function& out;
+		int& labels;							// numbers the labels it makes
+		std::vector<int> regs;					// per value, its virtual register (-1 until it needs one)
+		std::vector<std::vector<int>> users;	// per value, the instructions using it
+		std::vector<char> fused;				// per comparison, the branch after it jumps on its flags
+		// an address computed by the addressing of the loads and stores using it
+		struct Address {
+			int base = -1;						// values, -1 if none
+			int index = -1;
+			int scale = 1;
+			int slot = -1;						// the base is the stack slot
+			int64_t disp = 0;
+		};
+		std::vector<Address> addresses;			// per value
+		std::vector<char> folded;				// per value, it is computed by the addressing of its users
+		std::vector<int> blockLabels;			// per block, the name of its label
+		std::vector<int> destination;			// per block, where a jump to it goes (past the blocks that only jump on)
+		std::vector<int> following;				// per block, the next one written after it
+		int end = -1;							// label of the epilogue (-1 until a return jumps to it)
+		int depth = 0;							// of the instruction being lowered
+
+		void fuse();							// find the comparisons that only decide the branch after them
+		void fold();							// find the addresses the addressing can compute
+		bool collect(int v, int scale, bool root, Address& a, std::vector<int>& inner);
+		void operands(int v, std::vector<int>& out) const;	// the values its machine code reads
+		void coalesce();						// the phis and their operands that can share a register
+		void thread();							// find the blocks that only jump on and leave them out
+		int follow(int block, std::vector<char>& state);
+		int reg(int v);							// the virtual register of the value
+		int value(int v);						// a register with the value (a new one for a constant)
+		mir::Operand operand(int v);			// an immediate for a constant that fits, a register otherwise
+		void add(mir::op_t op, mir::Operand dst = mir::Operand(), mir::Operand src = mir::Operand()) { out.add(op, dst, src, depth); }
+		mir::Operand memory(int address, int size);	// the memory at the address
+		mir::cond_t compare(int v);				// the cmp of a comparison, returns the condition it holds on
+		void jump(int block, int next);			// to the destination of the block unless it is the next one
+		void copies(int from, int to);			// the phis of `to` get their values on the edge from `from`
+		void move(int dst, int v);				// the register gets the value
+		bool multiply(int v, int a, int64_t k);	// by a constant with a shift or lea, false if neither does
+		void divide(const ir::Ins&, int v, int64_t d);	// by a constant above 1, with a shift or a multiplication
+		void lower(const ir::Ins&, int v);
+	public:
+		Lowering(ir::Function& f, mir::Function& m, int& labelCount) : fn(f), out(m), labels(labelCount) {}
+		void run();
+	};
+}
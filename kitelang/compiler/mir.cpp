@@ -0,0 +1,250 @@
+#include "mir.h"
+#include <cctype>
+
+using namespace compiler::mir;
+
+namespace {
+	const char* mnemonics[] = { "mov", "movzx", "lea", "add", "sub", "imul", "and", "shl", "shr", "xor", "mul", "idiv", "cmp", "push", "pop", "jmp", "j", "set", "", "call", "" };
+
+	// the registers an address is computed from
+	void address(const Operand& o, std::vector<int>& out) {
+		if (o.kind != Operand::MEM) return;
+		if (o.reg >= 0 && o.reg != compiler::RSP) out.push_back(o.reg);
+		if (o.index >= 0) out.push_back(o.index);
+	}
+
+	void read(const Operand& o, std::vector<int>& out) {
+		if (o.kind == Operand::REG) {
+			if (o.reg != compiler::RSP) out.push_back(o.reg);
+		}
+		else address(o, out);
+	}
+
+	void number(std::string& s, int64_t v) {
+		s += std::to_string(v);
+	}
+
+	void operand(std::string& s, const Function& fn, const Ins& ins, const Operand& o, bool sized) {
+		switch (o.kind) {
+		case Operand::REG:
+			s += compiler::name(compiler::Reg((compiler::reg_t)o.reg, o.size));
+			return;
+		case Operand::IMM:
+			number(s, o.value);
+			return;
+		case Operand::SYM:
+			s += fn.names[o.value];
+			return;
+		case Operand::MEM: {
+			if (sized) s += o.size == 1 ? "byte " : o.size == 2 ? "word " : o.size == 4 ? "dword " : "qword ";
+			int64_t disp = o.value;
+			if (o.slot >= 0) {
+				const StackSlot& slot = fn.slots[o.slot];
+				disp += (slot.above >= 0 ? fn.frame + slot.above : slot.offset) + ins.depth;
+			}
+			s += '[';
+			if (o.reg >= 0) s += compiler::name(compiler::Reg((compiler::reg_t)o.reg));
+			if (o.index >= 0) {
+				if (o.reg >= 0) s += " + ";
+				s += compiler::name(compiler::Reg((compiler::reg_t)o.index));
+				if (o.scale != 1) {
+					s += '*';
+					number(s, o.scale);
+				}
+			}
+			if (disp > 0 || (o.reg < 0 && o.index < 0)) {
+				s += " + ";
+				number(s, disp);
+			}
+			else if (disp < 0) {
+				s += " - ";
+				number(s, -disp);
+			}
+			s += ']';
+			return;
+		}
+		default:
+			return;
+		}
+	}
+}
+
+const char* compiler::mir::cond_name(cond_t cc) {
+	switch (cc) {
+	case CC_E: return "e";
+	case CC_NE: return "ne";
+	case CC_L: return "l";
+	case CC_GE: return "ge";
+	case CC_LE: return "le";
+	case CC_G: return "g";
+	}
+	return "";
+}
+
+void compiler::mir::uses(const Ins& ins, int args, std::vector<int>& out) {
+	switch (ins.op) {
+	case MOV:
+		read(ins.src, out);
+		// a byte or a word only replaces part of the register
+		if (ins.dst.kind == Operand::REG && ins.dst.size < 4) out.push_back(ins.dst.reg);
+		else address(ins.dst, out);
+		return;
+	case MOVZX:
+	case LEA:
+		read(ins.src, out);
+		return;
+	case ADD:
+	case SUB:
+	case IMUL:
+	case AND:
+	case SHL:
+	case SHR:
+	case CMP:
+		read(ins.dst, out);
+		read(ins.src, out);
+		return;
+	case XOR:
+		if (ins.dst.kind == Operand::REG && ins.src.kind == Operand::REG && ins.dst.reg == ins.src.reg) return;
+		read(ins.dst, out);
+		read(ins.src, out);
+		return;
+	case MUL:
+		read(ins.src, out);
+		out.push_back(RAX);
+		return;
+	case IDIV:
+		read(ins.src, out);
+		out.push_back(RAX);
+		out.push_back(RDX);
+		return;
+	case SETCC:
+		// it only replaces the low byte of a register
+		read(ins.dst, out);
+		return;
+	case PUSH:
+		read(ins.src, out);
+		return;
+	case POP:
+		address(ins.dst, out);
+		return;
+	case CALL:
+		for (int i = 0; i < ins.src.value; i++) out.push_back(argregs[i]);
+		return;
+	case RAW:
+		for (int i = 0; i < args; i++) out.push_back(argregs[i]);
+		return;
+	default:
+		return;
+	}
+}
+
+void compiler::mir::defs(const Ins& ins, std::vector<int>& out) {
+	switch (ins.op) {
+	case MOV:
+	case MOVZX:
+	case LEA:
+	case ADD:
+	case SUB:
+	case IMUL:
+	case AND:
+	case SHL:
+	case SHR:
+	case XOR:
+	case SETCC:
+	case POP:
+		if (ins.dst.kind == Operand::REG && ins.dst.reg != RSP) out.push_back(ins.dst.reg);
+		return;
+	case MUL:
+	case IDIV:
+		out.push_back(RAX);
+		out.push_back(RDX);
+		return;
+	case CALL:
+		for (reg_t r : caller_saved) out.push_back(r);
+		return;
+	case RAW:
+		// an asm block may change any register
+		for (int r = RAX; r <= R15; r++)
+			if (r != RSP) out.push_back(r);
+		return;
+	default:
+		return;
+	}
+}
+
+void compiler::mir::named_callee_saved(const std::string& line, std::vector<reg_t>& out) {
+	size_t i = 0;
+	while (i < line.size()) {
+		if (line[i] == ';') return;
+		if (!isalnum((unsigned char)line[i])) {
+			i++;
+			continue;
+		}
+		size_t start = i;
+		while (i < line.size() && isalnum((unsigned char)line[i])) i++;
+		Reg r = reg_from_name(std::string_view(line).substr(start, i - start));
+		if (!r.none() && is_callee_saved(r.id)) {
+			bool known = false;
+			for (reg_t s : out) known |= s == r.id;
+			if (!known) out.push_back(r.id);
+		}
+	}
+}
+
+void compiler::mir::print(const Function& fn, AsmWriter& text) {
+	bool function = !fn.label.empty();
+	if (function) {
+		text.ins(fn.label, ":");
+		// the arguments of the process, from the stack the kernel made
+		if (fn.entry) {
+			text.ins("mov rdi, [rsp]");
+			text.ins("lea rsi, [rsp + 8]");
+		}
+		for (reg_t r : fn.saved) text.ins("push ", Reg(r));
+	}
+	if (fn.frame) text.ins("sub rsp, ", fn.frame);
+
+	std::string line;
+	for (const Ins& ins : fn.code) {
+		line.clear();
+		switch (ins.op) {
+		case LABEL:
+			if (ins.src.kind == Operand::IMM) text.ins("align ", ins.src.value);
+			text.ins(fn.names[ins.dst.value], ":");
+			continue;
+		case RAW:
+			text.ins(fn.names[ins.src.value]);
+			continue;
+		case JCC:
+		case SETCC:
+			line += mnemonics[ins.op];
+			line += cond_name(ins.cc);
+			break;
+		default:
+			line += mnemonics[ins.op];
+		}
+		// the size of a memory operand is only written when no register gives it
+		bool sized = ins.op == MOVZX || (ins.op != LEA && !ins.dst.is_reg() && !ins.src.is_reg());
+		if (ins.dst.kind != Operand::NONE) {
+			line += ' ';
+			operand(line, fn, ins, ins.dst, sized);
+		}
+		if (ins.src.kind != Operand::NONE && ins.op != CALL) {
+			line += ins.dst.kind != Operand::NONE ? ", " : " ";
+			operand(line, fn, ins, ins.src, sized);
+		}
+		text.ins(line);
+	}
+
+	if (function) {
+		if (fn.frame) text.ins("add rsp, ", fn.frame);
+		for (auto it = fn.saved.rbegin(); it != fn.saved.rend(); ++it) text.ins("pop ", Reg(*it));
+		// _start exits with its return value
+		if (fn.entry) {
+			text.ins("mov rdi, rax");
+			text.ins("mov rax, 60");
+			text.ins("syscall");
+		}
+		text.ins("ret");
+	}
+}
\ No newline at end of file
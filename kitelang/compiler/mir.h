@@ -0,0 +1,136 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "asm.h"
+
+// Machine IR
+// the code generator emits x86-64 instructions on virtual registers into a function, the
+// register allocator (see regalloc.h) then gives them physical registers and stack slots, and
+// the function is printed as NASM
+namespace compiler::mir {
+	// registers are numbered together, the physical ones (in the order of reg_t) first and the
+	// virtual ones from VIRTUAL on
+	constexpr int VIRTUAL = 16;
+	inline bool is_virtual(int r) { return r >= VIRTUAL; }
+
+	typedef enum : uint8_t {
+		MOV,
+		MOVZX,
+		LEA,
+		ADD,
+		SUB,
+		IMUL,
+		AND,
+		SHL,
+		SHR,
+		XOR,				// xor r, r only clears r
+		MUL,				// rdx:rax gets rax times the operand, unsigned (rax and rdx are implicit)
+		IDIV,				// divides rdx:rax by the operand (rax and rdx are implicit)
+		CMP,
+		PUSH,
+		POP,
+		JMP,
+		JCC,
+		SETCC,				// the byte register or memory gets 1 if the condition holds, 0 otherwise
+		LABEL,				// src is the alignment of its address, if any
+		CALL,				// src is the amount of argument registers it reads
+		RAW,				// a line of an asm block, src is its text
+	} op_t;
+
+	// condition codes of jcc and setcc, in the order of their encoding, the odd one of a pair
+	// negates the even one
+	typedef enum : uint8_t {
+		CC_E = 4, CC_NE = 5, CC_L = 12, CC_GE = 13, CC_LE = 14, CC_G = 15,
+	} cond_t;
+	const char* cond_name(cond_t);
+	inline cond_t negate(cond_t cc) { return (cond_t)(cc ^ 1); }
+
+	struct Operand {
+		enum kind_t : uint8_t { NONE, REG, IMM, MEM, SYM } kind = NONE;
+		uint8_t size = 8;	// bytes of the register or of the memory it reads or writes
+		uint8_t scale = 1;	// MEM: of the index
+		int reg = -1;		// REG; MEM: the base (-1 if none)
+		int index = -1;		// MEM: the index register (-1 if none)
+		int slot = -1;		// MEM: a stack slot of the function, the address is relative to it
+		int64_t value = 0;	// IMM; MEM: the displacement; SYM: the name in the function
+
+		bool is_reg() const { return kind == REG; }
+		bool is_reg(int r) const { return kind == REG && reg == r; }
+	};
+
+	inline Operand R(int reg, int size = 8) { Operand o; o.kind = Operand::REG; o.reg = reg; o.size = (uint8_t)size; return o; }
+	inline Operand Imm(int64_t v) { Operand o; o.kind = Operand::IMM; o.value = v; return o; }
+	inline Operand Mem(int base, int64_t disp = 0, int size = 8) { Operand o; o.kind = Operand::MEM; o.reg = base; o.value = disp; o.size = (uint8_t)size; return o; }
+	inline Operand Slot(int slot, int size = 8) { Operand o = Mem(RSP, 0, size); o.slot = slot; return o; }
+	inline Operand Index(Operand m, int index, int scale) { m.index = index; m.scale = (uint8_t)scale; return m; }
+	inline Operand Sym(int name) { Operand o; o.kind = Operand::SYM; o.value = name; return o; }
+
+	struct Ins {
+		op_t op;
+		cond_t cc = CC_E;	// JCC, SETCC
+		Operand dst, src;
+		int depth = 0;		// bytes asm blocks pushed at this point (@stackszinc), the slots are further away
+	};
+
+	// a place on the stack of the function
+	struct StackSlot {
+		int size = 8;
+		int align = 8;
+		int offset = -1;	// from the stack pointer after the prologue, set by the allocator
+		int above = -1;		// if not -1, the slot is that far above the frame (a slot of an outer frame)
+	};
+
+	// a function (or the code of a top-level statement) being generated
+	class Function {
+	public:
+		std::vector<Ins> code;
+		std::vector<std::string> names;		// labels, symbols and the lines of asm blocks
+		std::vector<StackSlot> slots;
+		int vregs = 0;
+		std::string label;					// empty for top-level code (no prologue and epilogue)
+		bool entry = false;					// _start, exits with the return value
+		int args = 0;						// argument registers the asm blocks may still read
+		// callee-saved registers the function has to keep, the allocator adds the ones it uses
+		std::vector<reg_t> saved;
+
+		int frame = 0;						// bytes of slots, set by the allocator
+		size_t spills = 0;					// virtual registers the allocator put on the stack
+
+		int reg() { return VIRTUAL + vregs++; }
+		int name(std::string s) {
+			names.push_back(std::move(s));
+			return (int)names.size() - 1;
+		}
+		int slot(int size, int align = 8) {
+			slots.push_back(StackSlot{ size, align });
+			return (int)slots.size() - 1;
+		}
+		void add(op_t op, Operand dst = Operand(), Operand src = Operand(), int depth = 0) {
+			code.push_back(Ins{ op, CC_E, dst, src, depth });
+		}
+		void jcc(cond_t cc, int label, int depth = 0) {
+			code.push_back(Ins{ JCC, cc, Sym(label), Operand(), depth });
+		}
+		void setcc(cond_t cc, Operand dst, int depth = 0) {
+			code.push_back(Ins{ SETCC, cc, dst, Operand(), depth });
+		}
+	};
+
+	// the registers an instruction reads and writes (physical and virtual, not rsp)
+	// `args` is the amount of argument registers asm blocks read
+	void uses(const Ins&, int args, std::vector<int>& out);
+	void defs(const Ins&, std::vector<int>& out);
+
+	// the callee-saved registers named in a line of assembly
+	void named_callee_saved(const std::string& line, std::vector<reg_t>& out);
+
+	// write the allocated function (with its prologue and epilogue)
+	void print(const Function&, AsmWriter&);
+
+	// registers in the order arguments are passed in
+	constexpr reg_t argregs[6] = { RDI, RSI, RDX, RCX, R8, R9 };
+	// registers a call may change
+	constexpr reg_t caller_saved[9] = { RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11 };
+	inline bool is_callee_saved(int r) { return r == RBX || r == RBP || (r >= R12 && r <= R15); }
+}
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "peephole.h"
+
+using namespace compiler::mir;
+
+namespace {
+	constexpr uint32_t FLAGS = 1u << 16;
+	constexpr uint32_t ALL = (1u << 17) - 1;
+
+	uint32_t mask(const std::vector<int>& regs) {
+		uint32_t m = 0;
+		for (int r : regs) m |= 1u << r;
+		return m;
+	}
+
+	bool sets_flags(op_t op) {
+		return op == ADD || op == SUB || op == IMUL || op == AND || op == SHL || op == SHR || op == XOR || op == MUL || op == IDIV || op == CMP || op == CALL;
+	}
+
+	bool same(const Operand& a, const Operand& b) {
+		return a.kind == b.kind && a.size == b.size && a.scale == b.scale && a.reg == b.reg && a.index == b.index && a.slot == b.slot && a.value == b.value;
+	}
+
+	// the operand reads the register (itself or in its address)
+	bool reads(const Operand& o, int r) {
+		return (o.kind == Operand::REG && o.reg == r) || (o.kind == Operand::MEM && (o.reg == r || o.index == r));
+	}
+
+	bool is_reg64(const Operand& o) {
+		return o.kind == Operand::REG && o.size == 8;
+	}
+
+}
+
+const char* compiler::mir::rule_name(rule_t rule) {
+	static const char* names[RULES] = {
+		"jump to next", "branch over jump", "jump to jump", "unreachable", "dead move",
+		"redundant move", "store load", "fold copy", "identity", "zero idiom",
+	};
+	return names[rule];
+}
+
+void compiler::mir::Peephole::run() {
+	// a rewrite may let another rule match, the passes are bounded for jumps going around in a cycle
+	for (int i = 0; i < 16 && pass(); i++) {}
+}
+
+void compiler::mir::Peephole::find_labels() {
+	labels.assign(fn.names.size(), -1);
+	for (size_t i = 0; i < fn.code.size(); i++)
+		if (fn.code[i].op == LABEL) labels[fn.code[i].dst.value] = (int)i;
+}
+
+int compiler::mir::Peephole::target(int i) const {
+	int l = labels[fn.code[i].dst.value];
+	if (l < 0) return -1;
+	while (l < (int)fn.code.size() && fn.code[l].op == LABEL) l++;
+	return l;
+}
+
+void compiler::mir::Peephole::liveness() {
+	size_t n = fn.code.size();
+	std::vector<uint32_t> used(n), defined(n);
+	std::vector<int> regs;
+	for (size_t i = 0; i < n; i++) {
+		const Ins& ins = fn.code[i];
+		// an asm block may read anything
+		if (ins.op == RAW) {
+			used[i] = ALL;
+			continue;
+		}
+		regs.clear();
+		uses(ins, fn.args, regs);
+		used[i] = mask(regs) | (ins.op == JCC || ins.op == SETCC ? FLAGS : 0);
+		regs.clear();
+		defs(ins, regs);
+		defined[i] = mask(regs) | (sets_flags(ins.op) ? FLAGS : 0);
+	}
+
+	// after the function the return value and the callee-saved registers are read, after
+	// top-level code anything may be
+	uint32_t exit = ALL;
+	if (!fn.label.empty()) {
+		exit = 1u << compiler::RAX;
+		for (int r = compiler::RAX; r <= compiler::R15; r++)
+			if (is_callee_saved(r)) exit |= 1u << r;
+	}
+	std::vector<uint32_t> before(n + 1, 0);
+	before[n] = exit;
+	live.assign(n, 0);
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (size_t k = n; k-- > 0;) {
+			const Ins& ins = fn.code[k];
+			uint32_t after = before[k + 1];
+			if (ins.op == JMP || ins.op == JCC) {
+				int l = labels[ins.dst.value];
+				uint32_t taken = l < 0 ? ALL : before[l];
+				after = ins.op == JMP ? taken : after | taken;
+			}
+			live[k] = after;
+			uint32_t in = used[k] | (after & ~defined[k]);
+			if (in != before[k]) {
+				before[k] = in;
+				changed = true;
+			}
+		}
+	}
+}
+
+bool compiler::mir::Peephole::pass() {
+	find_labels();
+	liveness();
+	int n = (int)fn.code.size();
+	removed.assign(n, false);
+	bool changed = false;
+	auto remove = [&](int i, rule_t rule) {
+		removed[i] = true;
+		count(rule);
+		changed = true;
+	};
+	// the label of the jump is one of the labels right after `from`
+	auto follows = [&](int from, const Ins& jump) {
+		for (int j = from; j < n && fn.code[j].op == LABEL; j++)
+			if (fn.code[j].dst.value == jump.dst.value) return true;
+		return false;
+	};
+	// a jump to a jmp goes to its target
+	auto thread = [&](Ins& jump) {
+		int t = target((int)(&jump - fn.code.data()));
+		if (t < 0 || t >= n || fn.code[t].op != JMP || fn.code[t].dst.value == jump.dst.value) return;
+		jump.dst = fn.code[t].dst;
+		count(JUMP_TO_JUMP);
+		changed = true;
+	};
+
+	for (int i = 0; i < n; i++) {
+		if (removed[i]) continue;
+		Ins& ins = fn.code[i];
+		switch (ins.op) {
+		case JMP:
+			if (follows(i + 1, ins)) {
+				remove(i, JUMP_TO_NEXT);
+				continue;
+			}
+			thread(ins);
+			// nothing jumps in before the next label (an asm block may have labels of its own)
+			for (int j = i + 1; j < n && fn.code[j].op != LABEL && fn.code[j].op != RAW; j++)
+				if (!removed[j]) remove(j, UNREACHABLE);
+			continue;
+		case JCC:
+			if (i + 1 < n && fn.code[i + 1].op == JMP && follows(i + 2, ins)) {
+				ins.cc = negate(ins.cc);
+				ins.dst = fn.code[i + 1].dst;
+				remove(i + 1, BRANCH_OVER_JUMP);
+				i++;
+				continue;
+			}
+			thread(ins);
+			continue;
+		case ADD:
+		case SUB:
+		case IMUL:
+			if (ins.dst.is_reg() && ins.src.kind == Operand::IMM && ins.src.value == (ins.op == IMUL ? 1 : 0) && dead(i, FLAGS))
+				remove(i, IDENTITY);
+			continue;
+		case XOR:
+			if (ins.dst.is_reg() && ins.src.is_reg(ins.dst.reg) && dead(i, (1u << ins.dst.reg) | FLAGS))
+				remove(i, DEAD_MOVE);
+			continue;
+		case MOV:
+		case MOVZX:
+		case LEA:
+			break;
+		default:
+			continue;
+		}
+
+		if (!ins.dst.is_reg() || ins.dst.reg == compiler::RSP) continue;
+		int r = ins.dst.reg;
+		if (dead(i, 1u << r)) {
+			remove(i, DEAD_MOVE);
+			continue;
+		}
+		if (ins.op != MOV) continue;
+		if (is_reg64(ins.dst) && is_reg64(ins.src)) {
+			// mov r, r, or the move back of the one before
+			const Ins* prev = i > 0 && !removed[i - 1] ? &fn.code[i - 1] : nullptr;
+			if (ins.src.reg == r || (prev && prev->op == MOV && is_reg64(prev->dst) && is_reg64(prev->src) && prev->dst.reg == ins.src.reg && prev->src.reg == r)) {
+				remove(i, REDUNDANT_MOVE);
+				continue;
+			}
+			// mov t, x / op t, y / mov x, t  ->  op x, y
+			int x = ins.src.reg;
+			if (i + 2 < n && !removed[i + 1] && !removed[i + 2]) {
+				Ins& op = fn.code[i + 1];
+				const Ins& back = fn.code[i + 2];
+				if ((op.op == ADD || op.op == SUB || op.op == IMUL) && op.dst.is_reg(r) && op.dst.size == 8 && !reads(op.src, r) &&
+					back.op == MOV && is_reg64(back.dst) && back.dst.reg == x && is_reg64(back.src) && back.src.reg == r && dead(i + 2, 1u << r)) {
+					op.dst.reg = x;
+					removed[i] = removed[i + 2] = true;
+					count(FOLD_COPY);
+					changed = true;
+					i += 2;
+					continue;
+				}
+			}
+		}
+		// a value loaded back from where it was just stored
+		if (ins.src.kind == Operand::MEM && i > 0 && !removed[i - 1]) {
+			const Ins& store = fn.code[i - 1];
+			if (store.op == MOV && store.depth == ins.depth && same(store.dst, ins.src) && is_reg64(store.src) && is_reg64(ins.dst)) {
+				if (store.src.reg == r) remove(i, STORE_LOAD);
+				else {
+					ins.src = store.src;
+					count(STORE_LOAD);
+					changed = true;
+				}
+				continue;
+			}
+		}
+		if (ins.src.kind == Operand::IMM && ins.src.value == 0 && ins.dst.size >= 4 && dead(i, FLAGS)) {
+			ins.op = XOR;
+			ins.dst = ins.src = R(r, 4);
+			count(ZERO_IDIOM);
+			changed = true;
+		}
+	}
+
+	if (!changed) return false;
+	size_t kept = 0;
+	for (int i = 0; i < n; i++)
+		if (!removed[i]) fn.code[kept++] = fn.code[i];
+	fn.code.resize(kept);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "mir.h"
+
+namespace compiler::mir {
+	// the rewrites of the peephole optimizer
+	typedef enum {
+		JUMP_TO_NEXT,		// jmp L before L:
+		BRANCH_OVER_JUMP,	// jcc L1 / jmp L2 / L1:  ->  j!cc L2 / L1:
+		JUMP_TO_JUMP,		// a jump to a jmp goes to its target instead
+		UNREACHABLE,		// instructions after a jmp, before the next label
+		DEAD_MOVE,			// a register written and never read
+		REDUNDANT_MOVE,		// mov r, r and mov a, b / mov b, a
+		STORE_LOAD,			// mov [m], r / mov s, [m]  ->  mov [m], r / mov s, r
+		FOLD_COPY,			// mov t, x / op t, y / mov x, t  ->  op x, y (t not read after)
+		IDENTITY,			// add r, 0, sub r, 0 and imul r, 1
+		ZERO_IDIOM,			// mov r, 0  ->  xor r32, r32
+		RULES,
+	} rule_t;
+	const char* rule_name(rule_t);
+
+	// Peephole optimizer
+	// runs over an allocated function before it is printed, and rewrites short sequences of
+	// instructions until none matches anymore
+	// the rules that remove or change instructions that write registers or the flags use their
+	// liveness (the flags are live from a comparison to the jcc reading them)
+	class Peephole {
+	private:
+		Function& fn;
+		size_t* counts;							// rewrites per rule
+		std::vector<uint32_t> live;				// per instruction, the registers (and flags) live after it
+		std::vector<int> labels;				// per name, the instruction placing the label (-1 if none)
+		std::vector<bool> removed;
+
+		void find_labels();
+		void liveness();
+		int target(int i) const;				// the first instruction after the label a jump goes to
+		bool dead(int i, uint32_t regs) const { return (live[i] & regs) == 0; }
+		void count(rule_t rule) { counts[rule]++; }
+		bool pass();							// one pass over the code, false if nothing changed
+	public:
+		Peephole(Function& f, size_t* rewrites) : fn(f), counts(rewrites) {}
+		void run();
+	};
+}
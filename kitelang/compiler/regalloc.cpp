@@ -0,0 +1,357 @@
+#include "regalloc.h"
+#include <algorithm>
+#include "../errors/errors.h"
+
+using namespace compiler::mir;
+
+namespace {
+	// the registers handed out, the callee-saved ones last as using them costs a push and a pop
+	constexpr compiler::reg_t order[] = {
+		compiler::RAX, compiler::RCX, compiler::RDX, compiler::RSI, compiler::RDI, compiler::R8, compiler::R9,
+		compiler::R10, compiler::R11, compiler::R12, compiler::R13, compiler::R14, compiler::R15,
+	};
+
+	bool allocatable(int r) {
+		for (compiler::reg_t o : order)
+			if (o == r) return true;
+		return false;
+	}
+
+	bool test(const std::vector<uint64_t>& set, int r) { return set[r >> 6] >> (r & 63) & 1; }
+	void insert(std::vector<uint64_t>& set, int r) { set[r >> 6] |= 1ull << (r & 63); }
+
+	// calls f with every register in the set
+	template <typename F>
+	void each(const std::vector<uint64_t>& set, F f) {
+		for (size_t w = 0; w < set.size(); w++)
+			for (uint64_t bits = set[w]; bits; bits &= bits - 1) f((int)(w * 64 + __builtin_ctzll(bits)));
+	}
+}
+
+void compiler::mir::Allocator::run() {
+	reloads.assign(fn.vregs, false);
+	for (int round = 0;; round++) {
+		build_blocks();
+		liveness();
+		build_intervals();
+		if (scan()) break;
+		// every round only adds registers that live for one instruction, so this is not reached
+		if (round == 64) throw errors::kiterr("too many values live at once in " + (fn.label.empty() ? std::string("top-level code") : fn.label), 0, 0, 0);
+		spill();
+	}
+	assign();
+	layout();
+}
+
+void compiler::mir::Allocator::build_blocks() {
+	// a block ends before a label and after a jump
+	blocks.clear();
+	int n = (int)fn.code.size();
+	for (int i = 0, start = 0; i < n; i++) {
+		op_t op = fn.code[i].op;
+		if (i + 1 == n || fn.code[i + 1].op == LABEL || op == JMP || op == JCC) {
+			blocks.push_back(Block{ start, i });
+			start = i + 1;
+		}
+	}
+	std::vector<int> labels(fn.names.size(), -1);
+	for (size_t b = 0; b < blocks.size(); b++) {
+		const Ins& first = fn.code[blocks[b].first];
+		if (first.op == LABEL) labels[first.dst.value] = (int)b;
+	}
+	for (size_t b = 0; b < blocks.size(); b++) {
+		const Ins& last = fn.code[blocks[b].last];
+		if (last.op == JMP || last.op == JCC) {
+			int target = labels[last.dst.value];
+			if (target >= 0) blocks[b].succ.push_back(target);
+		}
+		if (last.op != JMP && b + 1 < blocks.size()) blocks[b].succ.push_back((int)b + 1);
+	}
+}
+
+void compiler::mir::Allocator::liveness() {
+	size_t words = (VIRTUAL + fn.vregs + 63) / 64;
+	std::vector<std::vector<uint64_t>> gen(blocks.size()), kill(blocks.size());
+	for (size_t b = 0; b < blocks.size(); b++) {
+		gen[b].assign(words, 0);
+		kill[b].assign(words, 0);
+		blocks[b].in.assign(words, 0);
+		blocks[b].out.assign(words, 0);
+		for (int i = blocks[b].first; i <= blocks[b].last; i++) {
+			regs.clear();
+			uses(fn.code[i], fn.args, regs);
+			for (int r : regs)
+				if (!test(kill[b], r)) insert(gen[b], r);
+			regs.clear();
+			defs(fn.code[i], regs);
+			for (int r : regs) insert(kill[b], r);
+		}
+	}
+	// backwards until nothing changes, a loop takes a pass per level of nesting
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (size_t b = blocks.size(); b-- > 0;) {
+			Block& block = blocks[b];
+			for (int s : block.succ)
+				for (size_t w = 0; w < words; w++) block.out[w] |= blocks[s].in[w];
+			for (size_t w = 0; w < words; w++) {
+				uint64_t in = gen[b][w] | (block.out[w] & ~kill[b][w]);
+				if (in != block.in[w]) {
+					block.in[w] = in;
+					changed = true;
+				}
+			}
+		}
+	}
+}
+
+void compiler::mir::Allocator::build_intervals() {
+	intervals.assign(VIRTUAL + fn.vregs, Interval{});
+	fixed.assign(VIRTUAL, {});
+	for (const Block& block : blocks) {
+		int from = 2 * block.first, to = 2 * block.last + 1;
+		each(block.in, [&](int r) { if (is_virtual(r)) intervals[r].start = std::min(intervals[r].start, from); });
+		each(block.out, [&](int r) { if (is_virtual(r)) intervals[r].end = std::max(intervals[r].end, to); });
+
+		// the physical registers keep their holes, walking the block backwards
+		bool live[VIRTUAL];
+		int end[VIRTUAL];
+		for (int r = 0; r < VIRTUAL; r++) {
+			live[r] = test(block.out, r);
+			end[r] = to;
+		}
+		for (int i = block.last; i >= block.first; i--) {
+			regs.clear();
+			defs(fn.code[i], regs);
+			for (int r : regs) {
+				if (is_virtual(r)) continue;
+				fixed[r].emplace_back(2 * i + 1, live[r] ? end[r] : 2 * i + 1);
+				live[r] = false;
+			}
+			regs.clear();
+			uses(fn.code[i], fn.args, regs);
+			for (int r : regs) {
+				if (is_virtual(r) || live[r]) continue;
+				live[r] = true;
+				end[r] = 2 * i;
+			}
+		}
+		for (int r = 0; r < VIRTUAL; r++)
+			if (live[r]) fixed[r].emplace_back(from, end[r]);
+	}
+
+	for (int i = 0; i < (int)fn.code.size(); i++) {
+		const Ins& ins = fn.code[i];
+		regs.clear();
+		uses(ins, fn.args, regs);
+		for (int r : regs) {
+			if (!is_virtual(r)) continue;
+			intervals[r].start = std::min(intervals[r].start, 2 * i);
+			intervals[r].end = std::max(intervals[r].end, 2 * i);
+		}
+		regs.clear();
+		defs(ins, regs);
+		for (int r : regs) {
+			if (!is_virtual(r)) continue;
+			intervals[r].start = std::min(intervals[r].start, 2 * i + 1);
+			intervals[r].end = std::max(intervals[r].end, 2 * i + 1);
+		}
+		// a copy is free if both sides get the same register
+		if ((ins.op == MOV || ins.op == MOVZX) && ins.dst.is_reg() && ins.src.is_reg()) {
+			if (is_virtual(ins.dst.reg) && intervals[ins.dst.reg].hint < 0) intervals[ins.dst.reg].hint = ins.src.reg;
+			if (is_virtual(ins.src.reg) && intervals[ins.src.reg].hint < 0) intervals[ins.src.reg].hint = ins.dst.reg;
+		}
+	}
+	for (int v = 0; v < fn.vregs; v++) intervals[VIRTUAL + v].reload = reloads[v];
+
+	// sorted and merged, so both ends grow (see conflicts)
+	for (auto& ranges : fixed) {
+		std::sort(ranges.begin(), ranges.end());
+		size_t n = 0;
+		for (size_t i = 0; i < ranges.size(); i++) {
+			if (n && ranges[i].first <= ranges[n - 1].second + 1) ranges[n - 1].second = std::max(ranges[n - 1].second, ranges[i].second);
+			else ranges[n++] = ranges[i];
+		}
+		ranges.resize(n);
+	}
+}
+
+bool compiler::mir::Allocator::conflicts(int reg, const Interval& interval) const {
+	const auto& ranges = fixed[reg];
+	auto it = std::lower_bound(ranges.begin(), ranges.end(), interval.start, [](const std::pair<int, int>& r, int start) { return r.second < start; });
+	return it != ranges.end() && it->first <= interval.end;
+}
+
+bool compiler::mir::Allocator::scan() {
+	std::vector<int> sorted;
+	for (int r = VIRTUAL; r < (int)intervals.size(); r++)
+		if (intervals[r].end >= 0) sorted.push_back(r);
+	std::sort(sorted.begin(), sorted.end(), [&](int a, int b) { return intervals[a].start < intervals[b].start; });
+
+	spilled.clear();
+	std::vector<int> active;
+	int holder[VIRTUAL];
+	std::fill(holder, holder + VIRTUAL, -1);
+	for (int v : sorted) {
+		Interval& cur = intervals[v];
+		// the intervals that ended give their registers back
+		for (size_t i = 0; i < active.size();) {
+			if (intervals[active[i]].end < cur.start) {
+				holder[intervals[active[i]].reg] = -1;
+				active[i] = active.back();
+				active.pop_back();
+			}
+			else i++;
+		}
+		auto usable = [&](int r) { return holder[r] < 0 && !conflicts(r, cur); };
+
+		int chosen = -1;
+		if (cur.hint >= 0) {
+			int r = is_virtual(cur.hint) ? intervals[cur.hint].reg : cur.hint;
+			if (r >= 0 && allocatable(r) && usable(r)) chosen = r;
+		}
+		for (size_t i = 0; chosen < 0 && i < std::size(order); i++)
+			if (usable(order[i])) chosen = order[i];
+
+		if (chosen < 0) {
+			// the interval that ends last goes to the stack, out of this one and the active ones
+			// on a register this one could take
+			int victim = -1;
+			for (int a : active) {
+				if (intervals[a].reload || conflicts(intervals[a].reg, cur)) continue;
+				if (victim < 0 || intervals[a].end > intervals[victim].end) victim = a;
+			}
+			if (victim >= 0 && (cur.reload || intervals[victim].end > cur.end)) {
+				chosen = intervals[victim].reg;
+				intervals[victim].reg = -1;
+				active.erase(std::find(active.begin(), active.end(), victim));
+				spilled.push_back(victim);
+			}
+			else if (!cur.reload) {
+				spilled.push_back(v);
+				continue;
+			}
+			else throw errors::kiterr("too many values live at once in " + (fn.label.empty() ? std::string("top-level code") : fn.label), 0, 0, 0);
+		}
+		cur.reg = chosen;
+		holder[chosen] = v;
+		active.push_back(v);
+	}
+	return spilled.empty();
+}
+
+void compiler::mir::Allocator::spill() {
+	std::vector<int> slots(fn.vregs, -1);
+	for (int v : spilled) slots[v - VIRTUAL] = fn.slot(8);
+	fn.spills += spilled.size();
+	auto slot_of = [&](int r) { return is_virtual(r) ? slots[r - VIRTUAL] : -1; };
+
+	std::vector<Ins> code;
+	code.reserve(fn.code.size() + spilled.size() * 4);
+	std::vector<std::pair<int, int>> temps;		// spilled register, the one it is loaded into
+	for (Ins ins : fn.code) {
+		// a copy reads or writes the slot itself
+		if (ins.op == MOV && ins.dst.is_reg() && slot_of(ins.dst.reg) >= 0 && ins.dst.size == 8 &&
+			((ins.src.is_reg() && slot_of(ins.src.reg) < 0) || (ins.src.kind == Operand::IMM && ins.src.value >= INT32_MIN && ins.src.value <= INT32_MAX))) {
+			ins.dst = Slot(slot_of(ins.dst.reg));
+			code.push_back(ins);
+			continue;
+		}
+		if ((ins.op == MOV || ins.op == MOVZX) && ins.src.is_reg() && slot_of(ins.src.reg) >= 0 && ins.dst.is_reg() && slot_of(ins.dst.reg) < 0) {
+			ins.src = Slot(slot_of(ins.src.reg), ins.src.size);
+			code.push_back(ins);
+			continue;
+		}
+
+		temps.clear();
+		auto rename = [&](int& r) {
+			if (r < 0 || slot_of(r) < 0) return;
+			for (auto& [from, to] : temps)
+				if (from == r) {
+					r = to;
+					return;
+				}
+			int t = fn.reg();
+			reloads.push_back(true);
+			temps.emplace_back(r, t);
+			r = t;
+		};
+		regs.clear();
+		uses(ins, fn.args, regs);
+		std::vector<int> read, written;
+		for (int r : regs)
+			if (slot_of(r) >= 0) read.push_back(r);
+		regs.clear();
+		defs(ins, regs);
+		for (int r : regs)
+			if (slot_of(r) >= 0) written.push_back(r);
+		if (read.empty() && written.empty()) {
+			code.push_back(ins);
+			continue;
+		}
+
+		for (Operand* o : { &ins.dst, &ins.src }) {
+			if (o->kind == Operand::REG) rename(o->reg);
+			else if (o->kind == Operand::MEM) {
+				rename(o->reg);
+				rename(o->index);
+			}
+		}
+		auto temp = [&](int r) {
+			for (auto& [from, to] : temps)
+				if (from == r) return to;
+			return -1;
+		};
+		for (int r : read) code.push_back(Ins{ MOV, CC_E, R(temp(r)), Slot(slot_of(r)), ins.depth });
+		code.push_back(ins);
+		for (int r : written) code.push_back(Ins{ MOV, CC_E, Slot(slot_of(r)), R(temp(r)), ins.depth });
+	}
+	fn.code = std::move(code);
+}
+
+void compiler::mir::Allocator::assign() {
+	auto physical = [&](int& r) {
+		if (r >= 0 && is_virtual(r)) r = intervals[r].reg;
+	};
+	size_t n = 0;
+	for (Ins& ins : fn.code) {
+		for (Operand* o : { &ins.dst, &ins.src }) {
+			if (o->kind == Operand::REG) physical(o->reg);
+			else if (o->kind == Operand::MEM) {
+				physical(o->reg);
+				physical(o->index);
+			}
+		}
+		// the copies both sides of which got the same register
+		if (ins.op == MOV && ins.dst.is_reg() && ins.src.is_reg(ins.dst.reg) && ins.dst.size == 8 && ins.src.size == 8) continue;
+		fn.code[n++] = ins;
+	}
+	fn.code.resize(n);
+
+	for (int v = VIRTUAL; v < (int)intervals.size(); v++) {
+		int r = intervals[v].reg;
+		if (r >= 0 && is_callee_saved(r) && std::find(fn.saved.begin(), fn.saved.end(), (reg_t)r) == fn.saved.end()) fn.saved.push_back((reg_t)r);
+	}
+}
+
+void compiler::mir::Allocator::layout() {
+	int offset = 0;
+	bool aligned = false;
+	for (StackSlot& slot : fn.slots) {
+		if (slot.above >= 0) continue;
+		offset = (offset + slot.align - 1) / slot.align * slot.align;
+		slot.offset = offset;
+		offset += slot.size;
+		aligned |= slot.align > 8;
+	}
+	fn.frame = (offset + 7) & ~7;
+	if (fn.label.empty()) return;
+	// calls are made with the stack aligned to 16 bytes (and so are the arrays), the return
+	// address and the saved registers are below the frame
+	bool calls = aligned;
+	for (const Ins& ins : fn.code) calls |= ins.op == CALL || ins.op == RAW;
+	if (calls) {
+		int total = (int)fn.saved.size() * 8 + fn.frame + (fn.entry ? 0 : 8);
+		fn.frame += (16 - total % 16) % 16;
+	}
+}
\ No newline at end of file
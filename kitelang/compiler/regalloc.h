@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "mir.h"
+
+namespace compiler::mir {
+	// Linear scan register allocator
+	// every virtual register gets one live interval (from its first to its last live point, over
+	// the liveness of the control flow graph), the intervals are handed out registers in the
+	// order they start, and when none is free the one that ends last goes to a stack slot
+	// the physical registers the code names (arguments, returns, division, calls) are live in
+	// ranges of their own, an interval never gets a register in one of its ranges, so a value
+	// live across a call only gets a callee-saved register
+	// the spilled registers are loaded into short-lived ones around their uses and the
+	// function is allocated again, until everything fits
+	class Allocator {
+	private:
+		// a point of the code: instruction i reads its operands at 2i and writes them at 2i + 1
+		struct Interval {
+			int start = INT32_MAX;
+			int end = -1;
+			int reg = -1;					// the physical register it got
+			int hint = -1;					// register it is moved from or to
+			bool reload = false;			// made for a spilled register, never spilled itself
+		};
+		struct Block {
+			int first, last;				// instructions
+			std::vector<int> succ;
+			std::vector<uint64_t> in, out;	// live registers, as bits
+		};
+		Function& fn;
+		std::vector<Block> blocks;
+		std::vector<Interval> intervals;	// by register (the physical ones are not used)
+		std::vector<std::vector<std::pair<int, int>>> fixed;	// per physical register, sorted ranges
+		std::vector<int> spilled;
+		std::vector<bool> reloads;			// per virtual register, made for a spilled one
+		std::vector<int> regs;				// buffer for uses and defs
+
+		void build_blocks();
+		void liveness();
+		void build_intervals();
+		bool conflicts(int reg, const Interval&) const;
+		bool scan();						// false if registers were spilled
+		void spill();
+		void assign();
+		void layout();
+	public:
+		explicit Allocator(Function& f) : fn(f) {}
+		void run();
+	};
+}
\ No newline at end of file
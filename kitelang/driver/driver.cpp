@@ -0,0 +1,501 @@
+#include "driver.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "../precompiler/precompiler.h"
+#include "../lexer/lexer.h"
+#include "../parser/parser.h"
+#include "../semantics/checker.h"
+#include "../optimizer/folder.h"
+#include "../compiler/compiler.h"
+#include "../assembler/assembler.h"
+#include "../stats/stats.h"
+
+namespace {
+	std::string nthln(const std::string& str, int n) {
+		std::istringstream stream(str);
+		std::string line;
+		int lineNumber = 0;
+
+		while (std::getline(stream, line)) {
+			++lineNumber;
+			if (lineNumber == n) {
+				for (char& ch : line) if (ch == '\t') ch = ' ';
+				return line;
+			}
+		}
+
+		return "";
+	}
+
+	void printerr(std::ostream& diag, const std::string& source, const errors::kiterr& e, const std::string& sender, const std::string& src) {
+		std::string ln = std::to_string(e.line) + ": ";
+		diag << "kite: " << source << ": " << sender << ": " << e.what() << " at line " << e.line << std::endl << std::endl;
+		diag << ln << nthln(src, e.line) << std::endl;
+		for (int i = 1; i < e.pos_start + ln.size(); i++) diag << ' ';
+		for (int i = 0; i < e.pos_end - e.pos_start; i++) diag << '^';
+		if (e.pos_end == e.pos_start) diag << '^';
+		diag << " HERE" << std::endl;
+	}
+}
+
+int driver::compile(const std::string& source, const Options& options, std::ostream& diag, stats::Report* report) {
+	std::filesystem::path path = options.cwd.empty() ? std::filesystem::absolute(source) : std::filesystem::path(options.cwd) / source;
+	std::ifstream file(path);
+	std::string src;
+
+	// exit if file failed to open
+	if (!file.is_open() || !file) {
+		diag << "kite: failed to open file " << source << std::endl;
+		return 1;
+	}
+
+	// read the file into src
+	std::ostringstream ss;
+	ss << file.rdbuf();
+	src = ss.str();
+	if (report) report->source = source;
+
+	// Precompilation section
+	// includes are found relative to the directory of the source
+	std::filesystem::path dir = path.parent_path();
+	stats::Pass precompiling(report, "precompile");
+	// the declarations of the precompiled headers are put in by the parser
+	std::vector<std::shared_ptr<const precompiler::Header>> headers;
+	try {
+		Precompiler pc(dir, diag);
+		size_t bytes = src.size();
+		src = pc.precompile(src);
+		headers = pc.headers();
+		precompiling.stop(bytes, "bytes");
+	}
+	catch (std::runtime_error e) {
+		diag << "kite: " << source << ": precompiler: " << e.what() << std::endl;
+		return 1;
+	}
+
+	// Debugging code to show the modified source
+	// std::cout << src;
+
+	std::error_code ec;
+	std::filesystem::create_directories(dir / "kbuild", ec);
+	std::string projname = path.filename().replace_extension().string();
+	std::string asmPath = (dir / "kbuild" / (projname + ".asm")).string();
+	std::string objPath = (dir / "kbuild" / (projname + ".o")).string();
+	std::string irPath = (dir / "kbuild" / (projname + ".ir")).string();
+
+	// the output only depends on the precompiled source and the options, so an output
+	// compiled before is taken from the cache without lexing, parsing and generating it again
+	std::string outPath = options.emitObj ? objPath : options.emitIr ? irPath : asmPath;
+	std::string key;
+	if (options.cache) {
+		key = options.cache->key(src, std::string(options.emitObj ? "--emit=obj" : options.emitIr ? "--emit=ir" : "--emit=asm") + (options.optimize ? " -O" : ""));
+		if (options.cache->fetch(key, outPath)) {
+			if (report) report->cached = true;
+			return 0;
+		}
+	}
+	auto done = [&]() {
+		if (options.cache) options.cache->store(key, outPath);
+		return 0;
+	};
+	// an output may be a hardlink to a cache entry, so it is replaced and never written through
+	std::filesystem::remove(outPath, ec);
+
+	// every identifier is interned once by the lexer, the later stages refer to names by their IDs
+	lexer::SymbolTable symbols;
+	// the declarations of the precompiled headers, the parser puts them in at their markers
+	std::vector<const std::vector<ktypes::kfndec_t>*> declarations;
+	for (const std::shared_ptr<const precompiler::Header>& header : headers) declarations.push_back(&header->externs);
+	// all syntax tree nodes live in the arena and are freed together when it goes out of scope
+	parser::Arena arena;
+	size_t nodes = 0;
+	auto counted = [&](size_t tokens) {
+		for (size_t t = 0; t < parser::Arena::kinds; t++) nodes += arena.count(t);
+		if (!report) return;
+		report->counts.emplace_back("tokens", tokens);
+		report->counts.emplace_back("nodes", nodes);
+		for (int t = parser::NONE; t <= parser::CDIRECT; t++)
+			if (arena.count(t)) report->nodes.emplace_back(parser::node_name((parser::node_t)t), arena.count(t));
+	};
+	auto emitted = [&](const compiler::Compiler& c) {
+		if (!report) return;
+		report->counts.emplace_back("instructions", c.instructions());
+		report->counts.emplace_back("data entries", c.data_entries());
+		report->counts.emplace_back("spills", c.spills());
+		if (!options.optimize) return;
+		for (int p = 0; p < optimizer::PASSES; p++)
+			report->counts.emplace_back(std::string("ir ") + optimizer::pass_name((optimizer::pass_t)p), c.changes((optimizer::pass_t)p));
+		for (int r = 0; r < compiler::mir::RULES; r++)
+			report->counts.emplace_back(std::string("peephole ") + compiler::mir::rule_name((compiler::mir::rule_t)r), c.rewrites((compiler::mir::rule_t)r));
+	};
+	auto optimized = [&](const optimizer::Folder& f) {
+		if (!report) return;
+		report->counts.emplace_back("folded", f.folded());
+		report->counts.emplace_back("propagated", f.propagated());
+		report->counts.emplace_back("simplified", f.simplified());
+	};
+	// generates the program into `out`, false if it failed (the error is reported)
+	std::function<bool(std::ostream& out)> generate;
+
+	// the tokens refer to `src` for their text, so it has to stay alive until parsing is done
+	std::vector<lexer::Token> tokens;
+	parser::RootNode* root = nullptr;
+	std::vector<ktypes::kfndec_t> signatures;
+	semantics::Checker checker(symbols);
+	if (!options.stream) {
+		// Tokenization section
+		stats::Pass lexing(report, "lex");
+		try {
+			lexer::Lexer lex(src, symbols);
+			tokens = lex.tokenize();
+			lexing.stop(src.size(), "bytes");
+		}
+		catch (errors::kiterr e) {
+			printerr(diag, source, e, "lexer", src);
+			return 1;
+		}
+
+		// Debugging code for printing the tokens generated by the lexer
+		// for (int i = 0; i < tokens.size(); i++) {
+		//		std::cout << i << ": TOKEN(" << tokens[i].type << ", " << tokens[i].value << ", " << lexer::text(tokens[i], src) << ")" << std::endl;
+		// }
+
+		// Parsing section
+		parser::Parser parser(tokens, src, arena, symbols);
+		parser.headers(declarations);
+		stats::Pass parsing(report, "parse");
+		try {
+			// Try parsing and get the reference to the root node in `root`
+			root = parser.parse();
+			parsing.stop(tokens.size(), "tokens");
+		}
+		catch (errors::kiterr e) {
+			printerr(diag, source, e, "parser", src);
+			return 1;
+		}
+
+		// Debugging line for printing the syntax tree
+		// root->print(0);
+
+		counted(tokens.size());
+
+		// Semantics section
+		// the types and the names are resolved once and kept on the nodes for codegen
+		// (the calls point to the declarations of the checker, so it lives as long as the tree)
+		stats::Pass checking(report, "check");
+		try {
+			checker.check(root);
+			checking.stop(nodes, "nodes");
+		}
+		catch (errors::kiterr e) {
+			printerr(diag, source, e, "semantics", src);
+			return 1;
+		}
+
+		// Optimization section
+		if (options.optimize) {
+			stats::Pass optimizing(report, "optimize");
+			optimizer::Folder folder(arena);
+			folder.fold(root);
+			optimizing.stop(nodes, "nodes");
+			optimized(folder);
+		}
+
+		generate = [&](std::ostream& out) {
+			compiler::Compiler compiler(root);
+			compiler.jobs(options.fnJobs);
+			compiler.optimize(options.optimize);
+			compiler.emit_ir(options.emitIr);
+			compiler.stream(out);
+			try {
+				// start code generation
+				compiler.codegen();
+			}
+			catch (errors::kiterr e) {
+				printerr(diag, source, e, "compiler", src);
+				return false;
+			}
+			emitted(compiler);
+			return true;
+		};
+	}
+	else {
+		// with --stream a top-level statement is parsed, generated and written out before the next
+		// one is read, so only the tokens and the tree of one statement are kept at a time
+		// a function may call one defined after it, so a quick pass finds the signatures first
+		lexer::Lexer lex(src, symbols);
+		parser::Parser prescan(lex, src, arena, symbols);
+		prescan.headers(declarations);
+		stats::Pass scanning(report, "prescan");
+		try {
+			signatures = prescan.signatures();
+			scanning.stop(src.size(), "bytes");
+		}
+		catch (errors::kiterr e) {
+			printerr(diag, source, e, prescan.lexer_failed() ? "lexer" : "parser", src);
+			return 1;
+		}
+		generate = [&](std::ostream& out) {
+			lexer::Lexer lex(src, symbols);
+			parser::Parser parser(lex, src, arena, symbols);
+			parser.headers(declarations);
+			// a new checker, generate runs again for the NASM fallback
+			semantics::Checker checker(symbols);
+			checker.declare(signatures);
+			compiler::Compiler compiler;
+			compiler.optimize(options.optimize);
+			compiler.emit_ir(options.emitIr);
+			compiler.stream(out);
+			optimizer::Folder folder(arena);
+			parser::Arena::Mark empty = arena.mark();
+			for (;;) {
+				parser::Node* n;
+				try {
+					n = parser.declaration();
+				}
+				catch (errors::kiterr e) {
+					printerr(diag, source, e, parser.lexer_failed() ? "lexer" : "parser", src);
+					return false;
+				}
+				if (!n) break;
+				try {
+					checker.check(n);
+				}
+				catch (errors::kiterr e) {
+					printerr(diag, source, e, "semantics", src);
+					return false;
+				}
+				if (options.optimize) n = folder.fold(n);
+				try {
+					compiler.codegen(n);
+				}
+				catch (errors::kiterr e) {
+					printerr(diag, source, e, "compiler", src);
+					return false;
+				}
+				// the statement is written out, its nodes are not needed anymore
+				arena.reset(empty);
+			}
+			counted(parser.read());
+			emitted(compiler);
+			if (options.optimize) optimized(folder);
+			return true;
+		};
+	}
+	// with --stream parsing is a part of the generation
+	std::string stage = options.stream ? "parse+codegen" : "codegen";
+
+	if (!options.emitObj) {
+		// the result is streamed to the file as the functions are generated
+		std::ofstream outFile(outPath, std::ios::trunc);
+		if (!outFile) {
+			diag << "kite: failed to open " << outPath << " for writing" << std::endl;
+			return 1;
+		}
+
+		stats::Pass generating(report, stage);
+		if (!generate(outFile)) {
+			// do not leave a partial output behind
+			outFile.close();
+			std::filesystem::remove(outPath, ec);
+			return 1;
+		}
+		generating.stop(options.stream ? src.size() : nodes, options.stream ? "bytes" : "nodes");
+		outFile.close();
+		return done();
+	}
+
+	// with --emit=obj the assembly is streamed into the built-in assembler, a function at a time
+	std::string object;
+	try {
+		assembler::Assembler as;
+		assembler::AsmStreamBuf buf(as);
+		std::ostream text(&buf);
+		// let errors of the assembler through the stream
+		text.exceptions(std::ios::badbit);
+		// the code is assembled while it is generated, so this stage includes the assembler
+		stats::Pass generating(report, stage + "+asm");
+		if (!generate(text)) return 1;
+		buf.finish();
+		generating.stop(options.stream ? src.size() : nodes, options.stream ? "bytes" : "nodes");
+		stats::Pass writing(report, "elf");
+		object = as.object();
+		writing.stop(object.size(), "bytes");
+	}
+	catch (assembler::asmerr e) {
+		if (!e.unsupported) {
+			diag << "kite: " << source << ": assembler: " << e.what() << " at line " << e.line << " of the generated assembly" << std::endl;
+			return 1;
+		}
+		// valid NASM the built-in assembler does not handle (usually an `asm` block), NASM builds it instead
+		std::filesystem::remove(asmPath, ec);
+		std::ofstream outFile(asmPath, std::ios::trunc);
+		if (options.stream) arena.release();
+		stats::Pass generating(report, stage);
+		if (!generate(outFile)) {
+			outFile.close();
+			std::filesystem::remove(asmPath, ec);
+			return 1;
+		}
+		generating.stop(options.stream ? src.size() : nodes, options.stream ? "bytes" : "nodes");
+		outFile.close();
+		stats::Pass assembling(report, "nasm");
+		if (system(("nasm -felf64 -o \"" + objPath + "\" \"" + asmPath + "\"").c_str()) != 0) {
+			diag << "kite: " << source << ": assembler: " << e.what() << " is not supported and nasm failed" << std::endl;
+			return 1;
+		}
+		assembling.stop(std::filesystem::file_size(asmPath, ec), "bytes");
+		return done();
+	}
+
+	std::ofstream objFile(objPath, std::ios::binary | std::ios::trunc);
+	if (!objFile.write(object.data(), object.size())) {
+		diag << "kite: failed to open " << objPath << " for writing" << std::endl;
+		return 1;
+	}
+	objFile.close();
+	return done();
+}
+
+int driver::precompile_header(const std::string& header, const Options& options, std::ostream& diag) {
+	std::filesystem::path path = options.cwd.empty() ? std::filesystem::absolute(header) : std::filesystem::path(options.cwd) / header;
+	std::ifstream file(path);
+	if (!file.is_open() || !file) {
+		diag << "kite: failed to open file " << header << std::endl;
+		return 1;
+	}
+	std::ostringstream ss;
+	ss << file.rdbuf();
+	std::string src = ss.str();
+
+	precompiler::Header result;
+	std::string text;
+	try {
+		// the defines are kept to be defined in the units including the header, the names as
+		// written to find out if a define of such a unit would change the declarations
+		precompiler::Preprocessed scanned = precompiler::Preprocessed::scan(src.data(), src.size());
+		for (const precompiler::Preprocessed::Segment& segment : scanned.segments) {
+			if (segment.kind == precompiler::Preprocessed::Segment::INCLUDE) {
+				diag << "kite: " << header << ": precompiler: a precompiled header can not include other files (" << segment.name << ")" << std::endl;
+				return 1;
+			}
+			if (segment.kind == precompiler::Preprocessed::Segment::DEFINE)
+				result.defines.emplace_back(segment.name, segment.value);
+		}
+		result.lines = (uint32_t)std::count(scanned.text.begin(), scanned.text.end(), '\n');
+		result.names = precompiler::Header::scan_names(scanned.text);
+		text = Precompiler(path.parent_path(), diag).precompile(src);
+	}
+	catch (std::runtime_error e) {
+		diag << "kite: " << header << ": precompiler: " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::vector<lexer::Token> tokens;
+	lexer::SymbolTable symbols;
+	try {
+		tokens = lexer::Lexer(text, symbols).tokenize();
+	}
+	catch (errors::kiterr e) {
+		printerr(diag, header, e, "lexer", text);
+		return 1;
+	}
+	parser::Arena arena;
+	try {
+		parser::RootNode* root = parser::Parser(tokens, text, arena, symbols).parse();
+		for (parser::Node* node : root->statements) {
+			if (node->type != parser::EXTERN)
+				throw errors::kiterr("only extern declarations can be precompiled", node->line, node->pos_start, node->pos_end);
+			for (ktypes::kfndec_t fn : static_cast<parser::ExternNode*>(node)->symbols) {
+				fn.sym = -1;
+				result.externs.push_back(std::move(fn));
+			}
+		}
+	}
+	catch (errors::kiterr e) {
+		printerr(diag, header, e, "parser", text);
+		return 1;
+	}
+
+	// written next to the header and moved in place, a compile reading it never sees half of it
+	std::string compiled = precompiler::Header::path(path.string());
+	std::string temporary = compiled + ".tmp";
+	std::string data = result.serialize();
+	std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+	if (!out.write(data.data(), data.size())) {
+		diag << "kite: failed to open " << compiled << " for writing" << std::endl;
+		return 1;
+	}
+	out.close();
+	std::error_code ec;
+	std::filesystem::rename(temporary, compiled, ec);
+	if (ec) {
+		std::filesystem::remove(temporary, ec);
+		diag << "kite: failed to open " << compiled << " for writing" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int driver::compile_all(const std::vector<std::string>& sources, const Options& options, std::ostream& diag, std::vector<stats::Report>* reports) {
+	if (reports) reports->assign(sources.size(), stats::Report());
+	if (sources.size() == 1) {
+		// the threads are not needed for other files, the functions of this one use them
+		Options single = options;
+		single.fnJobs = std::max(options.jobs, options.fnJobs);
+		int status = compile(sources[0], single, diag, reports ? &(*reports)[0] : nullptr);
+		if (options.cache) options.cache->trim();
+		return status;
+	}
+
+	// every unit writes its diagnostics to its own buffer, they are printed in the order
+	// of the files as soon as all the files before are done
+	struct Unit {
+		std::ostringstream diag;
+		int status = 0;
+		bool done = false;
+	};
+	std::vector<Unit> units(sources.size());
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::atomic<size_t> next{ 0 };
+
+	auto work = [&]() {
+		for (size_t i; (i = next.fetch_add(1)) < sources.size();) {
+			try {
+				units[i].status = compile(sources[i], options, units[i].diag, reports ? &(*reports)[i] : nullptr);
+			}
+			catch (std::exception& e) {
+				// an exception must not end the whole process from a worker thread
+				units[i].diag << "kite: " << sources[i] << ": " << e.what() << std::endl;
+				units[i].status = 1;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			units[i].done = true;
+			finished.notify_one();
+		}
+	};
+
+	size_t threads = std::min<size_t>(std::max(options.jobs, 1), sources.size());
+	std::vector<std::thread> pool;
+	for (size_t i = 0; i < threads; i++) pool.emplace_back(work);
+
+	int status = 0;
+	for (Unit& unit : units) {
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [&] { return unit.done; });
+		lock.unlock();
+		diag << unit.diag.view();
+		status = std::max(status, unit.status);
+	}
+	for (std::thread& t : pool) t.join();
+	if (options.cache) options.cache->trim();
+	return status;
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "../cache/cache.h"
+#include "../stats/stats.h"
+
+// Compilation of whole source files, shared by the command line and the benchmarks
+namespace driver {
+	struct Options {
+		bool emitObj = false;      // write the object file with the built-in assembler instead of the .asm
+		bool emitIr = false;       // write the IR of the functions (.ir) instead of the .asm
+		int jobs = 1;              // amount of files compiled at once
+		int fnJobs = 1;            // threads generating the functions of one file
+		bool stream = false;       // parse, generate and free the top-level statements one at a time
+		bool optimize = false;     // fold constants before generating the code (-O)
+		cache::OutputCache* cache = nullptr; // outputs are looked up in and added to it (if not null)
+		std::string cwd;           // directory relative sources are found in (the working directory if empty)
+	};
+
+	// compile one source file to <its directory>/kbuild/<name>.asm (or .o, or .ir)
+	// every diagnostic is written to `diag`, returns the exit status (0 on success)
+	// nothing here depends on the working directory, so files can be compiled on several threads
+	// the time, throughput and heap use of each stage are added to the report (if not null)
+	int compile(const std::string& source, const Options&, std::ostream& diag, stats::Report* report = nullptr);
+
+	// precompile a header that only declares externs (and defines) to <its name>.kmc
+	// an include of the header then uses the declarations in it while it is newer than the header
+	// every diagnostic is written to `diag`, returns the exit status (0 on success)
+	int precompile_header(const std::string& header, const Options&, std::ostream& diag);
+
+	// compile every source file on `jobs` threads (a single file generates its functions on
+	// them instead), the diagnostics of each file are
+	// written to `diag` in the order of the files, returns the highest exit status
+	// the cache (if any) is trimmed to its size limit at the end, `reports` (if not null) gets
+	// the report of every file
+	int compile_all(const std::vector<std::string>& sources, const Options&, std::ostream& diag, std::vector<stats::Report>* reports = nullptr);
+}
@@ -0,0 +1,657 @@
+#include "builder.h"
+#include <algorithm>
+#include "../compiler/asm.h"
+#include "../errors/errors.h"
+#include "../semantics/semantics.h"
+
+namespace {
+	// bytes between the elements a pointer of the type indexes
+	int stride(ktypes::ktype_t type) {
+		switch (type) {
+		case ktypes::PTR8: return 1;
+		case ktypes::PTR16: return 2;
+		case ktypes::PTR32: return 4;
+		case ktypes::PTR64: return 8;
+		default: return ktypes::size(type);
+		}
+	}
+
+	// the type of the elements a pointer of the type indexes
+	ir::type_t element(ktypes::ktype_t type) {
+		switch (stride(type)) {
+		case 1: return ir::I8;
+		case 2: return ir::I16;
+		case 4: return ir::I32;
+		default: return ir::I64;
+		}
+	}
+
+	uint64_t key(int block, int var) {
+		return (uint64_t)(uint32_t)block << 32 | (uint32_t)var;
+	}
+}
+
+void ir::Builder::function(parser::FnNode* node) {
+	if (node->args.size() > 6)
+		throw errors::kiterr("function " + node->name + " has more than 6 arguments", node->line, node->pos_start, node->pos_end);
+	// a function may be declared inside a block, the one around it goes on after it
+	Function* outerFn = fn;
+	int outerCur = cur, outerDepth = depth;
+	bool outerInFn = inFn, outerOpaque = opaque;
+	ktypes::ktype_t outerReturns = returns;
+	Loop outerLoop = loop;
+	std::vector<Local> outerLocals = std::move(locals);
+	std::vector<bool> outerAddressed = std::move(addressed);
+	std::vector<int> outerLayout = std::move(layout);
+	std::unordered_map<uint64_t, int> outerCurrent = std::move(current);
+	std::vector<char> outerSealed = std::move(sealed);
+	std::vector<std::vector<std::pair<int, int>>> outerIncomplete = std::move(incomplete);
+	std::vector<int> outerForward = std::move(forward);
+
+	Function f;
+	f.label = node->name;
+	f.entry = node->name == "_start";
+	f.args = (int)node->args.size();
+	f.line = node->line;
+	fn = &f;
+	depth = 0;
+	inFn = true;
+	opaque = false;
+	returns = node->returns;
+	loop = Loop();
+	locals.clear();
+	addressed.clear();
+	layout.clear();
+	current.clear();
+	sealed.clear();
+	incomplete.clear();
+	forward.clear();
+	scan(node->root);
+	f.opaque = opaque;
+
+	enter(block(""));
+	seal(cur);
+	// the arguments are the first variables
+	for (int i = 0; i < (int)node->args.size(); i++) {
+		type_t type = type_of(node->args[i].type);
+		int arg = emit(ARG, bytes(type) < 8 ? I64 : type, {}, i);
+		bind(i, node->args[i].type);
+		store(i, arg);
+	}
+	visit_root(node->root);
+	if (!terminated()) emit(RET, VOID);
+	finish();
+	out.push_back(std::move(f));
+
+	fn = outerFn;
+	cur = outerCur;
+	depth = outerDepth;
+	inFn = outerInFn;
+	opaque = outerOpaque;
+	returns = outerReturns;
+	loop = outerLoop;
+	locals = std::move(outerLocals);
+	addressed = std::move(outerAddressed);
+	layout = std::move(outerLayout);
+	current = std::move(outerCurrent);
+	sealed = std::move(outerSealed);
+	incomplete = std::move(outerIncomplete);
+	forward = std::move(outerForward);
+}
+
+void ir::Builder::top(parser::Node* node, Function f) {
+	fn = &f;
+	depth = 0;
+	inFn = false;
+	// the variables are on the stack, where the next statements find them
+	opaque = true;
+	f.opaque = true;
+	f.line = node->line;
+	locals.assign(f.variables.size(), Local());
+	for (size_t i = 0; i < f.variables.size(); i++)
+		if (f.variables[i].slot >= 0) locals[i] = Local{ true, f.variables[i].slot, f.variables[i].type };
+	enter(block(""));
+	seal(cur);
+	visit_node(node);
+	if (!terminated()) emit(RET, VOID);
+	f.variables.resize(locals.size());
+	for (size_t i = 0; i < locals.size(); i++)
+		if (locals[i].bound) f.variables[i] = Variable{ locals[i].slot, locals[i].type };
+	finish();
+	out.push_back(std::move(f));
+	fn = nullptr;
+}
+
+void ir::Builder::scan(parser::Node* node) {
+	switch (node->type) {
+	case parser::ROOT:
+		for (parser::Node* n : static_cast<parser::RootNode*>(node)->statements) scan(n);
+		return;
+	case parser::BINOP:
+		scan(static_cast<parser::BinOpNode*>(node)->left);
+		scan(static_cast<parser::BinOpNode*>(node)->right);
+		return;
+	case parser::CALL:
+		for (parser::Node* arg : static_cast<parser::CallNode*>(node)->args) scan(arg);
+		return;
+	case parser::RETURN:
+		if (returns != ktypes::VOID) scan(static_cast<parser::ReturnNode*>(node)->value);
+		return;
+	case parser::LET:
+		if (!static_cast<parser::LetNode*>(node)->isAlloc) scan(static_cast<parser::LetNode*>(node)->root);
+		return;
+	case parser::IDX:
+		scan(static_cast<parser::IndexNode*>(node)->index);
+		return;
+	case parser::IF: {
+		parser::IfNode* n = static_cast<parser::IfNode*>(node);
+		scan(n->condition);
+		scan(n->block);
+		if (n->has_else_block) scan(n->else_block);
+		return;
+	}
+	case parser::CMP: {
+		parser::CmpNode* n = static_cast<parser::CmpNode*>(node);
+		scan(n->val1);
+		scan(n->val2);
+		for (const auto& [key, root] : n->comparisons) scan(root);
+		return;
+	}
+	case parser::FOR: {
+		parser::ForNode* n = static_cast<parser::ForNode*>(node);
+		scan(n->initVal);
+		scan(n->root);
+		scan(n->stepVal);
+		scan(n->targetVal);
+		return;
+	}
+	case parser::LOOP:
+		scan(static_cast<parser::LoopNode*>(node)->root);
+		return;
+	case parser::ADDROF: {
+		int slot = static_cast<parser::AddrOfNode*>(node)->slot;
+		if (slot >= (int)addressed.size()) addressed.resize(slot + 1);
+		addressed[slot] = true;
+		return;
+	}
+	case parser::ASM:
+	case parser::CDIRECT:
+		opaque = true;
+		return;
+	default:
+		// a nested function is scanned when it is built
+		return;
+	}
+}
+
+void ir::Builder::finish() {
+	if (!forward.empty()) {
+		forward.resize(fn->values.size(), -1);
+		replace(*fn, forward);
+	}
+	reorder(*fn, layout);
+	remove_unreachable(*fn);
+	// a phi may only have become trivial after the ones it merges were replaced, or after the
+	// unreachable blocks it merged a value from were dropped
+	remove_trivial_phis(*fn);
+	compact(*fn);
+}
+
+int ir::Builder::block(const std::string& name) {
+	sealed.push_back(0);
+	incomplete.emplace_back();
+	return fn->block(name);
+}
+
+void ir::Builder::enter(int b) {
+	cur = b;
+	layout.push_back(b);
+}
+
+void ir::Builder::seal(int b) {
+	// the phis made while the predecessors were not known get their operands
+	std::vector<std::pair<int, int>> phis = std::move(incomplete[b]);
+	sealed[b] = 1;
+	for (const auto& [var, phi] : phis) complete(var, phi);
+}
+
+bool ir::Builder::terminated() const {
+	const std::vector<int>& code = fn->blocks[cur].code;
+	return !code.empty() && fn->values[code.back()].terminator();
+}
+
+int ir::Builder::emit(op_t op, type_t type, std::vector<int> ops, int64_t value) {
+	return fn->add(cur, op, type, std::move(ops), value, depth);
+}
+
+void ir::Builder::jump(int target) {
+	if (terminated()) return;
+	fn->values[emit(JMP, VOID)].target[0] = target;
+	fn->blocks[target].preds.push_back(cur);
+}
+
+void ir::Builder::branch(int condition, int then, int otherwise) {
+	Ins& br = fn->values[emit(BR, VOID, { condition })];
+	br.target[0] = then;
+	br.target[1] = otherwise;
+	fn->blocks[then].preds.push_back(cur);
+	fn->blocks[otherwise].preds.push_back(cur);
+}
+
+void ir::Builder::dead() {
+	// the code after a return, break or continue is never run, it is dropped at the end
+	int b = block("unreachable");
+	sealed[b] = 1;
+	enter(b);
+}
+
+int ir::Builder::constant(int64_t value) {
+	return emit(CONST, I64, {}, value);
+}
+
+int ir::Builder::resolve(int value) {
+	while (value < (int)forward.size() && forward[value] >= 0) value = forward[value];
+	return value;
+}
+
+void ir::Builder::write(int var, int b, int value) {
+	current[key(b, var)] = value;
+}
+
+int ir::Builder::read(int var, int b) {
+	auto it = current.find(key(b, var));
+	if (it != current.end()) return resolve(it->second);
+	return read_recursive(var, b);
+}
+
+int ir::Builder::read_recursive(int var, int b) {
+	int value;
+	if (!sealed[b]) {
+		// a loop header, the value coming around the loop is not known yet
+		value = phi(b, var);
+		incomplete[b].emplace_back(var, value);
+	}
+	else if (fn->blocks[b].preds.size() == 1) value = read(var, fn->blocks[b].preds[0]);
+	else if (fn->blocks[b].preds.empty()) {
+		// read before it is set (only in code that is never run), the value does not matter
+		value = fn->insert(0, 0, CONST, I64);
+	}
+	else {
+		// the phi is the value while the predecessors are asked, which ends the search around a loop
+		value = phi(b, var);
+		write(var, b, value);
+		value = complete(var, value);
+	}
+	write(var, b, value);
+	return value;
+}
+
+int ir::Builder::phi(int b, int var) {
+	return fn->insert(b, 0, PHI, type_of(locals[var].type));
+}
+
+int ir::Builder::complete(int var, int phi) {
+	int b = fn->values[phi].block;
+	for (size_t i = 0; i < fn->blocks[b].preds.size(); i++) {
+		int value = read(var, fn->blocks[b].preds[i]);
+		fn->values[phi].ops.push_back(value);
+	}
+	return trivial(phi);
+}
+
+int ir::Builder::trivial(int phi) {
+	int same = -1;
+	for (int o : fn->values[phi].ops) {
+		o = resolve(o);
+		if (o == same || o == phi) continue;
+		// it merges two values
+		if (same >= 0) return phi;
+		same = o;
+	}
+	if (same < 0) return phi;
+	if (phi >= (int)forward.size()) forward.resize(fn->values.size(), -1);
+	forward[phi] = same;
+	fn->values[phi].op = NOP;
+	fn->values[phi].block = -1;
+	return same;
+}
+
+ir::Builder::Local& ir::Builder::bind(int slot, ktypes::ktype_t type) {
+	if (slot >= (int)locals.size()) locals.resize(slot + 1);
+	Local& local = locals[slot];
+	local = Local();
+	local.bound = true;
+	local.type = type;
+	// a variable the asm blocks may use or whose address is taken stays on the stack
+	if (opaque || (slot < (int)addressed.size() && addressed[slot])) local.slot = fn->slot(8);
+	return local;
+}
+
+const ir::Builder::Local& ir::Builder::variable(int slot, parser::Node* at) {
+	// the variables of an outer function are not reachable from a nested one
+	if (slot < 0 || slot >= (int)locals.size() || !locals[slot].bound)
+		throw errors::kiterr("variable is not present in this function", at->line, at->pos_start, at->pos_end);
+	return locals[slot];
+}
+
+int ir::Builder::load(int slot, parser::Node* at) {
+	const Local& local = variable(slot, at);
+	// asm blocks may have written the whole slot, a narrow value is cut again where it is stored
+	type_t type = type_of(local.type);
+	if (local.slot >= 0) return emit(GET, bytes(type) < 8 ? I64 : type, {}, local.slot);
+	return read(slot, cur);
+}
+
+void ir::Builder::store(int slot, int value) {
+	const Local& local = locals[slot];
+	// the slot always holds the whole zero extended value
+	if (local.slot >= 0) {
+		emit(SET, VOID, { narrow(value, local.type) }, local.slot);
+		return;
+	}
+	type_t type = type_of(local.type);
+	write(slot, cur, bytes(type) < 8 ? narrow(value, local.type) : emit(COPY, type, { value }));
+}
+
+int ir::Builder::narrow(int value, ktypes::ktype_t type) {
+	type_t t = type_of(type);
+	if (t == VOID || bytes(t) == 8) return value;
+	return emit(TRUNC, t, { value });
+}
+
+void ir::Builder::visit_node(parser::Node* node) {
+	switch (node->type) {
+	case parser::EXTERN:
+		for (const ktypes::kfndec_t& symbol : static_cast<parser::ExternNode*>(node)->symbols)
+			fn->directives.push_back("extern " + symbol.name);
+		return;
+	case parser::GLOBAL:
+		for (const std::string& symbol : static_cast<parser::GlobalNode*>(node)->symbols)
+			fn->directives.push_back("global " + symbol);
+		return;
+	case parser::FN: return function(static_cast<parser::FnNode*>(node));
+	case parser::RETURN: return visit_return(static_cast<parser::ReturnNode*>(node));
+	case parser::BREAK:
+		if (loop.end < 0)
+			throw errors::kiterr("break outside of a loop", node->line, node->pos_start, node->pos_end);
+		jump(loop.end);
+		return dead();
+	case parser::CONTINUE:
+		if (loop.next < 0)
+			throw errors::kiterr("continue outside of a loop", node->line, node->pos_start, node->pos_end);
+		jump(loop.next);
+		return dead();
+	case parser::LET: return visit_let(static_cast<parser::LetNode*>(node));
+	case parser::ROOT: return visit_root(static_cast<parser::RootNode*>(node));
+	case parser::CMP: return visit_cmp(static_cast<parser::CmpNode*>(node));
+	case parser::IF: return visit_if(static_cast<parser::IfNode*>(node));
+	case parser::ASM:
+		emit(ASM, VOID, {}, fn->name(static_cast<parser::AsmNode*>(node)->content));
+		return;
+	case parser::FOR: return visit_for(static_cast<parser::ForNode*>(node));
+	case parser::LOOP: return visit_loop(static_cast<parser::LoopNode*>(node));
+	case parser::CDIRECT: return visit_cdirect(static_cast<parser::CompDirectNode*>(node));
+	// an expression statement, its value is not used
+	default: visit_expr(node);
+	}
+}
+
+void ir::Builder::visit_root(parser::RootNode* node) {
+	for (parser::Node* n : node->statements) visit_node(n);
+}
+
+void ir::Builder::visit_return(parser::ReturnNode* node) {
+	if (!inFn)
+		throw errors::kiterr("return outside of a function", node->line, node->pos_start, node->pos_end);
+	if (returns != ktypes::VOID) emit(RET, VOID, { narrow(visit_expr(node->value), returns) });
+	else emit(RET, VOID);
+	dead();
+}
+
+void ir::Builder::visit_if(parser::IfNode* node) {
+	int id = labels++;
+	int condition = visit_expr(node->condition);
+	int onTrue = block("if_true_" + std::to_string(id));
+	int onElse = node->has_else_block ? block("if_else_" + std::to_string(id)) : -1;
+	int end = block("if_end_" + std::to_string(id));
+	branch(condition, onTrue, node->has_else_block ? onElse : end);
+	seal(onTrue);
+	enter(onTrue);
+	visit_node(node->block);
+	jump(end);
+	if (node->has_else_block) {
+		seal(onElse);
+		enter(onElse);
+		visit_node(node->else_block);
+		jump(end);
+	}
+	seal(end);
+	enter(end);
+}
+
+void ir::Builder::visit_cmp(parser::CmpNode* node) {
+	static const std::pair<const char*, cond_t> keywords[] = { { "eq", EQ }, { "neq", NE } };
+	int left = visit_expr(node->val1);
+	int right = visit_expr(node->val2);
+	int id = labels++;
+	std::vector<cond_t> conditions;
+	for (const auto& [k, root] : node->comparisons) {
+		auto cc = std::find_if(std::begin(keywords), std::end(keywords), [&](const auto& kw) { return k == kw.first; });
+		if (cc == std::end(keywords))
+			throw errors::kiterr("unknown comparison " + k, node->line, node->pos_start, node->pos_end);
+		conditions.push_back(cc->second);
+	}
+	// the first comparison that holds runs its block
+	std::vector<int> blocks;
+	for (const auto& [k, root] : node->comparisons) blocks.push_back(block(k + "_block_" + std::to_string(id)));
+	int end = block("end_" + std::to_string(id));
+	size_t i = 0;
+	for (const auto& [k, root] : node->comparisons) {
+		int holds = emit(CMP, I1, { left, right });
+		fn->values[holds].cc = conditions[i];
+		int next = i + 1 < blocks.size() ? block(k + "_else_" + std::to_string(id)) : end;
+		branch(holds, blocks[i], next);
+		seal(blocks[i]);
+		if (next != end) {
+			seal(next);
+			enter(next);
+		}
+		i++;
+	}
+	if (blocks.empty()) jump(end);
+	i = 0;
+	for (const auto& [k, root] : node->comparisons) {
+		enter(blocks[i++]);
+		visit_node(root);
+		jump(end);
+	}
+	seal(end);
+	enter(end);
+}
+
+void ir::Builder::visit_loop(parser::LoopNode* node) {
+	int id = labels++;
+	int start = block("loop_" + std::to_string(id));
+	int end = block("loop_end_" + std::to_string(id));
+	jump(start);
+	enter(start);
+	// the loop around it goes on after it
+	Loop outerLoop = loop;
+	loop = Loop{ start, end };
+	visit_node(node->root);
+	jump(start);
+	loop = outerLoop;
+	seal(start);
+	seal(end);
+	enter(end);
+}
+
+void ir::Builder::visit_for(parser::ForNode* node) {
+	int id = labels++;
+	int start = block("loop_" + std::to_string(id));
+	int next = block("loop_next_" + std::to_string(id));
+	int end = block("loop_end_" + std::to_string(id));
+	int init = visit_expr(node->initVal);
+	bind(node->slot, ktypes::INT64);
+	store(node->slot, init);
+	jump(start);
+	enter(start);
+
+	Loop outerLoop = loop;
+	loop = Loop{ next, end };
+	visit_node(node->root);
+	loop = outerLoop;
+
+	// continue steps the iterator too
+	jump(next);
+	seal(next);
+	enter(next);
+	int step = visit_expr(node->stepVal);
+	store(node->slot, emit(ADD, I64, { load(node->slot, node), step }));
+	int target = visit_expr(node->targetVal);
+	int done = emit(CMP, I1, { load(node->slot, node), target });
+	fn->values[done].cc = GT;
+	branch(done, end, start);
+	seal(start);
+	seal(end);
+	enter(end);
+}
+
+void ir::Builder::visit_let(parser::LetNode* node) {
+	if (node->isAlloc) {
+		int allocationSize = node->allocVal * ktypes::size(node->varType);
+		// the array is a slot of the frame, aligned to 16 bytes
+		int array = fn->slot(std::max((allocationSize + 15) & ~15, 0), 16);
+		int pointer = emit(ADDR, PTR, {}, array);
+		bind(node->slot, semantics::pointer_to(node->varType));
+		store(node->slot, pointer);
+	}
+	else {
+		int value = visit_expr(node->root);
+		bind(node->slot, node->varType);
+		store(node->slot, value);
+	}
+}
+
+void ir::Builder::visit_cdirect(parser::CompDirectNode* node) {
+	if (node->name == "stackszinc")
+		depth += node->val;
+	else if (node->name == "stackszdec")
+		depth -= node->val;
+	else
+		throw errors::kiterr("Invalid compiler directive " + node->name, node->line, node->pos_start, node->pos_end);
+}
+
+int ir::Builder::visit_expr(parser::Node* node) {
+	switch (node->type) {
+	case parser::CALL: return visit_call(static_cast<parser::CallNode*>(node));
+	case parser::INT_LIT: return constant(static_cast<parser::IntLitNode*>(node)->value);
+	case parser::CHAR_LIT: return constant((int)static_cast<parser::CharLitNode*>(node)->value);
+	case parser::REG: {
+		parser::RegNode* n = static_cast<parser::RegNode*>(node);
+		compiler::Reg source = compiler::reg_from_name(n->value);
+		if (source.none())
+			throw errors::kiterr("unknown register " + n->value, n->line, n->pos_start, n->pos_end);
+		return emit(REG, source.size == 1 ? I8 : source.size == 2 ? I16 : source.size == 4 ? I32 : I64, {}, source.id);
+	}
+	case parser::STRING_LIT: {
+		std::string label = "datasec_" + chunk + "_" + std::to_string(strings++);
+		fn->strings.emplace_back(label, static_cast<parser::StringLitNode*>(node)->value);
+		return emit(STR, PTR, {}, (int64_t)fn->strings.size() - 1);
+	}
+	case parser::VAR: {
+		parser::VarNode* n = static_cast<parser::VarNode*>(node);
+		return load(n->slot, n);
+	}
+	case parser::IDX: {
+		parser::IndexNode* n = static_cast<parser::IndexNode*>(node);
+		int address = visit_element(n);
+		return emit(LOAD, element(variable(n->slot, n).type), { address });
+	}
+	case parser::BINOP: return visit_binop(static_cast<parser::BinOpNode*>(node));
+	case parser::ADDROF: {
+		parser::AddrOfNode* n = static_cast<parser::AddrOfNode*>(node);
+		const Local& local = variable(n->slot, n);
+		if (local.slot < 0)
+			throw errors::kiterr("cannot take the address of " + n->name, n->line, n->pos_start, n->pos_end);
+		return emit(ADDR, PTR, {}, local.slot);
+	}
+	case parser::DEREF: {
+		parser::DerefNode* n = static_cast<parser::DerefNode*>(node);
+		return emit(LOAD, element(variable(n->slot, n).type), { load(n->slot, n) });
+	}
+	default: throw errors::kiterr("unsupported keyword " + std::to_string(node->type), node->line, node->pos_start, node->pos_end);
+	}
+}
+
+int ir::Builder::visit_element(parser::IndexNode* node) {
+	int index = visit_expr(node->index);
+	const Local& local = variable(node->slot, node);
+	int offset = emit(MUL, I64, { index, constant(stride(local.type)) });
+	return emit(ADD, PTR, { offset, load(node->slot, node) });
+}
+
+int ir::Builder::visit_call(parser::CallNode* node) {
+	// the arguments were checked against the declaration
+	const ktypes::kfndec_t& decl = *node->decl;
+	if (node->args.size() > 6)
+		throw errors::kiterr("more than 6 arguments given to function " + node->routine, node->line, node->pos_start, node->pos_end);
+	std::vector<int> args;
+	for (parser::Node* arg : node->args) args.push_back(visit_expr(arg));
+	for (size_t i = 0; i < args.size(); i++)
+		args[i] = narrow(args[i], i < decl.argtps.size() ? decl.argtps[i] : ktypes::INT64);
+	return emit(CALL, I64, std::move(args), fn->name(node->routine));
+}
+
+int ir::Builder::visit_binop(parser::BinOpNode* node) {
+	if (node->operation == lexer::EQ) return visit_assign(node);
+	// the parser already nested the operands by precedence, the left one is computed first
+	int left = visit_expr(node->left);
+	op_t op;
+	cond_t cc = EQ;
+	switch (node->operation) {
+	case lexer::PLUS: op = ADD; break;
+	case lexer::MINUS: op = SUB; break;
+	case lexer::MUL: op = MUL; break;
+	case lexer::DIV: op = DIV; break;
+	case lexer::MOD: op = MOD; break;
+	case lexer::EQEQ: op = CMP; cc = EQ; break;
+	case lexer::NEQEQ: op = CMP; cc = NE; break;
+	case lexer::GT: op = CMP; cc = GT; break;
+	case lexer::LT: op = CMP; cc = LT; break;
+	case lexer::GTE: op = CMP; cc = GE; break;
+	case lexer::LTE: op = CMP; cc = LE; break;
+	default: throw errors::kiterr("unsupported operator", node->line, node->pos_start, node->pos_end);
+	}
+	int right = visit_expr(node->right);
+	int value = emit(op, op == CMP ? I1 : I64, { left, right });
+	fn->values[value].cc = cc;
+	return value;
+}
+
+int ir::Builder::visit_assign(parser::BinOpNode* node) {
+	// the value is computed before the place it is stored to
+	int value = visit_expr(node->right);
+	switch (node->left->type) {
+	case parser::VAR: {	// regular variable (x)
+		parser::VarNode* n = static_cast<parser::VarNode*>(node->left);
+		variable(n->slot, n);
+		store(n->slot, value);
+		break;
+	}
+	case parser::DEREF: {	// variable dereference pointer (*x)
+		parser::DerefNode* n = static_cast<parser::DerefNode*>(node->left);
+		emit(STORE, VOID, { load(n->slot, n), value }, element(variable(n->slot, n).type));
+		break;
+	}
+	case parser::IDX: {	// index access pointer (x[i])
+		parser::IndexNode* n = static_cast<parser::IndexNode*>(node->left);
+		int address = visit_element(n);
+		emit(STORE, VOID, { address, value }, element(variable(n->slot, n).type));
+		break;
+	}
+	default:
+		throw errors::kiterr("invalid lhs of assignment", node->left->line, node->left->pos_start, node->left->pos_end);
+	}
+	return value;
+}
\ No newline at end of file
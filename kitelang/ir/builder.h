@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ir.h"
+#include "../parser/node.h"
+
+namespace ir {
+	// Builder
+	// makes the IR of the functions and of the top-level statements from the checked tree
+	// the variables of a function become SSA values while the code is built ("Simple and Efficient
+	// Construction of Static Single Assignment Form", Braun et al.): a read finds the value the
+	// variable got last in its block or asks the predecessors, a block that may still get
+	// predecessors (a loop header) gets phis that are completed when it is sealed, and a phi that
+	// only merges one value is replaced by it
+	// the variables whose address is taken, and all of a function with asm blocks (which may read
+	// them on the stack), stay in stack slots
+	class Builder {
+	private:
+		std::vector<Function>& out;					// the functions built, a nested one before the one around it
+		int& labels;								// numbers the blocks, per top-level function
+		const std::string& chunk;					// the top-level function, names the strings
+		int& strings;								// strings of the top-level function so far
+
+		Function* fn = nullptr;
+		int cur = -1;								// the block instructions are added to
+		int depth = 0;								// bytes pushed by asm blocks (@stackszinc)
+		bool inFn = false;
+		bool opaque = false;
+		ktypes::ktype_t returns = ktypes::ANY;		// return type of the current function
+		// the innermost loop, break and continue go to its blocks
+		struct Loop {
+			int next = -1;
+			int end = -1;
+		} loop;
+		struct Local {
+			bool bound = false;
+			int slot = -1;							// the stack slot it is in, -1 for an SSA variable
+			ktypes::ktype_t type = ktypes::ANY;
+		};
+		std::vector<Local> locals;					// by slot of the checker
+		std::vector<bool> addressed;				// per variable, its address is taken
+		std::vector<int> layout;					// the blocks in the order they were entered
+
+		// SSA construction
+		std::unordered_map<uint64_t, int> current;	// (block, variable): the value it has at the end of the block so far
+		std::vector<char> sealed;					// per block, all its predecessors are known
+		std::vector<std::vector<std::pair<int, int>>> incomplete;	// per block, (variable, phi) to complete when it is sealed
+		std::vector<int> forward;					// per value, the one a trivial phi was replaced by (-1 if none)
+
+		void scan(parser::Node*);					// find the asm blocks and the variables whose address is taken
+		void finish();								// forwards the trivial phis, drops the unreachable code
+
+		int block(const std::string& name);
+		void enter(int block);
+		void seal(int block);
+		bool terminated() const;
+		int emit(op_t, type_t, std::vector<int> ops = {}, int64_t value = 0);
+		void jump(int target);
+		void branch(int condition, int then, int otherwise);
+		void dead();								// goes on in a block nothing jumps to
+		int constant(int64_t value);
+
+		int resolve(int value);
+		void write(int var, int block, int value);
+		int read(int var, int block);
+		int read_recursive(int var, int block);
+		int phi(int block, int var);
+		int complete(int var, int phi);				// adds the operands from the predecessors
+		int trivial(int phi);						// the value replacing the phi, or the phi
+
+		Local& bind(int slot, ktypes::ktype_t type);	// a new variable
+		const Local& variable(int slot, parser::Node* at);	// throws if it is not a variable of this function
+		int load(int slot, parser::Node* at);
+		void store(int slot, int value);
+		int narrow(int value, ktypes::ktype_t type);	// the value cut to the type
+
+		// statements
+		void visit_node(parser::Node*);
+		void visit_root(parser::RootNode*);
+		void visit_return(parser::ReturnNode*);
+		void visit_cmp(parser::CmpNode*);
+		void visit_if(parser::IfNode*);
+		void visit_for(parser::ForNode*);
+		void visit_loop(parser::LoopNode*);
+		void visit_let(parser::LetNode*);
+		void visit_cdirect(parser::CompDirectNode*);
+
+		// expressions, each returns its value
+		int visit_expr(parser::Node*);
+		int visit_call(parser::CallNode*);
+		int visit_binop(parser::BinOpNode*);
+		int visit_assign(parser::BinOpNode*);
+		int visit_element(parser::IndexNode*);		// the address of the element
+	public:
+		Builder(std::vector<Function>& out, int& labels, const std::string& chunk, int& strings)
+			: out(out), labels(labels), chunk(chunk), strings(strings) {}
+		// the function, and the ones nested in it before it
+		void function(parser::FnNode*);
+		// a top-level statement into `f`, which has the variables of the statements before it in
+		// slots above its frame (f.variables), the ones it declares are added to them
+		void top(parser::Node*, Function f);
+	};
+}
@@ -0,0 +1,468 @@
+#include "ir.h"
+#include <algorithm>
+#include "../compiler/asm.h"
+
+const char* ir::type_name(type_t type) {
+	static const char* names[] = { "void", "i1", "i8", "i16", "i32", "i64", "ptr" };
+	return names[type];
+}
+
+ir::type_t ir::type_of(ktypes::ktype_t type) {
+	switch (type) {
+	case ktypes::VOID: return VOID;
+	case ktypes::ANY: return I64;
+	case ktypes::PTR8:
+	case ktypes::PTR16:
+	case ktypes::PTR32:
+	case ktypes::PTR64: return PTR;
+	default: break;
+	}
+	switch (ktypes::size(type)) {
+	case 1: return I8;
+	case 2: return I16;
+	case 4: return I32;
+	default: return I64;
+	}
+}
+
+int ir::bytes(type_t type) {
+	switch (type) {
+	case VOID: return 0;
+	case I1:
+	case I8: return 1;
+	case I16: return 2;
+	case I32: return 4;
+	default: return 8;
+	}
+}
+
+const char* ir::op_name(op_t op) {
+	static const char* names[] = {
+		"const", "arg", "reg", "str", "addr", "copy", "add", "sub", "mul", "div", "mod", "cmp", "trunc",
+		"load", "store", "get", "set", "call", "asm", "phi", "jmp", "br", "ret", "nop",
+	};
+	return names[op];
+}
+
+const char* ir::cond_name(cond_t cc) {
+	static const char* names[] = { "eq", "ne", "lt", "ge", "le", "gt" };
+	return names[cc];
+}
+
+int ir::Function::add(int block, op_t op, type_t type, std::vector<int> ops, int64_t value, int depth) {
+	Ins ins;
+	ins.op = op;
+	ins.type = type;
+	ins.block = block;
+	ins.depth = depth;
+	ins.value = value;
+	ins.ops = std::move(ops);
+	values.push_back(std::move(ins));
+	blocks[block].code.push_back((int)values.size() - 1);
+	return (int)values.size() - 1;
+}
+
+int ir::Function::insert(int block, size_t at, op_t op, type_t type, std::vector<int> ops, int64_t value) {
+	Ins ins;
+	ins.op = op;
+	ins.type = type;
+	ins.block = block;
+	ins.value = value;
+	ins.ops = std::move(ops);
+	values.push_back(std::move(ins));
+	std::vector<int>& code = blocks[block].code;
+	code.insert(code.begin() + at, (int)values.size() - 1);
+	return (int)values.size() - 1;
+}
+
+int ir::Function::successors(int block, int out[2]) const {
+	const std::vector<int>& code = blocks[block].code;
+	if (code.empty()) return 0;
+	const Ins& t = values[code.back()];
+	switch (t.op) {
+	case JMP:
+		out[0] = t.target[0];
+		return 1;
+	case BR:
+		out[0] = t.target[0];
+		out[1] = t.target[1];
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+bool ir::pure(const Ins& ins) {
+	switch (ins.op) {
+	case CONST:
+	case STR:
+	case ADDR:
+	case COPY:
+	case ADD:
+	case SUB:
+	case MUL:
+	case CMP:
+	case TRUNC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+std::vector<int> ir::reverse_postorder(const Function& fn) {
+	std::vector<int> order;
+	std::vector<char> seen(fn.blocks.size(), 0);
+	// an explicit stack of (block, successors visited)
+	std::vector<std::pair<int, int>> stack{ { 0, 0 } };
+	seen[0] = 1;
+	while (!stack.empty()) {
+		auto& [b, i] = stack.back();
+		int succ[2];
+		int n = fn.successors(b, succ);
+		if (i < n) {
+			int s = succ[i++];
+			if (!seen[s]) {
+				seen[s] = 1;
+				stack.push_back({ s, 0 });
+			}
+			continue;
+		}
+		order.push_back(b);
+		stack.pop_back();
+	}
+	std::reverse(order.begin(), order.end());
+	return order;
+}
+
+std::vector<int> ir::dominators(const Function& fn, const std::vector<int>& order) {
+	// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+	std::vector<int> rank(fn.blocks.size(), -1), idom(fn.blocks.size(), -1);
+	for (size_t i = 0; i < order.size(); i++) rank[order[i]] = (int)i;
+	if (order.empty()) return idom;
+	idom[order[0]] = order[0];
+	auto intersect = [&](int a, int b) {
+		while (a != b) {
+			while (rank[a] > rank[b]) a = idom[a];
+			while (rank[b] > rank[a]) b = idom[b];
+		}
+		return a;
+	};
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (size_t i = 1; i < order.size(); i++) {
+			int b = order[i], dom = -1;
+			for (int p : fn.blocks[b].preds) {
+				if (rank[p] < 0 || idom[p] < 0) continue;
+				dom = dom < 0 ? p : intersect(p, dom);
+			}
+			if (dom != idom[b]) {
+				idom[b] = dom;
+				changed = true;
+			}
+		}
+	}
+	idom[order[0]] = -1;
+	return idom;
+}
+
+size_t ir::remove_unreachable(Function& fn) {
+	std::vector<char> reached(fn.blocks.size(), 0);
+	for (int b : reverse_postorder(fn)) reached[b] = 1;
+	size_t removed = 0;
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		Block& block = fn.blocks[b];
+		if (block.removed) continue;
+		if (!reached[b]) {
+			for (int v : block.code) {
+				fn.values[v].op = NOP;
+				fn.values[v].block = -1;
+			}
+			block.code.clear();
+			block.preds.clear();
+			block.removed = true;
+			removed++;
+			continue;
+		}
+		// the phis lose the operands of the predecessors that are gone
+		size_t kept = 0;
+		for (size_t i = 0; i < block.preds.size(); i++) {
+			if (!reached[block.preds[i]]) continue;
+			for (int v : block.code) {
+				Ins& phi = fn.values[v];
+				if (phi.op == NOP) continue;
+				if (phi.op != PHI) break;
+				phi.ops[kept] = phi.ops[i];
+			}
+			block.preds[kept++] = block.preds[i];
+		}
+		if (kept == block.preds.size()) continue;
+		block.preds.resize(kept);
+		for (int v : block.code) {
+			if (fn.values[v].op == NOP) continue;
+			if (fn.values[v].op != PHI) break;
+			fn.values[v].ops.resize(kept);
+		}
+	}
+	return removed;
+}
+
+void ir::compact(Function& fn) {
+	std::vector<int> blockMap(fn.blocks.size(), -1), valueMap(fn.values.size(), -1);
+	int blocks = 0, values = 0;
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		if (fn.blocks[b].removed) continue;
+		blockMap[b] = blocks++;
+		for (int v : fn.blocks[b].code)
+			if (fn.values[v].op != NOP) valueMap[v] = values++;
+	}
+	std::vector<Ins> code(values);
+	std::vector<Block> layout;
+	layout.reserve(blocks);
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		Block& block = fn.blocks[b];
+		if (block.removed) continue;
+		Block moved{ std::move(block.name) };
+		moved.loop = block.loop;
+		for (int v : block.code) {
+			if (valueMap[v] < 0) continue;
+			Ins& ins = code[valueMap[v]] = std::move(fn.values[v]);
+			ins.block = blockMap[b];
+			for (int& o : ins.ops) o = valueMap[o];
+			for (int& t : ins.target)
+				if (t >= 0) t = blockMap[t];
+			moved.code.push_back(valueMap[v]);
+		}
+		for (int p : block.preds) moved.preds.push_back(blockMap[p]);
+		layout.push_back(std::move(moved));
+	}
+	fn.values = std::move(code);
+	fn.blocks = std::move(layout);
+}
+
+void ir::split_critical_edges(Function& fn) {
+	size_t count = fn.blocks.size();
+	for (size_t b = 0; b < count; b++) {
+		if (fn.blocks[b].removed || fn.blocks[b].code.empty()) continue;
+		int t = fn.blocks[b].code.back();
+		if (fn.values[t].op != BR) continue;
+		for (int k = 0; k < 2; k++) {
+			int s = fn.values[t].target[k];
+			// only the edges into blocks with phis need a place of their own
+			const Block& succ = fn.blocks[s];
+			if (succ.code.empty() || fn.values[succ.code[0]].op != PHI) continue;
+			size_t i = std::find(succ.preds.begin(), succ.preds.end(), (int)b) - succ.preds.begin();
+			int edge = fn.block(fn.blocks[s].name + "_from_" + std::to_string(i));
+			int jmp = fn.add(edge, JMP, VOID);
+			fn.values[jmp].target[0] = s;
+			fn.values[jmp].depth = fn.values[t].depth;
+			fn.blocks[edge].preds.push_back((int)b);
+			fn.blocks[s].preds[i] = edge;
+			fn.values[t].target[k] = edge;
+		}
+	}
+	if (fn.blocks.size() == count) return;
+	// an edge block is laid out right after the block it leaves
+	std::vector<int> order;
+	std::vector<std::vector<int>> after(count);
+	for (size_t e = count; e < fn.blocks.size(); e++) after[fn.blocks[e].preds[0]].push_back((int)e);
+	for (size_t b = 0; b < count; b++) {
+		order.push_back((int)b);
+		for (int e : after[b]) order.push_back(e);
+	}
+	reorder(fn, order);
+}
+
+void ir::reorder(Function& fn, const std::vector<int>& order) {
+	std::vector<int> rank(fn.blocks.size(), -1);
+	int n = 0;
+	for (int b : order) rank[b] = n++;
+	for (int& r : rank)
+		if (r < 0) r = n++;
+	std::vector<Block> layout(fn.blocks.size());
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		Block& block = fn.blocks[b];
+		for (int& p : block.preds) p = rank[p];
+		for (int v : block.code) {
+			Ins& ins = fn.values[v];
+			if (ins.op == NOP) continue;
+			ins.block = rank[b];
+			for (int& target : ins.target)
+				if (target >= 0) target = rank[target];
+		}
+		layout[rank[b]] = std::move(block);
+	}
+	fn.blocks = std::move(layout);
+}
+
+size_t ir::replace(Function& fn, std::vector<int>& map) {
+	// follows the chain to its end, pointing everything on it to the end
+	auto find = [&](int v) {
+		int end = v;
+		while (map[end] >= 0 && map[end] != end) end = map[end];
+		while (v != end) {
+			int next = map[v];
+			map[v] = end;
+			v = next;
+		}
+		return end;
+	};
+	size_t replaced = 0;
+	for (Block& block : fn.blocks) {
+		if (block.removed) continue;
+		for (int v : block.code)
+			for (int& o : fn.values[v].ops) {
+				if (map[o] < 0 || map[o] == o) continue;
+				o = find(o);
+				replaced++;
+			}
+	}
+	return replaced;
+}
+
+size_t ir::remove_trivial_phis(Function& fn) {
+	std::vector<int> map(fn.values.size(), -1);
+	auto resolve = [&](int v) {
+		while (map[v] >= 0) v = map[v];
+		return v;
+	};
+	size_t removed = 0;
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (Block& block : fn.blocks) {
+			for (int v : block.code) {
+				Ins& phi = fn.values[v];
+				if (phi.op == NOP) continue;
+				if (phi.op != PHI) break;
+				int same = -1;
+				bool trivial = true;
+				for (int o : phi.ops) {
+					o = resolve(o);
+					if (o == v || o == same) continue;
+					if (same >= 0) {
+						trivial = false;
+						break;
+					}
+					same = o;
+				}
+				// a phi only merging itself is in a loop nothing enters with a value
+				if (!trivial || same < 0) continue;
+				map[v] = same;
+				phi.op = NOP;
+				phi.block = -1;
+				removed++;
+				changed = true;
+			}
+		}
+	}
+	if (removed) replace(fn, map);
+	return removed;
+}
+
+namespace {
+	void quoted(std::string& out, const std::string& s) {
+		out += '"';
+		for (char c : s) {
+			if (c == '"' || c == '\\') out += '\\';
+			out += c;
+		}
+		out += '"';
+	}
+
+	void block_name(std::string& out, const ir::Function& fn, int b) {
+		out += fn.blocks[b].name.empty() ? "entry" : fn.blocks[b].name;
+	}
+}
+
+void ir::print(const Function& fn, std::string& out) {
+	if (fn.label.empty()) out += "top-level code";
+	else {
+		out += "function ";
+		out += fn.label;
+		out += ", " + std::to_string(fn.args) + (fn.args == 1 ? " argument" : " arguments");
+	}
+	if (fn.opaque) out += ", variables on the stack (asm)";
+	out += '\n';
+	for (size_t s = 0; s < fn.slots.size(); s++) {
+		out += "\tslot $" + std::to_string(s) + ": " + std::to_string(fn.slots[s].size) + " bytes";
+		if (fn.slots[s].align != 8) out += ", align " + std::to_string(fn.slots[s].align);
+		if (fn.slots[s].above >= 0) out += ", " + std::to_string(fn.slots[s].above) + " above the frame";
+		out += '\n';
+	}
+	for (const auto& [label, text] : fn.strings) {
+		out += "\tstring " + label + " ";
+		quoted(out, text);
+		out += '\n';
+	}
+
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		const Block& block = fn.blocks[b];
+		if (block.removed) continue;
+		block_name(out, fn, (int)b);
+		out += ':';
+		if (block.loop) out += "\t\t; loop";
+		if (!block.preds.empty()) {
+			out += block.loop ? ", from " : "\t\t; from ";
+			for (size_t i = 0; i < block.preds.size(); i++) {
+				if (i) out += ", ";
+				block_name(out, fn, block.preds[i]);
+			}
+		}
+		out += '\n';
+		for (int v : block.code) {
+			const Ins& ins = fn.values[v];
+			out += '\t';
+			if (ins.type != VOID) {
+				out += '%' + std::to_string(v) + " = ";
+				out += type_name(ins.type);
+				out += ' ';
+			}
+			out += op_name(ins.op);
+			switch (ins.op) {
+			case CONST:
+			case ARG:
+				out += ' ' + std::to_string(ins.value);
+				break;
+			case REG:
+				out += ' ';
+				out += compiler::name(compiler::Reg((compiler::reg_t)ins.value, bytes(ins.type)));
+				break;
+			case STR:
+				out += ' ' + fn.strings[ins.value].first;
+				break;
+			case ADDR:
+			case GET:
+			case SET:
+				out += " $" + std::to_string(ins.value);
+				break;
+			case CMP:
+				out += ' ';
+				out += cond_name(ins.cc);
+				break;
+			case STORE:
+				out += ' ';
+				out += type_name((type_t)ins.value);
+				break;
+			case CALL:
+				out += ' ' + fn.names[ins.value];
+				break;
+			case ASM:
+				out += ' ';
+				quoted(out, fn.names[ins.value]);
+				break;
+			default:
+				break;
+			}
+			for (size_t i = 0; i < ins.ops.size(); i++) {
+				out += ins.op == SET || i ? ", %" : " %";
+				out += std::to_string(ins.ops[i]);
+			}
+			for (int t : ins.target) {
+				if (t < 0) continue;
+				out += ins.op == JMP ? " " : ", ";
+				block_name(out, fn, t);
+			}
+			if (ins.depth) out += "\t\t; depth " + std::to_string(ins.depth);
+			out += '\n';
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../common.h"
+
+// Intermediate representation
+// a function is a control flow graph of basic blocks of typed three-address instructions in SSA
+// form: an instruction defines at most one value, which is never assigned again, and the values
+// that depend on the way into a block meet in the phis at its start
+// ir::Builder makes it from the checked tree, the passes of optimizer::PassManager rewrite it and
+// compiler::Lowering selects the machine instructions for it
+namespace ir {
+	// values narrower than 64 bits are kept zero extended, i1 is 0 or 1
+	typedef enum : uint8_t { VOID, I1, I8, I16, I32, I64, PTR } type_t;
+	const char* type_name(type_t);
+	type_t type_of(ktypes::ktype_t);	// the type the values of a variable of the type have
+	int bytes(type_t);
+
+	typedef enum : uint8_t {
+		CONST,		// value
+		ARG,		// argument register `value`, only at the start of the entry block
+		REG,		// the machine register `value` (as wide as the type)
+		STR,		// address of the string `value` of the function
+		ADDR,		// address of the stack slot `value`
+		COPY,
+		ADD,
+		SUB,
+		MUL,
+		DIV,		// the dividend is not sign extended, like the code always did: it is divided as unsigned by a divisor above 1
+		MOD,
+		CMP,		// 1 if the operands compare as `cc` (signed), 0 otherwise
+		TRUNC,		// the operand cut to the width of the type
+		LOAD,		// the value at the address, as wide as the type
+		STORE,		// the second operand to the address in the first one, as wide as the type `value`
+		GET,		// the value in the stack slot `value`
+		SET,		// the operand to the stack slot `value`
+		CALL,		// the function `value` (a name) with the operands as its arguments, its return value
+		ASM,		// the line of an asm block `value` (a name)
+		PHI,		// an operand per predecessor of the block, in their order
+		JMP,		// to target[0]
+		BR,			// to target[0] if the operand is not 0, to target[1] if it is
+		RET,		// with the operand as the return value (if any)
+		NOP,		// removed
+	} op_t;
+	const char* op_name(op_t);
+
+	typedef enum : uint8_t { EQ, NE, LT, GE, LE, GT } cond_t;
+	const char* cond_name(cond_t);
+	inline cond_t negate(cond_t cc) { return (cond_t)(cc ^ 1); }
+
+	struct Ins {
+		op_t op = NOP;
+		type_t type = VOID;			// of the value it defines
+		cond_t cc = EQ;				// CMP
+		int block = -1;				// the block it is in
+		int depth = 0;				// bytes asm blocks pushed at this point (@stackszinc)
+		int64_t value = 0;
+		std::vector<int> ops;		// operands, by value number
+		int target[2] = { -1, -1 };	// JMP, BR
+
+		bool terminator() const { return op == JMP || op == BR || op == RET; }
+	};
+
+	struct Block {
+		std::string name;			// empty for the entry block
+		std::vector<int> code;		// phis first, a terminator last
+		std::vector<int> preds;		// in the order of the operands of the phis
+		bool loop = false;			// the header of a loop, its code is aligned
+		bool removed = false;
+	};
+
+	// a place on the stack of the function
+	struct Slot {
+		int size = 8;
+		int align = 8;
+		int above = -1;				// if not -1, the slot is that far above the frame (a slot of an outer frame)
+	};
+
+	// a variable of top-level code, which stays on the stack after the statement
+	struct Variable {
+		int slot = -1;
+		ktypes::ktype_t type = ktypes::ANY;
+	};
+
+	class Function {
+	public:
+		std::string label;					// empty for top-level code
+		bool entry = false;					// _start
+		bool opaque = false;				// it has asm blocks, the variables stay on the stack
+		int args = 0;
+		int line = 0;						// of the definition, for errors
+		std::vector<Ins> values;			// by value number, every instruction has one
+		std::vector<Block> blocks;			// in the order they are laid out, the entry first
+		std::vector<std::string> names;		// functions called and lines of asm blocks
+		// the strings, as written in the source, with the labels of their data
+		std::vector<std::pair<std::string, std::string>> strings;
+		std::vector<Slot> slots;
+		std::vector<Variable> variables;	// top-level code: by slot of the checker
+		std::vector<std::string> directives;	// extern and global lines met in the body
+
+		int name(std::string s) {
+			names.push_back(std::move(s));
+			return (int)names.size() - 1;
+		}
+		int slot(int size, int align = 8) {
+			slots.push_back(Slot{ size, align });
+			return (int)slots.size() - 1;
+		}
+		int block(std::string name) {
+			blocks.push_back(Block{ std::move(name) });
+			return (int)blocks.size() - 1;
+		}
+		// a new instruction at the end of the block, returns its value number
+		int add(int block, op_t op, type_t type, std::vector<int> ops = {}, int64_t value = 0, int depth = 0);
+		// a new instruction before position `at` of the block
+		int insert(int block, size_t at, op_t op, type_t type, std::vector<int> ops = {}, int64_t value = 0);
+		const Ins& terminator(int block) const { return values[blocks[block].code.back()]; }
+		// the blocks the block goes to
+		int successors(int block, int out[2]) const;
+	};
+
+	// instructions that only compute their value (they can be removed when it is not used, or
+	// computed once for equal operands)
+	bool pure(const Ins&);
+
+	// the blocks reachable from the entry, in reverse postorder
+	std::vector<int> reverse_postorder(const Function&);
+	// per block, its immediate dominator (-1 for the entry and unreachable blocks)
+	// `order` is the reverse postorder
+	std::vector<int> dominators(const Function&, const std::vector<int>& order);
+	// drops the blocks the entry does not reach, and the phi operands coming from them
+	// returns the amount of blocks dropped
+	size_t remove_unreachable(Function&);
+	// drops the removed blocks and instructions, numbering the rest again from 0
+	void compact(Function&);
+	// lays the blocks out in the order (the ones not in it go last)
+	void reorder(Function&, const std::vector<int>& order);
+	// puts a block on every edge from a block with several successors to one with phis (a
+	// critical edge, or one whose phis merge a single value), so a value can be given to the
+	// phis of the successor on that edge alone
+	void split_critical_edges(Function&);
+	// replaces the operands by what `map` gives them (by value number, -1 to keep), returns the
+	// amount replaced; the map is followed until a value maps to itself or -1
+	size_t replace(Function&, std::vector<int>& map);
+	// replaces the phis whose operands are all the same value (or the phi itself) by that value,
+	// returns the amount removed
+	size_t remove_trivial_phis(Function&);
+
+	// the textual form (--emit=ir)
+	void print(const Function&, std::string& out);
+}
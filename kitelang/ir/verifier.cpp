@@ -0,0 +1,85 @@
+#include "verifier.h"
+#include <algorithm>
+#include "../errors/errors.h"
+
+namespace {
+	std::string where(const ir::Function& fn, int block) {
+		const std::string& name = fn.blocks[block].name;
+		return (fn.label.empty() ? std::string("top-level code") : fn.label) + ", block " + (name.empty() ? "entry" : name);
+	}
+}
+
+void ir::verify(const Function& fn) {
+	auto fail = [&](const std::string& what, int block) {
+		throw errors::kiterr("invalid IR in " + where(fn, block) + ": " + what, fn.line, 0, 0);
+	};
+	std::vector<int> order = reverse_postorder(fn);
+	std::vector<int> idom = dominators(fn, order);
+	std::vector<char> reached(fn.blocks.size(), 0);
+	for (int b : order) reached[b] = 1;
+	// position of every instruction in its block
+	std::vector<int> position(fn.values.size(), -1);
+
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		const Block& block = fn.blocks[b];
+		if (block.removed) continue;
+		if (!reached[b]) fail("not reachable", (int)b);
+		if (block.code.empty() || !fn.values[block.code.back()].terminator()) fail("no terminator at the end", (int)b);
+		bool phis = true;
+		for (size_t i = 0; i < block.code.size(); i++) {
+			int v = block.code[i];
+			if (v < 0 || v >= (int)fn.values.size()) fail("value %" + std::to_string(v) + " out of range", (int)b);
+			const Ins& ins = fn.values[v];
+			if (ins.op == NOP) continue;
+			if (ins.block != (int)b) fail("%" + std::to_string(v) + " says it is in another block", (int)b);
+			if (position[v] >= 0) fail("%" + std::to_string(v) + " placed twice", (int)b);
+			position[v] = (int)i;
+			if (ins.terminator() && i + 1 != block.code.size()) fail("%" + std::to_string(v) + " ends the block before its end", (int)b);
+			if (ins.op != PHI) phis = false;
+			else if (!phis) fail("phi %" + std::to_string(v) + " after other instructions", (int)b);
+			else if (ins.ops.size() != block.preds.size()) fail("phi %" + std::to_string(v) + " has not an operand per predecessor", (int)b);
+		}
+
+		int succ[2];
+		int n = fn.successors((int)b, succ);
+		if (n == 2 && succ[0] == succ[1]) fail("both targets of the branch are the same", (int)b);
+		for (int i = 0; i < n; i++) {
+			if (succ[i] < 0 || succ[i] >= (int)fn.blocks.size() || fn.blocks[succ[i]].removed) fail("goes to a block that does not exist", (int)b);
+			const std::vector<int>& preds = fn.blocks[succ[i]].preds;
+			if (std::count(preds.begin(), preds.end(), (int)b) != 1) fail("not a predecessor of the block it goes to", (int)b);
+		}
+		for (int p : block.preds) {
+			if (p < 0 || p >= (int)fn.blocks.size() || fn.blocks[p].removed) fail("a predecessor that does not exist", (int)b);
+			int ps[2];
+			int m = fn.successors(p, ps);
+			if (std::find(ps, ps + m, (int)b) == ps + m) fail("a predecessor that does not go to it", (int)b);
+		}
+	}
+
+	// `a` dominates `b`
+	auto dominates = [&](int a, int b) {
+		while (b >= 0 && b != a) b = idom[b];
+		return b == a;
+	};
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		const Block& block = fn.blocks[b];
+		if (block.removed) continue;
+		for (int v : block.code) {
+			const Ins& ins = fn.values[v];
+			if (ins.op == NOP) continue;
+			for (size_t k = 0; k < ins.ops.size(); k++) {
+				int o = ins.ops[k];
+				std::string operand = "operand %" + std::to_string(o) + " of %" + std::to_string(v);
+				if (o < 0 || o >= (int)fn.values.size() || fn.values[o].op == NOP || position[o] < 0) fail(operand + " is not defined", (int)b);
+				const Ins& def = fn.values[o];
+				if (def.type == VOID) fail(operand + " has no value", (int)b);
+				// the operand of a phi is used at the end of its predecessor
+				if (ins.op == PHI) {
+					if (!dominates(def.block, block.preds[k])) fail(operand + " does not dominate the predecessor", (int)b);
+				}
+				else if (def.block == (int)b ? position[o] >= position[v] : !dominates(def.block, (int)b))
+					fail(operand + " does not dominate its use", (int)b);
+			}
+		}
+	}
+}
\ No newline at end of file
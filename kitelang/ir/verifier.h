@@ -0,0 +1,12 @@
+#pragma once
+#include "ir.h"
+
+namespace ir {
+	// Verifier
+	// checks that the function is well formed SSA: the blocks end with their only terminator,
+	// the phis are at their start with an operand per predecessor, the predecessors are the blocks
+	// going to them, every block is reachable and every operand is a value defined where it is
+	// used (in a block dominating it, or earlier in the same one)
+	// throws errors::kiterr at the line of the function otherwise, which is a bug of a pass
+	void verify(const Function&);
+}
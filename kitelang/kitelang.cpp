@@ -1,138 +1,133 @@
-
+﻿
 #include "kitelang.h"
+#include "driver/driver.h"
 #include <filesystem>
+#include <memory>
+#include <thread>
+#include "server/server.h"
+
+namespace {
+	// compiled outputs are cached in $KITE_CACHE_DIR (~/.cache/kite by default)
+	// one cache for the process, a server keeps it (with its counts) between requests
+	cache::OutputCache* output_cache() {
+		static std::unique_ptr<cache::OutputCache> outputs = []() {
+			std::filesystem::path cacheDir = cache::OutputCache::default_dir();
+			return cacheDir.empty() ? nullptr : std::make_unique<cache::OutputCache>(cacheDir, cache::OutputCache::default_limit());
+		}();
+		return outputs.get();
+	}
 
-static std::string nthln(const std::string& str, int n) {
-	std::istringstream stream(str);
-	std::string line;
-	int lineNumber = 0;
+	// one compiler command line (without the server options), what it prints goes to `out` and `err`
+	// relative sources are found in `cwd` (the working directory if empty)
+	int run(const std::string& cwd, const std::vector<std::string>& args, std::ostream& out, std::ostream& err) {
+		// the options and the source paths
+		driver::Options options;
+		options.cwd = cwd;
+		std::vector<std::string> sources;
+		bool badArgs = false;
+		bool useCache = true, cacheStats = false, precompileHeaders = false;
+		enum { NO_REPORT, TEXT_REPORT, JSON_REPORT } timePasses = NO_REPORT;
+		for (const std::string& arg : args) {
+			if (arg == "--emit=asm") options.emitObj = options.emitIr = false;
+			else if (arg == "--no-cache") useCache = false;
+			else if (arg == "--cache-stats") cacheStats = true;
+			else if (arg == "--precompile-header") precompileHeaders = true;
+			else if (arg == "--time-passes") timePasses = TEXT_REPORT;
+			else if (arg == "--time-passes=json") timePasses = JSON_REPORT;
+			else if (arg == "--emit=obj") {
+				options.emitObj = true;
+				options.emitIr = false;
+			}
+			else if (arg == "--emit=ir") {
+				options.emitIr = true;
+				options.emitObj = false;
+			}
+			else if (arg == "--stream") options.stream = true;
+			else if (arg == "-O" || arg == "-O1") options.optimize = true;
+			else if (arg == "-O0") options.optimize = false;
+			else if (arg == "-j") options.jobs = (int)std::max(1u, std::thread::hardware_concurrency());
+			else if (arg.rfind("-j", 0) == 0) {
+				options.jobs = atoi(arg.c_str() + 2);
+				if (options.jobs < 1) badArgs = true;
+			}
+			else if (arg.rfind("-", 0) != 0) sources.push_back(arg);
+			else badArgs = true;
+		}
 
-	while (std::getline(stream, line)) {
-		++lineNumber;
-		if (lineNumber == n) {
-			for (char& ch : line) if (ch == '\t') ch = ' ';
-			return line;
+		// if there is no source path or an unknown option, the syntax is incorrect, print usage and exit
+		if ((sources.empty() && !cacheStats) || badArgs) {
+			err << "kite: usage: kite [--emit=asm|obj|ir] [-O] [-jN] [--stream] [--no-cache] [--cache-stats] [--time-passes[=json]] (path/to/source.kite)..." << std::endl;
+			err << "       kite --precompile-header (path/to/header.km)..." << std::endl;
+			err << "       kite --serve [--socket=path]" << std::endl;
+			err << "       kite --client [--socket=path] [--stop | (options and sources as above)]" << std::endl;
+			return 1;
 		}
-	}
 
-	return "";
-}
+		// the headers are written to .kmc files next to them
+		if (precompileHeaders) {
+			int status = 0;
+			for (const std::string& header : sources) status = std::max(status, driver::precompile_header(header, options, err));
+			return status;
+		}
 
-static void printerr(errors::kiterr e, std::string sender, std::string src) {
-	std::string ln = std::to_string(e.line) + ": ";
-	std::cerr << "kite: " << sender << ": " << e.what() << " at line " << e.line << std::endl << std::endl;
-	std::cerr << ln << nthln(src, e.line) << std::endl;
-	for (int i = 1; i < e.pos_start + ln.size(); i++) std::cerr << ' ';
-	for (int i = 0; i < e.pos_end - e.pos_start; i++) std::cerr << '^';
-	if (e.pos_end == e.pos_start) std::cerr << '^';
-	std::cerr << " HERE" << std::endl;
+		// the heap is only counted for the report, from here on
+		if (timePasses != NO_REPORT) stats::count_heap();
+
+		cache::OutputCache* outputs = output_cache();
+		if (useCache) options.cache = outputs;
+
+		std::vector<stats::Report> reports;
+		int status = sources.empty() ? 0 : driver::compile_all(sources, options, err, timePasses != NO_REPORT ? &reports : nullptr);
+
+		// the text report is for people (on stderr with the diagnostics), the JSON one for tools
+		if (timePasses == TEXT_REPORT)
+			for (const stats::Report& report : reports) report.print(err);
+		else if (timePasses == JSON_REPORT)
+			stats::json(out, reports);
+
+		if (cacheStats) {
+			if (!outputs) out << "kite: cache: no cache directory" << std::endl;
+			else {
+				cache::OutputCache::Stats stats = outputs->stats();
+				out << "kite: cache: " << outputs->path().string() << std::endl;
+				out << "  hits:    " << outputs->hits() << std::endl;
+				out << "  misses:  " << outputs->misses() << std::endl;
+				out << "  entries: " << stats.entries << std::endl;
+				out << "  size:    " << (stats.bytes >> 10) << " KB of " << (outputs->size_limit() >> 10) << " KB" << std::endl;
+			}
+		}
+		return status;
+	}
 }
 
 int main(int argc, char* argv[]) {
-	// if the count of the arguments is not 2, then the syntax is incorrect, print usage and exit
-	if (argc != 2) {
-		std::cerr << "kite: usage: kite (path/to/source.kite)" << std::endl;
-		return 1;
-	}
-
-	std::ifstream file(argv[1]);
-	std::string src;
-
-	std::filesystem::path path = std::filesystem::absolute(argv[1]);
-
-	// exit if file failed to open
-	if (!file.is_open() || !file) {
-		std::cerr << "kite: failed to open file" << std::endl;
-		return 1;
-	}
-
-	std::filesystem::current_path(path.parent_path());
-
-	// read the file into src
-	std::ostringstream ss;
-	ss << file.rdbuf();
-	src = ss.str();
-
-	// Precompilation section
-	try {
-		Precompiler pc;
-		src = pc.precompile(src);
-	}
-	catch (std::runtime_error e) {
-		std::cerr << "kite: precompiler: " << e.what() << std::endl;
-		return 1;
+	std::vector<std::string> args;
+	std::string socket = server::default_socket();
+	bool serve = false, client = false, stop = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--serve") serve = true;
+		else if (arg == "--client") client = true;
+		else if (arg == "--stop") stop = true;
+		else if (arg.rfind("--socket=", 0) == 0) socket = arg.substr(9);
+		else args.push_back(arg);
 	}
 
-	// Debugging code to show the modified source
-	// std::cout << src;
-
-	std::vector<token_ptr> tokens;
-
-	// Tokenization section
-	try {
-		lexer::Lexer lex(src);
-		tokens = lex.tokenize();
-	}
-	catch (errors::kiterr e) {
-		printerr(e, "lexer", src);
-		return 1;
-	}
-
-	// Debugging code for printing the tokens generated by the lexer
-	// for (int i = 0; i < tokens.size(); i++) {
-	//		std::cout << i << ": TOKEN(" << tokens[i]->type << ", " << tokens[i]->value << ", " << tokens[i]->value_str << ")" << std::endl;
-	// }
-
-	// Parsing section
-	std::shared_ptr<parser::RootNode> root;
-	parser::Parser parser(tokens);
-	try {
-		// Try parsing and get the reference to the root node in `root`
-		root = parser.parse();
-	}
-	catch (errors::kiterr e) {
-		printerr(e, "parser", src);
-		return 1;
-	}
-
-	// Debugging line for printing the syntax tree
-	// root->print(0);
-
-	compiler::Compiler compiler(root);
-	try {
-		// start code generation
-		compiler.codegen();
+	if (serve) {
+		// the heap is counted from the start, as any request may ask for --time-passes
+		stats::count_heap();
+		return server::serve(socket, run, std::cerr);
 	}
-	catch (errors::kiterr e) {
-		printerr(e, "compiler", src);
+	if (client && stop) {
+		if (server::stop(socket)) return 0;
+		std::cerr << "kite: no server is listening on " << socket << std::endl;
 		return 1;
 	}
-	
-	// print the result to file stream
-	system("mkdir -p kbuild");
-	std::ofstream outFile("kbuild/" + path.filename().replace_extension().string() + ".asm", std::ios::trunc);
-	if (!outFile) {
-		std::cerr << "Error opening file for writing." << std::endl;
-		return 1;
+	if (client) {
+		// the server has its own working directory, the sources are found in the one of the client
+		int status;
+		if (server::request(socket, std::filesystem::current_path().string(), args, std::cout, std::cerr, status)) return status;
+		// without a server the command runs here, so a build works either way
 	}
-	compiler.print(outFile);
-	outFile.close();
-
-	std::string projname = path.filename().replace_extension().string();
-	std::string stdlibobjs = "stdlib/obj/*.o";
-
-	// build executable (NASM and LD required)
-
-	// build to object file (NASM required)
-	// std::cout << "nasm -felf64 -o kbuild/" + projname + ".o kbuild/" + projname + ".asm\n";
-
-	// comment out if running linux with nasm and ld
-	// system(("nasm -felf64 -o kbuild/" + projname + ".o kbuild/" + projname + ".asm").c_str());
-
-	// link with stdlibs
-	// std::cout << "ld -o kbuild/" + projname + " kbuild/" + projname + ".o " + stdlibobjs << std::endl;
-	// comment out if running linux with nasm and ld
-	// system(("ld -o kbuild/" + projname + " kbuild/" + projname + ".o " + stdlibobjs).c_str());
-
-	return 0;
-}
+	return run("", args, std::cout, std::cerr);
+}
\ No newline at end of file
@@ -1,125 +1,154 @@
 #include "lexer.h"
 
-std::vector<token_ptr> lexer::Lexer::tokenize() {
+using namespace lexer::scan;
+
+std::vector<lexer::Token> lexer::Lexer::tokenize() {
 	// initialize the array (vector)
-	std::vector<token_ptr> result {};
-	// Initialize line and position counters
-	this->line = 1;
-	this->pos = 1;
+	// tokens are stored by value, reserve a rough estimate up front so the array rarely grows
+	std::vector<Token> result {};
+	result.reserve(src.size() / 4 + 1);
+	do result.push_back(next());
+	while (result.back().type != END);
+	return result;
+}
 
+lexer::Token lexer::Lexer::next() {
 	// while the pointer is in the bounds of the characters
 	while (ptr < src.size()) {
-		// if the current character (src[ptr]) is an alphabetic character or an underscore
-		// expect and parse the identifier and add to the tokens array
-		if (isalpha(src[ptr]) || src[ptr] == '_')
-			result.push_back(make_identifier());
+		char c = src[ptr];
+		uint8_t cls = tables.cls[(unsigned char)c];
+		// if the current character is an alphabetic character or an underscore
+		// expect and parse the identifier
+		if (cls & CC_IDSTART)
+			return make_identifier();
+		// ignore whitespace
+		else if (cls & CC_SPACE) skip_space();
 		// if the current character is a digit, parse an integer
 		// floating point numbers are not yet implemented in the language
-		else if (isdigit(src[ptr]))
-			result.push_back(make_int());
+		else if (cls & CC_DIGIT)
+			return make_int();
 		// if the current character is a double quote, that means it's a string literal
-		else if (src[ptr] == '"')
-			result.push_back(make_string());
+		else if (c == '"')
+			return make_string();
 		// if the current character is a single quote, that means it's a char literal
-		else if (src[ptr] == '\'')
-			result.push_back(make_char());
+		else if (c == '\'')
+			return make_char();
+		// if it is the marker of a precompiled header
+		else if (c == '@' && is(at(ptr + 1), CC_DIGIT))
+			return make_header();
 		// if it is an identifier with prefix
-		else if (prefixes.count(src[ptr]) && isalpha(src[(size_t)(ptr + 1)]))
-			result.push_back(make_with_prefix(prefixes[src[ptr]]));
+		else if ((cls & CC_PREFIX) && is(at(ptr + 1), CC_IDSTART) && at(ptr + 1) != '_')
+			return make_with_prefix(tables.prefix[(unsigned char)c]);
 		// then it is a special token (with two characters)
-		else if ((ptr < src.size() - 1) && (specialsTwoChar.count(std::string(1, src[ptr]) + src[(size_t)(ptr + 1)])))
-			result.push_back(make_special_two());
-		else if (specials.count(src[ptr]))
-			result.push_back(make_special());
+		else if (token_t two = two_char(c, at(ptr + 1)); two != END)
+			return make_special_two(two);
+		else if (cls & CC_SPECIAL)
+			return make_special(tables.special[(unsigned char)c]);
 		// if it is a single line comment prefix, skip the comment
-		else if (src[ptr] == ';') skip_comment();
+		else if (c == ';') skip_comment();
 		// if it is a multiline comment prefix, skip the comment
-		else if (src[ptr] == '~') skip_multiline_comment();
-		// ignore whitespace
-		else if (isspace(src[ptr])) advance();
+		else if (c == '~') skip_multiline_comment();
 		// case for invalid characters
 		else
-			throw errors::kiterr("invalid character `" + std::to_string(src[ptr]) + "`", this->line, this->pos, this->pos);
+			throw errors::kiterr("invalid character `" + std::to_string(c) + "`", this->line, pos(), pos());
 	}
-	return result;
+	// the stream ends with END (again on every call after it), so the parser never has to check the bounds
+	return Token{ END, -1, (uint32_t)src.size(), 0, this->line, pos(), pos() };
 }
 
-token_ptr lexer::Lexer::make_identifier() {
-	// this will store the result
-	std::string result;
-	int pos_start = this->pos;
+lexer::Token lexer::Lexer::make_identifier() {
+	// the result is the range of the source from here
+	size_t start = ptr;
+	int pos_start = pos();
 
-	// while the current character is alphanumeric or an underscore
-	while (isalnum(src[ptr]) || src[ptr] == '_') {
-		// add to the result and increment the pointer
-		result += advance();
-	}
+	// skip the run of alphanumeric characters and underscores
+	// (an identifier never spans lines, so the line count stays the same)
+	ptr = scan::skip_ident(src.data(), ptr + 1, src.size());
+	std::string_view result = src.substr(start, ptr - start);
 
 	// determine if the "word" is an identifier or a keyword
-	// if the result is in the "keywords" list (in lexer.h), then it is a keyword
-	token_t type =
-		(keywords.find(result) != keywords.end())
-		? KEYWORD
-		: IDENTIFIER;
-
-	return std::make_shared<Token>(type, result, this->line, pos_start, this->pos);
+	// if the result is in the "keywords" list (in scan.h), then it is a keyword
+	// keywords carry their keyword_t and identifiers their symbol ID as the value
+	if (int id = scan::keyword(result); id >= 0)
+		return Token{ KEYWORD, id, (uint32_t)start, (uint32_t)result.size(), this->line, pos_start, pos() };
+	return Token{ IDENTIFIER, symbols.intern(result), (uint32_t)start, (uint32_t)result.size(), this->line, pos_start, pos() };
 }
 
-token_ptr lexer::Lexer::make_int() {
-	// this will store the result (as a string for now)
-	std::string result;
-	int pos_start = this->pos;
+lexer::Token lexer::Lexer::make_int() {
+	// this will store the result
+	size_t start = ptr;
+	// wraps around on long literals (the parser reads them again in 64 bits)
+	unsigned result = 0;
+	int pos_start = pos();
 
 	// while it is a digit, add to the result and increment the pointer
-	while (isdigit(src[ptr])) {
-		result += advance();
+	while (is(at(ptr), CC_DIGIT)) {
+		result = result * 10 + (src[ptr++] - '0');
 	}
 
-	// convert the result to integer (atoi) and return
-	return std::make_shared<Token>(INT_LIT, std::atoi(result.c_str()), this->line, pos_start, this->pos);
+	return Token{ INT_LIT, (int)result, (uint32_t)start, (uint32_t)(ptr - start), this->line, pos_start, pos() };
 }
 
-token_ptr lexer::Lexer::make_string() {
-	int pos_start = this->pos;
+lexer::Token lexer::Lexer::make_string() {
+	int pos_start = pos();
 	int line_start = this->line;
 	// skip through the double quote
 	advance();
 
-	// this will store the result
-	std::string result;
+	// the contents are kept as written (escape sequences included)
+	size_t start = ptr;
 
 	// while the current character is not a closing quote
-	while (src[ptr] != '"') {
+	while (at(ptr) != '"') {
+		if (ptr >= src.size())
+			throw errors::kiterr("unterminated string literal", line_start, pos_start, pos_start);
 		if (src[ptr] == '\\')
-			result += advance();
-		result += advance();
+			advance();
+		advance();
 	}
+	size_t length = ptr - start;
 
 	// skip through the closing double quote
 	advance();
-	return std::make_shared<Token>(STRING_LIT, result, line_start, pos_start, pos_start);
+	return Token{ STRING_LIT, -1, (uint32_t)start, (uint32_t)length, line_start, pos_start, pos_start };
 }
 
-token_ptr lexer::Lexer::make_with_prefix(token_t type) {
-	int pos_start = this->pos;
+lexer::Token lexer::Lexer::make_with_prefix(token_t type) {
+	int pos_start = pos();
 
 	// skip through the prefix
 	advance();
 
-	// this will store the result
-	std::string result;
+	// the name starts after the prefix
+	size_t start = ptr;
 
-	// while the current character is alphanumeric or an underscore
-	while (isalnum(src[ptr])) {
-		// add to the result and increment the pointer
-		result += advance();
+	// while the current character is alphanumeric
+	while (is(at(ptr), CC_IDENT) && src[ptr] != '_') {
+		// increment the pointer
+		ptr++;
 	}
 
-	return std::make_shared<Token>(type, result, this->line, pos_start, this->pos);
+	// the address-of and dereference prefixes name a variable, intern it like an identifier
+	int value = (type == ADDROF || type == DEREF) ? symbols.intern(src.substr(start, ptr - start)) : -1;
+	return Token{ type, value, (uint32_t)start, (uint32_t)(ptr - start), this->line, pos_start, pos() };
+}
+
+lexer::Token lexer::Lexer::make_header() {
+	int pos_start = pos();
+
+	// skip through the @
+	advance();
+	size_t start = ptr;
+	int index = 0;
+	while (is(at(ptr), CC_DIGIT)) {
+		index = index * 10 + (src[ptr++] - '0');
+	}
+	return Token{ HEADER, index, (uint32_t)start, (uint32_t)(ptr - start), this->line, pos_start, pos() };
 }
 
-token_ptr lexer::Lexer::make_char() {
-	int pos_start = this->pos;
+lexer::Token lexer::Lexer::make_char() {
+	size_t start = ptr;
+	int pos_start = pos();
 
 	// skip through the single quote
 	advance();
@@ -147,65 +176,63 @@ token_ptr lexer::Lexer::make_char() {
 			result = '\"';
 			break;
 		default:
-			throw errors::kiterr("invalid escape character " + std::to_string(code), this->line, this->pos, this->pos);
+			throw errors::kiterr("invalid escape character " + std::to_string(code), this->line, pos(), pos());
 		}
 	}
 	// skip through the closing single quote
 	advance();
-	return std::make_shared<Token>(CHAR_LIT, result, this->line, pos_start, this->pos);
+	return Token{ CHAR_LIT, result, (uint32_t)start, (uint32_t)(ptr - start), this->line, pos_start, pos() };
 }
 
-token_ptr lexer::Lexer::make_special() {
-	// get the token type and value from the specials map (lexer.h)
-	token_ptr e = std::make_shared<Token>(specials[src[ptr]], std::to_string(src[ptr]), this->line, this->pos, this->pos);
+lexer::Token lexer::Lexer::make_special(token_t type) {
+	Token e{ type, -1, (uint32_t)ptr, 1, this->line, pos(), pos() };
 	// advance and return
-	advance();
+	ptr++;
 	return e;
 }
 
-token_ptr lexer::Lexer::make_special_two() {
-	// get the token type and value from the specialsTwoChar map (lexer.h)
-	std::string key(1, src[ptr]);
-	key += src[(size_t)(ptr + 1)];
-	token_ptr e = std::make_shared<Token>(
-		specialsTwoChar[
-			key
-		],
-		key,
-		this->line,
-		this->pos,
-		this->pos + 1
-	);
+lexer::Token lexer::Lexer::make_special_two(token_t type) {
+	Token e{ type, -1, (uint32_t)ptr, 2, this->line, pos(), pos() + 1 };
 	// advance and return
-	advance();
-	advance();
+	ptr += 2;
 	return e;
 }
 
+void lexer::Lexer::skip_space() {
+	skip_to(scan::skip_space(src.data(), ptr, src.size()));
+}
+
 void lexer::Lexer::skip_comment() {
-	// while the pointer is in the bounds and not encountered newline, advance
-	while (src[ptr] != '\n' && ptr < src.size()) advance();
+	// move to the newline (or the end of the source)
+	ptr = scan::find_byte(src.data(), ptr, src.size(), '\n');
 	// skip the newline
-	advance();
+	if (ptr < src.size()) advance();
 }
 
 void lexer::Lexer::skip_multiline_comment() {
-	// advance through the ~
-	advance();
-	// while still in bounds
-	while (ptr < src.size())
-		// if encountered closing comment, break
-		if (advance() == '~') break;
+	// find the closing ~ and skip through it
+	size_t end = scan::find_byte(src.data(), ptr + 1, src.size(), '~');
+	skip_to(end < src.size() ? end + 1 : end);
+}
+
+void lexer::Lexer::skip_to(size_t end) {
+	size_t last = 0;
+	size_t lines = scan::count_newlines(src.data(), ptr, end, last);
+	if (lines) {
+		line += (int)lines;
+		line_offset = last + 1;
+	}
+	ptr = end;
 }
 
 char lexer::Lexer::advance() {
+	// there is nothing to advance through past the end
+	if (ptr >= src.size()) return '\0';
 	// if it is a line break
 	if (src[ptr] == '\n') {
-		// reset position counter and
-		// increment line counter
-		pos = 1;
+		// the next line starts after it
+		line_offset = ptr + 1;
 		++line;
 	}
-	else ++pos;
 	return src[ptr++];
-}
\ No newline at end of file
+}
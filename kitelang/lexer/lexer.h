@@ -1,89 +1,58 @@
 #pragma once
 #include "token.h"
+#include "scan.h"
+#include "symbols.h"
 #include <vector>
-#include <memory>
-#include <map>
-#include <set>
+#include <string_view>
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
 #include "../errors/errors.h"
 
-// define an alias for a shared ptr to token object token_ptr
-typedef std::shared_ptr<lexer::Token> token_ptr;
-
 namespace lexer {
 	// Lexer class
+	// characters are classified through the constexpr tables in scan.h, keywords are resolved
+	// through a perfect hash and whitespace, comments and identifiers are skipped with the
+	// vectorized kernels from scan.h
 	class Lexer {
 	private:
-		// map of each special character to its token type
-		std::map<char, lexer::token_t> specials = {
-			{'+', lexer::PLUS},
-			{'-', lexer::MINUS},
-			{'*', lexer::MUL},
-			{'/', lexer::DIV},
-			{'(', lexer::LPAREN},
-			{')', lexer::RPAREN},
-			{'{', lexer::LBRACE},
-			{'}', lexer::RBRACE},
-			{',', lexer::COMMA},
-			{'=', lexer::EQ},
-			{'>', lexer::GT},
-			{'<', lexer::LT},
-			{'[', lexer::LSQR},
-			{']', lexer::RSQR},
-			{']', lexer::RSQR},
-			{':', lexer::COLON},
-			{'^', lexer::CARET},
-			{'%', lexer::MOD},
-		};
-		// map of each special two characters to its token type
-		std::map<std::string, lexer::token_t> specialsTwoChar = {
-			{"==", lexer::EQEQ},
-			{"!=", lexer::NEQEQ},
-			{">=", lexer::GTE},
-			{"<=", lexer::LTE},
-			{"->", lexer::ARROW},
-			{"::", lexer::VAARG},
-		};
-		// map of each prefix and its token type
-		std::map<char, lexer::token_t> prefixes = {
-			{'^', lexer::REG},
-			{'&', lexer::ADDROF},
-			{'*', lexer::DEREF},
-			{'@', lexer::CDIRECT}
-		};
-		// set of keywords in the language
-		// this is to determine if the "word" is a keyword or a reference to a variable or function (identifier)
-		std::set<std::string> keywords = {
-			"extern", "global", "fn", "let", "for", "cmp", "asm", "eq", "neq", "return", "break", "continue", "loop", "if", "else",
-			"void", "char", "byte", "bool", "int16","int32", "int64", "ptr8", "ptr16", "ptr32", "ptr64"
-		};
-		// The current line and position
-		int line = 0;
-		int pos = 0;
-		// The source code
-		std::string src;
+		// The current line and the offset where it starts in the source
+		// (the position in the line is derived from it)
+		int line = 1;
+		size_t line_offset = 0;
+		// The source code (owned by the caller, tokens refer to it)
+		std::string_view src;
 		// the pointer to the current character
-		int ptr = 0;
+		size_t ptr = 0;
+		// identifiers are interned here, their tokens carry the ID as the value
+		SymbolTable& symbols;
 		// function declarations
-		token_ptr make_int();                // for making and returning an integer token                (e.g `1234`)
-		token_ptr make_string();             // for making and returning a string token                  (e.g `"Hello, World!"`)
-		token_ptr make_char();               // for making and returning a char token                    (e.g `'A'`)
-		token_ptr make_identifier();         // for making and returning a keyword or identifier token   (e.g `varName` or `let`)
-		token_ptr make_special();            // for making and returning a special character token       (e.g `+` or `~`)
-		token_ptr make_special_two();        // for making and returning a special token with two chars  (e.g `==` or `!=`)
-		token_ptr make_with_prefix(token_t); // for making and returning an identifier with a prefix     (e.g `^rax` or `*ptr`)
+		Token make_int();                    // for making and returning an integer token                (e.g `1234`)
+		Token make_string();                 // for making and returning a string token                  (e.g `"Hello, World!"`)
+		Token make_char();                   // for making and returning a char token                    (e.g `'A'`)
+		Token make_identifier();             // for making and returning a keyword or identifier token   (e.g `varName` or `let`)
+		Token make_special(token_t);         // for making and returning a special character token       (e.g `+` or `~`)
+		Token make_special_two(token_t);     // for making and returning a special token with two chars  (e.g `==` or `!=`)
+		Token make_with_prefix(token_t);     // for making and returning an identifier with a prefix     (e.g `^rax` or `*ptr`)
+		Token make_header();                 // for making and returning a precompiled header marker     (e.g `@0`)
+		void skip_space();                   // for skipping a run of whitespace
 		void skip_comment();                 // for skipping single line comments                        (e.g % test)
 		void skip_multiline_comment();       // for skipping multiline comments                          (e.g ~ test ~)
+		void skip_to(size_t);                // for moving the pointer forward over arbitrary text, keeping the line count right
 		char advance();						 // for advancing to next character and keeping line and pos count right
+		char at(size_t i) const { return i < src.size() ? src[i] : '\0'; } // character at i, or 0 past the end
+		int pos() const { return (int)(ptr - line_offset) + 1; }             // position of the pointer in the current line
 	public:
 	    // the constructor that takes the source code and resets the character pointer
-		Lexer(std::string src) {
+		// the source must outlive the tokens, since they only refer to it
+		Lexer(std::string_view src, SymbolTable& symbols) : symbols(symbols) {
 			this->src = src;
 			this->ptr = 0;
 		}
 		// main tokenize function that returns the array of tokens representing the source code
-		std::vector<token_ptr> tokenize();
+		// the array is terminated with an END token
+		std::vector<Token> tokenize();
+		// the next token, for making them one at a time as they are needed (END at the end)
+		Token next();
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,210 @@
+#include "scan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KITE_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+	using namespace lexer::scan;
+
+	// scalar kernels, also used for the tails of the vectorized ones
+
+	size_t skip_space_scalar(const char* s, size_t i, size_t n) {
+		while (i < n && is(s[i], CC_SPACE)) i++;
+		return i;
+	}
+
+	size_t skip_ident_scalar(const char* s, size_t i, size_t n) {
+		while (i < n && is(s[i], CC_IDENT)) i++;
+		return i;
+	}
+
+	size_t find_byte_scalar(const char* s, size_t i, size_t n, char c) {
+		while (i < n && s[i] != c) i++;
+		return i;
+	}
+
+	size_t count_newlines_scalar(const char* s, size_t i, size_t j, size_t& last) {
+		size_t count = 0;
+		for (; i < j; i++)
+			if (s[i] == '\n') {
+				count++;
+				last = i;
+			}
+		return count;
+	}
+
+#ifdef KITE_SCAN_X86
+	// bytes of v in the (inclusive) range [lo, hi]
+	// shifts the range down to start at -128 so a single signed comparison is enough
+	inline __m128i in_range_128(__m128i v, char lo, char hi) {
+		__m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - lo)));
+		return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(0x80 + (hi - lo) + 1)));
+	}
+
+	inline __m128i space_mask_128(__m128i v) {
+		return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), in_range_128(v, '\t', '\r'));
+	}
+
+	inline __m128i ident_mask_128(__m128i v) {
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20)); // fold upper case into lower case
+		return _mm_or_si128(
+			_mm_or_si128(in_range_128(lower, 'a', 'z'), in_range_128(v, '0', '9')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+	}
+
+	size_t skip_space_sse2(const char* s, size_t i, size_t n) {
+		for (; i + 16 <= n; i += 16) {
+			unsigned mask = ~(unsigned)_mm_movemask_epi8(space_mask_128(_mm_loadu_si128((const __m128i*)(s + i)))) & 0xffff;
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return skip_space_scalar(s, i, n);
+	}
+
+	size_t skip_ident_sse2(const char* s, size_t i, size_t n) {
+		for (; i + 16 <= n; i += 16) {
+			unsigned mask = ~(unsigned)_mm_movemask_epi8(ident_mask_128(_mm_loadu_si128((const __m128i*)(s + i)))) & 0xffff;
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return skip_ident_scalar(s, i, n);
+	}
+
+	size_t find_byte_sse2(const char* s, size_t i, size_t n, char c) {
+		__m128i needle = _mm_set1_epi8(c);
+		for (; i + 16 <= n; i += 16) {
+			unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i)), needle));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return find_byte_scalar(s, i, n, c);
+	}
+
+	size_t count_newlines_sse2(const char* s, size_t i, size_t j, size_t& last) {
+		__m128i nl = _mm_set1_epi8('\n');
+		size_t count = 0;
+		for (; i + 16 <= j; i += 16) {
+			unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i)), nl));
+			if (mask) {
+				count += __builtin_popcount(mask);
+				last = i + 31 - __builtin_clz(mask);
+			}
+		}
+		return count + count_newlines_scalar(s, i, j, last);
+	}
+
+	__attribute__((target("avx2"))) inline __m256i in_range_256(__m256i v, char lo, char hi) {
+		__m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - lo)));
+		return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + (hi - lo) + 1)), shifted);
+	}
+
+	__attribute__((target("avx2"))) size_t skip_space_avx2(const char* s, size_t i, size_t n) {
+		for (; i + 32 <= n; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+			__m256i sp = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), in_range_256(v, '\t', '\r'));
+			unsigned mask = ~(unsigned)_mm256_movemask_epi8(sp);
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return skip_space_sse2(s, i, n);
+	}
+
+	__attribute__((target("avx2"))) size_t skip_ident_avx2(const char* s, size_t i, size_t n) {
+		for (; i + 32 <= n; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+			__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+			__m256i id = _mm256_or_si256(
+				_mm256_or_si256(in_range_256(lower, 'a', 'z'), in_range_256(v, '0', '9')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+			unsigned mask = ~(unsigned)_mm256_movemask_epi8(id);
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return skip_ident_sse2(s, i, n);
+	}
+
+	__attribute__((target("avx2"))) size_t find_byte_avx2(const char* s, size_t i, size_t n, char c) {
+		__m256i needle = _mm256_set1_epi8(c);
+		for (; i + 32 <= n; i += 32) {
+			unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), needle));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return find_byte_sse2(s, i, n, c);
+	}
+
+	__attribute__((target("avx2"))) size_t count_newlines_avx2(const char* s, size_t i, size_t j, size_t& last) {
+		__m256i nl = _mm256_set1_epi8('\n');
+		size_t count = 0;
+		for (; i + 32 <= j; i += 32) {
+			unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), nl));
+			if (mask) {
+				count += __builtin_popcount(mask);
+				last = i + 31 - __builtin_clz(mask);
+			}
+		}
+		return count + count_newlines_sse2(s, i, j, last);
+	}
+#endif
+
+	struct Kernels {
+		level_t level;
+		size_t (*skip_space)(const char*, size_t, size_t);
+		size_t (*skip_ident)(const char*, size_t, size_t);
+		size_t (*find_byte)(const char*, size_t, size_t, char);
+		size_t (*count_newlines)(const char*, size_t, size_t, size_t&);
+	};
+
+	Kernels kernels_for(level_t level) {
+#ifdef KITE_SCAN_X86
+		if (level == AVX2) return { AVX2, skip_space_avx2, skip_ident_avx2, find_byte_avx2, count_newlines_avx2 };
+		if (level == SSE2) return { SSE2, skip_space_sse2, skip_ident_sse2, find_byte_sse2, count_newlines_sse2 };
+#endif
+		return { SCALAR, skip_space_scalar, skip_ident_scalar, find_byte_scalar, count_newlines_scalar };
+	}
+
+	Kernels& active() {
+		static Kernels k = kernels_for(detect());
+		return k;
+	}
+}
+
+lexer::scan::level_t lexer::scan::detect() {
+#ifdef KITE_SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return AVX2;
+	// SSE2 is part of the x86-64 baseline
+	return SSE2;
+#else
+	return SCALAR;
+#endif
+}
+
+lexer::scan::level_t lexer::scan::level() {
+	return active().level;
+}
+
+void lexer::scan::set_level(level_t l) {
+	if (l > detect()) l = detect();
+	active() = kernels_for(l);
+}
+
+const char* lexer::scan::level_name(level_t l) {
+	switch (l) {
+	case AVX2: return "avx2";
+	case SSE2: return "sse2";
+	default: return "scalar";
+	}
+}
+
+size_t lexer::scan::skip_space(const char* s, size_t i, size_t n) {
+	return active().skip_space(s, i, n);
+}
+
+size_t lexer::scan::skip_ident(const char* s, size_t i, size_t n) {
+	return active().skip_ident(s, i, n);
+}
+
+size_t lexer::scan::find_byte(const char* s, size_t i, size_t n, char c) {
+	return active().find_byte(s, i, n, c);
+}
+
+size_t lexer::scan::count_newlines(const char* s, size_t i, size_t j, size_t& last) {
+	return active().count_newlines(s, i, j, last);
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include "token.h"
+
+// Character classification tables and bulk scanning kernels used by the lexer
+// the kernels have a scalar version and SSE2/AVX2 versions, the best one the CPU supports
+// is picked at runtime the first time they are used
+namespace lexer::scan {
+	// character class bits
+	enum : uint8_t {
+		CC_IDSTART = 1 << 0, // a-z A-Z _
+		CC_DIGIT   = 1 << 1, // 0-9
+		CC_SPACE   = 1 << 2, // whitespace (as isspace)
+		CC_SPECIAL = 1 << 3, // single character operator or punctuation
+		CC_PREFIX  = 1 << 4, // prefix of a register, address-of, dereference or directive
+		CC_IDENT   = CC_IDSTART | CC_DIGIT,
+	};
+
+	struct CharTables {
+		uint8_t cls[256];
+		token_t special[256]; // token type of single character specials (END if none)
+		token_t prefix[256];  // token type of prefixed identifiers (END if none)
+	};
+
+	constexpr CharTables make_char_tables() {
+		CharTables t{};
+		for (int c = 0; c < 256; c++) {
+			t.special[c] = END;
+			t.prefix[c] = END;
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') t.cls[c] |= CC_IDSTART;
+			if (c >= '0' && c <= '9') t.cls[c] |= CC_DIGIT;
+			if (c == ' ' || (c >= '\t' && c <= '\r')) t.cls[c] |= CC_SPACE;
+		}
+		const std::pair<char, token_t> specials[] = {
+			{'+', PLUS}, {'-', MINUS}, {'*', MUL}, {'/', DIV}, {'(', LPAREN}, {')', RPAREN},
+			{'{', LBRACE}, {'}', RBRACE}, {',', COMMA}, {'=', EQ}, {'>', GT}, {'<', LT},
+			{'[', LSQR}, {']', RSQR}, {':', COLON}, {'^', CARET}, {'%', MOD},
+		};
+		for (auto [c, tp] : specials) {
+			t.special[(unsigned char)c] = tp;
+			t.cls[(unsigned char)c] |= CC_SPECIAL;
+		}
+		const std::pair<char, token_t> prefixes[] = {
+			{'^', REG}, {'&', ADDROF}, {'*', DEREF}, {'@', CDIRECT},
+		};
+		for (auto [c, tp] : prefixes) {
+			t.prefix[(unsigned char)c] = tp;
+			t.cls[(unsigned char)c] |= CC_PREFIX;
+		}
+		return t;
+	}
+
+	inline constexpr CharTables tables = make_char_tables();
+
+	inline bool is(char c, uint8_t cls) { return (tables.cls[(unsigned char)c] & cls) != 0; }
+
+	// token type of a two character operator, END if the pair is not one
+	constexpr token_t two_char(char a, char b) {
+		switch (a) {
+		case '=': return b == '=' ? EQEQ : END;
+		case '!': return b == '=' ? NEQEQ : END;
+		case '>': return b == '=' ? GTE : END;
+		case '<': return b == '=' ? LTE : END;
+		case '-': return b == '>' ? ARROW : END;
+		case ':': return b == ':' ? VAARG : END;
+		default: return END;
+		}
+	}
+
+	// keywords of the language, resolved through a perfect hash
+	inline constexpr std::string_view keywords[] = {
+		"extern", "global", "fn", "let", "for", "cmp", "asm", "eq", "neq", "return", "break", "continue", "loop", "if", "else",
+		"void", "char", "byte", "bool", "int16", "int32", "int64", "ptr8", "ptr16", "ptr32", "ptr64"
+	};
+	constexpr size_t keywordCount = sizeof(keywords) / sizeof(keywords[0]);
+	static_assert(keywordCount == KW_PTR64 + 1 && keywords[KW_ELSE] == "else" && keywords[KW_VOID] == "void", "keyword_t does not match the keywords");
+
+	// hash on the first and last characters and the length, chosen to be collision free for the keywords above
+	constexpr size_t keyword_hash(std::string_view w) {
+		return ((unsigned char)w.front() + 5 * (unsigned char)w.back() + w.size()) & 63;
+	}
+
+	struct KeywordTable {
+		int8_t slot[64]; // index into `keywords`, -1 if empty
+		bool perfect;    // no two keywords share a slot
+	};
+
+	constexpr KeywordTable make_keyword_table() {
+		KeywordTable t{};
+		t.perfect = true;
+		for (auto& s : t.slot) s = -1;
+		for (size_t i = 0; i < keywordCount; i++) {
+			size_t h = keyword_hash(keywords[i]);
+			if (t.slot[h] != -1) t.perfect = false;
+			t.slot[h] = (int8_t)i;
+		}
+		return t;
+	}
+
+	inline constexpr KeywordTable keywordTable = make_keyword_table();
+	static_assert(keywordTable.perfect, "keyword hash has collisions, pick other multipliers");
+
+	// index of the keyword in `keywords`, -1 if the word is not a keyword
+	inline int keyword(std::string_view w) {
+		int i = keywordTable.slot[keyword_hash(w)];
+		return (i >= 0 && keywords[i] == w) ? i : -1;
+	}
+
+	// instruction set level of the scanning kernels
+	typedef enum {
+		SCALAR,
+		SSE2,
+		AVX2
+	} level_t;
+
+	// the best level supported by the CPU
+	level_t detect();
+	// the level currently in use
+	level_t level();
+	// override the level (clamped to what the CPU supports), used for benchmarking
+	void set_level(level_t);
+	const char* level_name(level_t);
+
+	// index of the first character at or after i that is not whitespace (n if none)
+	size_t skip_space(const char* s, size_t i, size_t n);
+	// index of the first character at or after i that is not alphanumeric or an underscore (n if none)
+	size_t skip_ident(const char* s, size_t i, size_t n);
+	// index of the first occurrence of c at or after i (n if none)
+	size_t find_byte(const char* s, size_t i, size_t n, char c);
+	// amount of newlines in [i, j), the index of the last one is stored in `last`
+	size_t count_newlines(const char* s, size_t i, size_t j, size_t& last);
+}
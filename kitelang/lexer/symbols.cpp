@@ -0,0 +1,50 @@
+#include "symbols.h"
+
+uint32_t lexer::SymbolTable::hash(std::string_view s) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for (char c : s) {
+		h ^= (unsigned char)c;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void lexer::SymbolTable::rehash(size_t capacity) {
+	slots.assign(capacity, -1);
+	size_t mask = capacity - 1;
+	for (int id = 0; id < (int)names.size(); id++) {
+		size_t i = hashes[id] & mask;
+		while (slots[i] != -1) i = (i + 1) & mask;
+		slots[i] = id;
+	}
+}
+
+int lexer::SymbolTable::intern(std::string_view s) {
+	uint32_t h = hash(s);
+	size_t mask = slots.size() - 1;
+	size_t i = h & mask;
+	// linear probing, the table is kept at most half full so a free slot is always found quickly
+	while (slots[i] != -1) {
+		int id = slots[i];
+		if (hashes[id] == h && names[id] == s) return id;
+		i = (i + 1) & mask;
+	}
+	int id = (int)names.size();
+	storage.emplace_back(s);
+	names.push_back(storage.back());
+	hashes.push_back(h);
+	slots[i] = id;
+	if (names.size() * 2 > slots.size()) rehash(slots.size() * 2);
+	return id;
+}
+
+int lexer::SymbolTable::find(std::string_view s) const {
+	uint32_t h = hash(s);
+	size_t mask = slots.size() - 1;
+	for (size_t i = h & mask; slots[i] != -1; i = (i + 1) & mask) {
+		int id = slots[i];
+		if (hashes[id] == h && names[id] == s) return id;
+	}
+	return -1;
+}
\ No newline at end of file
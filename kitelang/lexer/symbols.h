@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lexer {
+	// Interning table for identifiers
+	// every distinct name gets a dense integer ID (0, 1, 2, ...) the first time it is seen,
+	// so the later stages can index plain arrays by it instead of hashing strings
+	class SymbolTable {
+	private:
+		// the interned names, a deque never moves its elements so the views in `names` stay valid
+		std::deque<std::string> storage;
+		std::vector<std::string_view> names;
+		std::vector<uint32_t> hashes;
+		// open addressing hash table of IDs (-1 for an empty slot), the size is a power of two
+		std::vector<int> slots;
+		static uint32_t hash(std::string_view);
+		void rehash(size_t);
+	public:
+		SymbolTable() { rehash(1024); }
+		// ID of the name, adding it to the table if it is not there yet
+		int intern(std::string_view);
+		// ID of the name, -1 if it was never interned
+		int find(std::string_view) const;
+		std::string_view name(int id) const { return names[id]; }
+		// amount of interned names (every ID is less than this)
+		size_t size() const { return names.size(); }
+	};
+}
\ No newline at end of file
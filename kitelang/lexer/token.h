@@ -1,5 +1,6 @@
 #pragma once
-#include <string>
+#include <cstdint>
+#include <string_view>
 
 namespace lexer {
 	// Enumeration for the type of the token
@@ -35,35 +36,35 @@ namespace lexer {
 		CARET,
 		ARROW,
 		VAARG,
-		MOD
+		MOD,
+		HEADER,  // `@N`, left by the precompiler where it included the N-th precompiled header
+		END      // end of the token stream
 	} token_t;
 
-	// Token class
-	class Token {
-	public:
+	// IDs of the keywords (the value of KEYWORD tokens), in the order of scan::keywords
+	typedef enum {
+		KW_EXTERN, KW_GLOBAL, KW_FN, KW_LET, KW_FOR, KW_CMP, KW_ASM, KW_EQ, KW_NEQ, KW_RETURN, KW_BREAK, KW_CONTINUE, KW_LOOP, KW_IF, KW_ELSE,
+		KW_VOID, KW_CHAR, KW_BYTE, KW_BOOL, KW_INT16, KW_INT32, KW_INT64, KW_PTR8, KW_PTR16, KW_PTR32, KW_PTR64,
+	} keyword_t;
+
+	// Token
+	// plain data, the text of the token is not copied but referenced by its range in the source,
+	// so the token stream can be stored contiguously and copied around for free
+	struct Token {
 		token_t type;
+		// integer payload of the token (value of INT_LIT and CHAR_LIT tokens,
+		// symbol ID of IDENTIFIER, ADDROF and DEREF tokens, keyword_t of KEYWORD tokens,
+		// index of the header of HEADER tokens, -1 otherwise)
+		int value;
+		// the range of the token's text in the source
+		// (identifier or keyword, contents of a string literal, name after a prefix, or the operator itself)
+		uint32_t offset, length;
 		// the the line where the token is, and the range in the line
 		int line, pos_start, pos_end;
-		// each token has either of these values
-		// the value of the token is stored in `value` if it is integer, `value_str` if it is string
-		int value;
-		std::string value_str;
-		// constructor with integer value
-		Token(token_t type, int value, int line, int pos_start, int pos_end) {
-			this->type = type;
-			this->value = value;
-			this->line = line;
-			this->pos_start = pos_start;
-			this->pos_end = pos_end;
-		}
-		// constructor with string value
-		Token(token_t type, std::string value_str, int line, int pos_start, int pos_end) {
-			this->value = -1;
-			this->type = type;
-			this->value_str = value_str;
-			this->line = line;
-			this->pos_start = pos_start;
-			this->pos_end = pos_end;
-		}
 	};
+
+	// get the text of the token from the source it was made from
+	inline std::string_view text(const Token& t, std::string_view src) {
+		return src.substr(t.offset, t.length);
+	}
 }
\ No newline at end of file
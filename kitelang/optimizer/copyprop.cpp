@@ -0,0 +1,21 @@
+#include "passes.h"
+
+size_t optimizer::propagate_copies(ir::Function& fn) {
+	std::vector<int> map(fn.values.size(), -1);
+	size_t removed = 0;
+	for (const ir::Block& block : fn.blocks) {
+		if (block.removed) continue;
+		for (int v : block.code) {
+			ir::Ins& ins = fn.values[v];
+			if (ins.op == ir::COPY) map[v] = ins.ops[0];
+			// the operand is not wider than the type (the values are kept zero extended)
+			else if (ins.op == ir::TRUNC && ir::bytes(fn.values[ins.ops[0]].type) <= ir::bytes(ins.type)) map[v] = ins.ops[0];
+			else continue;
+			ins.op = ir::NOP;
+			ins.block = -1;
+			removed++;
+		}
+	}
+	if (removed) ir::replace(fn, map);
+	return removed + ir::remove_trivial_phis(fn);
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "passes.h"
+
+namespace {
+	// the instruction only gives a value, it can go when the value is not used
+	bool removable(const ir::Ins& ins) {
+		switch (ins.op) {
+		case ir::PHI:
+		case ir::ARG:
+		case ir::REG:
+		case ir::GET:
+			return true;
+		default:
+			return ir::pure(ins);
+		}
+	}
+}
+
+size_t optimizer::remove_dead_code(ir::Function& fn) {
+	// the instructions that have to stay and everything they use are live
+	std::vector<char> live(fn.values.size(), 0);
+	std::vector<int> work;
+	for (const ir::Block& block : fn.blocks) {
+		if (block.removed) continue;
+		for (int v : block.code)
+			if (fn.values[v].op != ir::NOP && !removable(fn.values[v])) {
+				live[v] = 1;
+				work.push_back(v);
+			}
+	}
+	while (!work.empty()) {
+		int v = work.back();
+		work.pop_back();
+		for (int o : fn.values[v].ops)
+			if (!live[o]) {
+				live[o] = 1;
+				work.push_back(o);
+			}
+	}
+	size_t removed = 0;
+	for (const ir::Block& block : fn.blocks) {
+		if (block.removed) continue;
+		for (int v : block.code) {
+			ir::Ins& ins = fn.values[v];
+			if (ins.op == ir::NOP || live[v]) continue;
+			ins.op = ir::NOP;
+			ins.block = -1;
+			removed++;
+		}
+	}
+	return removed;
+}
\ No newline at end of file
@@ -0,0 +1,324 @@
+#include "folder.h"
+
+namespace {
+	// the value of a literal, false if the expression is not one
+	bool constant(parser::Node* node, int64_t& value) {
+		if (node->type == parser::INT_LIT) {
+			value = static_cast<parser::IntLitNode*>(node)->value;
+			return true;
+		}
+		// a character is sign extended, like codegen moves it
+		if (node->type == parser::CHAR_LIT) {
+			value = (int)static_cast<parser::CharLitNode*>(node)->value;
+			return true;
+		}
+		return false;
+	}
+
+	// the expression only reads (no calls and no assignments)
+	bool pure(parser::Node* node) {
+		switch (node->type) {
+		case parser::BINOP: {
+			parser::BinOpNode* n = static_cast<parser::BinOpNode*>(node);
+			return n->operation != lexer::EQ && pure(n->left) && pure(n->right);
+		}
+		case parser::IDX:
+			return pure(static_cast<parser::IndexNode*>(node)->index);
+		case parser::CALL:
+			return false;
+		default:
+			return true;
+		}
+	}
+
+	// the value a variable of the type holds once it is stored (truncated and zero extended)
+	int64_t truncate(int64_t value, ktypes::ktype_t type) {
+		int size = type == ktypes::ANY || type == ktypes::VOID ? 8 : ktypes::size(type);
+		if (size >= 8) return value;
+		return (int64_t)((uint64_t)value & ((1ull << (size * 8)) - 1));
+	}
+
+	// a op b the way the generated code computes it, false if it cannot be known here
+	bool compute(lexer::token_t op, int64_t a, int64_t b, int64_t& result) {
+		switch (op) {
+		case lexer::PLUS: result = (int64_t)((uint64_t)a + (uint64_t)b); return true;
+		case lexer::MINUS: result = (int64_t)((uint64_t)a - (uint64_t)b); return true;
+		case lexer::MUL: result = (int64_t)((uint64_t)a * (uint64_t)b); return true;
+		case lexer::DIV:
+		case lexer::MOD:
+			// rdx is cleared before idiv, so a negative dividend is not divided like here (it faults)
+			if (a < 0 || b == 0) return false;
+			result = op == lexer::DIV ? a / b : a % b;
+			return true;
+		case lexer::EQEQ: result = a == b; return true;
+		case lexer::NEQEQ: result = a != b; return true;
+		case lexer::GT: result = a > b; return true;
+		case lexer::LT: result = a < b; return true;
+		case lexer::GTE: result = a >= b; return true;
+		case lexer::LTE: result = a <= b; return true;
+		default: return false;
+		}
+	}
+}
+
+void optimizer::Folder::fold(parser::RootNode* root) {
+	// the variables of the top-level statements are shared by them, only the ones of functions are replaced
+	propagate = false;
+	returns = ktypes::ANY;
+	block(root);
+}
+
+parser::Node* optimizer::Folder::fold(parser::Node* node) {
+	propagate = false;
+	returns = ktypes::ANY;
+	return statement(node);
+}
+
+void optimizer::Folder::function(parser::FnNode* node) {
+	// a function may be declared inside a block, the one around it goes on after it
+	std::vector<Constant> outerConstants = std::move(constants);
+	std::vector<bool> outerPinned = std::move(pinned);
+	bool outerPropagate = propagate;
+	ktypes::ktype_t outerReturns = returns;
+	constants.clear();
+	pinned.clear();
+	propagate = true;
+	returns = node->returns;
+
+	// the arguments are the first slots
+	for (int i = 0; i < (int)node->args.size(); i++) pin(i);
+	pin(node->root);
+	block(node->root);
+
+	constants = std::move(outerConstants);
+	pinned = std::move(outerPinned);
+	propagate = outerPropagate;
+	returns = outerReturns;
+}
+
+void optimizer::Folder::pin(int slot) {
+	if (slot < 0) return;
+	if (slot >= (int)pinned.size()) pinned.resize(slot + 1);
+	pinned[slot] = true;
+}
+
+void optimizer::Folder::pin(parser::Node* node) {
+	switch (node->type) {
+	case parser::ROOT:
+		for (parser::Node* n : static_cast<parser::RootNode*>(node)->statements) pin(n);
+		return;
+	case parser::BINOP: {
+		parser::BinOpNode* n = static_cast<parser::BinOpNode*>(node);
+		if (n->operation == lexer::EQ && n->left->type == parser::VAR) pin(static_cast<parser::VarNode*>(n->left)->slot);
+		pin(n->left);
+		pin(n->right);
+		return;
+	}
+	// the variables pointers are read from stay variables
+	case parser::DEREF:
+		pin(static_cast<parser::DerefNode*>(node)->slot);
+		return;
+	case parser::IDX:
+		pin(static_cast<parser::IndexNode*>(node)->slot);
+		pin(static_cast<parser::IndexNode*>(node)->index);
+		return;
+	case parser::ADDROF:
+		pin(static_cast<parser::AddrOfNode*>(node)->slot);
+		return;
+	case parser::CALL:
+		for (parser::Node* arg : static_cast<parser::CallNode*>(node)->args) pin(arg);
+		return;
+	case parser::RETURN:
+		if (returns != ktypes::VOID) pin(static_cast<parser::ReturnNode*>(node)->value);
+		return;
+	case parser::LET: {
+		parser::LetNode* n = static_cast<parser::LetNode*>(node);
+		if (n->isAlloc) pin(n->slot);
+		else pin(n->root);
+		return;
+	}
+	case parser::IF: {
+		parser::IfNode* n = static_cast<parser::IfNode*>(node);
+		pin(n->condition);
+		pin(n->block);
+		if (n->has_else_block) pin(n->else_block);
+		return;
+	}
+	case parser::CMP: {
+		parser::CmpNode* n = static_cast<parser::CmpNode*>(node);
+		pin(n->val1);
+		pin(n->val2);
+		for (const auto& [key, root] : n->comparisons) pin(root);
+		return;
+	}
+	case parser::FOR: {
+		parser::ForNode* n = static_cast<parser::ForNode*>(node);
+		pin(n->slot);
+		pin(n->initVal);
+		pin(n->root);
+		pin(n->stepVal);
+		pin(n->targetVal);
+		return;
+	}
+	case parser::LOOP:
+		pin(static_cast<parser::LoopNode*>(node)->root);
+		return;
+	// asm blocks may change the variables on the stack
+	case parser::ASM:
+	case parser::CDIRECT:
+		propagate = false;
+		return;
+	default:
+		// a nested function has variables of its own
+		return;
+	}
+}
+
+void optimizer::Folder::block(parser::RootNode* node) {
+	size_t kept = 0;
+	for (parser::Node* n : node->statements) {
+		if (n->type == parser::LET && !static_cast<parser::LetNode*>(n)->isAlloc) {
+			parser::LetNode* let = static_cast<parser::LetNode*>(n);
+			let->root = expr(let->root);
+			int64_t value;
+			if (propagate && let->slot >= 0 && !(let->slot < (int)pinned.size() && pinned[let->slot]) && constant(let->root, value)) {
+				if (let->slot >= (int)constants.size()) constants.resize(let->slot + 1);
+				constants[let->slot] = Constant{ true, truncate(value, let->varType) };
+				// every use of the variable is replaced, it is not declared anymore
+				continue;
+			}
+			node->statements[kept++] = n;
+			continue;
+		}
+		node->statements[kept++] = statement(n);
+	}
+	node->statements.resize(kept);
+}
+
+parser::Node* optimizer::Folder::statement(parser::Node* node) {
+	switch (node->type) {
+	case parser::ROOT:
+		block(static_cast<parser::RootNode*>(node));
+		return node;
+	case parser::FN:
+		function(static_cast<parser::FnNode*>(node));
+		return node;
+	case parser::RETURN: {
+		// the value of a return from a void function is not checked nor generated
+		parser::ReturnNode* n = static_cast<parser::ReturnNode*>(node);
+		if (returns != ktypes::VOID) n->value = expr(n->value);
+		return node;
+	}
+	case parser::LET: {
+		parser::LetNode* n = static_cast<parser::LetNode*>(node);
+		if (!n->isAlloc) n->root = expr(n->root);
+		return node;
+	}
+	case parser::IF: {
+		parser::IfNode* n = static_cast<parser::IfNode*>(node);
+		n->condition = expr(n->condition);
+		n->block = statement(n->block);
+		if (n->has_else_block) n->else_block = statement(n->else_block);
+		return node;
+	}
+	case parser::CMP: {
+		parser::CmpNode* n = static_cast<parser::CmpNode*>(node);
+		n->val1 = expr(n->val1);
+		n->val2 = expr(n->val2);
+		for (const auto& [key, root] : n->comparisons) block(root);
+		return node;
+	}
+	case parser::FOR: {
+		parser::ForNode* n = static_cast<parser::ForNode*>(node);
+		n->initVal = expr(n->initVal);
+		n->root = statement(n->root);
+		n->stepVal = expr(n->stepVal);
+		n->targetVal = expr(n->targetVal);
+		return node;
+	}
+	case parser::LOOP: {
+		parser::LoopNode* n = static_cast<parser::LoopNode*>(node);
+		n->root = statement(n->root);
+		return node;
+	}
+	case parser::EXTERN:
+	case parser::GLOBAL:
+	case parser::ASM:
+	case parser::CDIRECT:
+	case parser::BREAK:
+	case parser::CONTINUE:
+		return node;
+	default:
+		return expr(node);
+	}
+}
+
+parser::Node* optimizer::Folder::expr(parser::Node* node) {
+	switch (node->type) {
+	case parser::VAR: {
+		int slot = static_cast<parser::VarNode*>(node)->slot;
+		if (slot < 0 || slot >= (int)constants.size() || !constants[slot].known) return node;
+		propagateCount++;
+		return literal(constants[slot].value, node);
+	}
+	case parser::IDX: {
+		parser::IndexNode* n = static_cast<parser::IndexNode*>(node);
+		n->index = expr(n->index);
+		return node;
+	}
+	case parser::CALL:
+		for (parser::Node*& arg : static_cast<parser::CallNode*>(node)->args) arg = expr(arg);
+		return node;
+	case parser::BINOP:
+		return binop(static_cast<parser::BinOpNode*>(node));
+	default:
+		return node;
+	}
+}
+
+parser::Node* optimizer::Folder::binop(parser::BinOpNode* node) {
+	if (node->operation == lexer::EQ) {
+		node->right = expr(node->right);
+		if (node->left->type == parser::IDX) expr(node->left);
+		return node;
+	}
+	node->left = expr(node->left);
+	node->right = expr(node->right);
+
+	int64_t a, b, result;
+	bool left = constant(node->left, a), right = constant(node->right, b);
+	if (left && right) {
+		if (!compute(node->operation, a, b, result)) return node;
+		foldCount++;
+		return literal(result, node);
+	}
+
+	// the identities, the operand left is computed the same way on its own
+	parser::Node* simplified = nullptr;
+	switch (node->operation) {
+	case lexer::PLUS:
+		if (right && b == 0) simplified = node->left;
+		else if (left && a == 0) simplified = node->right;
+		break;
+	case lexer::MINUS:
+		if (right && b == 0) simplified = node->left;
+		break;
+	case lexer::MUL:
+		if (right && b == 1) simplified = node->left;
+		else if (left && a == 1) simplified = node->right;
+		// the other operand is not computed at all
+		else if ((right && b == 0 && pure(node->left)) || (left && a == 0 && pure(node->right))) simplified = literal(0, node);
+		break;
+	default:
+		break;
+	}
+	if (simplified == nullptr) return node;
+	simplifyCount++;
+	return simplified;
+}
+
+parser::Node* optimizer::Folder::literal(int64_t value, parser::Node* at) {
+	parser::IntLitNode* n = arena.make<parser::IntLitNode>(value, at->line, at->pos_start, at->pos_end);
+	n->valueType = at->valueType;
+	return n;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "../parser/node.h"
+#include "../parser/arena.h"
+
+namespace optimizer {
+	// Folder
+	// the constant folding pass, run over the checked tree before codegen (-O)
+	// constant subexpressions become literals, the variables of a function that are set once by
+	// a constant `let` and never assigned (or pointed to) are replaced by their value, and
+	// additions of 0 and multiplications by 1 or 0 are simplified
+	// values wrap around in 64 bits like the generated code, a division only folds when the code
+	// would give the same quotient (it does not sign extend the dividend, and may fault)
+	class Folder {
+	private:
+		parser::Arena& arena;							// the literals are made in it
+		struct Constant {
+			bool known = false;
+			int64_t value = 0;
+		};
+		std::vector<Constant> constants;				// per variable slot of the current function
+		std::vector<bool> pinned;						// per variable slot, it cannot be replaced
+		bool propagate = false;							// the function has no asm blocks
+		ktypes::ktype_t returns = ktypes::ANY;			// return type of the current function
+		size_t foldCount = 0;
+		size_t propagateCount = 0;
+		size_t simplifyCount = 0;
+
+		void function(parser::FnNode*);
+		void pin(parser::Node*);						// find the variables that cannot be replaced
+		void pin(int slot);
+		void block(parser::RootNode*);
+		parser::Node* statement(parser::Node*);
+		parser::Node* expr(parser::Node*);
+		parser::Node* binop(parser::BinOpNode*);
+		parser::Node* literal(int64_t value, parser::Node* at);
+	public:
+		explicit Folder(parser::Arena& a) : arena(a) {}
+		void fold(parser::RootNode*);
+		// streaming, one top-level statement at a time, returns what replaces it
+		parser::Node* fold(parser::Node*);
+		size_t folded() const { return foldCount; }				// subexpressions made literals
+		size_t propagated() const { return propagateCount; }	// uses of variables replaced
+		size_t simplified() const { return simplifyCount; }		// operations with an identity removed
+	};
+}
\ No newline at end of file
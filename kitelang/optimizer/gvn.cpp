@@ -0,0 +1,98 @@
+#include "passes.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+	// what a pure instruction computes: the same key is the same value
+	struct Key {
+		ir::op_t op;
+		ir::type_t type;
+		ir::cond_t cc;
+		int64_t value;
+		int a, b;
+		bool operator==(const Key& o) const {
+			return op == o.op && type == o.type && cc == o.cc && value == o.value && a == o.a && b == o.b;
+		}
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& k) const {
+			uint64_t h = (uint64_t)k.op << 56 ^ (uint64_t)k.type << 48 ^ (uint64_t)k.cc << 40;
+			h ^= (uint64_t)k.value * 0x9e3779b97f4a7c15ull;
+			h ^= ((uint64_t)(uint32_t)k.a << 32 | (uint32_t)k.b) * 0xff51afd7ed558ccdull;
+			return (size_t)(h ^ h >> 29);
+		}
+	};
+}
+
+size_t optimizer::number_values(ir::Function& fn) {
+	std::vector<int> order = ir::reverse_postorder(fn);
+	std::vector<int> idom = ir::dominators(fn, order);
+	std::vector<std::vector<int>> children(fn.blocks.size());
+	for (int b : order)
+		if (idom[b] >= 0) children[idom[b]].push_back(b);
+
+	std::vector<int> map(fn.values.size(), -1);
+	auto find = [&](int v) {
+		while (map[v] >= 0) v = map[v];
+		return v;
+	};
+	auto constant = [&](int v, int64_t c) {
+		return fn.values[v].op == ir::CONST && fn.values[v].value == c;
+	};
+	// the values seen in the dominators of the block, a scope per block on the way down the tree
+	std::unordered_map<Key, int, KeyHash> seen;
+	std::vector<Key> added;
+	std::vector<std::pair<int, size_t>> stack{ { 0, 0 } };
+	std::vector<size_t> scopes;
+	size_t replaced = 0;
+	while (!stack.empty()) {
+		auto [b, next] = stack.back();
+		if (next == 0) {
+			scopes.push_back(added.size());
+			for (int v : fn.blocks[b].code) {
+				ir::Ins& ins = fn.values[v];
+				if (ins.op == ir::NOP) continue;
+				for (int& o : ins.ops) o = find(o);
+				if (!ir::pure(ins)) continue;
+				int a = ins.ops.size() > 0 ? ins.ops[0] : -1, c = ins.ops.size() > 1 ? ins.ops[1] : -1;
+				// x + 0, x - 0 and x * 1 are x
+				int same = -1;
+				if ((ins.op == ir::ADD || ins.op == ir::SUB) && constant(c, 0)) same = a;
+				else if (ins.op == ir::ADD && constant(a, 0)) same = c;
+				else if (ins.op == ir::MUL && constant(c, 1)) same = a;
+				else if (ins.op == ir::MUL && constant(a, 1)) same = c;
+				// the result is as wide as the operand only when the type says so
+				if (same >= 0 && ir::bytes(fn.values[same].type) > ir::bytes(ins.type)) same = -1;
+				if (same < 0) {
+					// the operands of the commutative ones in one order
+					if ((ins.op == ir::ADD || ins.op == ir::MUL || (ins.op == ir::CMP && (ins.cc == ir::EQ || ins.cc == ir::NE))) && a > c) std::swap(a, c);
+					Key key{ ins.op, ins.type, ins.op == ir::CMP ? ins.cc : ir::EQ, ins.value, a, c };
+					auto [it, inserted] = seen.emplace(key, v);
+					if (inserted) {
+						added.push_back(key);
+						continue;
+					}
+					same = it->second;
+				}
+				map[v] = same;
+				ins.op = ir::NOP;
+				ins.block = -1;
+				replaced++;
+			}
+		}
+		if (next < children[b].size()) {
+			stack.back().second++;
+			stack.push_back({ children[b][next], 0 });
+			continue;
+		}
+		// the values of the block are not seen from its siblings
+		for (size_t i = scopes.back(); i < added.size(); i++) seen.erase(added[i]);
+		added.resize(scopes.back());
+		scopes.pop_back();
+		stack.pop_back();
+	}
+	// the phis, which may read a value of a block visited after them
+	if (replaced) ir::replace(fn, map);
+	return replaced;
+}
\ No newline at end of file
@@ -0,0 +1,305 @@
+#include "passes.h"
+#include <algorithm>
+
+namespace {
+	// loops of at most this many iterations are unrolled when all their copies together stay
+	// this small (in instructions)
+	constexpr int UNROLL_TRIPS = 8;
+	constexpr size_t UNROLL_SIZE = 64;
+
+	// a natural loop: the header dominates its blocks, which reach a back edge to it without
+	// passing it
+	struct Loop {
+		int header = -1;
+		std::vector<int> latches;				// the blocks with a back edge to the header
+		std::vector<int> blocks;				// in reverse postorder, the header first
+		std::vector<char> inside;				// per block
+		bool innermost = true;
+
+		bool contains(int b) const { return b >= 0 && b < (int)inside.size() && inside[b]; }
+	};
+
+	bool holds(ir::cond_t cc, int64_t a, int64_t b) {
+		switch (cc) {
+		case ir::EQ: return a == b;
+		case ir::NE: return a != b;
+		case ir::LT: return a < b;
+		case ir::GE: return a >= b;
+		case ir::LE: return a <= b;
+		default: return a > b;
+		}
+	}
+
+	// the invariant instructions of a loop go to the block before it, and a loop whose iterator
+	// counts from a constant by a constant to a constant few times is replaced by a copy of its
+	// body per iteration
+	class LoopOptimizer {
+	private:
+		ir::Function& fn;
+		std::vector<int> idom;
+		std::vector<Loop> loops;				// the inner ones first
+		std::vector<std::vector<int>> placed;	// per block, the new blocks laid out before it
+		size_t changes = 0;
+
+		bool dominates(int a, int b) const;
+		void find();
+		void adopt(int block, const Loop&);	// a new block before the loop is in the loops around it
+		int preheader(Loop&);					// the only block entering the loop (-1 if there are several)
+		void hoist(const Loop&, int pre);
+		int trips(const Loop&, int pre) const;	// of a loop that can be unrolled (0 if it cannot)
+		void unroll(const Loop&, int pre, int trips);
+	public:
+		explicit LoopOptimizer(ir::Function& f) : fn(f) {}
+		size_t run();
+	};
+}
+
+bool LoopOptimizer::dominates(int a, int b) const {
+	while (b >= 0 && b != a) b = idom[b];
+	return b == a;
+}
+
+void LoopOptimizer::find() {
+	std::vector<int> order = ir::reverse_postorder(fn);
+	idom = ir::dominators(fn, order);
+	std::vector<int> loopOf(fn.blocks.size(), -1);
+	for (int b : order) {
+		int succ[2];
+		for (int i = 0, n = fn.successors(b, succ); i < n; i++) {
+			int h = succ[i];
+			if (!dominates(h, b)) continue;
+			if (loopOf[h] < 0) {
+				loopOf[h] = (int)loops.size();
+				loops.emplace_back();
+				loops.back().header = h;
+				loops.back().inside.assign(fn.blocks.size(), 0);
+				loops.back().inside[h] = 1;
+			}
+			Loop& loop = loops[loopOf[h]];
+			loop.latches.push_back(b);
+			std::vector<int> work{ b };
+			while (!work.empty()) {
+				int x = work.back();
+				work.pop_back();
+				if (loop.inside[x]) continue;
+				loop.inside[x] = 1;
+				for (int p : fn.blocks[x].preds) work.push_back(p);
+			}
+		}
+	}
+	for (Loop& loop : loops) {
+		for (int b : order)
+			if (loop.inside[b]) loop.blocks.push_back(b);
+		for (const Loop& other : loops) loop.innermost = loop.innermost && (other.header == loop.header || !loop.inside[other.header]);
+	}
+	// what an inner loop hoists can leave the loops around it too
+	std::stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+}
+
+void LoopOptimizer::adopt(int block, const Loop& inner) {
+	for (Loop& loop : loops) {
+		if (loop.header == inner.header || !loop.contains(inner.header)) continue;
+		loop.inside.resize(fn.blocks.size(), 0);
+		loop.inside[block] = 1;
+		loop.blocks.insert(std::find(loop.blocks.begin(), loop.blocks.end(), inner.header), block);
+	}
+	placed[inner.header].push_back(block);
+}
+
+int LoopOptimizer::preheader(Loop& loop) {
+	int outside = -1, entries = 0;
+	for (int p : fn.blocks[loop.header].preds)
+		if (!loop.contains(p)) {
+			outside = p;
+			entries++;
+		}
+	if (entries != 1) return -1;
+	int t = fn.blocks[outside].code.back();
+	if (fn.values[t].op == ir::JMP) return outside;
+	// the edge from a branch gets a block of its own
+	int pre = fn.block(fn.blocks[loop.header].name + "_pre");
+	int jmp = fn.add(pre, ir::JMP, ir::VOID, {}, 0, fn.values[t].depth);
+	fn.values[jmp].target[0] = loop.header;
+	for (int& target : fn.values[t].target)
+		if (target == loop.header) target = pre;
+	fn.blocks[pre].preds.push_back(outside);
+	std::replace(fn.blocks[loop.header].preds.begin(), fn.blocks[loop.header].preds.end(), outside, pre);
+	adopt(pre, loop);
+	return pre;
+}
+
+void LoopOptimizer::hoist(const Loop& loop, int pre) {
+	for (int b : loop.blocks) {
+		if (fn.blocks[b].removed) continue;
+		std::vector<int>& code = fn.blocks[b].code;
+		size_t kept = 0;
+		for (int v : code) {
+			ir::Ins& ins = fn.values[v];
+			// only computes its value, from values of before the loop
+			bool invariant = ins.op != ir::NOP && ir::pure(ins);
+			for (int o : ins.ops) invariant = invariant && !loop.contains(fn.values[o].block);
+			if (!invariant) {
+				code[kept++] = v;
+				continue;
+			}
+			std::vector<int>& before = fn.blocks[pre].code;
+			ins.block = pre;
+			ins.depth = fn.values[before.back()].depth;
+			before.insert(before.end() - 1, v);
+			changes++;
+		}
+		code.resize(kept);
+	}
+}
+
+int LoopOptimizer::trips(const Loop& loop, int pre) const {
+	if (!loop.innermost || loop.latches.size() != 1) return 0;
+	int latch = loop.latches[0];
+	const ir::Ins& br = fn.terminator(latch);
+	if (br.op != ir::BR) return 0;
+	// the latch is the only way out, and nothing in the loop is an asm block (its labels would repeat)
+	size_t size = 0;
+	for (int b : loop.blocks) {
+		int succ[2];
+		for (int i = 0, n = fn.successors(b, succ); i < n; i++)
+			if (b != latch && !loop.contains(succ[i])) return 0;
+		for (int v : fn.blocks[b].code) {
+			if (fn.values[v].op == ir::ASM) return 0;
+			size += fn.values[v].op != ir::NOP;
+		}
+	}
+
+	// the branch compares the iterator after the step with a constant
+	const ir::Ins& cmp = fn.values[br.ops[0]];
+	if (cmp.op != ir::CMP) return 0;
+	ir::cond_t cc = cmp.cc;
+	int stepped = cmp.ops[0], limit = cmp.ops[1];
+	if (fn.values[stepped].op == ir::CONST) {
+		std::swap(stepped, limit);
+		static const ir::cond_t swapped[] = { ir::EQ, ir::NE, ir::GT, ir::LE, ir::GE, ir::LT };
+		cc = swapped[cc];
+	}
+	const ir::Ins& step = fn.values[stepped];
+	if (fn.values[limit].op != ir::CONST || (step.op != ir::ADD && step.op != ir::SUB) || step.type != ir::I64) return 0;
+	int iterator = step.ops[0], by = step.ops[1];
+	if (step.op == ir::ADD && fn.values[iterator].op == ir::CONST) std::swap(iterator, by);
+	const ir::Ins& phi = fn.values[iterator];
+	if (phi.op != ir::PHI || phi.block != loop.header || fn.values[by].op != ir::CONST) return 0;
+	const std::vector<int>& preds = fn.blocks[loop.header].preds;
+	size_t entry = std::find(preds.begin(), preds.end(), pre) - preds.begin();
+	size_t back = std::find(preds.begin(), preds.end(), latch) - preds.begin();
+	if (entry == preds.size() || back == preds.size() || phi.ops[back] != stepped || fn.values[phi.ops[entry]].op != ir::CONST) return 0;
+
+	// every iteration runs the body once before the test
+	uint64_t i = (uint64_t)fn.values[phi.ops[entry]].value;
+	uint64_t delta = (uint64_t)fn.values[by].value;
+	if (step.op == ir::SUB) delta = 0 - delta;
+	for (int n = 1; n <= UNROLL_TRIPS && size * n <= UNROLL_SIZE; n++) {
+		i += delta;
+		bool again = holds(cc, (int64_t)i, fn.values[limit].value) == (br.target[0] == loop.header);
+		if (!again) return n;
+	}
+	return 0;
+}
+
+void LoopOptimizer::unroll(const Loop& loop, int pre, int trips) {
+	int latch = loop.latches[0];
+	size_t values = fn.values.size();
+	std::vector<int> position(fn.blocks.size(), -1);
+	for (size_t i = 0; i < loop.blocks.size(); i++) position[loop.blocks[i]] = (int)i;
+	const std::vector<int>& preds = fn.blocks[loop.header].preds;
+	size_t entry = std::find(preds.begin(), preds.end(), pre) - preds.begin();
+	size_t back = std::find(preds.begin(), preds.end(), latch) - preds.begin();
+	const ir::Ins& br = fn.terminator(latch);
+	int after = br.target[0] == loop.header ? br.target[1] : br.target[0];
+
+	// per iteration, the blocks and values of its copy
+	std::vector<std::vector<int>> blocks(trips), copies(trips, std::vector<int>(values, -1));
+	auto copy = [&](int k, int v) { return v < (int)values && copies[k][v] >= 0 ? copies[k][v] : v; };
+	for (int k = 0; k < trips; k++)
+		for (int b : loop.blocks) {
+			int block = fn.block(fn.blocks[b].name + "_" + std::to_string(k));
+			blocks[k].push_back(block);
+			adopt(block, loop);
+		}
+	for (int k = 0; k < trips; k++) {
+		// the iterator comes in from before the loop, then from the iteration before
+		for (int v : fn.blocks[loop.header].code) {
+			const ir::Ins& phi = fn.values[v];
+			if (phi.op == ir::NOP) continue;
+			if (phi.op != ir::PHI) break;
+			copies[k][v] = k == 0 ? phi.ops[entry] : copy(k - 1, phi.ops[back]);
+		}
+		for (size_t i = 0; i < loop.blocks.size(); i++) {
+			int b = loop.blocks[i], block = blocks[k][i];
+			if (b == loop.header) fn.blocks[block].preds.push_back(k == 0 ? pre : blocks[k - 1][position[latch]]);
+			else
+				for (int p : fn.blocks[b].preds) fn.blocks[block].preds.push_back(blocks[k][position[p]]);
+			for (size_t j = 0; j < fn.blocks[b].code.size(); j++) {
+				int v = fn.blocks[b].code[j];
+				ir::Ins ins = fn.values[v];
+				if (ins.op == ir::NOP || (b == loop.header && ins.op == ir::PHI)) continue;
+				if (b == latch && ins.op == ir::BR) {
+					int jmp = fn.add(block, ir::JMP, ir::VOID, {}, 0, ins.depth);
+					fn.values[jmp].target[0] = k + 1 < trips ? blocks[k + 1][0] : after;
+					continue;
+				}
+				for (int& o : ins.ops) o = copy(k, o);
+				for (int& t : ins.target)
+					if (t >= 0) t = blocks[k][position[t]];
+				int c = fn.add(block, ins.op, ins.type, ins.ops, ins.value, ins.depth);
+				fn.values[c].cc = ins.cc;
+				fn.values[c].target[0] = ins.target[0];
+				fn.values[c].target[1] = ins.target[1];
+				copies[k][v] = c;
+			}
+		}
+	}
+
+	// the code after the loop gets the values of the last iteration
+	std::vector<int> map(fn.values.size(), -1);
+	for (int b : loop.blocks) {
+		for (int v : fn.blocks[b].code) {
+			map[v] = copy(trips - 1, v);
+			fn.values[v].op = ir::NOP;
+			fn.values[v].block = -1;
+			changes++;
+		}
+		fn.blocks[b].code.clear();
+		fn.blocks[b].preds.clear();
+		fn.blocks[b].removed = true;
+	}
+	ir::Ins& enter = fn.values[fn.blocks[pre].code.back()];
+	enter.target[0] = blocks[0][0];
+	std::replace(fn.blocks[after].preds.begin(), fn.blocks[after].preds.end(), latch, blocks[trips - 1][position[latch]]);
+	ir::replace(fn, map);
+}
+
+size_t LoopOptimizer::run() {
+	find();
+	if (loops.empty()) return 0;
+	size_t count = fn.blocks.size();
+	placed.assign(count, {});
+	for (Loop& loop : loops) {
+		int pre = preheader(loop);
+		if (pre < 0) {
+			fn.blocks[loop.header].loop = true;
+			continue;
+		}
+		hoist(loop, pre);
+		if (int n = trips(loop, pre)) unroll(loop, pre, n);
+		else fn.blocks[loop.header].loop = true;
+	}
+	// the new blocks go before the blocks they were made for
+	std::vector<int> order;
+	for (size_t b = 0; b < count; b++) {
+		order.insert(order.end(), placed[b].begin(), placed[b].end());
+		order.push_back((int)b);
+	}
+	ir::reorder(fn, order);
+	return changes;
+}
+
+size_t optimizer::optimize_loops(ir::Function& fn) {
+	return LoopOptimizer(fn).run();
+}
\ No newline at end of file
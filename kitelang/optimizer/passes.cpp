@@ -0,0 +1,32 @@
+#include "passes.h"
+#include "../ir/verifier.h"
+
+const char* optimizer::pass_name(pass_t pass) {
+	static const char* names[] = { "sccp", "copy propagation", "value numbering", "loops", "dead code" };
+	return names[pass];
+}
+
+optimizer::PassManager& optimizer::PassManager::standard() {
+	// constants first, so the rest sees the branches they decided gone, and again after the
+	// loops, whose unrolled iterations have constant iterators
+	add(SCCP).add(COPY_PROPAGATION).add(VALUE_NUMBERING).add(LOOPS);
+	return add(SCCP).add(COPY_PROPAGATION).add(VALUE_NUMBERING).add(DEAD_CODE);
+}
+
+void optimizer::PassManager::run(ir::Function& fn) {
+	ir::verify(fn);
+	for (pass_t pass : passes) {
+		size_t changed = 0;
+		switch (pass) {
+		case SCCP: changed = propagate_constants(fn); break;
+		case COPY_PROPAGATION: changed = propagate_copies(fn); break;
+		case VALUE_NUMBERING: changed = number_values(fn); break;
+		case LOOPS: changed = optimize_loops(fn); break;
+		case DEAD_CODE: changed = remove_dead_code(fn); break;
+		default: break;
+		}
+		counts[pass] += changed;
+		if (changed) ir::verify(fn);
+	}
+	ir::compact(fn);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "../ir/ir.h"
+
+namespace optimizer {
+	// the passes over the IR, each returns the amount of instructions it removed or changed
+	typedef enum {
+		SCCP,				// sparse conditional constant propagation, folds the branches it decides
+		COPY_PROPAGATION,	// uses of copies, of phis merging one value and of truncations that change nothing
+		VALUE_NUMBERING,	// an instruction computing what a dominating one did is replaced by it
+		LOOPS,				// invariant instructions leave loops, loops of a few constant iterations are unrolled
+		DEAD_CODE,			// instructions whose values are never used
+		PASSES,
+	} pass_t;
+	const char* pass_name(pass_t);
+
+	size_t propagate_constants(ir::Function&);
+	size_t propagate_copies(ir::Function&);
+	size_t number_values(ir::Function&);
+	size_t optimize_loops(ir::Function&);
+	size_t remove_dead_code(ir::Function&);
+
+	// PassManager
+	// runs its passes in order over a function, verifying it after every pass (see ir::verify),
+	// and drops the instructions they removed at the end
+	class PassManager {
+	private:
+		std::vector<pass_t> passes;
+		size_t* counts;							// changes per pass
+	public:
+		explicit PassManager(size_t* changes) : counts(changes) {}
+		PassManager& add(pass_t pass) {
+			passes.push_back(pass);
+			return *this;
+		}
+		// the passes of -O
+		PassManager& standard();
+		void run(ir::Function&);
+	};
+}
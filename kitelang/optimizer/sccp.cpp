@@ -0,0 +1,241 @@
+#include "passes.h"
+#include <algorithm>
+
+namespace {
+	// a value of the lattice: not known yet (only reached on edges not taken so far), one
+	// constant, or anything
+	struct Lattice {
+		enum { TOP, CONSTANT, BOTTOM } kind = TOP;
+		int64_t value = 0;
+	};
+
+	// the value cut to the type and zero extended, like it is kept in a register
+	int64_t cut(int64_t value, ir::type_t type) {
+		switch (ir::bytes(type)) {
+		case 1: return (uint8_t)value;
+		case 2: return (uint16_t)value;
+		case 4: return (uint32_t)value;
+		default: return value;
+		}
+	}
+
+	bool holds(ir::cond_t cc, int64_t a, int64_t b) {
+		switch (cc) {
+		case ir::EQ: return a == b;
+		case ir::NE: return a != b;
+		case ir::LT: return a < b;
+		case ir::GE: return a >= b;
+		case ir::LE: return a <= b;
+		default: return a > b;
+		}
+	}
+
+	// Wegman and Zadeck, "Constant Propagation with Conditional Branches": the values start
+	// unknown and only get lower, the blocks are only visited once an edge into them is taken
+	class Propagation {
+	private:
+		ir::Function& fn;
+		std::vector<Lattice> values;
+		std::vector<char> reached;					// per block
+		std::vector<std::vector<char>> taken;		// per block, per predecessor, the edge is taken
+		std::vector<std::vector<int>> users;		// per value, the instructions reading it
+		std::vector<std::pair<int, int>> edges;		// (from, to) to take
+		std::vector<int> changed;					// values that got lower
+
+		Lattice evaluate(const ir::Ins&) const;
+		void visit(int v);
+		void take(int from, int to);
+		void lower(int v, Lattice l);
+	public:
+		explicit Propagation(ir::Function& f) : fn(f) {}
+		size_t run();
+	};
+}
+
+Lattice Propagation::evaluate(const ir::Ins& ins) const {
+	Lattice l;
+	switch (ins.op) {
+	case ir::CONST:
+		l.kind = Lattice::CONSTANT;
+		l.value = ins.value;
+		return l;
+	case ir::PHI: {
+		// the operands on the edges taken so far meet
+		for (size_t k = 0; k < ins.ops.size(); k++) {
+			if (!taken[ins.block][k]) continue;
+			const Lattice& o = values[ins.ops[k]];
+			if (o.kind == Lattice::TOP) continue;
+			if (o.kind == Lattice::BOTTOM || (l.kind == Lattice::CONSTANT && l.value != o.value)) {
+				l.kind = Lattice::BOTTOM;
+				return l;
+			}
+			l = o;
+		}
+		return l;
+	}
+	case ir::COPY:
+	case ir::TRUNC:
+	case ir::ADD:
+	case ir::SUB:
+	case ir::MUL:
+	case ir::DIV:
+	case ir::MOD:
+	case ir::CMP:
+		break;
+	default:
+		l.kind = Lattice::BOTTOM;
+		return l;
+	}
+	for (int o : ins.ops) {
+		if (values[o].kind == Lattice::BOTTOM) {
+			l.kind = Lattice::BOTTOM;
+			return l;
+		}
+		if (values[o].kind == Lattice::TOP) return l;
+	}
+	int64_t a = values[ins.ops[0]].value, b = ins.ops.size() > 1 ? values[ins.ops[1]].value : 0;
+	l.kind = Lattice::CONSTANT;
+	// in 64 bits, wrapping around like the generated code
+	switch (ins.op) {
+	case ir::ADD: l.value = (int64_t)((uint64_t)a + (uint64_t)b); break;
+	case ir::SUB: l.value = (int64_t)((uint64_t)a - (uint64_t)b); break;
+	case ir::MUL: l.value = (int64_t)((uint64_t)a * (uint64_t)b); break;
+	// the dividend is not sign extended, only these give the quotient of the code (the others may fault)
+	case ir::DIV:
+	case ir::MOD:
+		if (a < 0 || b == 0) {
+			l.kind = Lattice::BOTTOM;
+			return l;
+		}
+		l.value = ins.op == ir::DIV ? a / b : a % b;
+		break;
+	case ir::CMP: l.value = holds(ins.cc, a, b); break;
+	default: l.value = a;
+	}
+	l.value = cut(l.value, ins.type);
+	return l;
+}
+
+void Propagation::lower(int v, Lattice l) {
+	Lattice& old = values[v];
+	if (l.kind == old.kind && (l.kind != Lattice::CONSTANT || l.value == old.value)) return;
+	// a value only gets lower
+	if (old.kind == Lattice::CONSTANT && l.kind == Lattice::CONSTANT) l.kind = Lattice::BOTTOM;
+	if (l.kind < old.kind) return;
+	old = l;
+	changed.push_back(v);
+}
+
+void Propagation::take(int from, int to) {
+	const std::vector<int>& preds = fn.blocks[to].preds;
+	size_t k = std::find(preds.begin(), preds.end(), from) - preds.begin();
+	if (from >= 0) {
+		if (taken[to][k]) return;
+		taken[to][k] = 1;
+	}
+	if (!reached[to]) {
+		reached[to] = 1;
+		for (int v : fn.blocks[to].code)
+			if (fn.values[v].op != ir::NOP) visit(v);
+		return;
+	}
+	// only the phis see the new edge
+	for (int v : fn.blocks[to].code) {
+		if (fn.values[v].op == ir::NOP) continue;
+		if (fn.values[v].op != ir::PHI) break;
+		visit(v);
+	}
+}
+
+void Propagation::visit(int v) {
+	const ir::Ins& ins = fn.values[v];
+	switch (ins.op) {
+	case ir::JMP:
+		edges.emplace_back(ins.block, ins.target[0]);
+		return;
+	case ir::BR: {
+		const Lattice& c = values[ins.ops[0]];
+		if (c.kind == Lattice::TOP) return;
+		if (c.kind == Lattice::BOTTOM || c.value) edges.emplace_back(ins.block, ins.target[0]);
+		if (c.kind == Lattice::BOTTOM || !c.value) edges.emplace_back(ins.block, ins.target[1]);
+		return;
+	}
+	default:
+		if (ins.type != ir::VOID) lower(v, evaluate(ins));
+	}
+}
+
+size_t Propagation::run() {
+	values.assign(fn.values.size(), Lattice());
+	reached.assign(fn.blocks.size(), 0);
+	taken.resize(fn.blocks.size());
+	users.resize(fn.values.size());
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		taken[b].assign(fn.blocks[b].preds.size(), 0);
+		for (int v : fn.blocks[b].code)
+			for (int o : fn.values[v].ops) users[o].push_back(v);
+	}
+	take(-1, 0);
+	while (!edges.empty() || !changed.empty()) {
+		if (!edges.empty()) {
+			auto [from, to] = edges.back();
+			edges.pop_back();
+			take(from, to);
+			continue;
+		}
+		int v = changed.back();
+		changed.pop_back();
+		for (int u : users[v])
+			if (fn.values[u].block >= 0 && reached[fn.values[u].block]) visit(u);
+	}
+
+	size_t folded = 0;
+	std::vector<int> phis;
+	for (size_t b = 0; b < fn.blocks.size(); b++) {
+		if (!reached[b]) continue;
+		for (int v : fn.blocks[b].code) {
+			ir::Ins& ins = fn.values[v];
+			if (ins.op == ir::NOP || ins.op == ir::CONST || values[v].kind != Lattice::CONSTANT) continue;
+			folded++;
+			if (ins.op == ir::PHI) {
+				phis.push_back(v);
+				continue;
+			}
+			ins.op = ir::CONST;
+			ins.value = values[v].value;
+			ins.ops.clear();
+		}
+		// a branch that always goes the same way jumps
+		ir::Ins& br = fn.values[fn.blocks[b].code.back()];
+		if (br.op != ir::BR || values[br.ops[0]].kind != Lattice::CONSTANT) continue;
+		bool on = values[br.ops[0]].value != 0;
+		ir::Block& succ = fn.blocks[br.target[on ? 1 : 0]];
+		size_t k = std::find(succ.preds.begin(), succ.preds.end(), (int)b) - succ.preds.begin();
+		succ.preds.erase(succ.preds.begin() + k);
+		for (int v : succ.code) {
+			if (fn.values[v].op == ir::NOP) continue;
+			if (fn.values[v].op != ir::PHI) break;
+			fn.values[v].ops.erase(fn.values[v].ops.begin() + k);
+		}
+		br.op = ir::JMP;
+		br.ops.clear();
+		br.target[0] = br.target[on ? 0 : 1];
+		br.target[1] = -1;
+		folded++;
+	}
+	// the phis stay at the start of their blocks, their constants are made at the start of the function
+	std::vector<int> map(fn.values.size(), -1);
+	for (int v : phis) {
+		int c = fn.insert(0, 0, ir::CONST, fn.values[v].type, {}, values[v].value);
+		fn.values[v].op = ir::NOP;
+		fn.values[v].block = -1;
+		map[v] = c;
+	}
+	map.resize(fn.values.size(), -1);
+	ir::replace(fn, map);
+	return folded + ir::remove_unreachable(fn);
+}
+
+size_t optimizer::propagate_constants(ir::Function& fn) {
+	return Propagation(fn).run();
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "arena.h"
+#include <cstdint>
+
+void* parser::Arena::allocate(size_t size, size_t align) {
+	uintptr_t p = ((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1);
+	if (cur == nullptr || p + size > (uintptr_t)end) {
+		grow(size, align);
+		p = ((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1);
+	}
+	cur = (char*)(p + size);
+	used += size;
+	return (void*)p;
+}
+
+void parser::Arena::grow(size_t size, size_t align) {
+	// objects larger than a block get a block of their own
+	size_t needed = sizeof(Block) + size + align;
+	size_t blksize = needed > blockSize ? needed : blockSize;
+	// through operator new, so the blocks are counted in the heap use (see stats::count_heap)
+	Block* b = static_cast<Block*>(::operator new(blksize));
+	b->next = blocks;
+	b->size = blksize;
+	blocks = b;
+	cur = (char*)(b + 1);
+	end = (char*)b + blksize;
+}
+
+void parser::Arena::release() {
+	// run destructors in reverse order of construction
+	for (Finalizer* f = finalizers; f != nullptr; f = f->next)
+		f->destroy(f->object);
+	finalizers = nullptr;
+	while (blocks != nullptr) {
+		Block* next = blocks->next;
+		::operator delete(blocks);
+		blocks = next;
+	}
+	cur = end = nullptr;
+	used = 0;
+	for (size_t& m : made) m = 0;
+}
+
+
+void parser::Arena::reset(const Mark& m) {
+	for (Finalizer* f = finalizers; f != m.finalizers; f = f->next)
+		f->destroy(f->object);
+	finalizers = m.finalizers;
+	while (blocks != m.blocks) {
+		Block* next = blocks->next;
+		::operator delete(blocks);
+		blocks = next;
+	}
+	// back to where the block of the mark was filled up to
+	cur = m.cur;
+	end = blocks ? (char*)blocks + blocks->size : nullptr;
+	used = m.used;
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace parser {
+	// Bump allocator that owns every node of a syntax tree
+	// nodes are carved out of large blocks and handed out as plain (non-owning) pointers,
+	// the whole tree is released at once when the arena is destroyed (or the part of it made
+	// after a mark, so one arena can hold the statements of a file one at a time)
+	class Arena {
+	private:
+		// header of each block of memory the arena allocates
+		struct Block {
+			Block* next;
+			size_t size;
+		};
+		// record of an object that needs its destructor run when the arena is released
+		// (nodes holding strings or vectors)
+		struct Finalizer {
+			Finalizer* next;
+			void (*destroy)(void*);
+			void* object;
+		};
+		static constexpr size_t blockSize = 64 * 1024;
+	public:
+		static constexpr size_t kinds = 32;	// highest `type` of the objects counted, plus one
+	private:
+		Block* blocks = nullptr;
+		Finalizer* finalizers = nullptr;
+		char* cur = nullptr;
+		char* end = nullptr;
+		size_t used = 0;
+		size_t made[kinds] = {};
+		void* allocate(size_t size, size_t align);
+		void grow(size_t size, size_t align);
+	public:
+		Arena() = default;
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+		~Arena() { release(); }
+
+		// construct an object of type T inside the arena
+		template <typename T, typename... Args>
+		T* make(Args&&... args) {
+			T* obj = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+			if constexpr (requires { obj->type; }) made[obj->type]++;
+			if constexpr (!std::is_trivially_destructible_v<T>) {
+				Finalizer* f = static_cast<Finalizer*>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+				f->next = finalizers;
+				f->destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+				f->object = obj;
+				finalizers = f;
+			}
+			return obj;
+		}
+
+		// the point the arena is at, the objects made after it can be destroyed with reset
+		struct Mark {
+			Block* blocks;
+			Finalizer* finalizers;
+			char* cur;
+			size_t used;
+		};
+		Mark mark() const { return Mark{ blocks, finalizers, cur, used }; }
+		// destroy every object made after the mark and free the blocks taken after it
+		// (the counts of the objects made are kept)
+		void reset(const Mark&);
+		// destroy every object and free every block
+		void release();
+		// amount of bytes handed out so far
+		size_t bytes() const { return used; }
+		// amount of objects made with the `type` (syntax tree nodes by parser::node_t)
+		size_t count(size_t type) const { return type < kinds ? made[type] : 0; }
+	};
+}
@@ -35,19 +35,28 @@ namespace parser {
 		LOOP,
 		CDIRECT
 	} node_t;
+	inline const char* node_name(node_t type) {
+		static const char* const names[] = {
+			"NONE", "ROOT", "BINOP", "STRING_LIT", "INT_LIT", "CHAR_LIT", "REG", "ADDROF", "DEREF", "EXTERN", "GLOBAL", "FN", "RETURN",
+			"BREAK", "CONTINUE", "CALL", "LET", "IDX", "VAR", "CMP", "IF", "ASM", "FOR", "LOOP", "CDIRECT"
+		};
+		return names[type];
+	}
 	class Node {
 	public:
 		node_t type = NONE;
 		int line;
 		int pos_start;
 		int pos_end;
+		// type of the value of an expression, set by semantics::Checker (ANY if it cannot be known)
+		ktypes::ktype_t valueType = ktypes::ANY;
 		virtual void print(int) const = 0;
 	};
 	class RootNode : public Node {
 	public:
-		std::vector<std::shared_ptr<Node>> statements;
-		RootNode(std::vector<std::shared_ptr<Node>> stmts, int line, int pos_start, int pos_end)
-			: statements(stmts) {
+		std::vector<Node*> statements;
+		RootNode(std::vector<Node*> stmts, int line, int pos_start, int pos_end)
+			: statements(std::move(stmts)) {
 			type = ROOT;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -56,21 +65,21 @@ namespace parser {
 		void print(int indent = 0) const {
 			for (int i = 0; i < indent; i++) std::cout << "--"; std::cout << ' ';
 			std::cout << "root" << std::endl;
-			for (std::shared_ptr<Node> st : statements) {
+			for (Node* st : statements) {
 				st->print(indent + 1);
 			}
 		}
 	};
 	class BinOpNode : public Node {
 	public:
-		std::shared_ptr<Node> left, right;
+		Node *left, *right;
 		lexer::token_t operation;
-		BinOpNode(std::shared_ptr<Node> l, lexer::token_t op, std::shared_ptr<Node> r, int line, int pos_start, int pos_end)
+		BinOpNode(Node* l, lexer::token_t op, Node* r, int line, int pos_start, int pos_end)
 			: left(l), right(r), operation(op) {
 			type = BINOP;
-			line = left->line;
-			pos_start = left->pos_start;
-			pos_end = right->pos_end;
+			this->line = line;
+			this->pos_start = pos_start;
+			this->pos_end = pos_end;
 		}
 		void print(int indent = 0) const {
 			for (int i = 0; i < indent; i++) std::cout << "--"; std::cout << ' ';
@@ -97,7 +106,7 @@ namespace parser {
 	public:
 		std::string value;
 		RegNode(std::string val, int line, int pos_start, int pos_end)
-			: value(val) {
+			: value(std::move(val)) {
 			type = REG;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -112,7 +121,7 @@ namespace parser {
 	public:
 		std::string value;
 		StringLitNode(std::string val, int line, int pos_start, int pos_end)
-			: value(val) {
+			: value(std::move(val)) {
 			type = STRING_LIT;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -125,8 +134,8 @@ namespace parser {
 	};
 	class IntLitNode : public Node {
 	public:
-		int value;
-		IntLitNode(int val, int line, int pos_start, int pos_end)
+		int64_t value;
+		IntLitNode(int64_t val, int line, int pos_start, int pos_end)
 			: value(val) {
 			type = INT_LIT;
 			this->line = line;
@@ -142,7 +151,7 @@ namespace parser {
 	public:
 		std::vector<ktypes::kfndec_t> symbols;
 		ExternNode(std::vector<ktypes::kfndec_t> rout, int line, int pos_start, int pos_end)
-			: symbols(rout) {
+			: symbols(std::move(rout)) {
 			type = EXTERN;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -161,7 +170,7 @@ namespace parser {
 	public:
 		std::vector<std::string> symbols;
 		GlobalNode(std::vector<std::string> rout, int line, int pos_start, int pos_end)
-			: symbols(rout) {
+			: symbols(std::move(rout)) {
 			type = GLOBAL;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -179,9 +188,11 @@ namespace parser {
 	class CallNode : public Node {
 	public:
 		std::string routine;
-		std::vector<std::shared_ptr<Node>> args;
-		CallNode(std::string rout, std::vector<std::shared_ptr<Node>> a, int line, int pos_start, int pos_end)
-			: routine(rout), args(a) {
+		int sym;                  // symbol ID of the routine
+		std::vector<Node*> args;
+		const ktypes::kfndec_t* decl = nullptr;  // the function called, set by semantics::Checker
+		CallNode(std::string rout, int sym, std::vector<Node*> a, int line, int pos_start, int pos_end)
+			: routine(std::move(rout)), sym(sym), args(std::move(a)) {
 			type = CALL;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -190,7 +201,7 @@ namespace parser {
 		void print(int indent = 0) const {
 			for (int i = 0; i < indent; i++) std::cout << "--"; std::cout << ' ';
 			std::cout << "call " << routine << std::endl;
-			for (std::shared_ptr<Node> st : args) {
+			for (Node* st : args) {
 				st->print(indent + 1);
 			}
 		}
@@ -198,12 +209,13 @@ namespace parser {
 	class FnNode : public Node {
 	public:
 		std::string name;
-		std::shared_ptr<RootNode> root;
+		int sym;                  // symbol ID of the name
+		RootNode* root;
 		std::vector<ktypes::kval_t> args;
 		ktypes::ktype_t returns;
 		bool is_variadic;
-		FnNode(std::string rout, std::vector<ktypes::kval_t> args, ktypes::ktype_t returns, std::shared_ptr<RootNode> rt, bool is_variadic, int line, int pos_start, int pos_end)
-			: name(rout), root(rt), args(args), returns(returns), is_variadic(is_variadic) {
+		FnNode(std::string rout, int sym, std::vector<ktypes::kval_t> args, ktypes::ktype_t returns, RootNode* rt, bool is_variadic, int line, int pos_start, int pos_end)
+			: name(std::move(rout)), sym(sym), root(rt), args(std::move(args)), returns(returns), is_variadic(is_variadic) {
 			type = FN;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -217,8 +229,8 @@ namespace parser {
 	};
 	class ReturnNode : public Node {
 	public:
-		std::shared_ptr<Node> value;
-		ReturnNode(std::shared_ptr<Node> value, int line, int pos_start, int pos_end)
+		Node* value;
+		ReturnNode(Node* value, int line, int pos_start, int pos_end)
 			: value(value) {
 			type = RETURN;
 			this->line = line;
@@ -260,19 +272,21 @@ namespace parser {
 	class LetNode : public Node {
 	public:
 		std::string name;
-		std::shared_ptr<Node> root;
+		int sym;                  // symbol ID of the name
+		int slot = -1;            // the variable in its function, set by semantics::Checker
+		Node* root;
 		bool isAlloc = false;
 		int allocVal = -1;
 		ktypes::ktype_t varType;
-		LetNode(std::string rout, ktypes::ktype_t varType, std::shared_ptr<Node> rt, int line, int pos_start, int pos_end)
-			: name(rout), root(rt), varType(varType) {
+		LetNode(std::string rout, int sym, ktypes::ktype_t varType, Node* rt, int line, int pos_start, int pos_end)
+			: name(std::move(rout)), sym(sym), root(rt), varType(varType) {
 			type = LET;
 			this->line = line;
 			this->pos_start = pos_start;
 			this->pos_end = pos_end;
 		}
-		LetNode(std::string rout, ktypes::ktype_t varType, int allocVal, int line, int pos_start, int pos_end)
-			: name(rout), allocVal(allocVal), isAlloc(true), varType(varType) {
+		LetNode(std::string rout, int sym, ktypes::ktype_t varType, int allocVal, int line, int pos_start, int pos_end)
+			: name(std::move(rout)), sym(sym), allocVal(allocVal), isAlloc(true), varType(varType) {
 			type = LET;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -287,9 +301,11 @@ namespace parser {
 	class IndexNode : public Node {
 	public:
 		std::string name;
-		std::shared_ptr<Node> index;
-		IndexNode(std::string rout, std::shared_ptr<Node> idx, int line, int pos_start, int pos_end)
-			: name(rout), index(idx) {
+		int sym;                  // symbol ID of the name
+		int slot = -1;            // the variable in its function, set by semantics::Checker
+		Node* index;
+		IndexNode(std::string rout, int sym, Node* idx, int line, int pos_start, int pos_end)
+			: name(std::move(rout)), sym(sym), index(idx) {
 			type = IDX;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -304,8 +320,10 @@ namespace parser {
 	class VarNode : public Node {
 	public:
 		std::string name;
-		VarNode(std::string rout, int line, int pos_start, int pos_end)
-			: name(rout) {
+		int sym;                  // symbol ID of the name
+		int slot = -1;            // the variable in its function, set by semantics::Checker
+		VarNode(std::string rout, int sym, int line, int pos_start, int pos_end)
+			: name(std::move(rout)), sym(sym) {
 			type = VAR;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -319,8 +337,10 @@ namespace parser {
 	class AddrOfNode : public Node {
 	public:
 		std::string name;
-		AddrOfNode(std::string rout, int line, int pos_start, int pos_end)
-			: name(rout) {
+		int sym;                  // symbol ID of the name
+		int slot = -1;            // the variable in its function, set by semantics::Checker
+		AddrOfNode(std::string rout, int sym, int line, int pos_start, int pos_end)
+			: name(std::move(rout)), sym(sym) {
 			type = ADDROF;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -334,8 +354,10 @@ namespace parser {
 	class DerefNode : public Node {
 	public:
 		std::string name;
-		DerefNode(std::string rout, int line, int pos_start, int pos_end)
-			: name(rout) {
+		int sym;                  // symbol ID of the name
+		int slot = -1;            // the variable in its function, set by semantics::Checker
+		DerefNode(std::string rout, int sym, int line, int pos_start, int pos_end)
+			: name(std::move(rout)), sym(sym) {
 			type = DEREF;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -351,7 +373,7 @@ namespace parser {
 		std::string name;
 		int val;
 		CompDirectNode(std::string rout, int val, int line, int pos_start, int pos_end)
-			: name(rout), val(val) {
+			: name(std::move(rout)), val(val) {
 			type = CDIRECT;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -364,9 +386,9 @@ namespace parser {
 	};
 	class IfNode : public Node {
 	public:
-		std::shared_ptr<Node> condition, block, else_block;
+		Node *condition, *block, *else_block;
 		bool has_else_block;
-		IfNode(std::shared_ptr<Node> condition, std::shared_ptr<Node> block, int line, int pos_start, int pos_end)
+		IfNode(Node* condition, Node* block, int line, int pos_start, int pos_end)
 			: condition(condition), block(block) {
 			type = IF;
 			this->line = line;
@@ -382,10 +404,10 @@ namespace parser {
 	};
 	class CmpNode : public Node {
 	public:
-		std::shared_ptr<Node> val1, val2;
-		std::map<std::string, std::shared_ptr<RootNode>> comparisons;
-		CmpNode(std::shared_ptr<Node> val1, std::shared_ptr<Node> val2, std::map<std::string, std::shared_ptr<RootNode>> comparisons, int line, int pos_start, int pos_end)
-			: val1(val1), val2(val2), comparisons(comparisons) {
+		Node *val1, *val2;
+		std::map<std::string, RootNode*> comparisons;
+		CmpNode(Node* val1, Node* val2, std::map<std::string, RootNode*> comparisons, int line, int pos_start, int pos_end)
+			: val1(val1), val2(val2), comparisons(std::move(comparisons)) {
 			type = CMP;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -396,9 +418,9 @@ namespace parser {
 			std::cout << "cmp" << std::endl;
 			val1->print(indent + 1);
 			val2->print(indent + 1);
-			for (std::map<std::string, std::shared_ptr<RootNode>>::const_iterator iter = comparisons.begin(); iter != comparisons.end(); ++iter) {
+			for (std::map<std::string, RootNode*>::const_iterator iter = comparisons.begin(); iter != comparisons.end(); ++iter) {
 				std::string k = iter->first;
-				std::shared_ptr<RootNode> v = iter->second;
+				RootNode* v = iter->second;
 				for (int i = 0; i < indent + 2; i++) std::cout << "--"; std::cout << ' ' << k << std::endl;
 				v->print(indent + 3);
 			}
@@ -407,7 +429,7 @@ namespace parser {
 	class AsmNode : public Node {
 	public:
 		std::string content;
-		AsmNode(std::string content, int line, int pos_start, int pos_end) : content(content) {
+		AsmNode(std::string content, int line, int pos_start, int pos_end) : content(std::move(content)) {
 			type = ASM;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -421,9 +443,11 @@ namespace parser {
 	class ForNode : public Node {
 	public:
 		std::string itername;
-		std::shared_ptr<Node> root, initVal, targetVal, stepVal;
-		ForNode(std::string itername, std::shared_ptr<Node> root, std::shared_ptr<Node> initVal, std::shared_ptr<Node> targetVal, std::shared_ptr<Node> stepVal, int line, int pos_start, int pos_end)
-			: itername(itername), root(root), initVal(initVal), targetVal(targetVal), stepVal(stepVal) {
+		int itersym;              // symbol ID of the iterator
+		int slot = -1;            // the iterator in its function, set by semantics::Checker
+		Node *root, *initVal, *targetVal, *stepVal;
+		ForNode(std::string itername, int itersym, Node* root, Node* initVal, Node* targetVal, Node* stepVal, int line, int pos_start, int pos_end)
+			: itername(std::move(itername)), itersym(itersym), root(root), initVal(initVal), targetVal(targetVal), stepVal(stepVal) {
 			type = FOR;
 			this->line = line;
 			this->pos_start = pos_start;
@@ -440,8 +464,8 @@ namespace parser {
 	};
 	class LoopNode : public Node {
 	public:
-		std::shared_ptr<Node> root;
-		LoopNode(std::shared_ptr<Node> root, int line, int pos_start, int pos_end)
+		Node* root;
+		LoopNode(Node* root, int line, int pos_start, int pos_end)
 			: root(root) {
 			type = LOOP;
 			this->line = line;
@@ -1,243 +1,310 @@
 #include "parser.h"
+#include <array>
 
-std::shared_ptr<parser::RootNode> parser::Parser::statement_list(bool isroot) {
-	if (peek()->type != lexer::LBRACE && !isroot)
-		throw errors::kiterr("expected {", peek()->line, peek()->pos_start, peek()->pos_end);
-	std::shared_ptr<lexer::Token> t = isroot ? peek() : advance();
-	int line = t->line, pos = t->pos_start;
+namespace {
+	// binding powers of the binary operators by their token, 0 for the tokens that end an expression
+	// assignment is the loosest, then the comparisons, the additive and the multiplicative operators
+	constexpr std::array<uint8_t, lexer::END + 1> powers = []() {
+		std::array<uint8_t, lexer::END + 1> p{};
+		p[lexer::EQ] = 1;
+		p[lexer::EQEQ] = p[lexer::NEQEQ] = p[lexer::GT] = p[lexer::LT] = p[lexer::GTE] = p[lexer::LTE] = 2;
+		p[lexer::PLUS] = p[lexer::MINUS] = 3;
+		p[lexer::MUL] = p[lexer::DIV] = p[lexer::MOD] = 4;
+		return p;
+	}();
+}
+
+parser::RootNode* parser::Parser::statement_list(bool isroot) {
+	if (peek().type != lexer::LBRACE && !isroot)
+		throw errors::kiterr("expected {", peek().line, peek().pos_start, peek().pos_end);
+	const lexer::Token& t = isroot ? peek() : advance();
+	int line = t.line, pos = t.pos_start;
 	
-	std::vector<std::shared_ptr<Node>> statements;
-	while (ptr < tokens.size() && peek()->type != lexer::RBRACE) {
+	std::vector<Node*> statements;
+	while (peek().type != lexer::END && peek().type != lexer::RBRACE) {
 		statements.push_back(statement());
 	}
-	if (ptr < tokens.size() && peek()->type == lexer::RBRACE) advance();
-	return std::make_shared<RootNode>(statements, line, pos, pos);
+	if (peek().type == lexer::RBRACE) advance();
+	return arena.make<RootNode>(std::move(statements), line, pos, pos);
 }
 
-std::shared_ptr<parser::Node> parser::Parser::statement() {
-	std::string stmt = peek()->value_str;
-	std::shared_ptr<lexer::Token> t = peek();
-	if (stmt == "global" && t->type == lexer::KEYWORD) return global_node();
-	if (stmt == "extern" && t->type == lexer::KEYWORD) return extern_node();
-	if (stmt == "fn" && t->type == lexer::KEYWORD) return fn_node();
-	if (stmt == "return" && t->type == lexer::KEYWORD) return return_node();
-	if (stmt == "cmp" && t->type == lexer::KEYWORD) return cmp_node();
-	if (stmt == "if" && t->type == lexer::KEYWORD) return if_node();
-	if (stmt == "let" && t->type == lexer::KEYWORD) return let_node();
-	if (stmt == "asm" && t->type == lexer::KEYWORD) return asm_node();
-	if (stmt == "for" && t->type == lexer::KEYWORD) return for_node();
-	if (stmt == "loop" && t->type == lexer::KEYWORD) return loop_node();
-	if (stmt == "break" && t->type == lexer::KEYWORD) { advance();  return std::make_shared<BreakNode>(t->line, t->pos_start, t->pos_end); };
-	if (stmt == "continue" && t->type == lexer::KEYWORD) { advance(); return std::make_shared<ContinueNode>(t->line, t->pos_start, t->pos_end); };
-	if (t->type == lexer::LBRACE) return statement_list();
-	if (t->type == lexer::CDIRECT) return comp_direct();
-	return expr();
+parser::Node* parser::Parser::declaration() {
+	forget();
+	// like the root statement list, a } ends the file
+	if (peek().type == lexer::END) return nullptr;
+	if (peek().type == lexer::RBRACE) {
+		advance();
+		return nullptr;
+	}
+	return statement();
 }
 
-std::shared_ptr<parser::CompDirectNode> parser::Parser::comp_direct() {
-	std::shared_ptr<lexer::Token> t = advance();
-	return std::make_shared<CompDirectNode>(t->value_str, advance()->value, t->line, t->pos_start, t->pos_end);
+std::vector<ktypes::kfndec_t> parser::Parser::signatures() {
+	std::vector<ktypes::kfndec_t> fns, externs;
+	Arena::Mark empty = arena.mark();
+	int depth = 0;
+	bool inFn = false;	// in the body of a function (its externs are its own)
+	while (peek().type != lexer::END) {
+		// the tokens of a skipped body are dropped with it
+		if (depth == 0) forget();
+		const lexer::Token& t = peek();
+		if (depth == 0 && t.type == lexer::KEYWORD && t.value == lexer::KW_FN) {
+			// only the header, the body is skipped like any other block
+			FnNode* node = fn_node(false);
+			std::vector<ktypes::ktype_t> types;
+			for (const ktypes::kval_t& arg : node->args) types.push_back(arg.type);
+			fns.push_back(ktypes::kfndec_t{ node->name, types, node->returns, node->is_variadic, node->sym });
+			inFn = true;
+		}
+		else if (!inFn && ((t.type == lexer::KEYWORD && t.value == lexer::KW_EXTERN) || t.type == lexer::HEADER)) {
+			ExternNode* node = t.type == lexer::HEADER ? header_node() : extern_node();
+			externs.insert(externs.end(), node->symbols.begin(), node->symbols.end());
+		}
+		else {
+			if (t.type == lexer::LBRACE) depth++;
+			else if (t.type == lexer::RBRACE) {
+				// a } at the top level ends the file
+				if (--depth < 0) break;
+				if (depth == 0) inFn = false;
+			}
+			advance();
+		}
+		arena.reset(empty);
+	}
+	fns.insert(fns.end(), externs.begin(), externs.end());
+	return fns;
 }
 
-std::shared_ptr<parser::Node> parser::Parser::expr() {
-	std::shared_ptr<Node> n = term();
-	int line = n->line;
-	int pos_start = n->pos_start;
-
-	while (true) {
-		auto current_token_type = peek()->type;
-
-		if (current_token_type == lexer::PLUS || current_token_type == lexer::MINUS ||
-			current_token_type == lexer::EQEQ || current_token_type == lexer::NEQEQ ||
-			current_token_type == lexer::GT || current_token_type == lexer::LT ||
-			current_token_type == lexer::GTE || current_token_type == lexer::LTE) {
+void parser::Parser::forget() {
+	// the nodes do not refer to the tokens, the ones before the current one are not needed anymore
+	if (tokens) return;
+	window.erase(window.begin(), window.begin() + (ptr - windowStart));
+	windowStart = ptr;
+}
 
-			std::shared_ptr<lexer::Token> op = advance();
-			std::shared_ptr<Node> r = term();
-			n = std::make_shared<BinOpNode>(n, op->type, r, line, pos_start, n->pos_end);
-		}
-		else if (current_token_type == lexer::EQ) {
-			std::shared_ptr<lexer::Token> op = advance();
-			std::shared_ptr<Node> r = expr();
-			n = std::make_shared<BinOpNode>(n, op->type, r, line, pos_start, n->pos_end);
+parser::Node* parser::Parser::statement() {
+	const lexer::Token& t = peek();
+	switch (t.type) {
+	case lexer::KEYWORD:
+		switch (t.value) {
+		case lexer::KW_GLOBAL: return global_node();
+		case lexer::KW_EXTERN: return extern_node();
+		case lexer::KW_FN: return fn_node();
+		case lexer::KW_RETURN: return return_node();
+		case lexer::KW_CMP: return cmp_node();
+		case lexer::KW_IF: return if_node();
+		case lexer::KW_LET: return let_node();
+		case lexer::KW_ASM: return asm_node();
+		case lexer::KW_FOR: return for_node();
+		case lexer::KW_LOOP: return loop_node();
+		case lexer::KW_BREAK: advance(); return arena.make<BreakNode>(t.line, t.pos_start, t.pos_end);
+		case lexer::KW_CONTINUE: advance(); return arena.make<ContinueNode>(t.line, t.pos_start, t.pos_end);
 		}
-		else break;
+		break;
+	case lexer::LBRACE: return statement_list();
+	case lexer::HEADER: return header_node();
+	case lexer::CDIRECT: return comp_direct();
+	default: break;
 	}
-
-	return n;
+	return expr();
 }
 
-std::shared_ptr<parser::Node> parser::Parser::term() {
-	std::shared_ptr<Node> n = factor();
-	int line = n->line;
-	int pos_start = n->pos_start;
+parser::CompDirectNode* parser::Parser::comp_direct() {
+	const lexer::Token& t = advance();
+	return arena.make<CompDirectNode>(std::string(text(t)), advance().value, t.line, t.pos_start, t.pos_end);
+}
 
-	while (peek()->type == lexer::MUL || peek()->type == lexer::DIV || peek()->type == lexer::MOD) {
-		std::shared_ptr<lexer::Token> op = advance();
-		std::shared_ptr<Node> r = factor();
-		n = std::make_shared<BinOpNode>(n, op->type, r, line, pos_start, n->pos_end);
+// precedence climbing over the operator table, the operators that bind tighter than minPower
+// are taken into the right operand, so the loop only sees the ones of its own level or looser
+parser::Node* parser::Parser::expr(int minPower) {
+	Node* n = factor();
+	while (true) {
+		lexer::token_t op = peek().type;
+		int power = powers[op];
+		if (power == 0 || power < minPower) break;
+		advance();
+		// assignment groups to the right (a = b = c), the others to the left (a - b - c)
+		Node* r = expr(op == lexer::EQ ? power : power + 1);
+		n = arena.make<BinOpNode>(n, op, r, n->line, n->pos_start, r->pos_end);
 	}
 	return n;
 }
 
-std::shared_ptr<parser::Node> parser::Parser::factor() {
-	std::shared_ptr<lexer::Token> t = advance();
-	switch (t->type) {
-	case lexer::INT_LIT:
-		return std::make_shared<IntLitNode>(t->value, t->line, t->pos_start, t->pos_end);
+parser::Node* parser::Parser::factor() {
+	const lexer::Token& t = advance();
+	switch (t.type) {
+	case lexer::INT_LIT: {
+		// the token only holds an int, the literal is read again in 64 bits (wrapping around like the arithmetic)
+		uint64_t value = 0;
+		for (char c : text(t)) value = value * 10 + (uint64_t)(c - '0');
+		return arena.make<IntLitNode>((int64_t)value, t.line, t.pos_start, t.pos_end);
+	}
 	case lexer::STRING_LIT:
-		return std::make_shared<StringLitNode>(t->value_str, t->line, t->pos_start, t->pos_end);
+		return arena.make<StringLitNode>(std::string(text(t)), t.line, t.pos_start, t.pos_end);
 	case lexer::CHAR_LIT:
-		return std::make_shared<CharLitNode>((char)t->value, t->line, t->pos_start);
+		return arena.make<CharLitNode>((char)t.value, t.line, t.pos_start);
 	case lexer::REG:
-		return std::make_shared<RegNode>(t->value_str, t->line, t->pos_start, t->pos_end);
+		return arena.make<RegNode>(std::string(text(t)), t.line, t.pos_start, t.pos_end);
 	case lexer::ADDROF:
-		return std::make_shared<AddrOfNode>(t->value_str, t->line, t->pos_start, t->pos_end);
+		return arena.make<AddrOfNode>(std::string(text(t)), t.value, t.line, t.pos_start, t.pos_end);
 	case lexer::DEREF:
-		return std::make_shared<DerefNode>(t->value_str, t->line, t->pos_start, t->pos_end);
+		return arena.make<DerefNode>(std::string(text(t)), t.value, t.line, t.pos_start, t.pos_end);
 	case lexer::LPAREN:
 		{
-			std::shared_ptr<parser::Node> n = expr();
+			parser::Node* n = expr();
 			consume(lexer::RPAREN);
 			return n;
 		}
 	case lexer::IDENTIFIER:
 		{
-			std::string name = t->value_str;
-			if (peek()->type == lexer::LSQR) {
+			std::string name(text(t));
+			if (peek().type == lexer::LSQR) {
 				consume(lexer::LSQR);
-				std::shared_ptr<Node> index = expr();
+				Node* index = expr();
 				consume(lexer::RSQR);
-				return std::make_shared<IndexNode>(name, index, t->line, t->pos_start, t->pos_end);
+				return arena.make<IndexNode>(std::move(name), t.value, index, t.line, t.pos_start, t.pos_end);
 			}
-			else if (peek()->type == lexer::LPAREN) {
+			else if (peek().type == lexer::LPAREN) {
 				consume(lexer::LPAREN);
-				std::vector<std::shared_ptr<Node>> args;
-				while (peek()->type != lexer::RPAREN) {
+				std::vector<Node*> args;
+				while (peek().type != lexer::RPAREN) {
 					args.push_back(expr());
-					if (peek()->type != lexer::COMMA) break;
+					if (peek().type != lexer::COMMA) break;
 					consume(lexer::COMMA);
 				}
 				consume(lexer::RPAREN);
-				return std::make_shared<CallNode>(name, args, t->line, t->pos_start, t->pos_end);
+				return arena.make<CallNode>(std::move(name), t.value, std::move(args), t.line, t.pos_start, t.pos_end);
 			}
 			else
-				return std::make_shared<VarNode>(name, t->line, t->pos_start, t->pos_end);
+				return arena.make<VarNode>(std::move(name), t.value, t.line, t.pos_start, t.pos_end);
 		}
 	default:
-		throw errors::kiterr("invalid factor " + std::to_string(peek()->type), t->line, t->pos_start, t->pos_end);
+		throw errors::kiterr("invalid factor " + std::to_string(peek().type), t.line, t.pos_start, t.pos_end);
 	}
 }
 
-std::shared_ptr<parser::GlobalNode> parser::Parser::global_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	if (peek()->type == lexer::LBRACE) {
+parser::GlobalNode* parser::Parser::global_node() {
+	const lexer::Token& t = advance();
+	if (peek().type == lexer::LBRACE) {
 		std::vector<std::string> symbols{};
 		consume(lexer::LBRACE);
-		while (peek()->type != lexer::RBRACE) {
-			if (peek()->type != lexer::IDENTIFIER)
-				throw errors::kiterr("expected identifier", peek()->line, peek()->pos_start, peek()->pos_end);
-			symbols.push_back(advance()->value_str);
-			if (peek()->type == lexer::RBRACE) break;
+		while (peek().type != lexer::RBRACE) {
+			if (peek().type != lexer::IDENTIFIER)
+				throw errors::kiterr("expected identifier", peek().line, peek().pos_start, peek().pos_end);
+			symbols.push_back(std::string(text(advance())));
+			if (peek().type == lexer::RBRACE) break;
 			consume(lexer::COMMA);
 		}
 		consume(lexer::RBRACE);
-		return std::make_shared<GlobalNode>(symbols, t->line, t->pos_start, t->pos_end);
+		return arena.make<GlobalNode>(std::move(symbols), t.line, t.pos_start, t.pos_end);
 	}
-	if (peek()->type != lexer::IDENTIFIER)
-		throw errors::kiterr("expected identifier", peek()->line, peek()->pos_start, peek()->pos_end);
-	return std::make_shared<GlobalNode>(std::vector<std::string>{ advance()->value_str }, t->line, t->pos_start, t->pos_end);
+	if (peek().type != lexer::IDENTIFIER)
+		throw errors::kiterr("expected identifier", peek().line, peek().pos_start, peek().pos_end);
+	return arena.make<GlobalNode>(std::vector<std::string>{ std::string(text(advance())) }, t.line, t.pos_start, t.pos_end);
+}
+
+// the declarations are the ones the text of the header would give, only their names are interned here
+parser::ExternNode* parser::Parser::header_node() {
+	const lexer::Token& t = advance();
+	if (t.value >= (int)precompiled.size())
+		throw errors::kiterr("unknown precompiled header " + std::to_string(t.value), t.line, t.pos_start, t.pos_end);
+	std::vector<ktypes::kfndec_t> fns = *precompiled[t.value];
+	for (ktypes::kfndec_t& fn : fns) fn.sym = symbols.intern(fn.name);
+	return arena.make<ExternNode>(std::move(fns), t.line, t.pos_start, t.pos_end);
 }
 
-std::shared_ptr<parser::ExternNode> parser::Parser::extern_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	if (peek()->type == lexer::LBRACE) {
+parser::ExternNode* parser::Parser::extern_node() {
+	const lexer::Token& t = advance();
+	if (peek().type == lexer::LBRACE) {
 		std::vector<ktypes::kfndec_t> fns {};
 		consume(lexer::LBRACE);
 
-		while (peek()->type != lexer::RBRACE) {
-			if (peek()->type != lexer::IDENTIFIER)
-				throw errors::kiterr("expected identifier", peek()->line, peek()->pos_start, peek()->pos_end);
-			std::string name = advance()->value_str;
+		while (peek().type != lexer::RBRACE) {
+			if (peek().type != lexer::IDENTIFIER)
+				throw errors::kiterr("expected identifier", peek().line, peek().pos_start, peek().pos_end);
+			const lexer::Token& nt = advance();
+			std::string name(text(nt));
 			std::vector<ktypes::ktype_t> types{};
 			consume(lexer::LPAREN);
 			bool is_variadic = false;
-			while (peek()->type != lexer::RPAREN) {
-				if (peek()->type == lexer::VAARG) {
+			while (peek().type != lexer::RPAREN) {
+				if (peek().type == lexer::VAARG) {
 					advance();
 					is_variadic = true;
 					break;
 				}
 				types.push_back(type());
-				if (peek()->type == lexer::RPAREN) break;
+				if (peek().type == lexer::RPAREN) break;
 				consume(lexer::COMMA);
 			}
 			consume(lexer::RPAREN);
 			consume(lexer::COLON);
 			ktypes::ktype_t returns = type();
-			fns.push_back(ktypes::kfndec_t{name, types, returns, is_variadic});
-			if (peek()->type == lexer::RBRACE) break;
+			fns.push_back(ktypes::kfndec_t{name, types, returns, is_variadic, nt.value});
+			if (peek().type == lexer::RBRACE) break;
 			consume(lexer::COMMA);
 		}
 		consume(lexer::RBRACE);
-		return std::make_shared<ExternNode>(fns, t->line, t->pos_start, t->pos_end);
+		return arena.make<ExternNode>(std::move(fns), t.line, t.pos_start, t.pos_end);
 	}
-	if (peek()->type != lexer::IDENTIFIER)
-		throw errors::kiterr("expected identifier", peek()->line, peek()->pos_start, peek()->pos_end);
-	std::string name = advance()->value_str;
+	if (peek().type != lexer::IDENTIFIER)
+		throw errors::kiterr("expected identifier", peek().line, peek().pos_start, peek().pos_end);
+	const lexer::Token& nt = advance();
+	std::string name(text(nt));
 	std::vector<ktypes::ktype_t> types;
 	consume(lexer::LPAREN);
-	while (peek()->type != lexer::RPAREN) {
+	while (peek().type != lexer::RPAREN) {
 		types.push_back(type());
-		if (peek()->type == lexer::RPAREN) break;
+		if (peek().type == lexer::RPAREN) break;
 		consume(lexer::COMMA);
 	}
 	consume(lexer::RPAREN);
 	consume(lexer::COLON);
 	ktypes::ktype_t returns = type();
-	return std::make_shared<ExternNode>(std::vector<ktypes::kfndec_t>{ ktypes::kfndec_t{ name, types, returns } }, t->line, t->pos_start, t->pos_end);
+	return arena.make<ExternNode>(std::vector<ktypes::kfndec_t>{ ktypes::kfndec_t{ name, types, returns, false, nt.value } }, t.line, t.pos_start, t.pos_end);
 }
 
-std::shared_ptr<parser::ReturnNode> parser::Parser::return_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	return std::make_shared<ReturnNode>(expr(), t->line, t->pos_start, t->pos_end);
+parser::ReturnNode* parser::Parser::return_node() {
+	const lexer::Token& t = advance();
+	return arena.make<ReturnNode>(expr(), t.line, t.pos_start, t.pos_end);
 }
 
-std::shared_ptr<parser::FnNode> parser::Parser::fn_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	std::string name = advance()->value_str;
+parser::FnNode* parser::Parser::fn_node(bool body) {
+	const lexer::Token& t = advance();
+	const lexer::Token& nt = advance();
+	std::string name(text(nt));
 	std::vector <ktypes::kval_t> args {};
 	bool is_variadic = false;
 	consume(lexer::LPAREN);
-	while (peek()->type != lexer::RPAREN) {
-		if (peek()->type == lexer::VAARG) {
+	while (peek().type != lexer::RPAREN) {
+		if (peek().type == lexer::VAARG) {
 			advance();
 			is_variadic = true;
 			break;
 		}
-		if (peek()->type != lexer::IDENTIFIER)
-			throw errors::kiterr("expected identifier", peek()->line, peek()->pos_start, peek()->pos_end);
-		std::string argnm = advance()->value_str;
+		if (peek().type != lexer::IDENTIFIER)
+			throw errors::kiterr("expected identifier", peek().line, peek().pos_start, peek().pos_end);
+		const lexer::Token& at = advance();
 		consume(lexer::COLON);
 		ktypes::ktype_t argtp = type();
-		args.push_back(ktypes::kval_t{argnm, argtp});
-		if (peek()->type == lexer::RPAREN) break;
+		args.push_back(ktypes::kval_t{std::string(text(at)), argtp, at.value});
+		if (peek().type == lexer::RPAREN) break;
 		consume(lexer::COMMA);
 	}
 	consume(lexer::RPAREN);
 	consume(lexer::COLON);
 	ktypes::ktype_t returns = type();
-	std::shared_ptr<RootNode> root = statement_list();
-	return std::make_shared<FnNode>(name, args, returns, root, is_variadic, t->line, t->pos_start, t->pos_end);
+	RootNode* root = body ? statement_list() : nullptr;
+	return arena.make<FnNode>(std::move(name), symbol(nt), std::move(args), returns, root, is_variadic, t.line, t.pos_start, t.pos_end);
 }
 
-std::shared_ptr<parser::IfNode> parser::Parser::if_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	std::shared_ptr<Node> condition = expr();
-	std::shared_ptr<Node> block = statement();
-	std::shared_ptr<IfNode> ifn = std::make_shared<IfNode>(condition, block, t->line, t->pos_start, t->pos_end);
-	if (peek()->type == lexer::KEYWORD && peek()->value_str == "else") {
-		consume(lexer::KEYWORD, "else");
+parser::IfNode* parser::Parser::if_node() {
+	const lexer::Token& t = advance();
+	Node* condition = expr();
+	Node* block = statement();
+	IfNode* ifn = arena.make<IfNode>(condition, block, t.line, t.pos_start, t.pos_end);
+	if (peek().type == lexer::KEYWORD && peek().value == lexer::KW_ELSE) {
+		advance();
 		ifn->else_block = statement();
 		ifn->has_else_block = true;
 	}
@@ -248,87 +315,97 @@ std::shared_ptr<parser::IfNode> parser::Parser::if_node() {
 	return ifn;
 }
 
-std::shared_ptr<parser::CmpNode> parser::Parser::cmp_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	std::shared_ptr<Node> val1 = expr();
+parser::CmpNode* parser::Parser::cmp_node() {
+	const lexer::Token& t = advance();
+	Node* val1 = expr();
 	consume(lexer::COMMA);
-	std::shared_ptr<Node> val2 = expr();
+	Node* val2 = expr();
 	consume(lexer::LBRACE);
-	std::map<std::string, std::shared_ptr<RootNode>> comparisons {};
-	while (peek()->type != lexer::RBRACE) {
-		if (peek()->type != lexer::KEYWORD)
-			throw errors::kiterr("expected comparison (eq, neq,...)", peek()->line, peek()->pos_start, peek()->pos_end);
-		std::string key = advance()->value_str;
+	std::map<std::string, RootNode*> comparisons {};
+	while (peek().type != lexer::RBRACE) {
+		if (peek().type != lexer::KEYWORD)
+			throw errors::kiterr("expected comparison (eq, neq,...)", peek().line, peek().pos_start, peek().pos_end);
+		std::string key(text(advance()));
 		comparisons[key] = statement_list();
 	}
 	consume(lexer::RBRACE);
-	return std::make_shared<CmpNode>(val1, val2, comparisons, t->line, t->pos_start, t->pos_end);
+	return arena.make<CmpNode>(val1, val2, std::move(comparisons), t.line, t.pos_start, t.pos_end);
 }
 
-std::shared_ptr<parser::AsmNode> parser::Parser::asm_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	return std::make_shared<AsmNode>(advance()->value_str, t->line, t->pos_start, t->pos_end);
+parser::AsmNode* parser::Parser::asm_node() {
+	const lexer::Token& t = advance();
+	return arena.make<AsmNode>(std::string(text(advance())), t.line, t.pos_start, t.pos_end);
 }
 
-std::shared_ptr<parser::LoopNode> parser::Parser::loop_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	return std::make_shared<LoopNode>(statement(), t->line, t->pos_start, t->pos_end);
+parser::LoopNode* parser::Parser::loop_node() {
+	const lexer::Token& t = advance();
+	return arena.make<LoopNode>(statement(), t.line, t.pos_start, t.pos_end);
 }
 
-std::shared_ptr<parser::ForNode> parser::Parser::for_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	std::string itername = advance()->value_str;
+parser::ForNode* parser::Parser::for_node() {
+	const lexer::Token& t = advance();
+	const lexer::Token& it = advance();
 	consume(lexer::EQ);
-	std::shared_ptr<Node> initVal = expr();
+	Node* initVal = expr();
 	consume(lexer::ARROW);
-	std::shared_ptr<Node> targetVal = expr();
+	Node* targetVal = expr();
 	consume(lexer::CARET);
-	std::shared_ptr<Node> stepVal = expr();
-	std::shared_ptr<Node> root = statement();
-	return std::make_shared<ForNode>(itername, root, initVal, targetVal, stepVal, t->line, t->pos_start, t->pos_end);
+	Node* stepVal = expr();
+	Node* root = statement();
+	return arena.make<ForNode>(std::string(text(it)), symbol(it), root, initVal, targetVal, stepVal, t.line, t.pos_start, t.pos_end);
 }
 
-std::shared_ptr<parser::LetNode> parser::Parser::let_node() {
-	std::shared_ptr<lexer::Token> t = advance();
-	std::string name = advance()->value_str;
+parser::LetNode* parser::Parser::let_node() {
+	const lexer::Token& t = advance();
+	const lexer::Token& nt = advance();
+	std::string name(text(nt));
 	consume(lexer::COLON);
 	ktypes::ktype_t tp = type();
-	if (peek()->type == lexer::EQ) {
+	if (peek().type == lexer::EQ) {
 		consume(lexer::EQ);
-		std::shared_ptr<Node> root = expr();
-		return std::make_shared<LetNode>(name, tp, root, t->line, t->pos_start, t->pos_end);
+		Node* root = expr();
+		return arena.make<LetNode>(std::move(name), symbol(nt), tp, root, t.line, t.pos_start, t.pos_end);
 	}
-	else if (peek()->type == lexer::LSQR) {
+	else if (peek().type == lexer::LSQR) {
 		consume(lexer::LSQR);
-		if (peek()->type != lexer::INT_LIT)
-			throw errors::kiterr("allocation size should be an integer literal", peek()->line, peek()->pos_start, peek()->pos_end);
-		int allocVal = advance()->value;
+		if (peek().type != lexer::INT_LIT)
+			throw errors::kiterr("allocation size should be an integer literal", peek().line, peek().pos_start, peek().pos_end);
+		int allocVal = advance().value;
 		consume(lexer::RSQR);
-		return std::make_shared<LetNode>(name, tp, allocVal, t->line, t->pos_start, t->pos_end);
+		return arena.make<LetNode>(std::move(name), symbol(nt), tp, allocVal, t.line, t.pos_start, t.pos_end);
 	}
-	else throw errors::kiterr("expected = or [", peek()->line, peek()->pos_start, peek()->pos_end);
+	else throw errors::kiterr("expected = or [", peek().line, peek().pos_start, peek().pos_end);
 }
 
+// the type keywords are in the order of the types
+static_assert(lexer::KW_PTR64 - lexer::KW_VOID == ktypes::PTR64 - ktypes::VOID, "the type keywords do not match ktype_t");
+
 ktypes::ktype_t parser::Parser::type() {
-	if (peek()->type != lexer::KEYWORD || !ktypes::nktype_t.contains(peek()->value_str))
-		throw errors::kiterr("expected type specifier", peek()->line, peek()->pos_start, peek()->pos_end);
-	return ktypes::from_string(advance()->value_str);
+	if (peek().type != lexer::KEYWORD || peek().value < lexer::KW_VOID)
+		throw errors::kiterr("expected type specifier", peek().line, peek().pos_start, peek().pos_end);
+	return (ktypes::ktype_t)(ktypes::VOID + (advance().value - lexer::KW_VOID));
 }
 
-std::shared_ptr<lexer::Token> parser::Parser::peek() {
-	return tokens[ptr];
+const lexer::Token& parser::Parser::pull() {
+	while (ptr - windowStart >= window.size()) {
+		try {
+			window.push_back(lex->next());
+		}
+		catch (errors::kiterr&) {
+			lexFailed = true;
+			throw;
+		}
+	}
+	return window[ptr - windowStart];
 }
 
-std::shared_ptr<lexer::Token> parser::Parser::advance() {
-	return tokens[ptr++];
+int parser::Parser::symbol(const lexer::Token& t) {
+	// identifiers already carry their ID from the lexer
+	if (t.type == lexer::IDENTIFIER) return t.value;
+	return symbols.intern(text(t));
 }
 
 void parser::Parser::consume(lexer::token_t t) {
-	if (peek()->type == t) advance();
-	else throw errors::kiterr("Unexpected token " + std::to_string(peek()->type) + ", expected: " + std::to_string(t), peek()->line, peek()->pos_start, peek()->pos_end);
-}
-
-void parser::Parser::consume(lexer::token_t t, std::string s) {
-	if (peek()->type == t && peek()->value_str == s) advance();
-	else throw errors::kiterr("Unexpected token " + peek()->value_str + ", expected: " + s, peek()->line, peek()->pos_start, peek()->pos_end);
+	if (peek().type == t) advance();
+	else throw errors::kiterr("Unexpected token " + std::to_string(peek().type) + ", expected: " + std::to_string(t), peek().line, peek().pos_start, peek().pos_end);
 }
\ No newline at end of file
@@ -1,45 +1,92 @@
 #pragma once
+#include <deque>
 #include "node.h"
+#include "arena.h"
+#include "../lexer/lexer.h"
+#include "../lexer/symbols.h"
 #include "../common.h"
 #include "../errors/errors.h"
 
 namespace parser {
+	// the arena counts the nodes it makes by their type
+	static_assert(CDIRECT < Arena::kinds);
+
 	class Parser {
 	private:
-		std::vector<std::shared_ptr<lexer::Token>> tokens;
-
-		std::shared_ptr<CompDirectNode> comp_direct();
-
-		std::shared_ptr<RootNode> statement_list(bool = false);
-		std::shared_ptr<Node> statement();
-		std::shared_ptr<Node> expr();
-		std::shared_ptr<Node> term();
-		std::shared_ptr<Node> factor();
-
-		std::shared_ptr<GlobalNode> global_node();
-		std::shared_ptr<ExternNode> extern_node();
-		std::shared_ptr<FnNode> fn_node();
-		std::shared_ptr<ReturnNode> return_node();
-		std::shared_ptr<CmpNode> cmp_node();
-		std::shared_ptr<IfNode> if_node();
-		std::shared_ptr<AsmNode> asm_node();
-		std::shared_ptr<ForNode> for_node();
-		std::shared_ptr<LoopNode> loop_node();
-		std::shared_ptr<LetNode> let_node();
+		// the token stream (terminated with END) and the source the tokens refer to
+		const std::vector<lexer::Token>* tokens = nullptr;
+		std::string_view src;
+		// when streaming the tokens are made by the lexer as they are needed instead, the window keeps
+		// the ones of the top-level statement being parsed (a deque, so the tokens never move)
+		lexer::Lexer* lex = nullptr;
+		std::deque<lexer::Token> window;
+		size_t windowStart = 0;		// index of the first token of the window in the stream
+		bool lexFailed = false;
+		// every node of the tree is allocated here, the arena outlives the parser
+		Arena& arena;
+		// names the lexer did not intern (e.g. a keyword used as a name) are interned here
+		lexer::SymbolTable& symbols;
+		// the extern declarations of the precompiled headers, by the index in their HEADER tokens
+		std::vector<const std::vector<ktypes::kfndec_t>*> precompiled;
+
+		CompDirectNode* comp_direct();
+
+		RootNode* statement_list(bool = false);
+		Node* statement();
+		Node* expr(int minPower = 1);
+		Node* factor();
+
+		GlobalNode* global_node();
+		ExternNode* extern_node();
+		ExternNode* header_node();
+		FnNode* fn_node(bool body = true);
+		ReturnNode* return_node();
+		CmpNode* cmp_node();
+		IfNode* if_node();
+		AsmNode* asm_node();
+		ForNode* for_node();
+		LoopNode* loop_node();
+		LetNode* let_node();
 
 		ktypes::ktype_t type();
 
-		std::shared_ptr<lexer::Token> peek();
-		std::shared_ptr<lexer::Token> advance();
+		const lexer::Token& pull();
+		void forget();
+		// inline, every token goes through them a few times
+		const lexer::Token& peek() { return tokens ? (*tokens)[ptr] : pull(); }
+		const lexer::Token& advance() {
+			// the stream always ends with an END token, never move past it
+			const lexer::Token& t = peek();
+			if (t.type != lexer::END) ptr++;
+			return t;
+		}
 		void consume(lexer::token_t);
-		void consume(lexer::token_t, std::string);
+		std::string_view text(const lexer::Token& t) const { return lexer::text(t, src); }
+		int symbol(const lexer::Token&);
 
 	public:
 		int ptr = 0;
-		Parser(std::vector<std::shared_ptr<lexer::Token>> t) : tokens(t), ptr(0) {
+		Parser(const std::vector<lexer::Token>& t, std::string_view src, Arena& arena, lexer::SymbolTable& symbols) : tokens(&t), src(src), arena(arena), symbols(symbols), ptr(0) {
+		}
+		// streaming, the tokens are taken from the lexer as they are needed
+		Parser(lexer::Lexer& lex, std::string_view src, Arena& arena, lexer::SymbolTable& symbols) : src(src), lex(&lex), arena(arena), symbols(symbols), ptr(0) {
+		}
+		// the declarations of the precompiled headers the precompiler left markers of
+		void headers(std::vector<const std::vector<ktypes::kfndec_t>*> declarations) {
+			precompiled = std::move(declarations);
 		}
-		std::shared_ptr<RootNode> parse() {
+		RootNode* parse() {
 			return statement_list(true);
 		}
+		// the next top-level statement, nullptr after the last one (streaming)
+		// the tokens of the statements before it are dropped
+		Node* declaration();
+		// the functions declared at the top level followed by the externs, in the order codegen
+		// declares them, from a quick pass over the tokens that does not build the bodies
+		std::vector<ktypes::kfndec_t> signatures();
+		// amount of tokens read so far
+		size_t read() const { return tokens ? tokens->size() : windowStart + window.size(); }
+		// the last error came from the lexer (streaming)
+		bool lexer_failed() const { return lexFailed; }
 	};
 }
\ No newline at end of file
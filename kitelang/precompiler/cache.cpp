@@ -0,0 +1,142 @@
+#include "cache.h"
+#include "mapped.h"
+#include "../lexer/scan.h"
+#include <cctype>
+#include <stdexcept>
+
+using namespace lexer::scan;
+
+precompiler::Preprocessed precompiler::Preprocessed::scan(const char* source, size_t size) {
+    Preprocessed result;
+    result.text.reserve(size + 1);
+    size_t textStart = 0; // start of the text segment being built
+
+    // finish the text segment being built (if any), so a directive can follow it
+    auto flush = [&]() {
+        if (result.text.size() > textStart)
+            result.segments.push_back(Segment{ Segment::TEXT, textStart, result.text.size() - textStart, "", "", 0 });
+        textStart = result.text.size();
+    };
+    auto at = [&](size_t i) { return i < size ? source[i] : '\0'; };
+
+    for (size_t ptr = 0; ptr < size; ptr++) {
+        if (source[ptr] == '#') {
+            ptr++;
+            std::string command;
+            while (ptr < size && isalpha(source[ptr])) {
+                command += source[ptr++];
+            }
+
+            while (ptr < size && isspace(source[ptr])) {
+                ptr++;
+            }
+
+            if (command == "include") {
+                char delimiter = at(ptr);
+                if (delimiter == '"' || delimiter == '<') {
+                    ptr++;
+                    std::string argument;
+                    while (ptr < size && source[ptr] != '"' && source[ptr] != '>') {
+                        argument += source[ptr++];
+                    }
+                    if (ptr < size) ptr++;
+                    flush();
+                    result.segments.push_back(Segment{ Segment::INCLUDE, 0, 0, argument, "", delimiter });
+                }
+            }
+            else if (command == "define") {
+                while (ptr < size && isspace(source[ptr])) {
+                    ptr++;
+                }
+                std::string key, value;
+                while (ptr < size && !isspace(source[ptr])) {
+                    key += source[ptr++];
+                }
+                while (ptr < size && isspace(source[ptr])) {
+                    ptr++;
+                }
+                while (ptr < size && !isspace(source[ptr])) {
+                    value += source[ptr++];
+                }
+                flush();
+                result.segments.push_back(Segment{ Segment::DEFINE, 0, 0, key, value, 0 });
+            }
+            // the rest of the line is kept
+            size_t end = find_byte(source, ptr, size, '\n');
+            result.text.append(source + ptr, end - ptr);
+            ptr = end;
+            result.text += '\n';
+        }
+        else {
+            // copy everything up to the next directive at once
+            size_t next = find_byte(source, ptr, size, '#');
+            result.text.append(source + ptr, next - ptr);
+            ptr = next - 1;
+        }
+    }
+    flush();
+    return result;
+}
+
+precompiler::IncludeCache& precompiler::IncludeCache::shared() {
+    static IncludeCache cache;
+    return cache;
+}
+
+std::shared_ptr<const precompiler::Preprocessed> precompiler::IncludeCache::load(const std::string& path) {
+    std::error_code ec;
+    std::filesystem::path canonical = std::filesystem::canonical(path, ec);
+    if (ec)
+        throw std::runtime_error("Failed to open file " + path);
+    std::filesystem::file_time_type mtime = std::filesystem::last_write_time(canonical, ec);
+    uintmax_t size = ec ? 0 : std::filesystem::file_size(canonical, ec);
+    std::string key = canonical.string();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = entries.find(key);
+        if (!ec && entry != entries.end() && entry->second.mtime == mtime && entry->second.size == size)
+            return entry->second.file;
+    }
+
+    // scan outside of the lock, two threads missing at once only do the work twice
+    MappedFile file(key);
+    auto preprocessed = std::make_shared<const Preprocessed>(Preprocessed::scan(file.data(), file.size()));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[key] = Entry{ mtime, size, preprocessed };
+    return preprocessed;
+}
+
+std::shared_ptr<const precompiler::Header> precompiler::IncludeCache::header(const std::string& path) {
+    std::error_code ec;
+    std::string compiled = Header::path(path);
+    std::filesystem::file_time_type mtime = std::filesystem::last_write_time(compiled, ec);
+    if (ec) return nullptr;
+    std::filesystem::file_time_type sourceTime = std::filesystem::last_write_time(path, ec);
+    if (ec || mtime <= sourceTime) return nullptr;
+    uintmax_t size = std::filesystem::file_size(compiled, ec);
+    if (ec) return nullptr;
+    std::string key = std::filesystem::canonical(compiled, ec).string();
+    if (ec) return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = headers.find(key);
+        if (entry != headers.end() && entry->second.mtime == mtime && entry->second.size == size)
+            return entry->second.header;
+    }
+
+    std::shared_ptr<const Header> header;
+    try {
+        MappedFile file(key);
+        header = Header::read(file.data(), file.size());
+    }
+    catch (std::runtime_error&) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    headers[key] = HeaderEntry{ mtime, size, header };
+    return header;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "header.h"
+
+namespace precompiler {
+    // Preprocessed form of a source file
+    // the directives are parsed out once, the result is the text between them plus the
+    // includes and defines in the order they appear, so it can be spliced into any
+    // translation unit without scanning the file again
+    // (which includes are actually expanded depends on what the unit already included)
+    struct Preprocessed {
+        struct Segment {
+            enum kind_t { TEXT, INCLUDE, DEFINE } kind;
+            size_t offset, length;  // TEXT: the range in `text`
+            std::string name;       // INCLUDE: the file as written, DEFINE: the key
+            std::string value;      // DEFINE: the value
+            char delimiter;         // INCLUDE: '"' or '<'
+        };
+        std::string text;
+        std::vector<Segment> segments;
+
+        static Preprocessed scan(const char* source, size_t size);
+    };
+
+    // Process-wide cache of preprocessed includes, safe to use from several threads
+    // entries are keyed by the canonical path and are read again when the
+    // modification time or the size of the file changes
+    class IncludeCache {
+    public:
+        static IncludeCache& shared();
+        // the preprocessed file, read through mmap if it is not cached (or out of date)
+        // throws std::runtime_error if the file can not be opened
+        std::shared_ptr<const Preprocessed> load(const std::string& path);
+        // the precompiled form of the header at `path` (read through mmap if it is not cached),
+        // nullptr if there is none, it is not newer than the header or it is not valid
+        std::shared_ptr<const Header> header(const std::string& path);
+
+    private:
+        struct Entry {
+            std::filesystem::file_time_type mtime;
+            uintmax_t size;
+            std::shared_ptr<const Preprocessed> file;
+        };
+        std::mutex mutex;
+        std::map<std::string, Entry> entries;
+        struct HeaderEntry {
+            std::filesystem::file_time_type mtime;
+            uintmax_t size;
+            std::shared_ptr<const Header> header;
+        };
+        std::map<std::string, HeaderEntry> headers;
+    };
+}
\ No newline at end of file
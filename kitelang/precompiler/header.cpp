@@ -0,0 +1,149 @@
+#include "header.h"
+#include "../lexer/scan.h"
+#include "../cache/sha256.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+using namespace lexer::scan;
+
+// the file is the magic number, the digest (64 hex digits) of the rest, then the line count,
+// the defines, the names and the externs, each list is its length followed by the elements
+// numbers are 32 bits in host order (the file is made and used on one machine), a string is
+// its length followed by its bytes, a type is a byte
+namespace {
+    constexpr uint32_t magic = 0x31434d4b;  // "KMC1", changed when the format or the types change
+
+    void put_u32(std::string& out, uint32_t v) { out.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+    void put_str(std::string& out, std::string_view s) {
+        put_u32(out, (uint32_t)s.size());
+        out.append(s);
+    }
+
+    // reads the file front to back, every read checks the bounds
+    struct Reader {
+        const char* p;
+        const char* end;
+        bool ok = true;
+
+        uint32_t u32() {
+            uint32_t v = 0;
+            if ((size_t)(end - p) < sizeof(v)) { ok = false; return 0; }
+            std::memcpy(&v, p, sizeof(v));
+            p += sizeof(v);
+            return v;
+        }
+        uint8_t u8() {
+            if (p == end) { ok = false; return 0; }
+            return (uint8_t)*p++;
+        }
+        std::string str() {
+            uint32_t size = u32();
+            if (!ok || (size_t)(end - p) < size) { ok = false; return ""; }
+            std::string s(p, size);
+            p += size;
+            return s;
+        }
+        ktypes::ktype_t type() {
+            uint8_t t = u8();
+            if (t > ktypes::PTR64) ok = false;
+            return (ktypes::ktype_t)t;
+        }
+    };
+}
+
+std::string precompiler::Header::path(const std::string& header) {
+    return std::filesystem::path(header).replace_extension(".kmc").string();
+}
+
+// the same names the precompiler expands defines over
+std::vector<std::string> precompiler::Header::scan_names(std::string_view text) {
+    const char* s = text.data();
+    size_t n = text.size();
+    std::vector<std::string> result;
+    size_t ptr = 0;
+    while (ptr < n) {
+        char c = s[ptr];
+        if (is(c, CC_IDSTART)) {
+            size_t start = ptr;
+            ptr = skip_ident(s, ptr + 1, n);
+            result.emplace_back(s + start, ptr - start);
+        }
+        else if (is(c, CC_DIGIT)) ptr = skip_ident(s, ptr + 1, n);
+        else if (c == '"' || c == '\'') {
+            ptr++;
+            while (ptr < n && s[ptr] != c) ptr += (s[ptr] == '\\') ? 2 : 1;
+            ptr = std::min(ptr + 1, n);
+        }
+        else if (c == ';') ptr = find_byte(s, ptr, n, '\n');
+        else if (c == '~') ptr = std::min(find_byte(s, ptr + 1, n, '~') + 1, n);
+        else ptr++;
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+bool precompiler::Header::mentions(std::string_view name) const {
+    auto it = std::lower_bound(names.begin(), names.end(), name, [](const std::string& a, std::string_view b) { return a < b; });
+    return it != names.end() && *it == name;
+}
+
+std::string precompiler::Header::serialize() {
+    std::string body;
+    put_u32(body, lines);
+    put_u32(body, (uint32_t)defines.size());
+    for (const auto& [key, value] : defines) {
+        put_str(body, key);
+        put_str(body, value);
+    }
+    put_u32(body, (uint32_t)names.size());
+    for (const std::string& name : names) put_str(body, name);
+    put_u32(body, (uint32_t)externs.size());
+    for (const ktypes::kfndec_t& fn : externs) {
+        put_str(body, fn.name);
+        body += (char)fn.returns;
+        body += (char)fn.is_variadic;
+        put_u32(body, (uint32_t)fn.argtps.size());
+        for (ktypes::ktype_t t : fn.argtps) body += (char)t;
+    }
+
+    digest = cache::Sha256().update(body).hex();
+    std::string result;
+    result.reserve(sizeof(magic) + digest.size() + body.size());
+    put_u32(result, magic);
+    result += digest;
+    result += body;
+    return result;
+}
+
+std::shared_ptr<const precompiler::Header> precompiler::Header::read(const char* data, size_t size) {
+    Reader in{ data, data + size };
+    if (in.u32() != magic || (size_t)(in.end - in.p) < 64) return nullptr;
+    auto header = std::make_shared<Header>();
+    header->digest.assign(in.p, 64);
+    in.p += 64;
+
+    header->lines = in.u32();
+    uint32_t count = in.u32();
+    for (uint32_t i = 0; in.ok && i < count; i++) {
+        std::string key = in.str();
+        header->defines.emplace_back(std::move(key), in.str());
+    }
+    count = in.u32();
+    for (uint32_t i = 0; in.ok && i < count; i++) header->names.push_back(in.str());
+    count = in.u32();
+    for (uint32_t i = 0; in.ok && i < count; i++) {
+        ktypes::kfndec_t fn{ in.str(), {}, ktypes::ANY, false, -1 };
+        fn.returns = in.type();
+        fn.is_variadic = in.u8() != 0;
+        uint32_t args = in.u32();
+        // every argument takes a byte, a larger count is a broken file
+        if (args > (size_t)(in.end - in.p)) in.ok = false;
+        for (uint32_t a = 0; in.ok && a < args; a++) fn.argtps.push_back(in.type());
+        header->externs.push_back(std::move(fn));
+    }
+    if (!in.ok || in.p != in.end) return nullptr;
+    return header;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "../common.h"
+
+namespace precompiler {
+    // Precompiled header (.kmc, written by kitelang --precompile-header)
+    // the parsed extern declarations and the defines of a header that only declares externs,
+    // an include of the header uses it instead of its text while it is newer than the header
+    // the precompiler leaves `@N` in the source where it would have put the text of the N-th
+    // precompiled header of the unit, the parser makes the extern declarations from it
+    struct Header {
+        std::string digest;                                        // SHA-256 of the contents, in hex
+        uint32_t lines = 0;                                        // line breaks the text of the header adds
+        std::vector<std::pair<std::string, std::string>> defines;  // in the order they appear
+        std::vector<std::string> names;                            // every name in the text as written, sorted
+        std::vector<ktypes::kfndec_t> externs;                     // the symbol IDs are not set
+
+        // path of the precompiled form of the header (foo.km -> foo.kmc)
+        static std::string path(const std::string& header);
+        // the names in the text of a source (strings and comments are skipped), sorted and unique
+        static std::vector<std::string> scan_names(std::string_view text);
+        // true if the name is in the text of the header
+        bool mentions(std::string_view name) const;
+
+        // the file contents, the digest is computed here
+        std::string serialize();
+        // nullptr if the data is not a precompiled header of this version of the compiler
+        static std::shared_ptr<const Header> read(const char* data, size_t size);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "mapped.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+precompiler::MappedFile::MappedFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open file " + path);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    buffer = ss.str();
+    ptr = buffer.data();
+    length = buffer.size();
+}
+
+precompiler::MappedFile::~MappedFile() {}
+
+#else
+
+precompiler::MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Failed to open file " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to open file " + path);
+    }
+    length = (size_t)st.st_size;
+    // an empty file can not be mapped, it is simply an empty view
+    if (length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map file " + path);
+        }
+        ptr = static_cast<const char*>(p);
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+precompiler::MappedFile::~MappedFile() {
+    if (ptr) munmap(const_cast<char*>(ptr), length);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace precompiler {
+    // Read-only view of a whole file
+    // the file is memory mapped where mmap is available, on Windows it is read into a buffer
+    class MappedFile {
+    public:
+        // throws std::runtime_error if the file can not be opened
+        explicit MappedFile(const std::string& path);
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        const char* data() const { return ptr; }
+        size_t size() const { return length; }
+
+    private:
+        const char* ptr = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        std::string buffer;
+#endif
+    };
+}
\ No newline at end of file
@@ -1,77 +1,106 @@
 #include "precompiler.h"
+#include "../lexer/scan.h"
 
-std::string Precompiler::precompile(const std::string& source) {
-    std::string result;
+using namespace lexer::scan;
 
-    for (size_t ptr = 0; ptr < source.size(); ptr++) {
-        if (source[ptr] == '#') {
-            ptr++;
-            std::string command;
-            while (ptr < source.size() && isalpha(source[ptr])) {
-                command += source[ptr++];
-            }
+std::string Precompiler::precompile(const std::string& source) {
+    std::string result = process(source);
+    // the declarations of a precompiled header are only the ones its text would give if no
+    // define of the unit changes a name in it, otherwise all of them are included as text
+    if (!precompiled.empty() && changesHeaders()) {
+        definitions.clear();
+        includedFiles.clear();
+        precompiled.clear();
+        usePrecompiled = false;
+        result = process(source);
+    }
+    if (definitions.empty()) return result;
+    return expand(result);
+}
 
-            while (ptr < source.size() && isspace(source[ptr])) {
-                ptr++;
-            }
+std::string Precompiler::process(const std::string& source) {
+    std::string result;
+    result.reserve(source.size());
+    splice(precompiler::Preprocessed::scan(source.data(), source.size()), result);
+    return result;
+}
 
-            std::string argument;
-            if (command == "include") {
-                char delimiter = source[ptr];
-                if (delimiter == '"' || delimiter == '<') {
-                    ptr++;
-                    while (ptr < source.size() && source[ptr] != '"' && source[ptr] != '>') {
-                        argument += source[ptr++];
-                    }
-                    if (ptr < source.size()) ptr++;
-                    result += handleInclude(argument, delimiter);
-                }
-            }
-            else if (command == "define") {
-                while (ptr < source.size() && isspace(source[ptr])) {
-                    ptr++;
-                }
-                std::string key, value;
-                while (ptr < source.size() && !isspace(source[ptr])) {
-                    key += source[ptr++];
-                }
-                while (ptr < source.size() && isspace(source[ptr])) {
-                    ptr++;
-                }
-                while (ptr < source.size() && !isspace(source[ptr])) {
-                    value += source[ptr++];
-                }
-                handleDefine(key, value);
-            }
-            while (ptr < source.size() && source[ptr] != '\n') {
-                result += source[ptr++];
-            }
-            result += '\n';
-        }
-        else {
-            result += source[ptr];
+void Precompiler::splice(const precompiler::Preprocessed& file, std::string& result) {
+    for (const precompiler::Preprocessed::Segment& segment : file.segments) {
+        switch (segment.kind) {
+        case precompiler::Preprocessed::Segment::TEXT:
+            result.append(file.text, segment.offset, segment.length);
+            break;
+        case precompiler::Preprocessed::Segment::INCLUDE:
+            handleInclude(segment.name, segment.delimiter, result);
+            break;
+        case precompiler::Preprocessed::Segment::DEFINE:
+            handleDefine(segment.name, segment.value);
+            break;
         }
     }
+}
 
-    for (const auto& pair : definitions) {
-        std::string key = pair.first;
-        std::string value = pair.second;
-        size_t pos = 0;
-        while ((pos = result.find(key, pos)) != std::string::npos) {
-            result.replace(pos, key.length(), value);
-            pos += value.length(); // Move past the replacement
+// true if a define expands a name of a precompiled header to something else than the
+// header itself defined it as
+bool Precompiler::changesHeaders() const {
+    for (const std::shared_ptr<const precompiler::Header>& header : precompiled) {
+        for (const auto& [key, value] : definitions) {
+            if (!header->mentions(key)) continue;
+            const std::string* own = nullptr;
+            for (const auto& define : header->defines)
+                if (define.first == key) own = &define.second;
+            if (!own || *own != value) return true;
         }
     }
+    return false;
+}
 
+// Replaces every identifier that has a definition with its value, in a single pass
+// only whole identifiers are matched (a define of `len` leaves `strlen` alone) and
+// string literals, char literals and comments are copied as they are
+// the values are not expanded again
+std::string Precompiler::expand(const std::string& source) const {
+    const char* s = source.data();
+    size_t n = source.size();
+    std::string result;
+    result.reserve(n + n / 8);
+
+    size_t copied = 0; // the text in [copied, ptr) is unchanged and not yet in the result
+    size_t ptr = 0;
+    while (ptr < n) {
+        char c = s[ptr];
+        if (is(c, CC_IDSTART)) {
+            size_t start = ptr;
+            ptr = skip_ident(s, ptr + 1, n);
+            auto definition = definitions.find(std::string_view(s + start, ptr - start));
+            if (definition != definitions.end()) {
+                result.append(s + copied, start - copied);
+                result += definition->second;
+                copied = ptr;
+            }
+        }
+        // numbers (and anything glued to them) are never names
+        else if (is(c, CC_DIGIT)) ptr = skip_ident(s, ptr + 1, n);
+        else if (c == '"' || c == '\'') {
+            ptr++;
+            while (ptr < n && s[ptr] != c) ptr += (s[ptr] == '\\') ? 2 : 1;
+            ptr = std::min(ptr + 1, n);
+        }
+        else if (c == ';') ptr = find_byte(s, ptr, n, '\n');
+        else if (c == '~') ptr = std::min(find_byte(s, ptr + 1, n, '~') + 1, n);
+        else ptr++;
+    }
+    result.append(s + copied, n - copied);
     return result;
 }
 
-std::string Precompiler::handleInclude(const std::string& filename, char type) {
+void Precompiler::handleInclude(const std::string& filename, char type, std::string& result) {
     std::string normalizedFilename = filename;
 
     if (includedFiles.find(normalizedFilename) != includedFiles.end()) {
-        std::cout << "Skipping already included file: " << normalizedFilename << std::endl;
-        return "";
+        log << "Skipping already included file: " << normalizedFilename << std::endl;
+        return;
     }
 
     includedFiles.insert(normalizedFilename);
@@ -80,21 +109,31 @@ std::string Precompiler::handleInclude(const std::string& filename, char type) {
 
     if (!filename.empty()) {
         if (type == '<') {
-            path = "stdlib/include/" + normalizedFilename;
+            path = (dir / "stdlib" / "include" / normalizedFilename).string();
         }
         else if (type == '"')
-            path = normalizedFilename;
+            path = (dir / normalizedFilename).string();
         else throw std::runtime_error("Invalid include format for " + filename);
     }
     else throw std::runtime_error("Empty #include precompiler directive");
 
-    std::ifstream file(path);
-    if (!file.is_open())
-        throw std::runtime_error("Failed to open file " + path);
+    // a header precompiled after it was last changed is not lexed and parsed again, its defines
+    // are taken from the precompiled form and its declarations are put in at `@N` by the parser
+    // (the marker takes as many lines as the text, so the lines of the unit stay the same)
+    if (usePrecompiled) {
+        if (std::shared_ptr<const precompiler::Header> header = precompiler::IncludeCache::shared().header(path)) {
+            for (const auto& [key, value] : header->defines) handleDefine(key, value);
+            result += '@' + std::to_string(precompiled.size()) + " ~kmc " + header->digest + '~';
+            result.append(header->lines, '\n');
+            precompiled.push_back(std::move(header));
+            return;
+        }
+    }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return precompile(buffer.str());
+    // the file is scanned only the first time any unit includes it
+    std::shared_ptr<const precompiler::Preprocessed> file = precompiler::IncludeCache::shared().load(path);
+    result.reserve(result.size() + file->text.size());
+    splice(*file, result);
 }
 
 void Precompiler::handleDefine(const std::string& key, const std::string& value) {
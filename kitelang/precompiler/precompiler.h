@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <set>
 #include <iostream>
@@ -8,17 +10,38 @@
 #include <fstream>
 #include <cctype>
 #include <filesystem>
+#include "cache.h"
 
 namespace fs = std::filesystem;
 
 class Precompiler {
 public:
+    // `dir` is the directory of the source, includes are found relative to it
+    // notes (like skipped includes) are written to `log`
+    Precompiler(fs::path dir = fs::path(), std::ostream& log = std::cout) : dir(std::move(dir)), log(log) {}
+
+    // resolves the includes, then expands the defines over the whole result
     std::string precompile(const std::string& source);
+    // the precompiled headers included in place of their text, `@N` marks where the N-th was
+    const std::vector<std::shared_ptr<const precompiler::Header>>& headers() const { return precompiled; }
 
 private:
-    std::unordered_map<std::string, std::string> definitions{};
+    fs::path dir;
+    std::ostream& log;
+    // hash and equality that accept string_views, so a name can be looked up without copying it
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    std::unordered_map<std::string, std::string, NameHash, std::equal_to<>> definitions{};
     std::set<std::string> includedFiles{}; // Track included files
+    std::vector<std::shared_ptr<const precompiler::Header>> precompiled{};
+    bool usePrecompiled = true;
 
-    std::string handleInclude(const std::string&, char);
+    std::string process(const std::string&);
+    void splice(const precompiler::Preprocessed&, std::string&);
+    std::string expand(const std::string&) const;
+    bool changesHeaders() const;
+    void handleInclude(const std::string&, char, std::string&);
     void handleDefine(const std::string& key, const std::string& value);
 };
@@ -0,0 +1,271 @@
+#include "checker.h"
+#include <exception>
+
+void semantics::Checker::check(parser::RootNode* root) {
+	// like codegen, every function is known everywhere and the other top-level statements come
+	// first, so an extern declared after a function is visible in it
+	for (parser::Node* n : root->statements) {
+		if (n->type != parser::FN) continue;
+		parser::FnNode* node = static_cast<parser::FnNode*>(n);
+		std::vector<ktypes::ktype_t> types;
+		for (const ktypes::kval_t& arg : node->args) types.push_back(arg.type);
+		fns.declare(ktypes::kfndec_t{ node->name, types, node->returns, node->is_variadic, node->sym });
+	}
+	// the first error in the order of the statements is reported, the statements after it are not checked
+	size_t first = root->statements.size();
+	std::exception_ptr error;
+	auto checked = [&](size_t i) {
+		if (i >= first) return;
+		try {
+			statement(root->statements[i]);
+		}
+		catch (errors::kiterr&) {
+			error = std::current_exception();
+			first = i;
+			reset();
+		}
+	};
+	for (size_t i = 0; i < root->statements.size(); i++)
+		if (root->statements[i]->type != parser::FN) checked(i);
+	for (size_t i = 0; i < root->statements.size(); i++)
+		if (root->statements[i]->type == parser::FN) checked(i);
+	if (error) std::rethrow_exception(error);
+}
+
+void semantics::Checker::declare(const std::vector<ktypes::kfndec_t>& signatures) {
+	for (const ktypes::kfndec_t& fn : signatures) fns.declare(fn);
+}
+
+void semantics::Checker::check(parser::Node* node) {
+	statement(node);
+}
+
+void semantics::Checker::reset() {
+	// the error left the state in the middle of a statement
+	vars = Scope();
+	for (auto it = shadowed.rbegin(); it != shadowed.rend(); ++it) fns.restore(it->first, it->second);
+	shadowed.clear();
+	inFn = false;
+	returns = ktypes::ANY;
+	slots = 0;
+}
+
+void semantics::Checker::statement(parser::Node* node) {
+	switch (node->type) {
+	case parser::FN: return fn(static_cast<parser::FnNode*>(node));
+	case parser::ROOT: return scope(static_cast<parser::RootNode*>(node));
+	case parser::LET: return let(static_cast<parser::LetNode*>(node));
+	case parser::FOR: return loop(static_cast<parser::ForNode*>(node));
+	case parser::EXTERN:
+		for (const ktypes::kfndec_t& fn : static_cast<parser::ExternNode*>(node)->symbols) declare(fn);
+		return;
+	case parser::RETURN:
+		// the value of a return from a void function is not generated
+		if (returns != ktypes::VOID) expr(static_cast<parser::ReturnNode*>(node)->value);
+		return;
+	case parser::IF: {
+		parser::IfNode* n = static_cast<parser::IfNode*>(node);
+		expr(n->condition);
+		statement(n->block);
+		if (n->has_else_block) statement(n->else_block);
+		return;
+	}
+	case parser::CMP: {
+		parser::CmpNode* n = static_cast<parser::CmpNode*>(node);
+		expr(n->val1);
+		expr(n->val2);
+		for (const auto& [key, root] : n->comparisons) statement(root);
+		return;
+	}
+	case parser::LOOP: return statement(static_cast<parser::LoopNode*>(node)->root);
+	case parser::GLOBAL:
+	case parser::ASM:
+	case parser::CDIRECT:
+	case parser::BREAK:
+	case parser::CONTINUE:
+		return;
+	default:
+		expr(node);
+	}
+}
+
+void semantics::Checker::scope(parser::RootNode* node) {
+	vars.push();
+	for (parser::Node* n : node->statements) statement(n);
+	vars.pop();
+}
+
+void semantics::Checker::fn(parser::FnNode* node) {
+	// a function may be declared inside a block, the one around it goes on after it
+	bool outerFn = inFn;
+	ktypes::ktype_t outerReturns = returns;
+	int outerSlots = slots;
+	size_t outerShadowed = shadowed.size();
+	inFn = true;
+	returns = node->returns;
+	slots = 0;
+	vars.push();
+	for (const ktypes::kval_t& arg : node->args) bind(arg.sym, arg.type);
+	scope(node->root);
+	vars.pop();
+	// the externs declared inside the function were only for the rest of it
+	while (shadowed.size() > outerShadowed) {
+		fns.restore(shadowed.back().first, shadowed.back().second);
+		shadowed.pop_back();
+	}
+	inFn = outerFn;
+	returns = outerReturns;
+	slots = outerSlots;
+}
+
+void semantics::Checker::declare(const ktypes::kfndec_t& fn) {
+	const ktypes::kfndec_t* previous = fns.declare(fn);
+	if (inFn) shadowed.emplace_back(fn.sym, previous);
+}
+
+void semantics::Checker::let(parser::LetNode* node) {
+	if (node->isAlloc) {
+		if (ktypes::size(node->varType) == 0)
+			throw errors::kiterr("cannot create array with void type", node->line, node->pos_start, node->pos_end);
+		node->slot = bind(node->sym, pointer_to(node->varType));
+		return;
+	}
+	ktypes::ktype_t resultReturn = expr(node->root);
+	if (!compatible(node->varType, resultReturn))
+		throw errors::kiterr("incompatible types " + ktypes::ktype_tn.at(node->varType) + " and " + ktypes::ktype_tn.at(resultReturn), node->line, node->pos_start, node->pos_end);
+	node->slot = bind(node->sym, node->varType);
+}
+
+void semantics::Checker::loop(parser::ForNode* node) {
+	vars.push();
+	// the initial value is computed before the iterator exists, the step and the target after the body
+	expr(node->initVal);
+	node->slot = bind(node->itersym, ktypes::INT64);
+	statement(node->root);
+	expr(node->stepVal);
+	expr(node->targetVal);
+	vars.pop();
+}
+
+ktypes::ktype_t semantics::Checker::expr(parser::Node* node) {
+	ktypes::ktype_t type = ktypes::ANY;
+	switch (node->type) {
+	case parser::INT_LIT: type = ktypes::INT64; break;
+	case parser::CHAR_LIT: type = ktypes::CHAR; break;
+	case parser::STRING_LIT: type = ktypes::PTR8; break;
+	case parser::REG: type = ktypes::ANY; break;
+	case parser::VAR: {
+		parser::VarNode* n = static_cast<parser::VarNode*>(node);
+		type = variable(n->sym, n->name, n, n->slot).type;
+		break;
+	}
+	case parser::ADDROF: {
+		parser::AddrOfNode* n = static_cast<parser::AddrOfNode*>(node);
+		type = pointer_to(variable(n->sym, n->name, n, n->slot).type);
+		break;
+	}
+	case parser::DEREF: {
+		parser::DerefNode* n = static_cast<parser::DerefNode*>(node);
+		type = element(variable(n->sym, n->name, n, n->slot).type);
+		break;
+	}
+	case parser::IDX: {
+		parser::IndexNode* n = static_cast<parser::IndexNode*>(node);
+		type = element(variable(n->sym, n->name, n, n->slot).type);
+		expr(n->index);
+		break;
+	}
+	case parser::CALL: type = call(static_cast<parser::CallNode*>(node)); break;
+	case parser::BINOP: type = binop(static_cast<parser::BinOpNode*>(node)); break;
+	default: throw errors::kiterr("expected an expression", node->line, node->pos_start, node->pos_end);
+	}
+	node->valueType = type;
+	return type;
+}
+
+ktypes::ktype_t semantics::Checker::call(parser::CallNode* node) {
+	const ktypes::kfndec_t& fn = fns.find(node->sym);
+	node->decl = &fn;
+
+	if (fn.is_variadic && fn.argtps.size() > node->args.size())
+		throw errors::kiterr("wrong amount of arguments given to function " + node->routine + ". expected at least " + std::to_string(fn.argtps.size()) + ", got " + std::to_string(node->args.size()), node->line, node->pos_start, node->pos_end);
+	if (!fn.is_variadic && fn.argtps.size() != node->args.size())
+		throw errors::kiterr("wrong amount of arguments given to function " + node->routine + ". expected " + std::to_string(fn.argtps.size()) + ", got " + std::to_string(node->args.size()), node->line, node->pos_start, node->pos_end);
+
+	for (size_t i = 0; i < node->args.size(); i++) {
+		ktypes::ktype_t resultReturn = expr(node->args[i]);
+		// the variadic arguments can be anything
+		if (i < fn.argtps.size() && !compatible(fn.argtps[i], resultReturn))
+			throw errors::kiterr("function " + node->routine + ", argument " + std::to_string(i + 1) + ": incompatible types " + ktypes::ktype_tn.at(fn.argtps[i]) + " and " + ktypes::ktype_tn.at(resultReturn), node->args[i]->line, node->args[i]->pos_start, node->args[i]->pos_end);
+	}
+	return fn.returns;
+}
+
+ktypes::ktype_t semantics::Checker::binop(parser::BinOpNode* node) {
+	if (node->operation == lexer::EQ) return assign(node);
+	ktypes::ktype_t left = expr(node->left);
+	ktypes::ktype_t right = expr(node->right);
+	switch (node->operation) {
+	case lexer::EQEQ:
+	case lexer::NEQEQ:
+	case lexer::GT:
+	case lexer::LT:
+	case lexer::GTE:
+	case lexer::LTE:
+		return ktypes::BOOL;
+	default:
+		break;
+	}
+	if (left == ktypes::ANY || right == ktypes::ANY) return ktypes::ANY;
+	// moving a pointer by an integer keeps its type, anything else is computed in 64 bits
+	if (node->operation == lexer::PLUS && is_pointer(left) != is_pointer(right))
+		return is_pointer(left) ? left : right;
+	if (node->operation == lexer::MINUS && is_pointer(left) && !is_pointer(right))
+		return left;
+	return ktypes::INT64;
+}
+
+ktypes::ktype_t semantics::Checker::assign(parser::BinOpNode* node) {
+	// the value is computed before the place it is stored to
+	expr(node->right);
+	ktypes::ktype_t type;
+	switch (node->left->type) {
+	case parser::VAR: {
+		parser::VarNode* n = static_cast<parser::VarNode*>(node->left);
+		type = variable(n->sym, n->name, n, n->slot).type;
+		break;
+	}
+	case parser::DEREF: {
+		parser::DerefNode* n = static_cast<parser::DerefNode*>(node->left);
+		ktypes::ktype_t pointer = variable(n->sym, n->name, n, n->slot).type;
+		if (!is_pointer(pointer))
+			throw errors::kiterr("cannot dereference a non-pointer", n->line, n->pos_start, n->pos_end);
+		type = element(pointer);
+		break;
+	}
+	case parser::IDX: {
+		parser::IndexNode* n = static_cast<parser::IndexNode*>(node->left);
+		type = element(variable(n->sym, n->name, n, n->slot).type);
+		expr(n->index);
+		break;
+	}
+	default:
+		throw errors::kiterr("invalid lhs of assignment", node->left->line, node->left->pos_start, node->left->pos_end);
+	}
+	node->left->valueType = type;
+	return type;
+}
+
+const semantics::variable_t& semantics::Checker::variable(int sym, const std::string& name, parser::Node* at, int& slot) {
+	const variable_t* var = vars.find(sym);
+	if (var == nullptr)
+		throw errors::kiterr("variable " + name + " is not present in this context", at->line, at->pos_start, at->pos_end);
+	slot = var->slot;
+	return *var;
+}
+
+int semantics::Checker::bind(int sym, ktypes::ktype_t type) {
+	int& counter = inFn ? slots : topSlots;
+	vars.bind(sym, variable_t{ counter, type });
+	return counter++;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+#include <utility>
+#include <vector>
+#include "semantics.h"
+#include "../lexer/symbols.h"
+#include "../errors/errors.h"
+
+namespace semantics {
+	// Checker
+	// the semantic pass, run once over the tree between parsing and codegen
+	// it finds the type of every expression and what every name refers to, and keeps them on the
+	// nodes (valueType, slot, decl), so codegen only reads them
+	// the variables of a function are numbered in the order they are declared (its arguments are
+	// 0 to n-1), the ones of the top-level statements are numbered together
+	class Checker {
+	private:
+		Scope vars;										// variables visible at the current point
+		FnTable fns;									// declared functions, the calls point into it
+		// the declarations the externs of the current function replaced, put back at its end
+		std::vector<std::pair<int, const ktypes::kfndec_t*>> shadowed;
+		bool inFn = false;
+		ktypes::ktype_t returns = ktypes::ANY;			// return type of the current function
+		int slots = 0;									// variables declared so far in the function
+		int topSlots = 0;								// the same for the top-level statements
+
+		void statement(parser::Node*);
+		void scope(parser::RootNode*);
+		void fn(parser::FnNode*);
+		void declare(const ktypes::kfndec_t&);
+		void let(parser::LetNode*);
+		void loop(parser::ForNode*);
+		ktypes::ktype_t expr(parser::Node*);
+		ktypes::ktype_t call(parser::CallNode*);
+		ktypes::ktype_t binop(parser::BinOpNode*);
+		ktypes::ktype_t assign(parser::BinOpNode*);
+		const variable_t& variable(int sym, const std::string& name, parser::Node* at, int& slot);	// throws if not in scope
+		int bind(int sym, ktypes::ktype_t type);
+		void reset();
+	public:
+		explicit Checker(const lexer::SymbolTable& symbols) {
+			vars.reserve(symbols.size());
+			fns.reserve(symbols.size());
+		}
+		// a whole file, the first error in the order of the statements is thrown
+		void check(parser::RootNode*);
+		// streaming, the top-level statements are handed in one at a time in the order of the file,
+		// the functions and externs found by Parser::signatures are declared first
+		void declare(const std::vector<ktypes::kfndec_t>&);
+		void check(parser::Node*);
+	};
+}
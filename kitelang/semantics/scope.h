@@ -0,0 +1,74 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include "../common.h"
+
+namespace semantics {
+	// a variable visible in the current scope
+	typedef struct {
+		int slot;                // index of the variable in its function (see Checker)
+		ktypes::ktype_t type;
+	} variable_t;
+
+	// Scope-chained table of variables, indexed by symbol ID
+	// every binding is appended to one stack and remembers the binding it shadows,
+	// so opening a scope is O(1) and closing it only undoes the bindings made inside it
+	// (no table is copied when entering a block)
+	class Scope {
+	private:
+		struct Binding {
+			int sym;
+			int shadowed;        // index of the binding of the same symbol it hides, -1 if none
+			variable_t var;
+		};
+		std::vector<Binding> bindings;
+		std::vector<int> innermost;   // per symbol, index of the visible binding or -1
+		std::vector<size_t> marks;    // size of `bindings` when each open scope was entered
+	public:
+		void reserve(size_t symbols) { if (innermost.size() < symbols) innermost.resize(symbols, -1); }
+		void push() { marks.push_back(bindings.size()); }
+		void pop() {
+			size_t mark = marks.back();
+			marks.pop_back();
+			while (bindings.size() > mark) {
+				innermost[bindings.back().sym] = bindings.back().shadowed;
+				bindings.pop_back();
+			}
+		}
+		void bind(int sym, variable_t var) {
+			reserve(sym + 1);
+			bindings.push_back(Binding{ sym, innermost[sym], var });
+			innermost[sym] = (int)bindings.size() - 1;
+		}
+		// the visible variable with the symbol, nullptr if there is none
+		const variable_t* find(int sym) const {
+			if (sym < 0 || sym >= (int)innermost.size() || innermost[sym] < 0) return nullptr;
+			return &bindings[innermost[sym]].var;
+		}
+	};
+
+	// Function declarations indexed by symbol ID
+	// the declarations are kept in place for the whole compilation, so the calls can point to them
+	class FnTable {
+	private:
+		std::deque<ktypes::kfndec_t> decls;				// every declaration made, in order
+		std::vector<const ktypes::kfndec_t*> visible;	// per symbol, the declaration in effect or nullptr
+		static const ktypes::kfndec_t none;
+	public:
+		void reserve(size_t symbols) { if (visible.size() < symbols) visible.resize(symbols, nullptr); }
+		// returns the declaration it replaces (nullptr if none), so a scope can put it back with restore
+		const ktypes::kfndec_t* declare(const ktypes::kfndec_t& fn) {
+			reserve(fn.sym + 1);
+			decls.push_back(fn);
+			const ktypes::kfndec_t* previous = visible[fn.sym];
+			visible[fn.sym] = &decls.back();
+			return previous;
+		}
+		void restore(int sym, const ktypes::kfndec_t* previous) { visible[sym] = previous; }
+		// the declaration of the function, one without arguments returning ANY if it is unknown
+		const ktypes::kfndec_t& find(int sym) const {
+			if (sym < 0 || sym >= (int)visible.size() || !visible[sym]) return none;
+			return *visible[sym];
+		}
+	};
+}
\ No newline at end of file
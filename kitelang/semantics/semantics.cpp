@@ -1,22 +1,13 @@
 #include "semantics.h"
 
-ktypes::ktype_t semantics::would_return(std::shared_ptr<parser::Node> node, std::map <std::string, ktypes::ktype_t> vartypes, std::map <std::string, ktypes::kfndec_t> fns) {
-	switch (node->type) {
-	case parser::CALL:   return call_would_return(std::static_pointer_cast<parser::CallNode>(node), fns);
-	case parser::ADDROF: return addrof_would_return(std::static_pointer_cast<parser::AddrOfNode>(node), vartypes);
-	case parser::DEREF:  return ktypes::ANY;
-	case parser::BINOP: return ktypes::ANY;
-	case parser::CHAR_LIT: return ktypes::CHAR;
-	case parser::STRING_LIT: return ktypes::PTR8;
-	case parser::IDX: return idx_would_return(std::static_pointer_cast<parser::IndexNode>(node), vartypes);
-	case parser::INT_LIT: return ktypes::INT64;
-	case parser::REG: return ktypes::ANY;
-	case parser::VAR: return var_would_return(std::static_pointer_cast<parser::VarNode>(node), vartypes);
-	}
+const ktypes::kfndec_t semantics::FnTable::none{ "", {}, ktypes::ANY, false, -1 };
+
+bool semantics::is_pointer(ktypes::ktype_t type) {
+	return type == ktypes::PTR8 || type == ktypes::PTR16 || type == ktypes::PTR32 || type == ktypes::PTR64;
 }
 
-ktypes::ktype_t semantics::addrof_would_return(std::shared_ptr<parser::AddrOfNode> node, std::map <std::string, ktypes::ktype_t> vartypes) {
-	switch (vartypes[node->name])
+ktypes::ktype_t semantics::pointer_to(ktypes::ktype_t type) {
+	switch (type)
 	{
 	case ktypes::CHAR:
 	case ktypes::BYTE:
@@ -26,29 +17,24 @@ ktypes::ktype_t semantics::addrof_would_return(std::shared_ptr<parser::AddrOfNod
 		return ktypes::PTR16;
 	case ktypes::INT32:
 		return ktypes::PTR32;
-	case ktypes::INT64:
-	case ktypes::PTR8:
-	case ktypes::PTR16:
-	case ktypes::PTR32:
-	case ktypes::PTR64:
 	default:
 		return ktypes::PTR64;
-		break;
 	}
-	return ktypes::PTR64;
-}
-
-ktypes::ktype_t semantics::call_would_return(std::shared_ptr<parser::CallNode> node, std::map <std::string, ktypes::kfndec_t> fns) {
-	return fns[node->routine].returns;
 }
 
-ktypes::ktype_t semantics::idx_would_return(std::shared_ptr<parser::IndexNode> node, std::map <std::string, ktypes::ktype_t> vartypes) {
-	// return vartypes[node->name];
-	return ktypes::ANY;
-}
-
-ktypes::ktype_t semantics::var_would_return(std::shared_ptr<parser::VarNode> node, std::map <std::string, ktypes::ktype_t> vartypes) {
-	return vartypes[node->name];
+ktypes::ktype_t semantics::element(ktypes::ktype_t type) {
+	switch (type)
+	{
+	case ktypes::PTR8:
+		return ktypes::BYTE;
+	case ktypes::PTR16:
+		return ktypes::INT16;
+	case ktypes::PTR32:
+		return ktypes::INT32;
+	// a 64-bit value may be an integer or a pointer, the types do not tell them apart
+	default:
+		return ktypes::ANY;
+	}
 }
 
 bool semantics::compatible(ktypes::ktype_t a, ktypes::ktype_t b) {
@@ -0,0 +1,218 @@
+#include "server.h"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// a request is the magic number, its kind, the working directory of the client and the
+// command line (a count and the strings), the reply is the exit status and what was
+// printed to stdout and stderr
+// numbers are 32 bits in host order (both ends are on the same machine), a string is
+// its length followed by its bytes
+namespace {
+	constexpr uint32_t magic = 0x4b495445;	// "KITE", changed when the protocol changes
+	enum kind_t : uint32_t { RUN, STOP };
+
+	bool write_all(int fd, const void* data, size_t size) {
+		const char* p = static_cast<const char*>(data);
+		while (size > 0) {
+			ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool read_all(int fd, void* data, size_t size) {
+		char* p = static_cast<char*>(data);
+		while (size > 0) {
+			ssize_t n = recv(fd, p, size, 0);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool write_u32(int fd, uint32_t v) { return write_all(fd, &v, sizeof(v)); }
+	bool read_u32(int fd, uint32_t& v) { return read_all(fd, &v, sizeof(v)); }
+
+	bool write_str(int fd, std::string_view s) {
+		return write_u32(fd, (uint32_t)s.size()) && write_all(fd, s.data(), s.size());
+	}
+
+	bool read_str(int fd, std::string& s) {
+		uint32_t size;
+		// no argument or output is anywhere near this, a larger one is a broken peer
+		if (!read_u32(fd, size) || size > (1u << 30)) return false;
+		s.resize(size);
+		return read_all(fd, s.data(), size);
+	}
+
+	bool address(const std::string& path, sockaddr_un& addr) {
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+		std::memcpy(addr.sun_path, path.data(), path.size());
+		return true;
+	}
+
+	// a connected socket, -1 if nothing listens on the path or the one listening is run by
+	// another user (who could have bound the path in /tmp first, to read the sources sent to it
+	// and answer with anything)
+	int connect_to(const std::string& path) {
+		sockaddr_un addr;
+		if (!address(path, addr)) return -1;
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) return -1;
+		ucred peer;
+		socklen_t len = sizeof(peer);
+		if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) != 0 || peer.uid != getuid()) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	// the requests being served, the server waits for them before it exits
+	struct Running {
+		std::mutex mutex;
+		std::condition_variable finished;
+		int count = 0;
+	};
+}
+
+std::string server::default_socket() {
+	if (const char* s = std::getenv("KITE_SOCKET")) return s;
+	if (const char* d = std::getenv("XDG_RUNTIME_DIR")) return std::string(d) + "/kite.sock";
+	return "/tmp/kite-" + std::to_string(getuid()) + ".sock";
+}
+
+int server::serve(const std::string& path, const handler_t& handler, std::ostream& log) {
+	sockaddr_un addr;
+	if (!address(path, addr)) {
+		log << "kite: server: invalid socket path " << path << std::endl;
+		return 1;
+	}
+	// a socket file left behind by a server that did not exit cleanly is replaced,
+	// one that a server still listens on is not
+	int other = connect_to(path);
+	if (other >= 0) {
+		close(other);
+		log << "kite: server: a server is already listening on " << path << std::endl;
+		return 1;
+	}
+	unlink(path.c_str());
+
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	// the socket is only usable by its user from the start, whoever connects can write files as it
+	mode_t mask = umask(0077);
+	bool bound = listener >= 0 && bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0;
+	umask(mask);
+	if (!bound || listen(listener, 64) != 0) {
+		log << "kite: server: failed to listen on " << path << ": " << std::strerror(errno) << std::endl;
+		if (listener >= 0) close(listener);
+		return 1;
+	}
+	log << "kite: server: listening on " << path << std::endl;
+
+	Running running;
+	std::atomic<bool> stopping{ false };
+	while (!stopping) {
+		int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			if (!stopping) log << "kite: server: accept failed: " << std::strerror(errno) << std::endl;
+			break;
+		}
+		ucred peer;
+		socklen_t len = sizeof(peer);
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) != 0 || peer.uid != getuid()) {
+			close(fd);
+			continue;
+		}
+		{
+			std::lock_guard<std::mutex> lock(running.mutex);
+			running.count++;
+		}
+		std::thread([&, fd]() {
+			uint32_t m, kind, argc;
+			std::string cwd;
+			std::vector<std::string> args;
+			bool ok = read_u32(fd, m) && m == magic && read_u32(fd, kind) && read_str(fd, cwd) && read_u32(fd, argc);
+			for (uint32_t i = 0; ok && i < argc; i++) {
+				args.emplace_back();
+				ok = read_str(fd, args.back());
+			}
+			if (ok && kind == RUN) {
+				std::ostringstream out, err;
+				int status;
+				try {
+					status = handler(cwd, args, out, err);
+				}
+				catch (std::exception& e) {
+					// a request must not take the server down
+					err << "kite: " << e.what() << std::endl;
+					status = 1;
+				}
+				// a client that went away gets no reply
+				(void)(write_u32(fd, (uint32_t)status) && write_str(fd, out.view()) && write_str(fd, err.view()));
+			}
+			else if (ok && kind == STOP) {
+				stopping = true;
+				// wakes up the accept of the main thread
+				shutdown(listener, SHUT_RDWR);
+				write_u32(fd, 0);
+			}
+			close(fd);
+			std::lock_guard<std::mutex> lock(running.mutex);
+			running.count--;
+			running.finished.notify_all();
+		}).detach();
+	}
+
+	std::unique_lock<std::mutex> lock(running.mutex);
+	running.finished.wait(lock, [&] { return running.count == 0; });
+	close(listener);
+	unlink(path.c_str());
+	log << "kite: server: stopped" << std::endl;
+	return 0;
+}
+
+bool server::request(const std::string& path, const std::string& cwd, const std::vector<std::string>& args, std::ostream& out, std::ostream& err, int& status) {
+	int fd = connect_to(path);
+	if (fd < 0) return false;
+	bool ok = write_u32(fd, magic) && write_u32(fd, RUN) && write_str(fd, cwd) && write_u32(fd, (uint32_t)args.size());
+	for (const std::string& arg : args) ok = ok && write_str(fd, arg);
+	uint32_t code;
+	std::string o, e;
+	ok = ok && read_u32(fd, code) && read_str(fd, o) && read_str(fd, e);
+	close(fd);
+	if (!ok) return false;
+	out << o;
+	err << e;
+	status = (int)code;
+	return true;
+}
+
+bool server::stop(const std::string& path) {
+	int fd = connect_to(path);
+	if (fd < 0) return false;
+	uint32_t done;
+	bool ok = write_u32(fd, magic) && write_u32(fd, STOP) && write_str(fd, "") && write_u32(fd, 0) && read_u32(fd, done);
+	close(fd);
+	return ok;
+}
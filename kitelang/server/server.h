@@ -0,0 +1,28 @@
+#pragma once
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Compile server on a local Unix socket (kitelang --serve) and its client (kitelang --client)
+// the server process stays up for a whole build, so the process start, the static tables,
+// the preprocessed includes and the output cache are set up once instead of once per file
+namespace server {
+	// runs one command line from a client in the working directory `cwd`, writing what it prints
+	// to `out` and `err`, returns the exit status
+	typedef std::function<int(const std::string& cwd, const std::vector<std::string>& args, std::ostream& out, std::ostream& err)> handler_t;
+
+	// $KITE_SOCKET, or kite.sock in $XDG_RUNTIME_DIR, or /tmp/kite-<uid>.sock
+	std::string default_socket();
+
+	// serve requests on the socket until a client asks the server to stop, every request runs
+	// on its own thread (only clients of the same user are accepted), returns the exit status
+	int serve(const std::string& socket, const handler_t& handler, std::ostream& log);
+
+	// run the command line on the server (in the working directory `cwd`) and put what it
+	// printed in `out` and `err`, false if no server of the same user is listening on the socket
+	bool request(const std::string& socket, const std::string& cwd, const std::vector<std::string>& args, std::ostream& out, std::ostream& err, int& status);
+
+	// ask the server to finish the requests it is running and exit, false if there is none
+	bool stop(const std::string& socket);
+}
@@ -0,0 +1,91 @@
+#include "stats.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+// the global operator new and delete are replaced to count the bytes in use, in every form:
+// one left to the library would allocate past the count and not pair with the free() below
+// (std::stable_sort takes its buffer with the nothrow new)
+namespace {
+	std::atomic<bool> counting{ false };
+	std::atomic<int64_t> inUse{ 0 };
+	std::atomic<int64_t> peak{ 0 };
+
+	void add(int64_t bytes) {
+		int64_t now = inUse.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		int64_t top = peak.load(std::memory_order_relaxed);
+		while (now > top && !peak.compare_exchange_weak(top, now, std::memory_order_relaxed));
+	}
+
+	// alignment 0 is the default one of malloc
+	void* attempt(size_t size, size_t alignment) {
+		if (alignment == 0) return std::malloc(size);
+		void* p;
+		return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+	}
+
+	void* allocate(size_t size, size_t alignment) {
+		void* p;
+		while ((p = attempt(size ? size : 1, alignment)) == nullptr) {
+			std::new_handler handler = std::get_new_handler();
+			if (handler == nullptr) throw std::bad_alloc();
+			handler();
+		}
+		if (counting.load(std::memory_order_relaxed)) add((int64_t)malloc_usable_size(p));
+		return p;
+	}
+
+	void* allocate(size_t size, size_t alignment, const std::nothrow_t&) noexcept {
+		try {
+			return allocate(size, alignment);
+		}
+		catch (const std::bad_alloc&) {
+			return nullptr;
+		}
+	}
+
+	void release(void* p) noexcept {
+		if (p == nullptr) return;
+		if (counting.load(std::memory_order_relaxed)) inUse.fetch_sub((int64_t)malloc_usable_size(p), std::memory_order_relaxed);
+		std::free(p);
+	}
+}
+
+void* operator new(size_t size) { return allocate(size, 0); }
+void* operator new[](size_t size) { return allocate(size, 0); }
+void* operator new(size_t size, const std::nothrow_t& tag) noexcept { return allocate(size, 0, tag); }
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return allocate(size, 0, tag); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept { return allocate(size, (size_t)alignment, tag); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept { return allocate(size, (size_t)alignment, tag); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
+
+void stats::count_heap() {
+	counting = true;
+}
+
+int64_t stats::heap_in_use() {
+	return inUse.load(std::memory_order_relaxed);
+}
+
+int64_t stats::heap_peak() {
+	return peak.load(std::memory_order_relaxed);
+}
+
+void stats::reset_heap_peak() {
+	peak.store(inUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
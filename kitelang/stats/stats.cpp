@@ -0,0 +1,121 @@
+#include "stats.h"
+#include <cstdio>
+#include <ctime>
+
+namespace {
+	double cpu_time() {
+		timespec ts;
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+
+	std::string format(const char* fmt, double value) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), fmt, value);
+		return buf;
+	}
+
+	// 1234567 bytes -> "1.18 MB", 1234567 tokens -> "1.23 M tokens"
+	std::string quantity(double value, const std::string& unit) {
+		bool bytes = unit == "bytes";
+		double step = bytes ? 1024 : 1000;
+		const char* prefixes[] = { "", "K", "M", "G" };
+		int i = 0;
+		while (value >= step && i < 3) {
+			value /= step;
+			i++;
+		}
+		return format("%.2f ", value) + prefixes[i] + (bytes ? "B" : (i ? " " : "") + unit);
+	}
+
+	void json_string(std::ostream& out, const std::string& s) {
+		out << '"';
+		for (char c : s) {
+			if (c == '"' || c == '\\') out << '\\' << c;
+			else if ((unsigned char)c < 0x20) out << "\\u00" << "0123456789abcdef"[c >> 4] << "0123456789abcdef"[c & 15];
+			else out << c;
+		}
+		out << '"';
+	}
+}
+
+stats::Pass::Pass(Report* report, std::string name) : report(report), name(std::move(name)) {
+	if (report == nullptr) return;
+	reset_heap_peak();
+	wallStart = std::chrono::steady_clock::now();
+	cpuStart = cpu_time();
+}
+
+void stats::Pass::stop(uint64_t amount, const char* unit) {
+	if (report == nullptr) return;
+	Stage s;
+	s.name = name;
+	s.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+	s.cpu = cpu_time() - cpuStart;
+	s.amount = amount;
+	s.unit = unit;
+	s.peakHeap = heap_peak();
+	report->stages.push_back(std::move(s));
+	report = nullptr;
+}
+
+void stats::Report::print(std::ostream& out) const {
+	out << "kite: " << source << ": time passes" << (cached ? " (output taken from the cache)" : "") << std::endl;
+	char line[160];
+	snprintf(line, sizeof(line), "  %-12s %12s %12s %22s %12s\n", "stage", "wall", "cpu", "throughput", "peak heap");
+	out << line;
+	double wall = 0, cpu = 0;
+	for (const Stage& s : stages) {
+		std::string rate = s.wall > 0 ? quantity(s.amount / s.wall, s.unit) + "/s" : "-";
+		snprintf(line, sizeof(line), "  %-12s %9.3f ms %9.3f ms %22s %12s\n", s.name.c_str(), s.wall * 1e3, s.cpu * 1e3, rate.c_str(), quantity((double)s.peakHeap, "bytes").c_str());
+		out << line;
+		wall += s.wall;
+		cpu += s.cpu;
+	}
+	snprintf(line, sizeof(line), "  %-12s %9.3f ms %9.3f ms\n", "total", wall * 1e3, cpu * 1e3);
+	out << line;
+	for (const auto& [name, n] : counts)
+		out << "  " << name << ": " << n << std::endl;
+	if (!nodes.empty()) {
+		out << "  nodes by type:";
+		for (const auto& [name, n] : nodes) out << ' ' << name << ' ' << n;
+		out << std::endl;
+	}
+}
+
+void stats::Report::json(std::ostream& out) const {
+	out << "{\"source\": ";
+	json_string(out, source);
+	out << ", \"cached\": " << (cached ? "true" : "false") << ", \"stages\": [";
+	for (size_t i = 0; i < stages.size(); i++) {
+		const Stage& s = stages[i];
+		out << (i ? ", " : "") << "{\"name\": ";
+		json_string(out, s.name);
+		out << ", \"wall_s\": " << format("%.9f", s.wall) << ", \"cpu_s\": " << format("%.9f", s.cpu);
+		out << ", \"amount\": " << s.amount << ", \"unit\": ";
+		json_string(out, s.unit);
+		out << ", \"per_second\": " << format("%.1f", s.wall > 0 ? s.amount / s.wall : 0) << ", \"peak_heap_bytes\": " << s.peakHeap << "}";
+	}
+	out << "], \"counts\": {";
+	for (size_t i = 0; i < counts.size(); i++) {
+		out << (i ? ", " : "");
+		json_string(out, counts[i].first);
+		out << ": " << counts[i].second;
+	}
+	out << "}, \"nodes\": {";
+	for (size_t i = 0; i < nodes.size(); i++) {
+		out << (i ? ", " : "");
+		json_string(out, nodes[i].first);
+		out << ": " << nodes[i].second;
+	}
+	out << "}}";
+}
+
+void stats::json(std::ostream& out, const std::vector<Report>& reports) {
+	out << "[";
+	for (size_t i = 0; i < reports.size(); i++) {
+		out << (i ? ",\n " : "");
+		reports[i].json(out);
+	}
+	out << "]" << std::endl;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Time, throughput and heap use of the compiler stages (--time-passes)
+namespace stats {
+	// heap use, counted by the replaced global operator new and delete (see heap.cpp)
+	// only once counting is enabled, which should be done first thing in main
+	// the figures are for the whole process, so they include every file compiled at the same time
+	void count_heap();
+	int64_t heap_in_use();
+	int64_t heap_peak();
+	void reset_heap_peak();		// the peak starts again from the current use
+
+	struct Stage {
+		std::string name;
+		double wall = 0;			// seconds
+		double cpu = 0;				// seconds of CPU time of the process
+		uint64_t amount = 0;		// how much input the stage handled, in `unit`s
+		std::string unit;
+		int64_t peakHeap = 0;		// bytes
+	};
+
+	// everything measured while compiling one file
+	struct Report {
+		std::string source;
+		bool cached = false;		// the output came from the cache, the later stages did not run
+		std::vector<Stage> stages;
+		std::vector<std::pair<std::string, uint64_t>> counts;
+		std::vector<std::pair<std::string, uint64_t>> nodes;	// syntax tree nodes by type
+		void print(std::ostream&) const;
+		void json(std::ostream&) const;
+	};
+	// the reports as one JSON array
+	void json(std::ostream&, const std::vector<Report>&);
+
+	// measures one stage, from its construction until stop() adds it to the report
+	// (nothing is measured without a report)
+	class Pass {
+	private:
+		Report* report;
+		std::string name;
+		std::chrono::steady_clock::time_point wallStart;
+		double cpuStart = 0;
+	public:
+		Pass(Report* report, std::string name);
+		void stop(uint64_t amount, const char* unit);
+	};
+}
@@ -1,9 +1,7 @@
 sh buildkite.sh
-kitelang/kitelang source.kite
-
-nasm -felf64 -o kbuild/source.o kbuild/source.asm
+kitelang/kitelang --emit=obj source.kite
 if [ $? -ne 0 ]; then
-    echo "Error: nasm failed."
+    echo "Error: kite failed."
     exit 1
 fi
 